@@ -30,6 +30,8 @@
 #include "r_utils/r_args.h"
 #include "r_utils/r_startup.h"
 #include "r_utils/r_time_utils.h"
+#include "r_utils/r_trace.h"
+#include "r_utils/r_keyed_pool.h"
 #include "r_disco/r_agent.h"
 #include "r_disco/r_devices.h"
 #include "r_disco/r_camera.h"
@@ -455,15 +457,19 @@ static void _append_extradata(std::vector<uint8_t>& ed, const std::vector<uint8_
     memcpy(&ed[current_size + start_code.size()], sprop_buffer.data(), sprop_buffer.size());
 }
 
+// The wizard decodes a key frame per stream it probes, usually the same camera's streams over and over
+// while the user steps back and forth, so keep those decoders around. Keyed by codec and parameter sets.
+static r_keyed_pool<string, r_av::r_video_decoder> _decoder_pool(4, [](r_av::r_video_decoder& d){
+    d.reset();
+    return true;
+});
+
 static r_nullable<shared_ptr<vector<uint8_t>>> _decode_frame(const r_pipeline::sample_context& sample_ctx, const vector<uint8_t>& key_frame, uint16_t output_width, uint16_t output_height, AVPixelFormat fmt)
 {
     auto video_enc = sample_ctx.video_encoding();
     if(video_enc.is_null())
         return r_nullable<shared_ptr<vector<uint8_t>>>();
 
-    // Enable parsing to properly handle Annex B streams with multiple NAL units
-    r_av::r_video_decoder decoder(_r_encoding_to_avcodec_id(video_enc.value()), true);
-
     std::vector<uint8_t> ed;
     std::vector<uint8_t> start_code = {0x00, 0x00, 0x00, 0x01};
 
@@ -494,18 +500,35 @@ static r_nullable<shared_ptr<vector<uint8_t>>> _decode_frame(const r_pipeline::s
         }
     }
 
-    // Only set extradata if stream doesn't have inline SPS/PPS
-    // When parsing is enabled and stream has inline params, let the parser handle them
-    if(ed.size() > 0 && !has_inline_sps)
-        decoder.set_extradata(ed);
+    auto decoder = _decoder_pool.get(
+        r_string_utils::format(
+            "%d/%s/%s/%s/%s",
+            (int)video_enc.value(),
+            vps.is_null() ? "" : vps.value().c_str(),
+            sps.is_null() ? "" : sps.value().c_str(),
+            pps.is_null() ? "" : pps.value().c_str(),
+            (has_inline_sps)?"inline":"extradata"
+        ),
+        [&](){
+            // Enable parsing to properly handle Annex B streams with multiple NAL units
+            r_av::r_video_decoder d(_r_encoding_to_avcodec_id(video_enc.value()), true);
 
-    decoder.attach_buffer(&key_frame[0], key_frame.size());
+            // Only set extradata if stream doesn't have inline SPS/PPS
+            // When parsing is enabled and stream has inline params, let the parser handle them
+            if(ed.size() > 0 && !has_inline_sps)
+                d.set_extradata(ed);
+
+            return d;
+        }
+    );
+
+    decoder->attach_buffer(&key_frame[0], key_frame.size());
 
     int attempt = 0;
     r_av::r_codec_state state = r_av::R_CODEC_STATE_INITIALIZED;
     while(attempt < 10 && state != r_av::R_CODEC_STATE_HAS_OUTPUT && state != r_av::R_CODEC_STATE_AGAIN_HAS_OUTPUT)
     {
-        state = decoder.decode();
+        state = decoder->decode();
         ++attempt;
     }
 
@@ -514,14 +537,14 @@ static r_nullable<shared_ptr<vector<uint8_t>>> _decode_frame(const r_pipeline::s
     {
         while(attempt < 20 && state != r_av::R_CODEC_STATE_HAS_OUTPUT && state != r_av::R_CODEC_STATE_AGAIN_HAS_OUTPUT)
         {
-            state = decoder.flush();
+            state = decoder->flush();
             ++attempt;
         }
     }
 
     r_nullable<shared_ptr<vector<uint8_t>>> output;
     if(state == r_av::R_CODEC_STATE_HAS_OUTPUT || state == r_av::R_CODEC_STATE_AGAIN_HAS_OUTPUT)
-        output.set_value(decoder.get(fmt, output_width, output_height, 1));
+        output.set_value(decoder->get(fmt, output_width, output_height, 1));
 
     return output;
 }
@@ -1162,6 +1185,12 @@ int main(int argc, char** argv)
 
     r_logger::install_logger(r_fs::platform_path(log_path), "revere_log_");
 
+    // Keep syslog and the log file off of the ingest threads, uninstall_logger() drains it.
+    r_logger::start_async_logging();
+
+    // kill -USR2 starts a trace, a second one writes it next to the logs.
+    r_trace::install_trace_signal(r_fs::platform_path(log_path));
+
     // UI state needs to be created before we can register the log callback
     // We'll register it after creating ui_state
 
@@ -6,12 +6,20 @@
 #include <vector>
 #include <cstdint>
 
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
 namespace vision
 {
 
 struct frame
 {
+    // BGRA scaled to the tile, or (when the renderer can draw YUV itself) the decoded picture as it
+    // came out of the decoder.
     std::shared_ptr<std::vector<uint8_t>> buffer;
+    std::shared_ptr<AVFrame> planes;
     uint16_t w;
     uint16_t h;
     uint16_t original_w;
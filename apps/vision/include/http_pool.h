@@ -0,0 +1,90 @@
+#ifndef __vision_http_pool_h
+#define __vision_http_pool_h
+
+#include "r_utils/r_socket.h"
+#include "r_utils/r_metrics.h"
+#include "r_http/r_client_response.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+namespace vision
+{
+
+// Idle connections the pool keeps open. A wall refreshing from several threads at once may open
+// more, those beyond this are closed when they're handed back.
+constexpr size_t HTTP_POOL_MAX_IDLE = 4;
+
+// Revere closes a kept alive connection 5 seconds after its last response, the pool stops reusing
+// one a little before that so it never sends a request into a connection being closed.
+constexpr std::chrono::milliseconds HTTP_POOL_IDLE_TIMEOUT(4000);
+
+struct http_pool_stats
+{
+    uint64_t requests {0};
+    uint64_t connects {0};  // requests that had to open a new connection
+};
+
+struct http_endpoint_latency
+{
+    std::string endpoint;
+    r_utils::r_histogram_snapshot latency;  // microseconds
+};
+
+// http_pool makes GET requests over keep-alive connections, so a burst of queries (a timeline
+// refresh, say) costs one handshake rather than one per request. Connections are reused in last
+// in, first out order and a request that fails on a reused connection (one the server closed while
+// it sat idle) is retried once on a new one.
+class http_pool final
+{
+public:
+    http_pool(size_t max_idle = HTTP_POOL_MAX_IDLE);
+    http_pool(const http_pool&) = delete;
+    http_pool(http_pool&&) = delete;
+    ~http_pool() noexcept;
+
+    http_pool& operator=(const http_pool&) = delete;
+    http_pool& operator=(http_pool&&) = delete;
+
+    r_http::r_client_response get(const std::string& host, int port, const std::string& uri, uint64_t timeout_millis = 10000);
+
+    http_pool_stats stats() const;
+
+    // Request latency by endpoint (the path, without the query string).
+    std::vector<http_endpoint_latency> latencies() const;
+
+private:
+    struct _connection
+    {
+        std::string host;
+        int port;
+        std::unique_ptr<r_utils::r_socket> sok;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    std::unique_ptr<r_utils::r_socket> _take(const std::string& host, int port, uint64_t timeout_millis, bool& reused);
+    void _give_back(const std::string& host, int port, std::unique_ptr<r_utils::r_socket> sok);
+    r_utils::r_histogram& _latency(const std::string& endpoint);
+
+    size_t _max_idle;
+
+    mutable std::mutex _lock;
+    std::deque<_connection> _idle;
+    std::map<std::string, r_utils::r_histogram*> _latencies;
+
+    std::atomic<uint64_t> _requests;
+    std::atomic<uint64_t> _connects;
+};
+
+// The pool every query to revere goes through.
+http_pool& revere_http();
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include "timeline_constants.h"
 #include "error_handling.h"
 #include "font_keys.h"
+#include "http_pool.h"
 
 namespace vision
 {
@@ -43,7 +44,7 @@ struct main_client_state
 };
 
 template<typename EXIT_CB, typename SETTINGS_CB, typename ONE_BY_ONE_CB, typename TWO_BY_TWO_CB, typename FOUR_BY_FOUR_CB>
-uint16_t main_menu(EXIT_CB exit_cb, SETTINGS_CB settings_cb, ONE_BY_ONE_CB one_by_one_cb, TWO_BY_TWO_CB two_by_two_cb, FOUR_BY_FOUR_CB four_by_four_cb)
+uint16_t main_menu(EXIT_CB exit_cb, SETTINGS_CB settings_cb, ONE_BY_ONE_CB one_by_one_cb, TWO_BY_TWO_CB two_by_two_cb, FOUR_BY_FOUR_CB four_by_four_cb, bool& show_request_latency)
 {
     ImGui::BeginMainMenuBar();
     if (ImGui::BeginMenu("File"))
@@ -64,6 +65,9 @@ uint16_t main_menu(EXIT_CB exit_cb, SETTINGS_CB settings_cb, ONE_BY_ONE_CB one_b
         if (ImGui::MenuItem("4x4"))
             four_by_four_cb();
 
+        ImGui::Separator();
+        ImGui::MenuItem("Request Latency", nullptr, &show_request_latency);
+
         ImGui::EndMenu();
     }
     uint16_t h = (uint16_t)ImGui::GetWindowHeight();
@@ -71,6 +75,48 @@ uint16_t main_menu(EXIT_CB exit_cb, SETTINGS_CB settings_cb, ONE_BY_ONE_CB one_b
     return h;
 }
 
+// Debug overlay showing how long requests to revere take and how often they reuse a connection.
+inline void request_latency_window(bool& open, const http_pool& pool)
+{
+    if(!open)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(520, 240), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Request Latency", &open))
+    {
+        auto stats = pool.stats();
+        ImGui::Text("%llu requests, %llu connects (%.0f%% reused)",
+                    (unsigned long long)stats.requests,
+                    (unsigned long long)stats.connects,
+                    (stats.requests > 0) ? 100.0 * (double)(stats.requests - std::min(stats.connects, stats.requests)) / (double)stats.requests : 0.0);
+
+        if(ImGui::BeginTable("##latencies", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Endpoint");
+            ImGui::TableSetupColumn("Count");
+            ImGui::TableSetupColumn("p50 (ms)");
+            ImGui::TableSetupColumn("p99 (ms)");
+            ImGui::TableHeadersRow();
+
+            for(const auto& l : pool.latencies())
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(l.endpoint.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)l.latency.count);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", (double)l.latency.percentile(0.5) / 1000.0);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", (double)l.latency.percentile(0.99) / 1000.0);
+            }
+
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+
 template<typename OK_CB, typename CANCEL_CB>
 void configure_modal(
     ImGuiContext* GImGui,
@@ -19,6 +19,7 @@
 #include "render_context.h"
 #include "frame.h"
 #include "control_bar.h"
+#include "timeline_cache.h"
 
 namespace vision
 {
@@ -46,6 +47,13 @@ public:
 
     void post_video_frame(const std::string& name, std::shared_ptr<std::vector<uint8_t>> buffer, uint16_t w, uint16_t h, uint16_t original_w, uint16_t original_h, int64_t pts);
 
+    // True if a decoded picture like f can be posted as it is, to be drawn (scaled and converted
+    // to RGB) by the renderer rather than scaled and converted by swscale first.
+    bool can_post_planes(const AVFrame* f) const;
+    // The same decision for a renderer that does (or doesn't) draw IYUV and NV12 textures natively.
+    static bool can_post_planes(const AVFrame* f, bool i420_textures, bool nv12_textures);
+    void post_video_planes(const std::string& name, std::shared_ptr<AVFrame> planes, int64_t pts);
+
     r_utils::r_nullable<std::shared_ptr<render_context>> lookup_render_context(const std::string& name, uint16_t w, uint16_t h);
 
     void update_render_context_timestamp(const std::string& name, int64_t pts);
@@ -87,21 +95,8 @@ public:
 
                 // Create streaming texture for video (optimized for frequent updates)
                 auto rc = std::make_shared<render_context>();
-                rc->tex = r_ui_utils::texture::create_streaming(
-                    _renderer,
-                    frame_p.second.w,
-                    frame_p.second.h,
-                    false  // RGB, not RGBA
-                );
-                if (rc->tex)
-                {
-                    rc->tex->update_rgb(
-                        frame_p.second.buffer->data(),
-                        frame_p.second.w,
-                        frame_p.second.h
-                    );
-                }
-                else
+                rc->tex = _create_video_texture(frame_p.second);
+                if (!rc->tex)
                 {
                     R_LOG_ERROR("Failed to create streaming texture for stream: %s", frame_p.first.c_str());
                 }
@@ -115,20 +110,7 @@ public:
                 {
                     // Recreate streaming texture with new dimensions
                     auto rc = std::make_shared<render_context>();
-                    rc->tex = r_ui_utils::texture::create_streaming(
-                        _renderer,
-                        frame_p.second.w,
-                        frame_p.second.h,
-                        false  // RGB, not RGBA
-                    );
-                    if (rc->tex)
-                    {
-                        rc->tex->update_rgb(
-                            frame_p.second.buffer->data(),
-                            frame_p.second.w,
-                            frame_p.second.h
-                        );
-                    }
+                    rc->tex = _create_video_texture(frame_p.second);
                     rc->w = frame_p.second.w;
                     rc->h = frame_p.second.h;
                     _render_contexts[found_rc->first] = rc;
@@ -138,11 +120,7 @@ public:
                     // Update existing streaming texture
                     if (found_rc->second->tex)
                     {
-                        found_rc->second->tex->update_rgb(
-                            frame_p.second.buffer->data(),
-                            frame_p.second.w,
-                            frame_p.second.h
-                        );
+                        _update_video_texture(*found_rc->second->tex, frame_p.second);
                     }
                 }
             }
@@ -169,10 +147,17 @@ public:
 private:
     void _entry_point();
 
+    std::shared_ptr<r_ui_utils::texture> _create_video_texture(const frame& f);
+    void _update_video_texture(r_ui_utils::texture& tex, const frame& f);
+    // Queues f for the main loop's next load_video_textures(), _internals_lok must be held.
+    void _post_frame(const std::string& name, frame f, int64_t pts);
     mutable std::mutex _internals_lok;
 
     configure_state& _cfg;
     SDL_Renderer* _renderer;
+    // Whether the renderer converts these YUV formats to RGB itself (in its shaders).
+    bool _i420_textures;
+    bool _nv12_textures;
     std::map<std::string, stream_info> _stream_infos;
     std::map<std::string, std::shared_ptr<pipeline_state>> _pipes;
 
@@ -183,10 +168,14 @@ private:
     std::map<std::string, std::chrono::system_clock::time_point> _playback_start_positions;
     std::map<std::string, int64_t> _playback_start_pts;
 
+    // Timelines already fetched, every camera's. Only used with _internals_lok held.
+    timeline_cache _timelines;
+
     std::thread _th;
     bool _running;
     std::chrono::steady_clock::time_point _last_dead_check;
     std::chrono::steady_clock::time_point _last_stream_start;
+    std::chrono::steady_clock::time_point _last_decode_report;
 
     // Flag to signal main loop that new frames are available
     std::atomic<bool> _has_new_frames{false};
@@ -9,6 +9,7 @@
 #include <thread>
 #include <chrono>
 #include <cstdint>
+#include <atomic>
 #include "stream_info.h"
 #include "sample.h"
 #include "pipeline_host.h"
@@ -17,6 +18,14 @@
 namespace vision
 {
 
+// What a pipeline did since its stats were last taken.
+struct decode_stats
+{
+    uint64_t frames_decoded {0};
+    uint64_t frames_skipped {0};
+    std::chrono::nanoseconds decode_time {0};  // decoding and scaling, on the process thread
+};
+
 class pipeline_state final
 {
 public:
@@ -25,6 +34,16 @@ public:
 
     void resize(uint16_t w, uint16_t h);
 
+    // The host calls this every time it draws the tile. A tile that hasn't been drawn for a while
+    // is hidden, and its video isn't decoded until it's drawn again.
+    void shown();
+    bool visible() const;
+
+    // How much decoding the tile's size calls for.
+    inline r_av::r_decode_fidelity fidelity() const {return _fidelity;}
+
+    decode_stats take_decode_stats();
+
     void play_live();
     void play();
     void stop();
@@ -94,6 +113,15 @@ private:
     std::chrono::system_clock::time_point _range_start;
     std::chrono::system_clock::time_point _range_end;
     std::chrono::steady_clock::time_point _last_play_time;
+
+    std::atomic<r_av::r_decode_fidelity> _fidelity;
+    std::atomic<int64_t> _last_shown_ns;
+    // Set once a video sample is skipped, decoding can only pick up again at a key frame.
+    std::atomic<bool> _need_key_frame;
+
+    std::atomic<uint64_t> _frames_decoded;
+    std::atomic<uint64_t> _frames_skipped;
+    std::atomic<int64_t> _decode_ns;
 };
 
 }
@@ -3,8 +3,10 @@
 #define __vision_query_h
 
 #include <vector>
+#include <map>
 #include "imgui_ui.h"
 #include "analytics_event.h"
+#include "timeline_data.h"
 
 namespace vision
 {
@@ -19,6 +21,10 @@ std::vector<motion_event> query_motion_events(const configure_state& cs, const s
 
 std::vector<analytics_event> query_analytics(const configure_state& cs, const std::string& camera_id, const std::chrono::system_clock::time_point& start, const std::chrono::system_clock::time_point& end, const std::string& stream_tag = "");
 
+// Segments, motion events and analytics for every camera in camera_ids, in as few requests as
+// revere allows.
+std::map<std::string, timeline_data> query_timelines(const configure_state& cs, const std::vector<std::string>& camera_ids, const std::chrono::system_clock::time_point& start, const std::chrono::system_clock::time_point& end);
+
 }
 
 #endif
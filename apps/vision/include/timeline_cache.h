@@ -0,0 +1,103 @@
+
+#ifndef __vision_timeline_cache_h
+#define __vision_timeline_cache_h
+
+#include "timeline_data.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+namespace vision
+{
+
+// Past this the cameras looked at least recently are dropped from the cache.
+constexpr size_t TIMELINE_CACHE_BUDGET = 16 * 1024 * 1024;
+
+// The last few seconds of a timeline can still change (a segment is still being recorded, a motion
+// event hasn't ended), so whatever was fetched within this of the time it was fetched is fetched
+// again next time.
+constexpr std::chrono::seconds TIMELINE_CACHE_SETTLE_TIME(30);
+
+// Revere overwrites its oldest recordings and motion as storage fills, so a range fetched this long
+// ago is fetched again rather than trusted.
+constexpr std::chrono::minutes TIMELINE_CACHE_MAX_AGE(10);
+
+// timeline_cache keeps the timelines (segments, motion events and analytics) vision has already
+// fetched, per camera, along with the time ranges they cover. A lookup only fetches the parts of
+// its range that aren't covered yet, so panning and zooming around a range already seen costs no
+// requests and a live timeline only fetches its tail. What a fetch returns replaces whatever the
+// cache held inside the fetched range.
+//
+// Fetches are made for every camera on the wall that hasn't got the range yet, not just the one
+// asked for, so selecting another camera is usually answered from the cache too.
+//
+// Not thread safe.
+class timeline_cache final
+{
+public:
+    typedef std::function<std::map<std::string, timeline_data>(const std::vector<std::string>& camera_ids, const std::chrono::system_clock::time_point& start, const std::chrono::system_clock::time_point& end)> fetch_cb;
+
+    timeline_cache(
+        fetch_cb fetch,
+        size_t budget = TIMELINE_CACHE_BUDGET,
+        std::chrono::milliseconds settle_time = TIMELINE_CACHE_SETTLE_TIME,
+        std::chrono::milliseconds max_age = TIMELINE_CACHE_MAX_AGE
+    );
+    timeline_cache(const timeline_cache&) = delete;
+    timeline_cache(timeline_cache&&) = delete;
+    ~timeline_cache() noexcept;
+
+    timeline_cache& operator=(const timeline_cache&) = delete;
+    timeline_cache& operator=(timeline_cache&&) = delete;
+
+    // The timeline of camera_id over [start, end]. camera_ids are the other cameras worth fetching
+    // along with it.
+    timeline_data get(const std::string& camera_id, const std::vector<std::string>& camera_ids, const std::chrono::system_clock::time_point& start, const std::chrono::system_clock::time_point& end);
+
+    void clear();
+
+private:
+    typedef std::pair<std::chrono::system_clock::time_point, std::chrono::system_clock::time_point> _range;
+
+    struct _covered
+    {
+        _range range;
+        // When the oldest part of range was fetched.
+        std::chrono::steady_clock::time_point fetched;
+    };
+
+    struct _camera
+    {
+        // Sorted and disjoint.
+        std::vector<_covered> covered;
+        // Sorted by start, overlapping ones merged.
+        std::vector<segment> segments;
+        std::vector<motion_event> motion_events;
+        // By motion_start_time.
+        std::map<std::chrono::system_clock::time_point, analytics_event> analytics;
+
+        size_t bytes {0};
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    static std::vector<_range> _gaps(const _camera& c, const _range& r);
+    static void _merge(_camera& c, timeline_data&& data, const _range& r, const std::chrono::system_clock::time_point& settled, const std::chrono::steady_clock::time_point& fetched);
+    void _expire(const std::chrono::steady_clock::time_point& now);
+    static void _trim(_camera& c, const _range& r);
+    static timeline_data _slice(const _camera& c, const _range& r);
+    static size_t _bytes(const _camera& c);
+    void _evict(const std::string& keep, const _range& r);
+
+    fetch_cb _fetch;
+    size_t _budget;
+    std::chrono::milliseconds _settle_time;
+    std::chrono::milliseconds _max_age;
+    std::map<std::string, _camera> _cameras;
+};
+
+}
+
+#endif
@@ -0,0 +1,23 @@
+
+#ifndef __vision_timeline_data_h
+#define __vision_timeline_data_h
+
+#include <vector>
+#include "segment.h"
+#include "motion_event.h"
+#include "analytics_event.h"
+
+namespace vision
+{
+
+// Everything a camera's timeline shows over some range.
+struct timeline_data
+{
+    std::vector<segment> segments;
+    std::vector<motion_event> motion_events;
+    std::vector<analytics_event> analytics;
+};
+
+}
+
+#endif
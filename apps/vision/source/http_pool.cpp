@@ -0,0 +1,165 @@
+
+#include "http_pool.h"
+#include "r_http/r_client_request.h"
+#include "r_http/r_uri.h"
+#include "r_utils/r_string_utils.h"
+#include "r_utils/r_exception.h"
+#include <algorithm>
+
+using namespace vision;
+using namespace r_http;
+using namespace r_utils;
+using namespace std;
+using namespace std::chrono;
+
+http_pool::http_pool(size_t max_idle) :
+    _max_idle(max_idle),
+    _lock(),
+    _idle(),
+    _latencies(),
+    _requests(0),
+    _connects(0)
+{
+}
+
+http_pool::~http_pool() noexcept
+{
+}
+
+r_client_response http_pool::get(const string& host, int port, const string& uri, uint64_t timeout_millis)
+{
+    ++_requests;
+
+    auto endpoint = uri.substr(0, uri.find('?'));
+    r_histogram_timer t(_latency(endpoint));
+
+    r_client_request req(host, port);
+    req.set_uri(uri);
+
+    bool reused = false;
+    auto sok = _take(host, port, timeout_millis, reused);
+
+    r_client_response resp;
+    try
+    {
+        req.write_request(*sok);
+        resp.read_response(*sok);
+    }
+    catch(...)
+    {
+        if(!reused)
+            throw;
+
+        // The server closed the connection while it sat idle, it's safe to send a GET again.
+        reused = false;
+        sok = _take(host, port, timeout_millis, reused);
+        req.write_request(*sok);
+        resp = r_client_response();
+        resp.read_response(*sok);
+    }
+
+    if(!r_string_utils::contains(r_string_utils::to_lower(resp.get_header("connection")), "close"))
+        _give_back(host, port, std::move(sok));
+
+    return resp;
+}
+
+http_pool_stats http_pool::stats() const
+{
+    http_pool_stats result;
+    result.requests = _requests;
+    result.connects = _connects;
+    return result;
+}
+
+vector<http_endpoint_latency> http_pool::latencies() const
+{
+    lock_guard<mutex> g(_lock);
+
+    vector<http_endpoint_latency> result;
+    result.reserve(_latencies.size());
+    for(const auto& l : _latencies)
+        result.push_back({l.first, l.second->snapshot()});
+    return result;
+}
+
+unique_ptr<r_socket> http_pool::_take(const string& host, int port, uint64_t timeout_millis, bool& reused)
+{
+    unique_ptr<r_socket> sok;
+
+    {
+        auto now = steady_clock::now();
+
+        lock_guard<mutex> g(_lock);
+
+        _idle.erase(remove_if(_idle.begin(), _idle.end(), [&](const _connection& c){
+            return now - c.last_used > HTTP_POOL_IDLE_TIMEOUT;
+        }), _idle.end());
+
+        for(auto i = _idle.rbegin(); i != _idle.rend(); ++i)
+        {
+            if(i->host == host && i->port == port)
+            {
+                sok = std::move(i->sok);
+                _idle.erase(next(i).base());
+                break;
+            }
+        }
+    }
+
+    // An idle connection with something to read has been closed by the server (or is out of step
+    // with it), either way it can't be used.
+    if(sok)
+    {
+        uint64_t wait_millis = 0;
+        if(!sok->wait_till_recv_wont_block(wait_millis))
+        {
+            sok->set_io_timeout(timeout_millis);
+            reused = true;
+            return sok;
+        }
+    }
+
+    ++_connects;
+
+    sok = make_unique<r_socket>();
+    sok->set_io_timeout(timeout_millis);
+    sok->connect(host, port);
+    reused = false;
+    return sok;
+}
+
+void http_pool::_give_back(const string& host, int port, unique_ptr<r_socket> sok)
+{
+    lock_guard<mutex> g(_lock);
+
+    if(_idle.size() >= _max_idle)
+        _idle.pop_front();
+
+    _idle.push_back({host, port, std::move(sok), steady_clock::now()});
+}
+
+r_histogram& http_pool::_latency(const string& endpoint)
+{
+    lock_guard<mutex> g(_lock);
+
+    auto found = _latencies.find(endpoint);
+    if(found == _latencies.end())
+    {
+        auto& h = metrics().histogram(
+            "vision_http_request_duration_seconds",
+            "Time vision waited on requests to revere.",
+            {{"endpoint", endpoint}},
+            R_METRICS_MICROSECONDS
+        );
+        found = _latencies.emplace(endpoint, &h).first;
+    }
+
+    return *found->second;
+}
+
+http_pool& vision::revere_http()
+{
+    static http_pool pool;
+    return pool;
+}
@@ -490,6 +490,7 @@ int main(int, char**)
     }
 
     bool close_requested = false;
+    bool show_request_latency = false;
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
@@ -668,9 +669,13 @@ int main(int, char**)
                 },
                 [&cfg_state, &ph, &ui_state](){change_layout(cfg_state, ph, ui_state, LAYOUT_ONE_BY_ONE);},
                 [&cfg_state, &ph, &ui_state](){change_layout(cfg_state, ph, ui_state, LAYOUT_TWO_BY_TWO);},
-                [&cfg_state, &ph, &ui_state](){change_layout(cfg_state, ph, ui_state, LAYOUT_FOUR_BY_FOUR);}
+                [&cfg_state, &ph, &ui_state](){change_layout(cfg_state, ph, ui_state, LAYOUT_FOUR_BY_FOUR);},
+                show_request_latency
             );
 
+            // Tiles nobody can see aren't looked up, so their pipelines stop decoding until they're back.
+            bool window_hidden = (SDL_GetWindowFlags(window) & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN)) != 0;
+
             auto window_size = ImGui::GetIO().DisplaySize;
             auto window_width = (uint16_t)window_size.x;
             auto window_height = (uint16_t)window_size.y;
@@ -727,6 +732,12 @@ int main(int, char**)
                                 ImGui::Image(nullptr, ImVec2(w, h), ImVec2(0.0f, 0.0f), ImVec2(1.0f, 1.0f));
                                 return;
                             }
+
+                            if (window_hidden || !ImGui::IsRectVisible(ImVec2(w, h)))
+                            {
+                                ImGui::Dummy(ImVec2(w, h));
+                                return;
+                            }
                             
                             auto maybe_rc = ph.lookup_render_context(name, w, h);
 
@@ -924,6 +935,8 @@ int main(int, char**)
 
             //ImGui::ShowDemoWindow();
 
+            vision::request_latency_window(show_request_latency, vision::revere_http());
+
             configure_wizard();
             
             if(ui_state.mcs.obos.cbs.exp_state == EXPORT_STATE_FINISHED_SUCCESS)
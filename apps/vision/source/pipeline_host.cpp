@@ -17,20 +17,42 @@ using namespace r_utils;
 using namespace std;
 using namespace std::chrono;
 
+// How often the decoding done by the whole wall is logged.
+static const seconds DECODE_REPORT_INTERVAL(10);
+
+static r_ui_utils::yuv_planes _yuv_planes(const AVFrame* f)
+{
+    r_ui_utils::yuv_planes planes;
+    planes.nv12 = (f->format == AV_PIX_FMT_NV12);
+    planes.y = f->data[0];
+    planes.y_pitch = f->linesize[0];
+    planes.u = f->data[1];
+    planes.u_pitch = f->linesize[1];
+    planes.v = f->data[2];
+    planes.v_pitch = f->linesize[2];
+    return planes;
+}
+
 pipeline_host::pipeline_host(configure_state& cfg, SDL_Renderer* renderer) :
     _internals_lok(),
     _cfg(cfg),
     _renderer(renderer),
+    _i420_textures(r_ui_utils::texture::has_native_format(renderer, SDL_PIXELFORMAT_IYUV)),
+    _nv12_textures(r_ui_utils::texture::has_native_format(renderer, SDL_PIXELFORMAT_NV12)),
     _stream_infos(),
     _pipes(),
     _render_contexts(),
     _video_frames(),
     _playback_start_positions(),
     _playback_start_pts(),
+    _timelines([this](const vector<string>& camera_ids, const system_clock::time_point& start, const system_clock::time_point& end){
+        return query_timelines(_cfg, camera_ids, start, end);
+    }),
     _th(),
     _running(false),
     _last_dead_check(steady_clock::now()),
-    _last_stream_start(steady_clock::now())
+    _last_stream_start(steady_clock::now()),
+    _last_decode_report(steady_clock::now())
 {
 }
 
@@ -194,6 +216,88 @@ void pipeline_host::post_video_frame(const string& name, shared_ptr<vector<uint8
             name.c_str(), w, h, buffer->size(), data[0], data[1], data[2], data[3]);
     }
 
+    frame f;
+    f.buffer = buffer;
+    f.w = w;
+    f.h = h;
+    f.original_w = original_w;
+    f.original_h = original_h;
+
+    _post_frame(name, f, pts);
+}
+
+bool pipeline_host::can_post_planes(const AVFrame* f) const
+{
+    return can_post_planes(f, _i420_textures, _nv12_textures);
+}
+
+bool pipeline_host::can_post_planes(const AVFrame* f, bool i420_textures, bool nv12_textures)
+{
+    // SDL's YUV conversion assumes limited range (full range pictures go through swscale).
+    if(!f || f->color_range == AVCOL_RANGE_JPEG)
+        return false;
+
+    if(f->format == AV_PIX_FMT_YUV420P)
+        return i420_textures;
+    if(f->format == AV_PIX_FMT_NV12)
+        return nv12_textures;
+
+    return false;
+}
+
+void pipeline_host::post_video_planes(const string& name, shared_ptr<AVFrame> planes, int64_t pts)
+{
+    lock_guard<mutex> g(_internals_lok);
+
+    if (name.empty())
+    {
+        R_LOG_ERROR("Empty stream name in post_video_planes");
+        return;
+    }
+
+    if (!planes || !can_post_planes(planes.get()))
+    {
+        R_LOG_ERROR("Unsupported picture in post_video_planes for stream %s", name.c_str());
+        return;
+    }
+
+    if (!state_validate::is_valid_frame_dimensions(planes->width, planes->height))
+    {
+        R_LOG_ERROR("Invalid frame dimensions in post_video_planes for stream %s: %dx%d", name.c_str(), planes->width, planes->height);
+        return;
+    }
+
+    // The renderer scales the picture to the tile when it draws it, so the texture is the picture's size.
+    frame f;
+    f.planes = planes;
+    f.w = (uint16_t)planes->width;
+    f.h = (uint16_t)planes->height;
+    f.original_w = f.w;
+    f.original_h = f.h;
+
+    _post_frame(name, f, pts);
+}
+
+shared_ptr<r_ui_utils::texture> pipeline_host::_create_video_texture(const frame& f)
+{
+    if(f.planes)
+        return r_ui_utils::texture::create_from_yuv(_renderer, _yuv_planes(f.planes.get()), f.w, f.h);
+
+    auto tex = r_ui_utils::texture::create_streaming(_renderer, f.w, f.h, false);  // RGB, not RGBA
+    if(tex)
+        tex->update_rgb(f.buffer->data(), f.w, f.h);
+    return tex;
+}
+
+void pipeline_host::_update_video_texture(r_ui_utils::texture& tex, const frame& f)
+{
+    if(f.planes)
+        tex.update_yuv(_yuv_planes(f.planes.get()), f.w, f.h);
+    else tex.update_rgb(f.buffer->data(), f.w, f.h);
+}
+
+void pipeline_host::_post_frame(const string& name, frame f, int64_t pts)
+{
     // Calculate playback-relative timestamp if we're in playback mode
     int64_t display_pts = pts;
     auto playback_start_pos_it = _playback_start_positions.find(name);
@@ -221,12 +325,6 @@ void pipeline_host::post_video_frame(const string& name, shared_ptr<vector<uint8
         }
     }
 
-    frame f;
-    f.buffer = buffer;
-    f.w = w;
-    f.h = h;
-    f.original_w = original_w;
-    f.original_h = original_h;
     f.pts = display_pts;
 
     // Signal that new frames are available
@@ -294,6 +392,7 @@ r_nullable<shared_ptr<render_context>> pipeline_host::lookup_render_context(cons
                 auto ps = make_shared<pipeline_state>(found_si->second, this, w, h, _cfg);
                 ps->play_live();
                 _pipes.insert(make_pair(name, ps));
+                found_ps = _pipes.find(name);
             }
             catch(const std::exception& e)
             {
@@ -324,6 +423,9 @@ r_nullable<shared_ptr<render_context>> pipeline_host::lookup_render_context(cons
                 }
             }
         }
+
+        // Being looked up is being drawn, tiles that stop being looked up stop decoding.
+        found_ps->second->shown();
     }
 
     // Finally, once a buffer makes it to the end of the a pipeline we will create a render_context for it
@@ -423,15 +525,19 @@ void pipeline_host::control_bar_update_data_cb(const std::string& stream_name, c
         {
             auto range = cbs.get_range();
             found_pipe->second->update_range(range.first, range.second);
-            cbs.set_contents(query_segments(_cfg, found_si->second.camera_id, range.first, range.second));
 
-            // Query motion events
-            auto motion_events = query_motion_events(_cfg, found_si->second.camera_id, range.first, range.second);
-            cbs.set_motion_events(motion_events);
+            // Every camera on the wall, so one request fills in all of their timelines.
+            vector<string> camera_ids;
+            for(const auto& si : _stream_infos)
+            {
+                if(!si.second.camera_id.empty())
+                    camera_ids.push_back(si.second.camera_id);
+            }
 
-            // Query analytics events
-            auto analytics_events = query_analytics(_cfg, found_si->second.camera_id, range.first, range.second);
-            cbs.set_analytics_events(analytics_events);
+            auto timeline = _timelines.get(found_si->second.camera_id, camera_ids, range.first, range.second);
+            cbs.set_contents(timeline.segments);
+            cbs.set_motion_events(timeline.motion_events);
+            cbs.set_analytics_events(timeline.analytics);
         }
         catch(const std::exception& e)
         {
@@ -529,6 +635,44 @@ void pipeline_host::_entry_point()
 
         auto now = steady_clock::now();
 
+        if(now - _last_decode_report >= DECODE_REPORT_INTERVAL)
+        {
+            auto interval = duration<double>(now - _last_decode_report).count();
+            _last_decode_report = now;
+
+            size_t n_full = 0, n_reduced = 0, n_key_frames = 0, n_hidden = 0;
+            decode_stats total;
+
+            {
+                lock_guard<mutex> pipes_lock(_internals_lok);
+                for(auto& p : _pipes)
+                {
+                    if(!p.second->visible())
+                        ++n_hidden;
+                    else if(p.second->fidelity() == r_av::R_DECODE_FIDELITY_KEY_FRAMES)
+                        ++n_key_frames;
+                    else if(p.second->fidelity() == r_av::R_DECODE_FIDELITY_REDUCED)
+                        ++n_reduced;
+                    else ++n_full;
+
+                    auto stats = p.second->take_decode_stats();
+                    total.frames_decoded += stats.frames_decoded;
+                    total.frames_skipped += stats.frames_skipped;
+                    total.decode_time += stats.decode_time;
+                }
+            }
+
+            // Decode time per second is roughly the share of a core the wall's decoding takes.
+            if(total.frames_decoded > 0 || total.frames_skipped > 0)
+            {
+                R_LOG_INFO("Tiles: %zu full, %zu reduced, %zu key frames only, %zu hidden. %.1f frames/s decoded, %.1f skipped, decode time %.0f ms/s.",
+                           n_full, n_reduced, n_key_frames, n_hidden,
+                           (double)total.frames_decoded / interval,
+                           (double)total.frames_skipped / interval,
+                           duration<double, milli>(total.decode_time).count() / interval);
+            }
+        }
+
         // dead check
         if(duration_cast<seconds>(now - _last_dead_check) > seconds(10))
         {
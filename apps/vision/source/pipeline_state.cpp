@@ -17,6 +17,43 @@ using namespace r_http;
 using namespace std;
 using namespace std::chrono;
 
+// Decoded frames waiting to be uploaded, shared by every tile. Frames come back when the texture
+// upload releases them, so this only needs to cover what is in flight at once.
+static const size_t FRAME_POOL_MAX_IDLE = 64;
+
+static const int TILE_DECODE_THREADS = 2;
+
+// Tiles smaller than these (in pixels on screen) can't show everything the stream has. Below the
+// first, deblocking is skipped and pictures are scaled with a cheaper filter. Below the second
+// (an 8x8 wall on 1080p, say) only key frames are decoded.
+static const uint32_t REDUCED_FIDELITY_MAX_PIXELS = 640 * 360;
+static const uint32_t KEY_FRAMES_ONLY_MAX_PIXELS = 320 * 180;
+
+// A tile the host hasn't drawn for this long is off screen (or the window is minimized).
+static const milliseconds TILE_HIDDEN_AFTER(1000);
+
+static r_av::r_frame_pool& _frame_pool()
+{
+    static r_av::r_frame_pool pool(FRAME_POOL_MAX_IDLE);
+    return pool;
+}
+
+static r_av::r_decode_fidelity _tile_fidelity(uint16_t w, uint16_t h)
+{
+    auto pixels = (uint32_t)w * h;
+
+    if(pixels < KEY_FRAMES_ONLY_MAX_PIXELS)
+        return r_av::R_DECODE_FIDELITY_KEY_FRAMES;
+    if(pixels < REDUCED_FIDELITY_MAX_PIXELS)
+        return r_av::R_DECODE_FIDELITY_REDUCED;
+    return r_av::R_DECODE_FIDELITY_FULL;
+}
+
+static int64_t _now_ns()
+{
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
 static void aspect_correct_video_dimensions(
     uint16_t streamWidth,
     uint16_t streamHeight,
@@ -88,7 +125,14 @@ pipeline_state::pipeline_state(const stream_info& si, pipeline_host* ph, uint16_
     _cfg_state(cfg_state),
     _last_control_bar_pos(),
     _range_start(),
-    _range_end()
+    _range_end(),
+    _last_play_time(),
+    _fidelity(_tile_fidelity(w, h)),
+    _last_shown_ns(_now_ns()),
+    _need_key_frame(false),
+    _frames_decoded(0),
+    _frames_skipped(0),
+    _decode_ns(0)
 {
     // The callbacks for audio and video sample post the arriving buffers (as samples) onto the
     // _process_q. The process thread (in the pipeline_state) then pulls samples from the process_q
@@ -139,13 +183,29 @@ pipeline_state::pipeline_state(const stream_info& si, pipeline_host* ph, uint16_
                 this->_video_decoder.raw().set_extradata(make_h265_extradata(h265_vps_b, h265_sps_b, h265_pps_b));
             }
             else R_THROW(("Unsupported video codec."));
+
+            // A wall of tiles is a lot of decoders, so each only gets a couple of slice threads (frame
+            // threads would put every tile a few frames behind live).
+            this->_video_decoder.raw().set_threading(r_av::R_DECODER_THREADING_LOW_LATENCY, TILE_DECODE_THREADS);
+        }
+
+        // Calculate absolute timestamp: stream start + pts (kept up to date for skipped samples too,
+        // so a hidden tile doesn't look like a dead stream)
+        this->_last_v_pts = sc.stream_start_ts() + pts;
+
+        // Hidden tiles decode nothing and tiny ones only key frames.
+        if(!this->visible() || (!key && (this->_need_key_frame || this->_fidelity == r_av::R_DECODE_FIDELITY_KEY_FRAMES)))
+        {
+            this->_need_key_frame = true;
+            ++this->_frames_skipped;
+            return;
         }
 
+        this->_need_key_frame = false;
+
         sample s;
         s.buffer = move(buffer);
         s.media_type = VIDEO_MEDIA;
-        // Calculate absolute timestamp: stream start + pts
-        this->_last_v_pts = sc.stream_start_ts() + pts;
         this->_process_q.post(s);
     });
 
@@ -165,11 +225,35 @@ void pipeline_state::resize(uint16_t w, uint16_t h)
     _w = w;
     _h = h;
 
+    // Coming out of key frames only, the frames in between were never decoded.
+    auto fidelity = _tile_fidelity(w, h);
+    if(_fidelity.exchange(fidelity) == r_av::R_DECODE_FIDELITY_KEY_FRAMES && fidelity != r_av::R_DECODE_FIDELITY_KEY_FRAMES)
+        _need_key_frame = true;
+
     // Send our last video sample to the pipeline again, to resize it.
     if(!_last_video_sample.is_null())
         _process_q.post(_last_video_sample.value());
 }
 
+void pipeline_state::shown()
+{
+    _last_shown_ns = _now_ns();
+}
+
+bool pipeline_state::visible() const
+{
+    return nanoseconds(_now_ns() - _last_shown_ns) < TILE_HIDDEN_AFTER;
+}
+
+decode_stats pipeline_state::take_decode_stats()
+{
+    decode_stats stats;
+    stats.frames_decoded = _frames_decoded.exchange(0);
+    stats.frames_skipped = _frames_skipped.exchange(0);
+    stats.decode_time = nanoseconds(_decode_ns.exchange(0));
+    return stats;
+}
+
 void pipeline_state::play_live()
 {
     _last_play_time = steady_clock::now();
@@ -285,6 +369,15 @@ void pipeline_state::_entry_point()
 
                 auto m = maybe_sample.raw().first.buffer.map(r_gst_buffer::MT_READ);
 
+                auto fidelity = _fidelity.load();
+                if(_video_decoder.raw().fidelity() != fidelity)
+                {
+                    _video_decoder.raw().set_fidelity(fidelity);
+                    _video_decoder.raw().set_scaler_quality((fidelity == r_av::R_DECODE_FIDELITY_FULL) ? r_av::R_SCALER_QUALITY_BILINEAR : r_av::R_SCALER_QUALITY_FAST_BILINEAR);
+                }
+
+                auto decode_start = steady_clock::now();
+
                 while(tries > 0)
                 {
                     _video_decoder.raw().attach_buffer(m.data(), m.size());
@@ -299,7 +392,13 @@ void pipeline_state::_entry_point()
 
                         // If we are behind, drop the frame here
 
-                        if(process_q_depth < 2)
+                        if(process_q_depth < 2 && _ph->can_post_planes(_video_decoder.raw().get_frame()))
+                        {
+                            // The renderer scales and converts the picture when it draws it, so it
+                            // goes to the host as it came out of the decoder (a reference, no copy).
+                            _ph->post_video_planes(_si.name, _video_decoder.raw().ref_frame(), _last_v_pts);
+                        }
+                        else if(process_q_depth < 2)
                         {
                             uint16_t input_width = _video_decoder.raw().input_width();
                             uint16_t input_height = _video_decoder.raw().input_height();
@@ -325,7 +424,7 @@ void pipeline_state::_entry_point()
 
                             // Use BGRA format which matches SDL_PIXELFORMAT_ARGB8888 on little-endian (x86)
                             // BGRA in memory = B G R A bytes = ARGB8888 pixel format
-                            auto decoded_frame = _video_decoder.raw().get(AV_PIX_FMT_BGRA, dest_width, dest_height, 1);
+                            auto decoded_frame = _video_decoder.raw().get(_frame_pool(), AV_PIX_FMT_BGRA, dest_width, dest_height, 1);
 
                             static int pixel_log_count = 0;
                             if (decoded_frame && pixel_log_count++ < 5)
@@ -349,6 +448,9 @@ void pipeline_state::_entry_point()
 
                     --tries;
                 }
+
+                ++_frames_decoded;
+                _decode_ns += duration_cast<nanoseconds>(steady_clock::now() - decode_start).count();
             }
             maybe_sample.raw().second.set_value(true);
         }
@@ -1,11 +1,12 @@
 
 #include "query.h"
-#include "r_utils/r_socket.h"
+#include "http_pool.h"
 #include "r_utils/r_time_utils.h"
+#include "r_utils/r_string_utils.h"
 #include "r_utils/3rdparty/json/json.h"
-#include "r_http/r_client_request.h"
 #include "r_http/r_client_response.h"
 #include <map>
+#include <algorithm>
 
 using namespace vision;
 using namespace r_http;
@@ -14,20 +15,85 @@ using namespace std;
 using namespace std::chrono;
 using json = nlohmann::json;
 
-vector<sidebar_list_ui_item> vision::query_cameras(const string& ip_address)
+static const int REVERE_PORT = 10080;
+
+// The most cameras revere answers for in one /timeline request.
+static const size_t TIMELINE_MAX_CAMERAS = 64;
+
+static string _revere_ipv4(const configure_state& cs)
 {
-    vector<sidebar_list_ui_item> cameras;
+    auto maybe_revere_ipv4 = cs.get_revere_ipv4();
+    if(maybe_revere_ipv4.is_null())
+        R_THROW(("Revere IPv4 address not set."));
+    return maybe_revere_ipv4.value();
+}
+
+static vector<segment> _parse_segments(const json& j)
+{
+    vector<segment> result;
+    result.reserve(j.size());
+    for(auto s : j)
+    {
+        segment seg;
+        seg.start = r_time_utils::iso_8601_to_tp(s["start_time"]);
+        seg.end = r_time_utils::iso_8601_to_tp(s["end_time"]);
+        result.push_back(seg);
+    }
+
+    return result;
+}
+
+static vector<motion_event> _parse_motion_events(const json& j)
+{
+    //{"avg_motion":0,"end_time":"2022-08-02T06:38:07.000","motion":96,"start_time":"2022-08-02T06:37:55.000","stddev":1}
+
+    vector<motion_event> result;
+    result.reserve(j.size());
+    for(auto s : j)
+    {
+        motion_event me;
+        me.start = r_time_utils::iso_8601_to_tp(s["start_time"]);
+        me.end = r_time_utils::iso_8601_to_tp(s["end_time"]);
+        me.motion = s["motion"].get<uint8_t>();
+        me.stddev = s["stddev"].get<uint8_t>();
+        result.push_back(me);
+    }
+
+    return result;
+}
+
+static vector<analytics_event> _parse_analytics(const json& j)
+{
+    vector<analytics_event> result;
+    result.reserve(j.size());
+
+    for(auto entry : j)
+    {
+        analytics_event ae;
+        ae.motion_start_time = r_time_utils::iso_8601_to_tp(entry["motion_start_time"]);
+        ae.motion_end_time = r_time_utils::iso_8601_to_tp(entry["motion_end_time"]);
+        ae.total_detections = entry["total_detections"].get<int>();
+
+        for(auto det : entry["detections"])
+        {
+            analytics_detection ad;
+            ad.class_name = det["class_name"].get<string>();
+            ad.confidence = det["confidence"].get<float>();
+            ad.timestamp = r_time_utils::iso_8601_to_tp(det["timestamp"]);
+            ae.detections.push_back(ad);
+        }
+
+        result.push_back(ae);
+    }
 
-    r_socket sok;
-    sok.set_io_timeout(10000);
-    sok.connect(ip_address, 10080);
+    return result;
+}
 
-    r_client_request req(ip_address, 10080);
-    req.set_uri(r_uri("/cameras"));
-    req.write_request(sok);
+vector<sidebar_list_ui_item> vision::query_cameras(const string& ip_address)
+{
+    vector<sidebar_list_ui_item> cameras;
 
-    r_client_response resp;
-    resp.read_response(sok);
+    auto resp = revere_http().get(ip_address, REVERE_PORT, "/cameras");
 
     auto response_txt = resp.get_body_as_string();
 
@@ -54,80 +120,30 @@ vector<sidebar_list_ui_item> vision::query_cameras(const string& ip_address)
 
 vector<uint8_t> vision::query_key(const string& ip_address, const string& camera_id, const string& start_time)
 {
-    r_socket sok;
-    sok.set_io_timeout(10000);
-
-    sok.connect(ip_address, 10080);
-
-    r_client_request req(ip_address, 10080);
-    req.set_uri("/key_frame?camera_id=" + camera_id + "&start_time=" + start_time);
-    req.write_request(sok);
-
-    r_client_response response;
-    response.read_response(sok);
-
-    sok.close();
+    auto response = revere_http().get(ip_address, REVERE_PORT, "/key_frame?camera_id=" + camera_id + "&start_time=" + start_time);
 
     return response.release_body();
 }
 
 vector<segment> vision::query_segments(const configure_state& cs, const std::string& camera_id, const system_clock::time_point& start, const system_clock::time_point& end)
 {
-    auto maybe_revere_ipv4 = cs.get_revere_ipv4();
-    if(maybe_revere_ipv4.is_null())
-        R_THROW(("Revere IPv4 address not set."));
-
-    r_socket sok;
-    sok.set_io_timeout(10000);
-    sok.connect(maybe_revere_ipv4.value(), 10080);
-
-    r_client_request req(maybe_revere_ipv4.value(), 10080);
     auto uri = r_string_utils::format("/contents?camera_id=%s&start_time=%s&end_time=%s", camera_id.c_str(), r_time_utils::tp_to_iso_8601(start, false).c_str(), r_time_utils::tp_to_iso_8601(end, false).c_str());
-    req.set_uri(uri);
-    req.write_request(sok);
 
-    r_client_response resp;
-    resp.read_response(sok);
-    sok.close();
+    auto resp = revere_http().get(_revere_ipv4(cs), REVERE_PORT, uri);
 
     if(resp.get_status() != 200)
         R_THROW(("Could not query segments."));
 
-    auto doc = resp.get_body_as_string().value();
-
-    auto j = json::parse(doc);
-
-    vector<segment> result;
-    result.reserve(j["segments"].size());
-    for(auto s : j["segments"])
-    {
-        segment seg;
-        seg.start = r_time_utils::iso_8601_to_tp(s["start_time"]);
-        seg.end = r_time_utils::iso_8601_to_tp(s["end_time"]);
-        result.push_back(seg);
-    }
+    auto j = json::parse(resp.get_body_as_string().value());
 
-    return result;
+    return _parse_segments(j["segments"]);
 }
 
 vector<motion_event> vision::query_motion_events(const configure_state& cs, const string& camera_id, const system_clock::time_point& start, const system_clock::time_point& end)
 {
-    auto maybe_revere_ipv4 = cs.get_revere_ipv4();
-    if(maybe_revere_ipv4.is_null())
-        R_THROW(("Revere IPv4 address not set."));
-
-    r_socket sok;
-    sok.set_io_timeout(10000);
-    sok.connect(maybe_revere_ipv4.value(), 10080);
-
-    r_client_request req(maybe_revere_ipv4.value(), 10080);
     auto uri = r_string_utils::format("/motion_events?camera_id=%s&start_time=%s&end_time=%s", camera_id.c_str(), r_time_utils::tp_to_iso_8601(start, false).c_str(), r_time_utils::tp_to_iso_8601(end, false).c_str());
-    req.set_uri(uri);
-    req.write_request(sok);
 
-    r_client_response resp;
-    resp.read_response(sok);
-    sok.close();
+    auto resp = revere_http().get(_revere_ipv4(cs), REVERE_PORT, uri);
 
     if(resp.get_status() != 200)
     {
@@ -135,38 +151,14 @@ vector<motion_event> vision::query_motion_events(const configure_state& cs, cons
         R_THROW(("Could not query motion events."));
     }
 
-    auto response_body = resp.get_body_as_string().value();
-    
-    auto j = json::parse(response_body);
-
-    //{"avg_motion":0,"end_time":"2022-08-02T06:38:07.000","motion":96,"start_time":"2022-08-02T06:37:55.000","stddev":1}
-
-    vector<motion_event> result;
-    result.reserve(j["motion_events"].size());
-    for(auto s : j["motion_events"])
-    {
-        motion_event me;
-        me.start = r_time_utils::iso_8601_to_tp(s["start_time"]);
-        me.end = r_time_utils::iso_8601_to_tp(s["end_time"]);
-        me.motion = s["motion"].get<uint8_t>();
-        me.stddev = s["stddev"].get<uint8_t>();
-        result.push_back(me);
-    }
+    auto j = json::parse(resp.get_body_as_string().value());
 
-    return result;
+    return _parse_motion_events(j["motion_events"]);
 }
 
 
 vector<analytics_event> vision::query_analytics(const configure_state& cs, const string& camera_id, const system_clock::time_point& start, const system_clock::time_point& end, const string& stream_tag)
 {
-    auto maybe_revere_ipv4 = cs.get_revere_ipv4();
-    if(maybe_revere_ipv4.is_null())
-        R_THROW(("Revere IPv4 address not set."));
-
-    r_socket sok;
-    sok.set_io_timeout(10000);
-    sok.connect(maybe_revere_ipv4.value(), 10080);
-
     // Build query string
     string query = "/analytics?camera_id=" + camera_id + 
                    "&start_time=" + r_time_utils::tp_to_iso_8601(start, true) + 
@@ -176,16 +168,8 @@ vector<analytics_event> vision::query_analytics(const configure_state& cs, const
     if(!stream_tag.empty()) {
         query += "&stream_tag=" + stream_tag;
     }
-    
-
-    r_client_request req(maybe_revere_ipv4.value(), 10080);
-    req.set_uri(query);
-    req.write_request(sok);
-
-    r_client_response resp;
-    resp.read_response(sok);
 
-    sok.close();
+    auto resp = revere_http().get(_revere_ipv4(cs), REVERE_PORT, query);
 
     if(resp.get_status() != 200)
     {
@@ -193,29 +177,40 @@ vector<analytics_event> vision::query_analytics(const configure_state& cs, const
         R_THROW(("Could not query analytics."));
     }
 
-    auto response_body = resp.get_body_as_string().value();
-    auto j = json::parse(response_body);
+    auto j = json::parse(resp.get_body_as_string().value());
 
-    vector<analytics_event> result;
-    result.reserve(j["analytics"].size());
+    return _parse_analytics(j["analytics"]);
+}
+
+map<string, timeline_data> vision::query_timelines(const configure_state& cs, const vector<string>& camera_ids, const system_clock::time_point& start, const system_clock::time_point& end)
+{
+    map<string, timeline_data> result;
 
-    for(auto entry : j["analytics"])
+    for(size_t first = 0; first < camera_ids.size(); first += TIMELINE_MAX_CAMERAS)
     {
-        analytics_event ae;
-        ae.motion_start_time = r_time_utils::iso_8601_to_tp(entry["motion_start_time"]);
-        ae.motion_end_time = r_time_utils::iso_8601_to_tp(entry["motion_end_time"]);
-        ae.total_detections = entry["total_detections"].get<int>();
+        auto last = min(first + TIMELINE_MAX_CAMERAS, camera_ids.size());
+        vector<string> batch(camera_ids.begin() + first, camera_ids.begin() + last);
 
-        for(auto det : entry["detections"])
+        auto uri = r_string_utils::format("/timeline?camera_ids=%s&start_time=%s&end_time=%s", r_string_utils::join(batch, ',').c_str(), r_time_utils::tp_to_iso_8601(start, true).c_str(), r_time_utils::tp_to_iso_8601(end, true).c_str());
+
+        auto resp = revere_http().get(_revere_ipv4(cs), REVERE_PORT, uri);
+
+        if(resp.get_status() != 200)
         {
-            analytics_detection ad;
-            ad.class_name = det["class_name"].get<string>();
-            ad.confidence = det["confidence"].get<float>();
-            ad.timestamp = r_time_utils::iso_8601_to_tp(det["timestamp"]);
-            ae.detections.push_back(ad);
+            R_LOG_ERROR("Timeline query failed with status %d", resp.get_status());
+            R_THROW(("Could not query timelines."));
         }
 
-        result.push_back(ae);
+        auto j = json::parse(resp.get_body_as_string().value());
+
+        for(auto& camera : j["cameras"].items())
+        {
+            timeline_data td;
+            td.segments = _parse_segments(camera.value()["segments"]);
+            td.motion_events = _parse_motion_events(camera.value()["motion_events"]);
+            td.analytics = _parse_analytics(camera.value()["analytics"]);
+            result[camera.key()] = std::move(td);
+        }
     }
 
     return result;
@@ -0,0 +1,308 @@
+
+#include "timeline_cache.h"
+#include <algorithm>
+
+using namespace vision;
+using namespace std;
+using namespace std::chrono;
+
+static void _absorb(segment& into, const segment& s)
+{
+    into.end = max(into.end, s.end);
+}
+
+static void _absorb(motion_event& into, const motion_event& me)
+{
+    into.end = max(into.end, me.end);
+    into.motion = max(into.motion, me.motion);
+    into.stddev = max(into.stddev, me.stddev);
+}
+
+// Sorts items by start and joins those that overlap or touch. Data fetched in pieces comes back cut
+// at the piece edges, this puts it back together.
+template<typename T>
+static void _union(vector<T>& items)
+{
+    sort(items.begin(), items.end(), [](const T& a, const T& b){ return a.start < b.start; });
+
+    vector<T> joined;
+    joined.reserve(items.size());
+    for(const auto& item : items)
+    {
+        if(!joined.empty() && item.start <= joined.back().end)
+            _absorb(joined.back(), item);
+        else joined.push_back(item);
+    }
+
+    items = std::move(joined);
+}
+
+template<typename T>
+static bool _overlaps(const T& item, const system_clock::time_point& start, const system_clock::time_point& end)
+{
+    return item.start <= end && item.end >= start;
+}
+
+timeline_cache::timeline_cache(fetch_cb fetch, size_t budget, milliseconds settle_time, milliseconds max_age) :
+    _fetch(fetch),
+    _budget(budget),
+    _settle_time(settle_time),
+    _max_age(max_age),
+    _cameras()
+{
+}
+
+timeline_cache::~timeline_cache() noexcept
+{
+}
+
+timeline_data timeline_cache::get(const string& camera_id, const vector<string>& camera_ids, const system_clock::time_point& start, const system_clock::time_point& end)
+{
+    // Motion is kept to the second, so the cached ranges are too. This also keeps the edges of
+    // neighboring ranges lined up.
+    _range r;
+    r.first = time_point_cast<seconds>(start);
+    r.second = time_point_cast<seconds>(end);
+    if(r.second < end)
+        r.second += seconds(1);
+
+    auto now = steady_clock::now();
+
+    _expire(now);
+
+    auto& c = _cameras[camera_id];
+    c.last_used = now;
+
+    for(const auto& gap : _gaps(c, r))
+    {
+        vector<string> ids;
+        ids.push_back(camera_id);
+        for(const auto& id : camera_ids)
+        {
+            if(find(ids.begin(), ids.end(), id) != ids.end())
+                continue;
+
+            auto found = _cameras.find(id);
+            if(found == _cameras.end() || !_gaps(found->second, gap).empty())
+                ids.push_back(id);
+        }
+
+        auto settled = system_clock::now() - _settle_time;
+
+        auto timelines = _fetch(ids, gap.first, gap.second);
+
+        // A camera revere couldn't answer for is left uncovered, it's asked for again next time.
+        for(auto& t : timelines)
+        {
+            if(find(ids.begin(), ids.end(), t.first) != ids.end())
+                _merge(_cameras[t.first], std::move(t.second), gap, settled, now);
+        }
+    }
+
+    _evict(camera_id, r);
+
+    return _slice(c, {start, end});
+}
+
+void timeline_cache::clear()
+{
+    _cameras.clear();
+}
+
+vector<timeline_cache::_range> timeline_cache::_gaps(const _camera& c, const _range& r)
+{
+    vector<_range> gaps;
+
+    auto pos = r.first;
+    for(const auto& covered : c.covered)
+    {
+        if(covered.range.second <= pos)
+            continue;
+        if(covered.range.first >= r.second)
+            break;
+        if(covered.range.first > pos)
+            gaps.push_back({pos, covered.range.first});
+        pos = covered.range.second;
+    }
+
+    if(pos < r.second)
+        gaps.push_back({pos, r.second});
+
+    return gaps;
+}
+
+void timeline_cache::_merge(_camera& c, timeline_data&& data, const _range& r, const system_clock::time_point& settled, const steady_clock::time_point& fetched)
+{
+    // The fetch is the truth about r. Whatever the cache held entirely inside it (an unsettled tail,
+    // or an expired range revere may have since overwritten) is replaced. What sticks out of r was
+    // cut at its edge, it's joined back up with the fetched pieces.
+    c.segments.erase(remove_if(c.segments.begin(), c.segments.end(), [&](const segment& s){
+        return s.start >= r.first && s.end <= r.second;
+    }), c.segments.end());
+    c.segments.insert(c.segments.end(), data.segments.begin(), data.segments.end());
+    _union(c.segments);
+
+    c.motion_events.erase(remove_if(c.motion_events.begin(), c.motion_events.end(), [&](const motion_event& me){
+        return me.start >= r.first && me.end <= r.second;
+    }), c.motion_events.end());
+    c.motion_events.insert(c.motion_events.end(), data.motion_events.begin(), data.motion_events.end());
+    _union(c.motion_events);
+
+    c.analytics.erase(c.analytics.lower_bound(r.first), c.analytics.lower_bound(r.second));
+    for(auto& ae : data.analytics)
+    {
+        auto key = ae.motion_start_time;
+        c.analytics[key] = std::move(ae);
+    }
+
+    // Only what has settled counts as covered, the rest is fetched again next time.
+    auto covered_end = min(r.second, settled);
+    if(covered_end > r.first)
+    {
+        c.covered.push_back({{r.first, covered_end}, fetched});
+        sort(c.covered.begin(), c.covered.end(), [](const _covered& a, const _covered& b){
+            return a.range.first < b.range.first;
+        });
+
+        // A joined range expires with its oldest part.
+        vector<_covered> joined;
+        joined.reserve(c.covered.size());
+        for(const auto& covered : c.covered)
+        {
+            if(!joined.empty() && covered.range.first <= joined.back().range.second)
+            {
+                joined.back().range.second = max(joined.back().range.second, covered.range.second);
+                joined.back().fetched = min(joined.back().fetched, covered.fetched);
+            }
+            else joined.push_back(covered);
+        }
+        c.covered = std::move(joined);
+    }
+
+    c.bytes = _bytes(c);
+}
+
+void timeline_cache::_trim(_camera& c, const _range& r)
+{
+    vector<_covered> covered;
+    for(const auto& cr : c.covered)
+    {
+        auto first = max(cr.range.first, r.first);
+        auto second = min(cr.range.second, r.second);
+        if(first < second)
+            covered.push_back({{first, second}, cr.fetched});
+    }
+    c.covered = std::move(covered);
+
+    c.segments.erase(remove_if(c.segments.begin(), c.segments.end(), [&](const segment& s){
+        return !_overlaps(s, r.first, r.second);
+    }), c.segments.end());
+    c.segments.shrink_to_fit();
+
+    c.motion_events.erase(remove_if(c.motion_events.begin(), c.motion_events.end(), [&](const motion_event& me){
+        return !_overlaps(me, r.first, r.second);
+    }), c.motion_events.end());
+    c.motion_events.shrink_to_fit();
+
+    for(auto i = c.analytics.begin(); i != c.analytics.end();)
+    {
+        if(i->second.motion_start_time > r.second || i->second.motion_end_time < r.first)
+            i = c.analytics.erase(i);
+        else ++i;
+    }
+
+    c.bytes = _bytes(c);
+}
+
+timeline_data timeline_cache::_slice(const _camera& c, const _range& r)
+{
+    timeline_data result;
+
+    auto segments_end = upper_bound(c.segments.begin(), c.segments.end(), r.second, [](const system_clock::time_point& tp, const segment& s){
+        return tp < s.start;
+    });
+    for(auto i = c.segments.begin(); i != segments_end; ++i)
+    {
+        if(i->end >= r.first)
+            result.segments.push_back(*i);
+    }
+
+    auto motion_end = upper_bound(c.motion_events.begin(), c.motion_events.end(), r.second, [](const system_clock::time_point& tp, const motion_event& me){
+        return tp < me.start;
+    });
+    for(auto i = c.motion_events.begin(); i != motion_end; ++i)
+    {
+        if(i->end >= r.first)
+            result.motion_events.push_back(*i);
+    }
+
+    for(auto i = c.analytics.begin(), e = c.analytics.upper_bound(r.second); i != e; ++i)
+    {
+        if(i->second.motion_end_time >= r.first)
+            result.analytics.push_back(i->second);
+    }
+
+    return result;
+}
+
+size_t timeline_cache::_bytes(const _camera& c)
+{
+    auto bytes = sizeof(_camera) +
+                 (c.covered.capacity() * sizeof(_covered)) +
+                 (c.segments.capacity() * sizeof(segment)) +
+                 (c.motion_events.capacity() * sizeof(motion_event));
+
+    for(const auto& a : c.analytics)
+    {
+        // Map nodes carry a few pointers and a color on top of the pair.
+        bytes += sizeof(a) + (4 * sizeof(void*)) + (a.second.detections.capacity() * sizeof(analytics_detection));
+        for(const auto& d : a.second.detections)
+            bytes += d.class_name.capacity();
+    }
+
+    return bytes;
+}
+
+void timeline_cache::_expire(const steady_clock::time_point& now)
+{
+    // The data stays until the refetch of its range replaces it, so there's something to show
+    // meanwhile.
+    for(auto& c : _cameras)
+    {
+        auto& covered = c.second.covered;
+        covered.erase(remove_if(covered.begin(), covered.end(), [&](const _covered& cr){
+            return now - cr.fetched >= _max_age;
+        }), covered.end());
+    }
+}
+
+void timeline_cache::_evict(const string& keep, const _range& r)
+{
+    size_t total = 0;
+    for(const auto& c : _cameras)
+        total += c.second.bytes;
+
+    while(total > _budget)
+    {
+        auto oldest = _cameras.end();
+        for(auto i = _cameras.begin(); i != _cameras.end(); ++i)
+        {
+            if(i->first != keep && (oldest == _cameras.end() || i->second.last_used < oldest->second.last_used))
+                oldest = i;
+        }
+
+        if(oldest == _cameras.end())
+            break;
+
+        total -= oldest->second.bytes;
+        _cameras.erase(oldest);
+    }
+
+    // The camera being looked at is too big by itself, keep just what's on screen.
+    if(total > _budget)
+    {
+        auto found = _cameras.find(keep);
+        if(found != _cameras.end())
+            _trim(found->second, r);
+    }
+}
@@ -0,0 +1,29 @@
+
+#include "framework.h"
+
+class test_timeline_cache : public test_fixture
+{
+public:
+    RTF_FIXTURE(test_timeline_cache);
+      TEST(test_timeline_cache::test_pan_inside_covered_range);
+      TEST(test_timeline_cache::test_zoom_out_fetches_only_gaps);
+      TEST(test_timeline_cache::test_live_fetches_only_tail);
+      TEST(test_timeline_cache::test_pieces_joined_at_fetch_edges);
+      TEST(test_timeline_cache::test_other_cameras_fetched_along);
+      TEST(test_timeline_cache::test_expired_range_refetched);
+      TEST(test_timeline_cache::test_budget_trims_to_view);
+    RTF_FIXTURE_END();
+
+    virtual ~test_timeline_cache() throw() {}
+
+    virtual void setup();
+    virtual void teardown();
+
+    void test_pan_inside_covered_range();
+    void test_zoom_out_fetches_only_gaps();
+    void test_live_fetches_only_tail();
+    void test_pieces_joined_at_fetch_edges();
+    void test_other_cameras_fetched_along();
+    void test_expired_range_refetched();
+    void test_budget_trims_to_view();
+};
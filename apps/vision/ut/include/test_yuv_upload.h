@@ -0,0 +1,27 @@
+
+#include "framework.h"
+
+class test_yuv_upload : public test_fixture
+{
+public:
+    RTF_FIXTURE(test_yuv_upload);
+      TEST(test_yuv_upload::test_i420_texture);
+      TEST(test_yuv_upload::test_nv12_texture);
+      TEST(test_yuv_upload::test_bad_planes);
+      TEST(test_yuv_upload::test_texture_loader);
+      TEST(test_yuv_upload::test_can_post_planes);
+      TEST(test_yuv_upload::test_software_renderer_falls_back);
+    RTF_FIXTURE_END();
+
+    virtual ~test_yuv_upload() throw() {}
+
+    virtual void setup();
+    virtual void teardown();
+
+    void test_i420_texture();
+    void test_nv12_texture();
+    void test_bad_planes();
+    void test_texture_loader();
+    void test_can_post_planes();
+    void test_software_renderer_falls_back();
+};
@@ -0,0 +1,245 @@
+
+#include "test_timeline_cache.h"
+#include "timeline_cache.h"
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+using namespace vision;
+
+REGISTER_TEST_FIXTURE(test_timeline_cache);
+
+namespace
+{
+
+struct fetch_log
+{
+    vector<string> camera_ids;
+    system_clock::time_point start;
+    system_clock::time_point end;
+};
+
+// Stands in for revere. Everything it returns is clipped to the range asked for, the way revere
+// clips motion events, so pieces of one recording come back cut at the fetch edges.
+struct fake_revere
+{
+    map<string, vector<segment>> segments;
+    map<string, vector<motion_event>> motion_events;
+    vector<fetch_log> fetches;
+
+    map<string, timeline_data> fetch(const vector<string>& camera_ids, const system_clock::time_point& start, const system_clock::time_point& end)
+    {
+        fetches.push_back({camera_ids, start, end});
+
+        map<string, timeline_data> result;
+        for(const auto& id : camera_ids)
+        {
+            timeline_data td;
+            for(auto s : segments[id])
+            {
+                if(s.end < start || s.start > end)
+                    continue;
+                s.start = max(s.start, start);
+                s.end = min(s.end, end);
+                td.segments.push_back(s);
+            }
+            for(auto me : motion_events[id])
+            {
+                if(me.end < start || me.start > end)
+                    continue;
+                me.start = max(me.start, start);
+                me.end = min(me.end, end);
+                td.motion_events.push_back(me);
+            }
+            result[id] = td;
+        }
+        return result;
+    }
+
+    timeline_cache::fetch_cb cb()
+    {
+        return [this](const vector<string>& camera_ids, const system_clock::time_point& start, const system_clock::time_point& end){
+            return fetch(camera_ids, start, end);
+        };
+    }
+};
+
+system_clock::time_point whole_seconds(const system_clock::time_point& tp)
+{
+    return time_point_cast<seconds>(tp);
+}
+
+segment make_segment(const system_clock::time_point& start, const system_clock::time_point& end)
+{
+    segment s;
+    s.start = start;
+    s.end = end;
+    return s;
+}
+
+motion_event make_motion(const system_clock::time_point& start, const system_clock::time_point& end)
+{
+    motion_event me;
+    me.start = start;
+    me.end = end;
+    me.motion = 50;
+    me.stddev = 5;
+    return me;
+}
+
+}
+
+void test_timeline_cache::setup()
+{
+}
+
+void test_timeline_cache::teardown()
+{
+}
+
+void test_timeline_cache::test_pan_inside_covered_range()
+{
+    auto base = whole_seconds(system_clock::now() - hours(24));
+
+    fake_revere revere;
+    revere.segments["a"].push_back(make_segment(base, base + hours(4)));
+
+    timeline_cache cache(revere.cb());
+
+    auto td = cache.get("a", {"a"}, base, base + hours(4));
+    RTF_ASSERT(revere.fetches.size() == 1);
+    RTF_ASSERT(td.segments.size() == 1);
+
+    // Panning and zooming in anywhere inside what's been seen costs nothing.
+    cache.get("a", {"a"}, base + hours(1), base + hours(2));
+    cache.get("a", {"a"}, base + minutes(90), base + hours(3));
+    td = cache.get("a", {"a"}, base + minutes(10), base + minutes(20));
+    RTF_ASSERT(revere.fetches.size() == 1);
+    RTF_ASSERT(td.segments.size() == 1);
+}
+
+void test_timeline_cache::test_zoom_out_fetches_only_gaps()
+{
+    auto base = whole_seconds(system_clock::now() - hours(24));
+
+    fake_revere revere;
+    timeline_cache cache(revere.cb());
+
+    cache.get("a", {"a"}, base + hours(1), base + hours(2));
+    RTF_ASSERT(revere.fetches.size() == 1);
+
+    // Zooming out fetches what's either side of the range already seen, not the whole range.
+    cache.get("a", {"a"}, base, base + hours(3));
+    RTF_ASSERT(revere.fetches.size() == 3);
+    RTF_ASSERT(revere.fetches[1].start == base && revere.fetches[1].end == base + hours(1));
+    RTF_ASSERT(revere.fetches[2].start == base + hours(2) && revere.fetches[2].end == base + hours(3));
+
+    cache.get("a", {"a"}, base, base + hours(3));
+    RTF_ASSERT(revere.fetches.size() == 3);
+}
+
+void test_timeline_cache::test_live_fetches_only_tail()
+{
+    fake_revere revere;
+    timeline_cache cache(revere.cb(), TIMELINE_CACHE_BUDGET, seconds(30));
+
+    auto now = system_clock::now();
+    cache.get("a", {"a"}, now - hours(1), now);
+    RTF_ASSERT(revere.fetches.size() == 1);
+
+    // The next refresh only asks for what hadn't settled when the last one was made.
+    now = system_clock::now();
+    cache.get("a", {"a"}, now - hours(1), now);
+    RTF_ASSERT(revere.fetches.size() == 2);
+    RTF_ASSERT(revere.fetches[1].start >= now - seconds(32));
+    RTF_ASSERT(revere.fetches[1].end >= now);
+}
+
+void test_timeline_cache::test_pieces_joined_at_fetch_edges()
+{
+    auto base = whole_seconds(system_clock::now() - hours(24));
+
+    fake_revere revere;
+    revere.segments["a"].push_back(make_segment(base, base + hours(3)));
+    revere.motion_events["a"].push_back(make_motion(base + minutes(50), base + minutes(70)));
+    revere.motion_events["a"].push_back(make_motion(base + minutes(80), base + minutes(81)));
+
+    timeline_cache cache(revere.cb());
+
+    cache.get("a", {"a"}, base + hours(1), base + hours(2));
+    cache.get("a", {"a"}, base, base + hours(1));
+    auto td = cache.get("a", {"a"}, base, base + hours(3));
+    RTF_ASSERT(revere.fetches.size() == 3);
+
+    // The recording and the motion event crossing the fetch edges come back whole, and motion that
+    // really is separate stays separate.
+    RTF_ASSERT(td.segments.size() == 1);
+    RTF_ASSERT(td.segments[0].start == base && td.segments[0].end == base + hours(3));
+    RTF_ASSERT(td.motion_events.size() == 2);
+    RTF_ASSERT(td.motion_events[0].start == base + minutes(50) && td.motion_events[0].end == base + minutes(70));
+    RTF_ASSERT(td.motion_events[1].start == base + minutes(80));
+}
+
+void test_timeline_cache::test_other_cameras_fetched_along()
+{
+    auto base = whole_seconds(system_clock::now() - hours(24));
+
+    fake_revere revere;
+    revere.segments["b"].push_back(make_segment(base, base + hours(1)));
+
+    timeline_cache cache(revere.cb());
+
+    cache.get("a", {"a", "b", "c"}, base, base + hours(1));
+    RTF_ASSERT(revere.fetches.size() == 1);
+    RTF_ASSERT(revere.fetches[0].camera_ids.size() == 3);
+
+    // Switching the selection to another camera on the wall is answered from the cache.
+    auto td = cache.get("b", {"a", "b", "c"}, base, base + hours(1));
+    RTF_ASSERT(revere.fetches.size() == 1);
+    RTF_ASSERT(td.segments.size() == 1);
+}
+
+void test_timeline_cache::test_expired_range_refetched()
+{
+    auto base = whole_seconds(system_clock::now() - hours(24));
+
+    fake_revere revere;
+    revere.segments["a"].push_back(make_segment(base, base + minutes(30)));
+    revere.segments["a"].push_back(make_segment(base + minutes(40), base + hours(1)));
+
+    timeline_cache cache(revere.cb(), TIMELINE_CACHE_BUDGET, TIMELINE_CACHE_SETTLE_TIME, milliseconds(0));
+
+    auto td = cache.get("a", {"a"}, base, base + hours(1));
+    RTF_ASSERT(td.segments.size() == 2);
+
+    // Revere overwrote its oldest recording, a range that has expired is fetched again and what
+    // went away goes away from the cache too.
+    revere.segments["a"].erase(revere.segments["a"].begin());
+
+    td = cache.get("a", {"a"}, base, base + hours(1));
+    RTF_ASSERT(revere.fetches.size() == 2);
+    RTF_ASSERT(td.segments.size() == 1);
+    RTF_ASSERT(td.segments[0].start == base + minutes(40));
+}
+
+void test_timeline_cache::test_budget_trims_to_view()
+{
+    auto base = whole_seconds(system_clock::now() - hours(24));
+
+    fake_revere revere;
+    for(int i = 0; i < 1000; ++i)
+        revere.motion_events["a"].push_back(make_motion(base + seconds(i * 10), base + seconds((i * 10) + 5)));
+
+    // Too small for anything but what's on screen.
+    timeline_cache cache(revere.cb(), 4096);
+
+    cache.get("a", {"a"}, base, base + seconds(10000));
+    auto td = cache.get("a", {"a"}, base, base + seconds(100));
+    RTF_ASSERT(td.motion_events.size() == 11);
+
+    // What was trimmed away is fetched again when it's looked at.
+    auto fetches = revere.fetches.size();
+    td = cache.get("a", {"a"}, base + seconds(5000), base + seconds(5100));
+    RTF_ASSERT(revere.fetches.size() == fetches + 1);
+    RTF_ASSERT(td.motion_events.size() == 11);
+}
@@ -0,0 +1,365 @@
+
+#include "test_yuv_upload.h"
+#include "pipeline_host.h"
+#include "configure_state.h"
+#include "r_ui_utils/texture.h"
+#include "r_ui_utils/texture_loader.h"
+#include <SDL.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+using namespace std;
+using namespace vision;
+using namespace r_ui_utils;
+
+REGISTER_TEST_FIXTURE(test_yuv_upload);
+
+namespace
+{
+
+struct yuv
+{
+    uint8_t y;
+    uint8_t u;
+    uint8_t v;
+};
+
+// Limited range BT.601, which is what SDL converts pictures this small with.
+const yuv RED {81, 90, 240};
+const yuv GREEN {145, 54, 34};
+const yuv BLUE {41, 240, 110};
+
+// A w x h 4:2:0 picture, top half one colour and bottom half another. Every row has padding after it
+// (like a decoder's linesize) filled with BLUE, which must not end up in the texture.
+struct picture
+{
+    bool nv12;
+    int w;
+    int h;
+    int y_pitch;
+    int c_pitch;
+    vector<uint8_t> y;
+    vector<uint8_t> u;  // interleaved U and V for NV12
+    vector<uint8_t> v;
+
+    yuv_planes planes() const
+    {
+        yuv_planes p;
+        p.nv12 = nv12;
+        p.y = y.data();
+        p.y_pitch = y_pitch;
+        p.u = u.data();
+        p.u_pitch = c_pitch;
+        p.v = (nv12) ? nullptr : v.data();
+        p.v_pitch = (nv12) ? 0 : c_pitch;
+        return p;
+    }
+};
+
+picture _make_picture(bool nv12, int w, int h, yuv top, yuv bottom)
+{
+    picture p;
+    p.nv12 = nv12;
+    p.w = w;
+    p.h = h;
+    p.y_pitch = w + 16;
+    p.c_pitch = ((nv12) ? w : w / 2) + 16;
+
+    p.y.assign((size_t)p.y_pitch * h, BLUE.y);
+    for(int row = 0; row < h; ++row)
+    {
+        auto c = (row < h / 2) ? top : bottom;
+        for(int x = 0; x < w; ++x)
+            p.y[((size_t)row * p.y_pitch) + x] = c.y;
+    }
+
+    p.u.assign((size_t)p.c_pitch * (h / 2), BLUE.u);
+    if(!nv12)
+        p.v.assign((size_t)p.c_pitch * (h / 2), BLUE.v);
+
+    for(int row = 0; row < h / 2; ++row)
+    {
+        auto c = (row < h / 4) ? top : bottom;
+        for(int x = 0; x < w / 2; ++x)
+        {
+            if(nv12)
+            {
+                p.u[((size_t)row * p.c_pitch) + (x * 2)] = c.u;
+                p.u[((size_t)row * p.c_pitch) + (x * 2) + 1] = c.v;
+            }
+            else
+            {
+                p.u[((size_t)row * p.c_pitch) + x] = c.u;
+                p.v[((size_t)row * p.c_pitch) + x] = c.v;
+            }
+        }
+    }
+
+    return p;
+}
+
+// SDL's software renderer drawing into a surface, so textures can be drawn and read back without a
+// display.
+struct software_renderer
+{
+    SDL_Surface* surface;
+    SDL_Renderer* renderer;
+
+    software_renderer(int w, int h) :
+        surface(SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888)),
+        renderer((surface) ? SDL_CreateSoftwareRenderer(surface) : nullptr)
+    {
+    }
+
+    ~software_renderer()
+    {
+        if(renderer)
+            SDL_DestroyRenderer(renderer);
+        if(surface)
+            SDL_FreeSurface(surface);
+    }
+
+    bool _is(int x, int y, yuv c)
+    {
+        auto pixel = *(Uint32*)((uint8_t*)surface->pixels + ((size_t)y * surface->pitch) + ((size_t)x * 4));
+        Uint8 r, g, b;
+        SDL_GetRGB(pixel, surface->format, &r, &g, &b);
+
+        auto hi = [](Uint8 v){return v > 200;};
+        auto lo = [](Uint8 v){return v < 60;};
+
+        if(c.y == RED.y)
+            return hi(r) && lo(g) && lo(b);
+        if(c.y == GREEN.y)
+            return lo(r) && hi(g) && lo(b);
+        return lo(r) && lo(g) && hi(b);
+    }
+
+    // Draws tex over the whole surface and checks every pixel (but the rows either side of the
+    // middle) is top or bottom.
+    bool shows(texture& tex, yuv top, yuv bottom)
+    {
+        SDL_RenderClear(renderer);
+        if(SDL_RenderCopy(renderer, tex.sdl_texture(), nullptr, nullptr) != 0)
+            return false;
+        SDL_RenderPresent(renderer);
+
+        for(int y = 0; y < surface->h; ++y)
+        {
+            if(y >= (surface->h / 2) - 1 && y <= surface->h / 2)
+                continue;
+
+            for(int x = 0; x < surface->w; ++x)
+            {
+                if(!_is(x, y, (y < surface->h / 2) ? top : bottom))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+Uint32 _format(const texture& tex)
+{
+    Uint32 format = 0;
+    SDL_QueryTexture(tex.sdl_texture(), &format, nullptr, nullptr, nullptr);
+    return format;
+}
+
+shared_ptr<AVFrame> _av_frame(AVPixelFormat format, AVColorRange range)
+{
+    shared_ptr<AVFrame> f(av_frame_alloc(), [](AVFrame* f){av_frame_free(&f);});
+    f->format = format;
+    f->width = 64;
+    f->height = 48;
+    f->color_range = range;
+    if(av_frame_get_buffer(f.get(), 32) < 0)
+        return nullptr;
+    return f;
+}
+
+}
+
+void test_yuv_upload::setup()
+{
+    SDL_Init(SDL_INIT_EVENTS);
+}
+
+void test_yuv_upload::teardown()
+{
+    SDL_Quit();
+}
+
+void test_yuv_upload::test_i420_texture()
+{
+    software_renderer sr(64, 48);
+    RTF_ASSERT(sr.renderer);
+
+    auto pic = _make_picture(false, 64, 48, RED, GREEN);
+    auto tex = texture::create_from_yuv(sr.renderer, pic.planes(), 64, 48);
+    RTF_ASSERT(tex && tex->is_valid());
+    RTF_ASSERT(tex->width() == 64 && tex->height() == 48);
+    RTF_ASSERT(_format(*tex) == SDL_PIXELFORMAT_IYUV);
+    RTF_ASSERT(sr.shows(*tex, RED, GREEN));
+
+    // Same size and format, updated in place.
+    auto texture_before = tex->sdl_texture();
+    pic = _make_picture(false, 64, 48, GREEN, RED);
+    RTF_ASSERT(tex->update_yuv(pic.planes(), 64, 48));
+    RTF_ASSERT(tex->sdl_texture() == texture_before);
+    RTF_ASSERT(sr.shows(*tex, GREEN, RED));
+}
+
+void test_yuv_upload::test_nv12_texture()
+{
+    software_renderer sr(64, 48);
+    RTF_ASSERT(sr.renderer);
+
+    auto pic = _make_picture(true, 64, 48, GREEN, RED);
+    auto tex = texture::create_from_yuv(sr.renderer, pic.planes(), 64, 48);
+    RTF_ASSERT(tex && tex->is_valid());
+    RTF_ASSERT(_format(*tex) == SDL_PIXELFORMAT_NV12);
+    RTF_ASSERT(sr.shows(*tex, GREEN, RED));
+
+    // A picture of another size and format (the stream changed) gets a new texture.
+    auto i420 = _make_picture(false, 32, 24, RED, GREEN);
+    RTF_ASSERT(tex->update_yuv(i420.planes(), 32, 24));
+    RTF_ASSERT(tex->width() == 32 && tex->height() == 24);
+    RTF_ASSERT(_format(*tex) == SDL_PIXELFORMAT_IYUV);
+    RTF_ASSERT(sr.shows(*tex, RED, GREEN));
+
+    // And back again.
+    pic = _make_picture(true, 64, 48, RED, GREEN);
+    RTF_ASSERT(tex->update_yuv(pic.planes(), 64, 48));
+    RTF_ASSERT(_format(*tex) == SDL_PIXELFORMAT_NV12);
+    RTF_ASSERT(sr.shows(*tex, RED, GREEN));
+}
+
+void test_yuv_upload::test_bad_planes()
+{
+    software_renderer sr(64, 48);
+    RTF_ASSERT(sr.renderer);
+
+    auto pic = _make_picture(false, 64, 48, RED, GREEN);
+
+    RTF_ASSERT(!texture::create_from_yuv(nullptr, pic.planes(), 64, 48));
+    RTF_ASSERT(!texture::create_from_yuv(sr.renderer, pic.planes(), 0, 48));
+
+    // I420 needs all three planes, NV12 only two.
+    auto planes = pic.planes();
+    planes.v = nullptr;
+    RTF_ASSERT(!texture::create_from_yuv(sr.renderer, planes, 64, 48));
+
+    auto tex = texture::create_from_yuv(sr.renderer, pic.planes(), 64, 48);
+    RTF_ASSERT(tex);
+    RTF_ASSERT(!tex->update_yuv(planes, 64, 48));
+
+    // A failed update leaves the picture that was there.
+    RTF_ASSERT(sr.shows(*tex, RED, GREEN));
+}
+
+void test_yuv_upload::test_texture_loader()
+{
+    software_renderer sr(64, 48);
+    RTF_ASSERT(sr.renderer);
+
+    // Textures are made on the thread that owns the renderer (the one calling work()), for a decode
+    // thread that asks for them.
+    texture_loader tl;
+    tl.set_renderer(sr.renderer);
+
+    auto pic = _make_picture(true, 64, 48, RED, GREEN);
+
+    shared_ptr<texture> tex;
+    atomic<bool> done {false};
+    bool threw = false;
+
+    thread decode_thread([&](){
+        try
+        {
+            tex = tl.create_texture();
+            tl.load_texture_from_yuv_memory(tex, pic.planes(), 64, 48);
+        }
+        catch(...)
+        {
+            threw = true;
+        }
+        done = true;
+    });
+
+    while(!done)
+    {
+        tl.work();
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    decode_thread.join();
+
+    RTF_ASSERT(!threw);
+    RTF_ASSERT(tex && tex->is_valid());
+    RTF_ASSERT(tex->width() == 64 && tex->height() == 48);
+    RTF_ASSERT(_format(*tex) == SDL_PIXELFORMAT_NV12);
+    RTF_ASSERT(sr.shows(*tex, RED, GREEN));
+}
+
+void test_yuv_upload::test_can_post_planes()
+{
+    auto i420 = _av_frame(AV_PIX_FMT_YUV420P, AVCOL_RANGE_MPEG);
+    auto nv12 = _av_frame(AV_PIX_FMT_NV12, AVCOL_RANGE_MPEG);
+    auto unspecified = _av_frame(AV_PIX_FMT_YUV420P, AVCOL_RANGE_UNSPECIFIED);
+    auto full_range = _av_frame(AV_PIX_FMT_YUV420P, AVCOL_RANGE_JPEG);
+    auto yuv422 = _av_frame(AV_PIX_FMT_YUV422P, AVCOL_RANGE_MPEG);
+    RTF_ASSERT(i420 && nv12 && unspecified && full_range && yuv422);
+
+    // Each format goes as planes only if the renderer draws that format itself.
+    RTF_ASSERT(pipeline_host::can_post_planes(i420.get(), true, false));
+    RTF_ASSERT(!pipeline_host::can_post_planes(i420.get(), false, true));
+    RTF_ASSERT(pipeline_host::can_post_planes(nv12.get(), false, true));
+    RTF_ASSERT(!pipeline_host::can_post_planes(nv12.get(), true, false));
+    RTF_ASSERT(pipeline_host::can_post_planes(unspecified.get(), true, true));
+
+    // Full range and anything but 4:2:0 go through swscale to RGB.
+    RTF_ASSERT(!pipeline_host::can_post_planes(full_range.get(), true, true));
+    RTF_ASSERT(!pipeline_host::can_post_planes(yuv422.get(), true, true));
+    RTF_ASSERT(!pipeline_host::can_post_planes(nullptr, true, true));
+}
+
+void test_yuv_upload::test_software_renderer_falls_back()
+{
+    software_renderer sr(64, 48);
+    RTF_ASSERT(sr.renderer);
+
+    // SDL's software renderer converts YUV on the CPU, so it never counts as native and vision
+    // keeps sending it RGB.
+    RTF_ASSERT(!texture::has_native_format(sr.renderer, SDL_PIXELFORMAT_IYUV));
+    RTF_ASSERT(!texture::has_native_format(sr.renderer, SDL_PIXELFORMAT_NV12));
+
+    configure_state cfg;
+    pipeline_host ph(cfg, sr.renderer);
+
+    auto i420 = _av_frame(AV_PIX_FMT_YUV420P, AVCOL_RANGE_MPEG);
+    auto nv12 = _av_frame(AV_PIX_FMT_NV12, AVCOL_RANGE_MPEG);
+    RTF_ASSERT(i420 && nv12);
+
+    RTF_ASSERT(!ph.can_post_planes(i420.get()));
+    RTF_ASSERT(!ph.can_post_planes(nv12.get()));
+
+    // Planes posted anyway are refused rather than drawn.
+    ph.consume_new_frames_flag();
+    ph.post_video_planes("camera", i420, 1000);
+    RTF_ASSERT(!ph.consume_new_frames_flag());
+
+    // The RGB path is what it gets.
+    auto bgra = make_shared<vector<uint8_t>>((size_t)64 * 48 * 4, 0);
+    ph.post_video_frame("camera", bgra, 64, 48, 64, 48, 1000);
+    RTF_ASSERT(ph.consume_new_frames_flag());
+}
@@ -0,0 +1,19 @@
+
+#ifndef __bench_clips_h
+#define __bench_clips_h
+
+#include "r_av/r_video_decoder.h"
+#include <vector>
+#include <cstdint>
+
+// Encodes n_frames of a moving w x h test pattern. Returns false if this FFmpeg has no encoder for
+// codec_id.
+bool encode_test_clip(AVCodecID codec_id, uint16_t w, uint16_t h, int n_frames, std::vector<std::vector<uint8_t>>& packets, std::vector<uint8_t>& extradata);
+
+// A decoder holding a decoded w x h picture (a JPEG of a gradient, so neighbouring pixels differ).
+r_av::r_video_decoder decoded_test_pattern(uint16_t w, uint16_t h);
+
+// Decodes every packet then drains the decoder, returns the number of frames that came out.
+int decode_all(r_av::r_video_decoder& decoder, const std::vector<std::vector<uint8_t>>& packets);
+
+#endif
@@ -0,0 +1,92 @@
+
+#include "bench_clips.h"
+#include "r_av/r_video_encoder.h"
+#include "r_utils/r_exception.h"
+
+using namespace std;
+using namespace r_av;
+
+bool encode_test_clip(AVCodecID codec_id, uint16_t w, uint16_t h, int n_frames, vector<vector<uint8_t>>& packets, vector<uint8_t>& extradata)
+{
+    if(!avcodec_find_encoder(codec_id))
+        return false;
+
+    auto h264 = (codec_id == AV_CODEC_ID_H264);
+
+    // zerolatency so that every frame comes straight back out (no lookahead or b frames to flush).
+    r_video_encoder encoder(codec_id, 4000000, w, h, {30,1}, AV_PIX_FMT_YUV420P, 0, 30, (h264) ? AV_PROFILE_H264_MAIN : AV_PROFILE_UNKNOWN, (h264) ? 41 : AV_LEVEL_UNKNOWN, "ultrafast", "zerolatency");
+
+    vector<uint8_t> yuv((size_t)w * h * 3 / 2);
+
+    for(int f = 0; f < n_frames; ++f)
+    {
+        for(size_t y = 0; y < h; ++y)
+            for(size_t x = 0; x < w; ++x)
+                yuv[(y * w) + x] = (uint8_t)((x + y + (f * 4)) & 0xff);
+        for(size_t i = (size_t)w * h; i < yuv.size(); ++i)
+            yuv[i] = (uint8_t)((i + f) & 0xff);
+
+        encoder.attach_buffer(yuv.data(), yuv.size(), f);
+
+        while(encoder.encode() == R_CODEC_STATE_HAS_OUTPUT)
+        {
+            auto pi = encoder.get();
+            packets.push_back(vector<uint8_t>(pi.data, pi.data + pi.size));
+        }
+    }
+
+    extradata = encoder.get_extradata();
+
+    return true;
+}
+
+r_video_decoder decoded_test_pattern(uint16_t w, uint16_t h)
+{
+    vector<uint8_t> yuv((size_t)w * h * 3 / 2);
+    for(size_t y = 0; y < h; ++y)
+        for(size_t x = 0; x < w; ++x)
+            yuv[(y * w) + x] = (uint8_t)((x + y) & 0xff);
+    for(size_t i = (size_t)w * h; i < yuv.size(); ++i)
+        yuv[i] = (uint8_t)(i & 0xff);
+
+    r_video_encoder encoder(AV_CODEC_ID_MJPEG, 100000, w, h, {1,1}, AV_PIX_FMT_YUVJ420P, 0, 1, 0, 0);
+    encoder.attach_buffer(yuv.data(), yuv.size(), 0);
+    if(encoder.encode() != R_CODEC_STATE_HAS_OUTPUT)
+        R_THROW(("Unable to encode test pattern."));
+    auto pi = encoder.get();
+
+    r_video_decoder decoder(AV_CODEC_ID_MJPEG);
+    decoder.attach_buffer(pi.data, pi.size);
+    auto ds = decoder.decode();
+    if(ds == R_CODEC_STATE_HUNGRY)
+        ds = decoder.flush();
+    if(ds != R_CODEC_STATE_HAS_OUTPUT && ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+        R_THROW(("Unable to decode test pattern."));
+
+    return decoder;
+}
+
+int decode_all(r_video_decoder& decoder, const vector<vector<uint8_t>>& packets)
+{
+    int n_frames = 0;
+
+    for(auto& p : packets)
+    {
+        decoder.attach_buffer(p.data(), p.size());
+
+        while(true)
+        {
+            auto ds = decoder.decode();
+            if(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+                ++n_frames;
+            // AGAIN_HAS_OUTPUT means the packet is still waiting to go in.
+            if(ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+                break;
+        }
+    }
+
+    while(decoder.flush() == R_CODEC_STATE_HAS_OUTPUT)
+        ++n_frames;
+
+    return n_frames;
+}
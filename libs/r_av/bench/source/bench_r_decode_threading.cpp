@@ -0,0 +1,78 @@
+
+#include "bench.h"
+#include "bench_clips.h"
+#include "r_av/r_video_decoder.h"
+#include "r_utils/r_string_utils.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+using namespace r_av;
+
+// The aggregate frames per second of N streams of 1080p decoded at once, one thread per stream, for
+// each threading preset.
+REGISTER_BENCH(decode_threading)
+{
+    const int N_FRAMES = 30;
+
+    const pair<AVCodecID, const char*> codecs[] = {{AV_CODEC_ID_H264, "h264"}, {AV_CODEC_ID_HEVC, "hevc"}};
+    const pair<r_decoder_threading, const char*> presets[] = {
+        {R_DECODER_THREADING_SINGLE, "single"},
+        {R_DECODER_THREADING_LOW_LATENCY, "low_latency"},
+        {R_DECODER_THREADING_THROUGHPUT, "throughput"}
+    };
+
+    printf("1080p decode, aggregate fps (%u cores, budget %u threads)\n", std::thread::hardware_concurrency(), std::thread::hardware_concurrency());
+
+    for(auto& codec : codecs)
+    {
+        vector<vector<uint8_t>> packets;
+        vector<uint8_t> extradata;
+        if(!encode_test_clip(codec.first, 1920, 1080, N_FRAMES, packets, extradata))
+        {
+            printf("%s: no encoder, skipped\n", codec.second);
+            continue;
+        }
+
+        for(int n_streams : {1, 2, 4, 8})
+        {
+            string line = r_string_utils::format("%s x%d", codec.second, n_streams);
+
+            for(auto& preset : presets)
+            {
+                atomic<int> n_decoded(0);
+
+                auto start = steady_clock::now();
+
+                vector<thread> streams;
+                for(int i = 0; i < n_streams; ++i)
+                {
+                    streams.push_back(thread([&](){
+                        r_video_decoder decoder(codec.first);
+                        decoder.set_extradata(extradata);
+                        decoder.set_threading(preset.first);
+                        n_decoded += decode_all(decoder, packets);
+                    }));
+                }
+
+                for(auto& t : streams)
+                    t.join();
+
+                auto elapsed = duration<double>(steady_clock::now() - start).count();
+
+                line += r_string_utils::format("  %s %.1f", preset.second, (double)n_decoded / elapsed);
+
+                if(n_decoded != n_streams * N_FRAMES)
+                    line += r_string_utils::format(" (only %d of %d frames)", (int)n_decoded, n_streams * N_FRAMES);
+            }
+
+            printf("%s\n", line.c_str());
+        }
+    }
+}
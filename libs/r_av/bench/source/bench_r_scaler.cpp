@@ -0,0 +1,67 @@
+
+#include "bench.h"
+#include "bench_clips.h"
+#include "r_av/r_video_decoder.h"
+#include "r_utils/r_string_utils.h"
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+using namespace r_av;
+
+// The time to scale a frame from common camera resolutions to common display sizes, for each
+// quality, on one thread and split across threads.
+REGISTER_BENCH(scaler)
+{
+    const int N = 5;
+
+    const pair<uint16_t, uint16_t> sources[] = {{3840, 2160}, {1920, 1080}, {1280, 720}};
+    const pair<uint16_t, uint16_t> outputs[] = {{1920, 1080}, {1280, 720}, {640, 360}, {320, 180}};
+    const pair<r_scaler_quality, const char*> qualities[] = {
+        {R_SCALER_QUALITY_BILINEAR, "bilinear"},
+        {R_SCALER_QUALITY_FAST_BILINEAR, "fast_bilinear"},
+        {R_SCALER_QUALITY_POINT, "point"}
+    };
+
+    printf("scale to BGRA, us per frame (1 thread / %d threads)\n", R_MAX_SCALER_THREADS);
+
+    for(auto& src : sources)
+    {
+        auto decoder = decoded_test_pattern(src.first, src.second);
+
+        for(auto& out : outputs)
+        {
+            vector<uint8_t> buffer(r_video_decoder::output_image_size(AV_PIX_FMT_BGRA, out.first, out.second, 1));
+
+            string line = r_string_utils::format("%4ux%-4u -> %4ux%-4u", src.first, src.second, out.first, out.second);
+
+            for(auto& q : qualities)
+            {
+                decoder.set_scaler_quality(q.first);
+
+                double us[2];
+                int thread_counts[2] = {1, R_MAX_SCALER_THREADS};
+                for(int t = 0; t < 2; ++t)
+                {
+                    decoder.set_scaler_threads(thread_counts[t]);
+
+                    // The first scale creates the scaler.
+                    decoder.get(AV_PIX_FMT_BGRA, out.first, out.second, buffer.data(), buffer.size(), 1);
+
+                    auto start = steady_clock::now();
+                    for(int i = 0; i < N; ++i)
+                        decoder.get(AV_PIX_FMT_BGRA, out.first, out.second, buffer.data(), buffer.size(), 1);
+                    us[t] = (double)duration_cast<microseconds>(steady_clock::now() - start).count() / (double)N;
+                }
+
+                line += r_string_utils::format("  %s %.0f/%.0f", q.second, us[0], us[1]);
+            }
+
+            printf("%s\n", line.c_str());
+        }
+    }
+}
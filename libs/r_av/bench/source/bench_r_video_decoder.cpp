@@ -0,0 +1,73 @@
+
+#include "bench.h"
+#include "bench_clips.h"
+#include "r_av/r_video_decoder.h"
+#include "r_utils/r_exception.h"
+#include <chrono>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_av;
+
+// Decodes a 1080p clip and scales every frame to 640x360 BGRA three ways (a new image each time, an
+// image from a pool and a caller's buffer), printing the allocations and time per frame of each.
+REGISTER_BENCH(decoder_output_buffers)
+{
+    const int N_FRAMES = 60;
+    const uint16_t w = 640, h = 360;
+
+    vector<vector<uint8_t>> packets;
+    vector<uint8_t> extradata;
+    if(!encode_test_clip(AV_CODEC_ID_H264, 1920, 1080, N_FRAMES, packets, extradata))
+        R_THROW(("No H.264 encoder."));
+
+    r_video_decoder decoder(AV_CODEC_ID_H264);
+    decoder.set_extradata(extradata);
+
+    r_frame_pool pool(4);
+    vector<uint8_t> caller_buffer(r_video_decoder::output_image_size(AV_PIX_FMT_BGRA, w, h, 1));
+
+    // Like a UI that hangs on to a frame until it draws the next one.
+    shared_ptr<vector<uint8_t>> held;
+
+    int n_frames = 0;
+    nanoseconds decode_time(0), allocating_time(0), pooled_time(0), caller_time(0);
+
+    for(auto& p : packets)
+    {
+        decoder.attach_buffer(p.data(), p.size());
+
+        auto t0 = steady_clock::now();
+        auto ds = decoder.decode();
+        decode_time += steady_clock::now() - t0;
+
+        if(ds != R_CODEC_STATE_HAS_OUTPUT && ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+            continue;
+
+        auto t1 = steady_clock::now();
+        auto allocated = decoder.get(AV_PIX_FMT_BGRA, w, h, 1);
+        auto t2 = steady_clock::now();
+        auto pooled = decoder.get(pool, AV_PIX_FMT_BGRA, w, h, 1);
+        auto t3 = steady_clock::now();
+        decoder.get(AV_PIX_FMT_BGRA, w, h, caller_buffer.data(), caller_buffer.size(), 1);
+        auto t4 = steady_clock::now();
+
+        allocating_time += t2 - t1;
+        pooled_time += t3 - t2;
+        caller_time += t4 - t3;
+
+        held = pooled;
+        ++n_frames;
+    }
+
+    if(n_frames == 0)
+        R_THROW(("Nothing decoded."));
+
+    auto per_frame_us = [n_frames](nanoseconds d){return (double)d.count() / 1000.0 / (double)n_frames;};
+
+    printf("%d frames, decode %.1f fps\n", n_frames, (double)n_frames / duration<double>(decode_time).count());
+    printf("images allocated per frame: get() 1, pooled %.3f, caller buffer 0\n", (double)pool.stats().created / (double)n_frames);
+    printf("scale per frame: get() %.1fus, pooled %.1fus, caller buffer %.1fus\n", per_frame_us(allocating_time), per_frame_us(pooled_time), per_frame_us(caller_time));
+}
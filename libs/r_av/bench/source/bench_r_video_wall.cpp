@@ -0,0 +1,84 @@
+
+#include "bench.h"
+#include "bench_clips.h"
+#include "r_av/r_video_decoder.h"
+#include "r_utils/r_string_utils.h"
+#include "r_utils/r_exception.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <ctime>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+using namespace r_av;
+
+// The CPU time it takes to show 2 seconds of a wall of 640x360 substreams (decoded and scaled to
+// BGRA at tile size, as vision does), at full fidelity and at the fidelity vision picks for the tile
+// size: reduced for a 4x4 wall on 1080p, key frames only for an 8x8.
+REGISTER_BENCH(video_wall)
+{
+    const int N_FRAMES = 60;
+
+    vector<vector<uint8_t>> packets;
+    vector<uint8_t> extradata;
+    if(!encode_test_clip(AV_CODEC_ID_H264, 640, 360, N_FRAMES, packets, extradata))
+        R_THROW(("No H.264 encoder."));
+
+    struct wall { const char* name; int n_tiles; uint16_t tile_w; uint16_t tile_h; r_decode_fidelity fidelity; };
+    const wall walls[] = {
+        {"4x4", 16, 480, 270, R_DECODE_FIDELITY_REDUCED},
+        {"8x8", 64, 240, 135, R_DECODE_FIDELITY_KEY_FRAMES}
+    };
+
+    printf("640x360 substreams, 2 seconds of video (%u cores)\n", std::thread::hardware_concurrency());
+
+    for(auto& w : walls)
+    {
+        string line = r_string_utils::format("%s (%d tiles of %ux%u)", w.name, w.n_tiles, w.tile_w, w.tile_h);
+
+        for(auto fidelity : {R_DECODE_FIDELITY_FULL, w.fidelity})
+        {
+            atomic<int> n_shown(0);
+
+            auto cpu_start = clock();
+            auto start = steady_clock::now();
+
+            vector<thread> tiles;
+            for(int i = 0; i < w.n_tiles; ++i)
+            {
+                tiles.push_back(thread([&](){
+                    r_video_decoder decoder(AV_CODEC_ID_H264);
+                    decoder.set_extradata(extradata);
+                    decoder.set_threading(R_DECODER_THREADING_SINGLE);
+                    decoder.set_fidelity(fidelity);
+                    decoder.set_scaler_quality((fidelity == R_DECODE_FIDELITY_FULL) ? R_SCALER_QUALITY_BILINEAR : R_SCALER_QUALITY_FAST_BILINEAR);
+
+                    for(auto& p : packets)
+                    {
+                        decoder.attach_buffer(p.data(), p.size());
+                        auto ds = decoder.decode();
+                        if(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+                        {
+                            decoder.get(AV_PIX_FMT_BGRA, w.tile_w, w.tile_h, 1);
+                            ++n_shown;
+                        }
+                    }
+                }));
+            }
+
+            for(auto& t : tiles)
+                t.join();
+
+            auto cpu_seconds = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+            auto elapsed = duration<double>(steady_clock::now() - start).count();
+
+            line += r_string_utils::format("  %s %.2f cpu s (%.2f s, %d frames)", (fidelity == R_DECODE_FIDELITY_FULL) ? "full" : ((fidelity == R_DECODE_FIDELITY_REDUCED) ? "reduced" : "key_frames"), cpu_seconds, elapsed, (int)n_shown);
+        }
+
+        printf("%s\n", line.c_str());
+    }
+}
@@ -0,0 +1,94 @@
+
+#include "bench.h"
+#include "bench_clips.h"
+#include "r_av/r_video_decoder.h"
+#include "r_utils/r_exception.h"
+#include <chrono>
+#include <vector>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+using namespace r_av;
+
+// The CPU time a 16 tile wall of 1080p streams spends getting each decoded picture ready to upload:
+// converted to BGRA at tile size by swscale and copied (before), or its planes copied as they are for
+// the renderer to convert and scale (after). Only renderers that has_native_format() the planes take
+// the second path, SDL's software renderer never does.
+REGISTER_BENCH(yuv_upload)
+{
+    const int N_TILES = 16;
+    const int N_FRAMES = 30;
+    const uint16_t TILE_W = 480, TILE_H = 270;
+
+    vector<vector<uint8_t>> packets;
+    vector<uint8_t> extradata;
+    if(!encode_test_clip(AV_CODEC_ID_H264, 1920, 1080, N_FRAMES, packets, extradata))
+        R_THROW(("No H.264 encoder."));
+
+    printf("%d tiles of 1920x1080 shown at %ux%u, %d frames each\n", N_TILES, TILE_W, TILE_H, N_FRAMES);
+
+    for(auto planes : {false, true})
+    {
+        // Stands in for the texture, what SDL_UpdateTexture() / SDL_UpdateYUVTexture() copy into.
+        vector<uint8_t> upload;
+        nanoseconds prepare(0);
+        int n_frames = 0;
+
+        auto cpu_start = clock();
+
+        for(int t = 0; t < N_TILES; ++t)
+        {
+            r_video_decoder decoder(AV_CODEC_ID_H264);
+            decoder.set_extradata(extradata);
+            decoder.set_threading(R_DECODER_THREADING_SINGLE);
+
+            for(auto& p : packets)
+            {
+                decoder.attach_buffer(p.data(), p.size());
+                auto ds = decoder.decode();
+                if(ds != R_CODEC_STATE_HAS_OUTPUT && ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+                    continue;
+
+                auto start = steady_clock::now();
+
+                if(planes)
+                {
+                    auto f = decoder.ref_frame();
+                    if(f->format != AV_PIX_FMT_YUV420P)
+                        R_THROW(("Expected YUV420P from the H.264 decoder."));
+
+                    upload.resize((size_t)f->width * f->height * 3 / 2);
+                    auto dst = upload.data();
+                    for(int plane = 0; plane < 3; ++plane)
+                    {
+                        int w = (plane == 0) ? f->width : (f->width + 1) / 2;
+                        int h = (plane == 0) ? f->height : (f->height + 1) / 2;
+                        for(int y = 0; y < h; ++y, dst += w)
+                            memcpy(dst, f->data[plane] + ((size_t)y * f->linesize[plane]), w);
+                    }
+                }
+                else
+                {
+                    auto bgra = decoder.get(AV_PIX_FMT_BGRA, TILE_W, TILE_H, 1);
+                    upload.resize(bgra->size());
+                    memcpy(upload.data(), bgra->data(), bgra->size());
+                }
+
+                prepare += duration_cast<nanoseconds>(steady_clock::now() - start);
+                ++n_frames;
+            }
+        }
+
+        auto cpu_seconds = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+        printf("%-26s %.3f ms per frame to prepare, %.2f cpu s in all (decode included, %d frames)\n",
+               (planes) ? "after (planes)" : "before (swscale to BGRA)",
+               duration<double, milli>(prepare).count() / ((n_frames > 0) ? n_frames : 1),
+               cpu_seconds,
+               n_frames);
+    }
+}
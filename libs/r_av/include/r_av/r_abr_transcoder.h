@@ -0,0 +1,128 @@
+#ifndef r_av_r_abr_transcoder_h
+#define r_av_r_abr_transcoder_h
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include "r_av/r_video_decoder.h"
+#include "r_av/r_video_encoder.h"
+#include "r_utils/r_macro.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <memory>
+
+namespace r_av
+{
+
+// Decoded frames a rung may fall behind by before its oldest waiting frame is dropped. A rung that
+// can't keep up loses frames, it never holds up the decode or the other rungs.
+constexpr size_t R_ABR_MAX_PENDING_FRAMES = 4;
+
+struct r_abr_rung
+{
+    uint16_t width;
+    uint16_t height;
+    uint32_t bitrate;
+};
+
+struct r_abr_rung_stats
+{
+    uint64_t frames_encoded {0};
+    uint64_t frames_dropped {0};
+    uint64_t bytes_encoded {0};
+    // Frames encoded per second since start().
+    double encode_fps {0.0};
+    // CPU time the rung's thread spent scaling and encoding, per frame and as a share of one core.
+    double cpu_ms_per_frame {0.0};
+    double cpu_load {0.0};
+};
+
+// r_abr_transcoder turns one compressed video stream into a ladder of H.264 renditions. Each input
+// frame is decoded once (on the thread calling write_frame()), then every rung scales the same
+// decoded frame to its own size and encodes it on its own thread, so the rungs encode concurrently
+// and a ladder costs one decode rather than one per rung.
+//
+// Encoded packets are handed to the callback on the rung's thread, the packet's data is only valid
+// until the callback returns.
+class r_abr_transcoder final
+{
+public:
+    typedef std::function<void(size_t rung, const r_packet_info& pi)> packet_cb;
+
+    R_API r_abr_transcoder(
+        AVCodecID input_codec,
+        const std::vector<uint8_t>& input_extradata,
+        AVRational input_timebase,
+        AVRational framerate,
+        const std::vector<r_abr_rung>& ladder,
+        packet_cb cb
+    );
+
+    R_API ~r_abr_transcoder();
+
+    R_API r_abr_transcoder(const r_abr_transcoder&) = delete;
+    R_API r_abr_transcoder& operator=(const r_abr_transcoder&) = delete;
+
+    // A transcoder runs once, it can't be started again after stop().
+    R_API void start();
+    // Encodes whatever the rungs still have waiting, flushes the encoders and joins their threads.
+    R_API void stop();
+
+    // Decodes data and queues the picture (if one came out) for every rung.
+    R_API void write_frame(const uint8_t* data, size_t size, int64_t pts);
+
+    size_t n_rungs() const { return _rungs.size(); }
+    R_API std::vector<uint8_t> get_extradata(size_t rung) const;
+    R_API std::vector<r_abr_rung_stats> stats() const;
+
+private:
+    struct _decoded
+    {
+        std::shared_ptr<AVFrame> frame;
+        int64_t pts;
+    };
+
+    struct _rung_state
+    {
+        r_abr_rung rung;
+        r_video_encoder encoder;
+        std::thread worker;
+
+        std::mutex lock;
+        std::condition_variable cond;
+        std::deque<_decoded> pending;
+
+        std::atomic<uint64_t> frames_encoded {0};
+        std::atomic<uint64_t> frames_dropped {0};
+        std::atomic<uint64_t> bytes_encoded {0};
+        std::atomic<int64_t> cpu_ns {0};
+    };
+
+    void _queue(const std::shared_ptr<AVFrame>& frame, int64_t pts);
+    void _rung_worker(size_t index);
+    void _write_packets(size_t index, _rung_state& rs, bool flush);
+
+    r_video_decoder _decoder;
+    AVRational _input_timebase;
+    AVRational _framerate;
+    packet_cb _cb;
+    std::vector<std::unique_ptr<_rung_state>> _rungs;
+    std::atomic<bool> _running;
+    // Read by stats() from any thread.
+    std::atomic<std::chrono::steady_clock::time_point> _started;
+    std::atomic<std::chrono::steady_clock::time_point> _stopped;
+};
+
+}
+
+#endif
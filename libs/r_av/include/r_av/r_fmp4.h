@@ -0,0 +1,58 @@
+#ifndef r_av_r_fmp4_h
+#define r_av_r_fmp4_h
+
+#include "r_utils/r_macro.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/rational.h>
+}
+
+namespace r_av
+{
+
+// r_fmp4_concat joins fragmented MP4s (r_muxer with movflags=frag_keyframe+empty_moov) that were
+// muxed separately, with the same streams, into one file. This lets a long export be muxed as
+// independent pieces in parallel and then written out in order.
+//
+// The first piece's ftyp and moov are written as is. Every piece's fragments (moof + mdat) follow,
+// with their decode times (tfdt) moved forward by the piece's start time and their sequence numbers
+// (mfhd) renumbered so they run on from the previous piece. Each piece must have been muxed with
+// its own timestamps starting at 0.
+class r_fmp4_concat final
+{
+public:
+    R_API r_fmp4_concat(const std::function<void(const uint8_t*, size_t)>& write);
+    R_API r_fmp4_concat(const r_fmp4_concat&) = delete;
+    R_API r_fmp4_concat(r_fmp4_concat&&) = delete;
+
+    R_API r_fmp4_concat& operator=(const r_fmp4_concat&) = delete;
+    R_API r_fmp4_concat& operator=(r_fmp4_concat&&) = delete;
+
+    // Pieces must be appended in order. start_time is where the piece begins in the joined output,
+    // in time_base units. The piece is patched in place.
+    R_API void append(std::vector<uint8_t>& piece, int64_t start_time, AVRational time_base);
+
+    size_t n_fragments() const { return _sequence_number; }
+    uint64_t bytes_written() const { return _bytes_written; }
+
+private:
+    void _parse_moov(uint8_t* p, uint8_t* end);
+    void _patch_moof(uint8_t* p, uint8_t* end, int64_t start_time, AVRational time_base);
+
+    std::function<void(const uint8_t*, size_t)> _write;
+    std::map<uint32_t, uint32_t> _timescales; // track id -> mdhd timescale
+    bool _wrote_header;
+    uint32_t _sequence_number;
+    uint64_t _bytes_written;
+};
+
+}
+
+#endif
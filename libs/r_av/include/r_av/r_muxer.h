@@ -55,6 +55,9 @@ public:
 
     R_API void set_output_option(const std::string& key, const std::string& value);
 
+    // Options for the container muxer itself (e.g. "movflags"), applied when the header is written.
+    R_API void set_format_option(const std::string& key, const std::string& value);
+
     R_API void open();
 
     R_API void write_video_frame(uint8_t* p, size_t size, int64_t input_pts, int64_t input_dts, AVRational input_time_base, bool key);
@@ -70,6 +73,7 @@ private:
     bool _output_to_buffer;
     std::string _format_name;
     std::map<std::string, std::string> _output_options;
+    std::map<std::string, std::string> _format_options;
     std::vector<uint8_t> _buffer;
 
     r_utils::r_std_utils::raii_ptr<AVFormatContext> _fc;
@@ -74,6 +74,7 @@ private:
     size_t _max_queue_size;
 
     // Codec components
+    r_frame_pool _frame_pool;  // decoded frames, so each one doesn't allocate
     r_video_decoder _decoder;
     r_video_encoder _encoder;
     r_muxer _muxer;
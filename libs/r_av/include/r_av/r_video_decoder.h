@@ -12,6 +12,8 @@ extern "C"
 
 #include "r_av/r_codec_state.h"
 #include "r_utils/r_macro.h"
+#include "r_utils/r_keyed_pool.h"
+#include "r_utils/r_lru_cache.h"
 #include <vector>
 #include <cstdint>
 #include <map>
@@ -20,9 +22,42 @@ extern "C"
 namespace r_av
 {
 
-// Note: This model where we keep previously caches scaler states around and then clear
-// them at the end might need to change. If an app resized constantly it would be effectively
-// a memory leak (not technically one because at decoder cleanup they would be destroyed).
+enum r_scaler_quality
+{
+    R_SCALER_QUALITY_BILINEAR,
+    R_SCALER_QUALITY_FAST_BILINEAR,  // noticeably softer, but cheaper (motion, thumbnails)
+    R_SCALER_QUALITY_POINT,          // nearest neighbour, cheapest of all
+    R_SCALER_QUALITY_BICUBIC
+};
+
+// A decoder keeps at most this many scalers, when it needs another the least recently used one is
+// freed (so a window being resized doesn't leave a scaler behind for every size it passed through).
+constexpr size_t R_MAX_SCALERS = 4;
+
+// When the scaler thread count is automatic, pictures at least this tall (in or out) are split
+// into slices scaled by up to R_MAX_SCALER_THREADS threads. Anything smaller isn't worth the hand off.
+constexpr uint16_t R_THREADED_SCALE_MIN_HEIGHT = 720;
+constexpr int R_MAX_SCALER_THREADS = 4;
+
+enum r_decoder_threading
+{
+    R_DECODER_THREADING_SINGLE,       // decode on the calling thread only
+    R_DECODER_THREADING_LOW_LATENCY,  // slice threads: every frame still comes out of the packet that carried it
+    R_DECODER_THREADING_THROUGHPUT    // frame threads: more frames per second, but each comes out thread count - 1 packets late
+};
+
+// How much of each picture a decoder bothers to reconstruct. Below full, pictures are meant for
+// showing small (a tile in a wall of video), where what is skipped can't be seen anyway.
+enum r_decode_fidelity
+{
+    R_DECODE_FIDELITY_FULL,
+    R_DECODE_FIDELITY_REDUCED,    // no deblocking, and half resolution where the codec can decode at lower resolution
+    R_DECODE_FIDELITY_KEY_FRAMES  // reduced, and everything but key frames is thrown away undecoded
+};
+
+// The most threads one decoder asks for when its thread count is automatic.
+constexpr int R_MAX_DECODER_THREADS = 8;
+
 struct r_scaler_state
 {
     AVPixelFormat input_format;
@@ -31,10 +66,16 @@ struct r_scaler_state
     AVPixelFormat output_format;
     uint16_t output_width;
     uint16_t output_height;
+    r_scaler_quality quality;
+    int threads;
 };
 
 R_API bool operator<(const r_scaler_state& lhs, const r_scaler_state& rhs);
 
+// Output images keyed by their size in bytes. Decoders producing same sized images (every tile of a
+// video wall, say) can share one, so the images they hand out are recycled rather than allocated.
+typedef r_utils::r_keyed_pool<size_t, std::vector<uint8_t>> r_frame_pool;
+
 class r_video_decoder final
 {
 public:
@@ -49,18 +90,71 @@ public:
 
     R_API void set_extradata(const std::vector<uint8_t>& ed);
 
-    R_API void attach_buffer(const uint8_t* data, size_t size);
+    // Threading has to be chosen before the first decode() or flush(). A thread_count of 0 asks for
+    // as many as there are cores (up to R_MAX_DECODER_THREADS). Either way a decoder is only given
+    // what is left of the process wide budget when it opens, and gets 1 thread if that's nothing.
+    R_API void set_threading(r_decoder_threading threading, int thread_count = 0);
+    // For FF_THREAD_FRAME / FF_THREAD_SLICE combinations the presets don't cover.
+    R_API void set_thread_type(int thread_type, int thread_count);
+    // The threads this decoder was given (1 until it has opened).
+    R_API int thread_count() const;
+
+    // The most decode threads all open decoders can hold between them (the number of cores by
+    // default). Decoders already open keep what they have.
+    R_API static void set_thread_budget(int threads);
+    R_API static int threads_in_use();
+
+    // Can be changed between any two decode() calls, except that a codec's lower resolution decoding
+    // (which H.264 and H.265 don't have) only comes into play if reduced is chosen before the first.
+    // Going back to full mid stream leaves pictures damaged until the next key frame.
+    R_API void set_fidelity(r_decode_fidelity fidelity);
+    R_API r_decode_fidelity fidelity() const { return _fidelity; }
+
+    // pts (in whatever timebase the caller keeps) comes back on the frame decoded from this data, as
+    // get_frame()->pts and best_effort_timestamp, even when the decoder reorders frames.
+    R_API void attach_buffer(const uint8_t* data, size_t size, int64_t pts = AV_NOPTS_VALUE);
 
     R_API r_codec_state decode();
     R_API r_codec_state flush();
 
+    // Returns the decoder to its just constructed state (keeping the opened codec, extradata and
+    // scalers) so that it can be reused for an unrelated stream with the same configuration.
+    R_API void reset();
+
     R_API std::shared_ptr<std::vector<uint8_t>> get(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, int alignment = 32);
 
+    // Like get() but the image comes from pool (and goes back to it when the last reference is
+    // released), so steady state decoding doesn't allocate.
+    R_API std::shared_ptr<std::vector<uint8_t>> get(r_frame_pool& pool, AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, int alignment = 32);
+
+    // Scales into a buffer the caller owns and returns the number of bytes written. Throws if the
+    // buffer is smaller than output_image_size().
+    R_API size_t get(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, uint8_t* output, size_t output_size, int alignment = 32);
+
+    R_API static size_t output_image_size(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, int alignment = 32);
+
+    // The decoded frame as it came out of the codec (its own pixel format, planes and line sizes),
+    // with no conversion or copy. It is only valid until the next decode(), flush() or reset().
+    R_API const AVFrame* get_frame() const;
+
+    // A new reference to the decoded frame's buffers (no pixels are copied), for keeping a frame
+    // past the next decode().
+    R_API std::shared_ptr<AVFrame> ref_frame() const;
+
     R_API uint16_t input_width() const;
     R_API uint16_t input_height() const;
 
+    // Applies to scalers created from here on (existing ones are kept until they age out).
+    R_API void set_scaler_quality(r_scaler_quality quality);
+    // 0 (the default) picks a thread count from the picture size, 1 never splits the work.
+    R_API void set_scaler_threads(int threads);
+
+    R_API r_utils::r_lru_cache_stats scaler_cache_stats() const;
+
 private:
     void _clear();
+    std::shared_ptr<const std::shared_ptr<SwsContext>> _get_scaler(const r_scaler_state& state);
+    void _scale(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, uint8_t* output, int alignment);
 
     AVCodecID _codec_id;
     const AVCodec* _codec;
@@ -71,8 +165,18 @@ private:
     size_t _buffer_size;
     const uint8_t* _pos;
     int _remaining_size;
+    int64_t _pts;
     AVFrame* _frame;
-    std::map<r_scaler_state, SwsContext*> _scalers;
+    std::unique_ptr<r_utils::r_lru_cache<r_scaler_state, std::shared_ptr<SwsContext>>> _scalers;
+    r_scaler_quality _scaler_quality;
+    int _scaler_threads;
+    AVFrame* _scaled_frame;
+    int _thread_type;
+    int _thread_count;
+    int _threads_granted;
+    bool _low_delay;
+    r_decode_fidelity _fidelity;
+    bool _draining;
     bool _codec_opened;
 
     void _open_codec();
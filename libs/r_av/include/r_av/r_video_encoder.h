@@ -67,6 +67,10 @@ public:
     R_API r_codec_state encode();
     R_API r_codec_state flush();
 
+    // Prepares the encoder for an unrelated image. Returns false if the encoder has been drained
+    // with flush() and the codec can't be reset, in which case it must be destroyed.
+    R_API bool reset();
+
     R_API r_packet_info get();
 
     R_API std::vector<uint8_t> get_extradata() const;
@@ -79,6 +83,7 @@ private:
     AVCodecContext* _context;
     int64_t _pts;
     bool _frame_sent;
+    bool _drained;
     std::vector<uint8_t> _buffer;
     r_utils::r_std_utils::raii_ptr<AVPacket> _pkt;
 };
@@ -0,0 +1,298 @@
+#include "r_av/r_abr_transcoder.h"
+#include "r_utils/r_exception.h"
+#include "r_utils/r_logger.h"
+#include "r_utils/r_std_utils.h"
+#include "r_utils/r_trace.h"
+#include <algorithm>
+#include <climits>
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
+}
+
+#if defined(IS_LINUX) || defined(IS_MACOS)
+#include <time.h>
+#endif
+
+using namespace r_av;
+using namespace r_utils;
+using namespace r_utils::r_std_utils;
+using namespace std;
+using namespace std::chrono;
+
+// CPU time used by the calling thread.
+static int64_t _thread_cpu_ns()
+{
+#if defined(IS_LINUX) || defined(IS_MACOS)
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((int64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#elif defined(IS_WINDOWS)
+    FILETIME creation, exit, kernel, user;
+    if(!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (int64_t)(k.QuadPart + u.QuadPart) * 100;
+#else
+    return 0;
+#endif
+}
+
+r_abr_transcoder::r_abr_transcoder(
+    AVCodecID input_codec,
+    const std::vector<uint8_t>& input_extradata,
+    AVRational input_timebase,
+    AVRational framerate,
+    const std::vector<r_abr_rung>& ladder,
+    packet_cb cb
+) :
+    _decoder(input_codec),
+    _input_timebase(input_timebase),
+    _framerate(framerate),
+    _cb(cb),
+    _rungs(),
+    _running(false),
+    _started(),
+    _stopped()
+{
+    if(ladder.empty())
+        R_STHROW(r_invalid_argument_exception, ("An ABR ladder needs at least one rung."));
+
+    if(framerate.num <= 0 || framerate.den <= 0)
+        R_STHROW(r_invalid_argument_exception, ("Invalid framerate."));
+
+    if(!input_extradata.empty())
+        _decoder.set_extradata(input_extradata);
+
+    // The rungs are tuned for latency, frame threading the decoder would throw that away.
+    _decoder.set_threading(R_DECODER_THREADING_LOW_LATENCY);
+
+    // A key frame a second in every rung, so a viewer can switch rungs within a second.
+    auto gop_size = (uint16_t)(std::max)(framerate.num / framerate.den, 1);
+
+    for(auto& r : ladder)
+    {
+        auto rs = make_unique<_rung_state>();
+        rs->rung = r;
+        rs->encoder = r_video_encoder(
+            AV_CODEC_ID_H264,
+            r.bitrate,
+            r.width,
+            r.height,
+            framerate,
+            AV_PIX_FMT_YUV420P,
+            0,
+            gop_size,
+            AV_PROFILE_H264_MAIN,
+            41,
+            "veryfast",
+            "zerolatency"
+        );
+        _rungs.push_back(std::move(rs));
+    }
+}
+
+r_abr_transcoder::~r_abr_transcoder()
+{
+    stop();
+}
+
+void r_abr_transcoder::start()
+{
+    if(_running.exchange(true))
+        return;
+
+    _started = steady_clock::now();
+
+    for(size_t i = 0; i < _rungs.size(); ++i)
+        _rungs[i]->worker = thread(&r_abr_transcoder::_rung_worker, this, i);
+}
+
+void r_abr_transcoder::stop()
+{
+    if(!_running.exchange(false))
+        return;
+
+    for(auto& rs : _rungs)
+    {
+        lock_guard<mutex> g(rs->lock);
+        rs->cond.notify_one();
+    }
+
+    for(auto& rs : _rungs)
+    {
+        if(rs->worker.joinable())
+            rs->worker.join();
+    }
+
+    _stopped = steady_clock::now();
+}
+
+void r_abr_transcoder::write_frame(const uint8_t* data, size_t size, int64_t pts)
+{
+    if(!_running)
+        return;
+
+    R_TRACE_SPAN("abr.decode");
+
+    _decoder.attach_buffer(data, size, pts);
+
+    while(true)
+    {
+        auto ds = _decoder.decode();
+        if(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+        {
+            // The picture that comes out isn't necessarily the one that went in (the decoder holds
+            // frames back to reorder them), so it's stamped with its own time.
+            auto frame = _decoder.ref_frame();
+            _queue(frame, (frame->best_effort_timestamp != AV_NOPTS_VALUE) ? frame->best_effort_timestamp : pts);
+        }
+        // AGAIN_HAS_OUTPUT means the packet is still waiting to go in.
+        if(ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+            break;
+    }
+}
+
+vector<uint8_t> r_abr_transcoder::get_extradata(size_t rung) const
+{
+    return _rungs.at(rung)->encoder.get_extradata();
+}
+
+vector<r_abr_rung_stats> r_abr_transcoder::stats() const
+{
+    auto until = (_running) ? steady_clock::now() : _stopped.load();
+    auto elapsed = duration<double>(until - _started.load()).count();
+
+    vector<r_abr_rung_stats> result;
+    for(auto& rs : _rungs)
+    {
+        r_abr_rung_stats s;
+        s.frames_encoded = rs->frames_encoded;
+        s.frames_dropped = rs->frames_dropped;
+        s.bytes_encoded = rs->bytes_encoded;
+
+        auto cpu_seconds = (double)rs->cpu_ns / 1000000000.0;
+
+        if(elapsed > 0.0)
+        {
+            s.encode_fps = (double)s.frames_encoded / elapsed;
+            s.cpu_load = cpu_seconds / elapsed;
+        }
+
+        if(s.frames_encoded > 0)
+            s.cpu_ms_per_frame = (cpu_seconds * 1000.0) / (double)s.frames_encoded;
+
+        result.push_back(s);
+    }
+
+    return result;
+}
+
+void r_abr_transcoder::_queue(const shared_ptr<AVFrame>& frame, int64_t pts)
+{
+    // Every rung shares the one decoded picture.
+    for(auto& rs : _rungs)
+    {
+        lock_guard<mutex> g(rs->lock);
+
+        if(rs->pending.size() >= R_ABR_MAX_PENDING_FRAMES)
+        {
+            rs->pending.pop_front();
+            ++rs->frames_dropped;
+        }
+
+        rs->pending.push_back({frame, pts});
+        rs->cond.notify_one();
+    }
+}
+
+void r_abr_transcoder::_rung_worker(size_t index)
+{
+    auto& rs = *_rungs[index];
+    auto w = rs.rung.width, h = rs.rung.height;
+
+    auto cpu_start = _thread_cpu_ns();
+
+    try
+    {
+        AVRational encoder_tb = {_framerate.den, _framerate.num};
+
+        vector<uint8_t> yuv((size_t)av_image_get_buffer_size(AV_PIX_FMT_YUV420P, w, h, 1));
+        uint8_t* dst_data[4];
+        int dst_linesize[4];
+        av_image_fill_arrays(dst_data, dst_linesize, yuv.data(), AV_PIX_FMT_YUV420P, w, h, 1);
+
+        raii_ptr<SwsContext> scaler([](SwsContext* c){sws_freeContext(c);});
+        int scaler_w = 0, scaler_h = 0, scaler_format = AV_PIX_FMT_NONE;
+
+        int64_t last_pts = LLONG_MIN;
+
+        while(true)
+        {
+            _decoded d;
+            {
+                unique_lock<mutex> g(rs.lock);
+                rs.cond.wait(g, [&](){return !rs.pending.empty() || !_running;});
+
+                // Stopped, and everything that was waiting has been encoded.
+                if(rs.pending.empty())
+                    break;
+
+                d = std::move(rs.pending.front());
+                rs.pending.pop_front();
+            }
+
+            R_TRACE_SPAN("abr.rung");
+
+            auto f = d.frame.get();
+
+            if(!scaler || f->width != scaler_w || f->height != scaler_h || f->format != scaler_format)
+            {
+                scaler = sws_getContext(f->width, f->height, (AVPixelFormat)f->format, w, h, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+                if(!scaler)
+                    R_THROW(("Unable to create scaler for %dx%d -> %ux%u", f->width, f->height, w, h));
+                scaler_w = f->width;
+                scaler_h = f->height;
+                scaler_format = f->format;
+            }
+
+            sws_scale(scaler.get(), f->data, f->linesize, 0, f->height, dst_data, dst_linesize);
+
+            // The encoder needs strictly increasing timestamps, input jitter can round two frames together.
+            auto pts = av_rescale_q(d.pts, _input_timebase, encoder_tb);
+            if(pts <= last_pts)
+                pts = last_pts + 1;
+            last_pts = pts;
+
+            rs.encoder.attach_buffer(yuv.data(), yuv.size(), pts);
+            _write_packets(index, rs, false);
+
+            ++rs.frames_encoded;
+            rs.cpu_ns = _thread_cpu_ns() - cpu_start;
+        }
+
+        _write_packets(index, rs, true);
+    }
+    catch(const std::exception& ex)
+    {
+        R_LOG_ERROR("ABR rung %zu (%ux%u) failed: %s", index, (unsigned)w, (unsigned)h, ex.what());
+    }
+
+    rs.cpu_ns = _thread_cpu_ns() - cpu_start;
+}
+
+void r_abr_transcoder::_write_packets(size_t index, _rung_state& rs, bool flush)
+{
+    while(((flush) ? rs.encoder.flush() : rs.encoder.encode()) == R_CODEC_STATE_HAS_OUTPUT)
+    {
+        auto pi = rs.encoder.get();
+        rs.bytes_encoded += pi.size;
+        _cb(index, pi);
+    }
+}
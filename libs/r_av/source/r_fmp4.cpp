@@ -0,0 +1,247 @@
+#include "r_av/r_fmp4.h"
+#include "r_utils/r_exception.h"
+
+extern "C"
+{
+#include <libavutil/mathematics.h>
+}
+
+using namespace r_av;
+using namespace std;
+
+namespace
+{
+
+struct _box
+{
+    uint8_t* start;
+    uint8_t* payload;
+    uint8_t* end;
+    uint32_t type;
+};
+
+constexpr uint32_t _fourcc(const char* s)
+{
+    return ((uint32_t)(uint8_t)s[0] << 24) | ((uint32_t)(uint8_t)s[1] << 16) | ((uint32_t)(uint8_t)s[2] << 8) | (uint32_t)(uint8_t)s[3];
+}
+
+uint32_t _r32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+uint64_t _r64(const uint8_t* p)
+{
+    return ((uint64_t)_r32(p) << 32) | (uint64_t)_r32(p + 4);
+}
+
+void _w32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+void _w64(uint8_t* p, uint64_t v)
+{
+    _w32(p, (uint32_t)(v >> 32));
+    _w32(p + 4, (uint32_t)v);
+}
+
+// Reads the box at p and moves p past it, returns false at end.
+bool _next_box(uint8_t*& p, uint8_t* end, _box& box)
+{
+    if(p >= end)
+        return false;
+
+    if(end - p < 8)
+        R_THROW(("Truncated MP4 box header."));
+
+    uint64_t size = _r32(p);
+    size_t header_size = 8;
+
+    if(size == 1)
+    {
+        if(end - p < 16)
+            R_THROW(("Truncated MP4 box header."));
+        size = _r64(p + 8);
+        header_size = 16;
+    }
+    else if(size == 0)
+        size = (uint64_t)(end - p);
+
+    if(size < header_size || size > (uint64_t)(end - p))
+        R_THROW(("Invalid MP4 box size."));
+
+    box.start = p;
+    box.payload = p + header_size;
+    box.end = p + size;
+    box.type = _r32(p + 4);
+
+    p = box.end;
+
+    return true;
+}
+
+// tkhd and mdhd: version 1 has 64 bit creation and modification times ahead of the field we want.
+uint8_t* _after_times(const _box& box)
+{
+    auto offset = (box.payload[0] == 1) ? 20 : 12;
+    if(box.end - box.payload < offset + 4)
+        R_THROW(("Truncated MP4 box."));
+    return box.payload + offset;
+}
+
+}
+
+r_fmp4_concat::r_fmp4_concat(const function<void(const uint8_t*, size_t)>& write) :
+    _write(write),
+    _timescales(),
+    _wrote_header(false),
+    _sequence_number(0),
+    _bytes_written(0)
+{
+}
+
+void r_fmp4_concat::append(vector<uint8_t>& piece, int64_t start_time, AVRational time_base)
+{
+    auto p = piece.data();
+    auto end = p + piece.size();
+
+    bool header_piece = !_wrote_header;
+
+    _box box;
+    while(_next_box(p, end, box))
+    {
+        bool keep = false;
+
+        if(box.type == _fourcc("ftyp"))
+            keep = header_piece;
+        else if(box.type == _fourcc("moov"))
+        {
+            if(header_piece)
+            {
+                _parse_moov(box.payload, box.end);
+                _wrote_header = true;
+                keep = true;
+            }
+        }
+        else if(box.type == _fourcc("moof"))
+        {
+            if(!_wrote_header)
+                R_THROW(("Fragment found before the moov."));
+            _patch_moof(box.payload, box.end, start_time, time_base);
+            keep = true;
+        }
+        else if(box.type == _fourcc("mdat"))
+            keep = _wrote_header;
+        // mfra, sidx and friends index a single piece, so they're dropped.
+
+        if(keep)
+        {
+            _write(box.start, box.end - box.start);
+            _bytes_written += box.end - box.start;
+        }
+    }
+
+    if(!_wrote_header)
+        R_THROW(("First piece has no moov."));
+}
+
+void r_fmp4_concat::_parse_moov(uint8_t* p, uint8_t* end)
+{
+    _box trak;
+    while(_next_box(p, end, trak))
+    {
+        if(trak.type != _fourcc("trak"))
+            continue;
+
+        uint32_t track_id = 0, timescale = 0;
+
+        auto tp = trak.payload;
+        _box child;
+        while(_next_box(tp, trak.end, child))
+        {
+            if(child.type == _fourcc("tkhd"))
+                track_id = _r32(_after_times(child));
+            else if(child.type == _fourcc("mdia"))
+            {
+                auto mp = child.payload;
+                _box mdhd;
+                while(_next_box(mp, child.end, mdhd))
+                {
+                    if(mdhd.type == _fourcc("mdhd"))
+                        timescale = _r32(_after_times(mdhd));
+                }
+            }
+        }
+
+        if(track_id == 0 || timescale == 0)
+            R_THROW(("MP4 track is missing its id or timescale."));
+
+        _timescales[track_id] = timescale;
+    }
+}
+
+void r_fmp4_concat::_patch_moof(uint8_t* p, uint8_t* end, int64_t start_time, AVRational time_base)
+{
+    _box box;
+    while(_next_box(p, end, box))
+    {
+        if(box.type == _fourcc("mfhd"))
+        {
+            if(box.end - box.payload < 8)
+                R_THROW(("Truncated mfhd."));
+            _w32(box.payload + 4, ++_sequence_number);
+        }
+        else if(box.type == _fourcc("traf"))
+        {
+            uint32_t timescale = 0;
+
+            auto tp = box.payload;
+            _box child;
+            while(_next_box(tp, box.end, child))
+            {
+                if(child.type == _fourcc("tfhd"))
+                {
+                    if(child.end - child.payload < 8)
+                        R_THROW(("Truncated tfhd."));
+
+                    // An explicit base data offset is relative to the start of the piece, so it would
+                    // be wrong once the fragment has moved (mux with movflags=default_base_moof).
+                    if(_r32(child.payload) & 0x000001)
+                        R_THROW(("Fragment has an explicit base data offset."));
+
+                    auto found = _timescales.find(_r32(child.payload + 4));
+                    if(found == _timescales.end())
+                        R_THROW(("Fragment refers to an unknown track."));
+                    timescale = found->second;
+                }
+                else if(child.type == _fourcc("tfdt"))
+                {
+                    if(timescale == 0)
+                        R_THROW(("tfdt found before tfhd."));
+
+                    auto offset = av_rescale_q(start_time, time_base, AVRational{1, (int)timescale});
+
+                    if(child.payload[0] == 1)
+                    {
+                        if(child.end - child.payload < 12)
+                            R_THROW(("Truncated tfdt."));
+                        _w64(child.payload + 4, _r64(child.payload + 4) + (uint64_t)offset);
+                    }
+                    else
+                    {
+                        if(child.end - child.payload < 8)
+                            R_THROW(("Truncated tfdt."));
+                        auto t = (uint64_t)_r32(child.payload + 4) + (uint64_t)offset;
+                        if(t > UINT32_MAX)
+                            R_THROW(("Decode time no longer fits a version 0 tfdt."));
+                        _w32(child.payload + 4, (uint32_t)t);
+                    }
+                }
+            }
+        }
+    }
+}
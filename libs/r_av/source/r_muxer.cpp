@@ -30,6 +30,7 @@ r_muxer::r_muxer(const std::string& path, bool output_to_buffer, const std::stri
     _output_to_buffer(output_to_buffer),
     _format_name(format_name),
     _output_options(),
+    _format_options(),
     _buffer(),
     _fc([](AVFormatContext* fc){avformat_free_context(fc);}),
     _video_stream(nullptr),
@@ -178,6 +179,11 @@ void r_muxer::set_output_option(const std::string& key, const std::string& value
     _output_options[key] = value;
 }
 
+void r_muxer::set_format_option(const std::string& key, const std::string& value)
+{
+    _format_options[key] = value;
+}
+
 void r_muxer::open()
 {
     if(_fc.get()->nb_streams < 1)
@@ -203,7 +209,14 @@ void r_muxer::open()
             R_THROW(("Unable to open output io context: %s", ff_rc_to_msg(res).c_str()));
     }
 
-    int res = avformat_write_header(_fc.get(), NULL);
+    AVDictionary* format_opts = nullptr;
+    for(const auto& kv : _format_options)
+        av_dict_set(&format_opts, kv.first.c_str(), kv.second.c_str(), 0);
+
+    int res = avformat_write_header(_fc.get(), &format_opts);
+
+    av_dict_free(&format_opts);
+
     if(res < 0)
         R_THROW(("Unable to write header to output file: %s", ff_rc_to_msg(res).c_str()));
 
@@ -8,6 +8,9 @@ using namespace r_av;
 using namespace r_utils;
 using namespace std;
 
+// The frame being encoded and the previous one (kept for duplicating) are all that are ever out.
+static const size_t FRAME_POOL_MAX_IDLE = 2;
+
 r_transcoder::r_transcoder(
     const std::string& output_url,
     const std::string& output_format,
@@ -24,6 +27,7 @@ r_transcoder::r_transcoder(
 ) :
     _running(false),
     _max_queue_size(30),
+    _frame_pool(FRAME_POOL_MAX_IDLE),
     _decoder(input_codec),
     _encoder(),
     _muxer(output_url, false, output_format),
@@ -48,6 +52,9 @@ r_transcoder::r_transcoder(
         _decoder.set_extradata(input_extradata);
     }
 
+    // The encoder is tuned for latency, frame threading the decoder would throw that away.
+    _decoder.set_threading(R_DECODER_THREADING_LOW_LATENCY);
+
     // Create encoder
     _encoder = r_video_encoder(
         AV_CODEC_ID_H264,
@@ -165,6 +172,7 @@ void r_transcoder::_worker_thread()
 
             // 3. Get decoded frame (with scaling)
             auto decoded = _decoder.get(
+                _frame_pool,
                 AV_PIX_FMT_YUV420P,
                 _output_width,
                 _output_height,
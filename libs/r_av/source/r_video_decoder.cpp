@@ -3,6 +3,17 @@
 #include "r_utils/r_exception.h"
 #include "r_utils/r_std_utils.h"
 #include <cstring>
+#include <tuple>
+#include <thread>
+#include <algorithm>
+#include <mutex>
+
+extern "C"
+{
+#include <libavutil/opt.h>
+#include <libavutil/version.h>
+#include <libswscale/version.h>
+}
 
 using namespace r_av;
 using namespace r_utils;
@@ -21,14 +32,65 @@ static string _ff_rc_to_msg(int rc)
 
 bool r_av::operator<(const r_scaler_state& lhs, const r_scaler_state& rhs)
 {
-    if((lhs.input_format < rhs.input_format) ||
-       ((lhs.input_format == rhs.input_format) && lhs.input_width < rhs.input_width) ||
-       ((lhs.input_format == rhs.input_format) && (lhs.input_width == rhs.input_width) && lhs.input_height < rhs.input_height) ||
-       ((lhs.input_format == rhs.input_format) && (lhs.input_width == rhs.input_width) && (lhs.input_height == rhs.input_height) && lhs.output_format < rhs.output_format) ||
-       ((lhs.input_format == rhs.input_format) && (lhs.input_width == rhs.input_width) && (lhs.input_height == rhs.input_height) && (lhs.output_format == rhs.output_format) && lhs.output_width < rhs.output_width) ||
-       ((lhs.input_format == rhs.input_format) && (lhs.input_width == rhs.input_width) && (lhs.input_height == rhs.input_height) && (lhs.output_format == rhs.output_format) && (lhs.output_width == rhs.output_width) && lhs.output_height < rhs.output_height))
-        return true;
-    return false;
+    return tie(lhs.input_format, lhs.input_width, lhs.input_height, lhs.output_format, lhs.output_width, lhs.output_height, lhs.quality, lhs.threads) <
+           tie(rhs.input_format, rhs.input_width, rhs.input_height, rhs.output_format, rhs.output_width, rhs.output_height, rhs.quality, rhs.threads);
+}
+
+static int _sws_flags(r_scaler_quality quality)
+{
+    switch(quality)
+    {
+        case R_SCALER_QUALITY_FAST_BILINEAR: return SWS_FAST_BILINEAR;
+        case R_SCALER_QUALITY_POINT: return SWS_POINT;
+        case R_SCALER_QUALITY_BICUBIC: return SWS_BICUBIC;
+        default: break;
+    }
+    return SWS_BILINEAR;
+}
+
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+static void _no_free(void*, uint8_t*)
+{
+}
+#endif
+
+struct _thread_budget_state
+{
+    mutex lock;
+    int budget {(std::max)((int)thread::hardware_concurrency(), 1)};
+    int in_use {0};
+};
+
+// Never destroyed: a decoder with static storage may be closed after it would be.
+static _thread_budget_state& _thread_budget()
+{
+    static _thread_budget_state* state = new _thread_budget_state();
+    return *state;
+}
+
+static int _acquire_threads(int wanted)
+{
+    auto& b = _thread_budget();
+    lock_guard<mutex> g(b.lock);
+
+    auto granted = (std::min)(wanted, b.budget - b.in_use);
+
+    // A single thread is just the caller's, it doesn't come out of the budget.
+    if(granted < 2)
+        return 1;
+
+    b.in_use += granted;
+    return granted;
+}
+
+static void _release_threads(int granted)
+{
+    if(granted < 2)
+        return;
+
+    auto& b = _thread_budget();
+    lock_guard<mutex> g(b.lock);
+    b.in_use -= granted;
 }
 
 r_video_decoder::r_video_decoder() :
@@ -41,8 +103,18 @@ r_video_decoder::r_video_decoder() :
     _buffer_size(0),
     _pos(nullptr),
     _remaining_size(0),
+    _pts(AV_NOPTS_VALUE),
     _frame(nullptr),
-    _scalers(),
+    _scalers(make_unique<r_lru_cache<r_scaler_state, shared_ptr<SwsContext>>>(R_MAX_SCALERS)),
+    _scaler_quality(R_SCALER_QUALITY_BILINEAR),
+    _scaler_threads(0),
+    _scaled_frame(nullptr),
+    _thread_type(0),
+    _thread_count(1),
+    _threads_granted(0),
+    _low_delay(true),
+    _fidelity(R_DECODE_FIDELITY_FULL),
+    _draining(false),
     _codec_opened(false)
 {
 }
@@ -57,8 +129,18 @@ r_video_decoder::r_video_decoder(AVCodecID codec_id, bool parse_input) :
     _buffer_size(0),
     _pos(nullptr),
     _remaining_size(0),
+    _pts(AV_NOPTS_VALUE),
     _frame(av_frame_alloc()),
-    _scalers(),
+    _scalers(make_unique<r_lru_cache<r_scaler_state, shared_ptr<SwsContext>>>(R_MAX_SCALERS)),
+    _scaler_quality(R_SCALER_QUALITY_BILINEAR),
+    _scaler_threads(0),
+    _scaled_frame(nullptr),
+    _thread_type(0),
+    _thread_count(1),
+    _threads_granted(0),
+    _low_delay(true),
+    _fidelity(R_DECODE_FIDELITY_FULL),
+    _draining(false),
     _codec_opened(false)
 {
     if(!_codec)
@@ -71,13 +153,7 @@ r_video_decoder::r_video_decoder(AVCodecID codec_id, bool parse_input) :
     _context->extradata = nullptr;
     _context->extradata_size = 0;
 
-    if(_codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)
-        _context->thread_type = FF_THREAD_FRAME;
-    else if(_codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)
-        _context->thread_type = FF_THREAD_SLICE;
-    else _context->thread_count = 1; //don't use multithreading
-
-    _context->flags |= AV_CODEC_FLAG_LOW_DELAY;  // Try reducing buffering
+    // Threading (and with it AV_CODEC_FLAG_LOW_DELAY) is applied when the codec is opened.
     _context->workaround_bugs = FF_BUG_AUTODETECT;  // Enable autodetection of bugs
 
     // Critical for H.264
@@ -96,8 +172,18 @@ r_video_decoder::r_video_decoder(r_video_decoder&& obj) :
     _buffer_size(std::move(obj._buffer_size)),
     _pos(std::move(obj._pos)),
     _remaining_size(std::move(obj._remaining_size)),
+    _pts(std::move(obj._pts)),
     _frame(std::move(obj._frame)),
     _scalers(std::move(obj._scalers)),
+    _scaler_quality(std::move(obj._scaler_quality)),
+    _scaler_threads(std::move(obj._scaler_threads)),
+    _scaled_frame(std::move(obj._scaled_frame)),
+    _thread_type(std::move(obj._thread_type)),
+    _thread_count(std::move(obj._thread_count)),
+    _threads_granted(std::move(obj._threads_granted)),
+    _low_delay(std::move(obj._low_delay)),
+    _fidelity(std::move(obj._fidelity)),
+    _draining(std::move(obj._draining)),
     _codec_opened(std::move(obj._codec_opened))
 {
     obj._codec_id = AV_CODEC_ID_NONE;
@@ -108,6 +194,8 @@ r_video_decoder::r_video_decoder(r_video_decoder&& obj) :
     obj._buffer_size = 0;
     obj._pos = nullptr;
     obj._frame = nullptr;
+    obj._scaled_frame = nullptr;
+    obj._threads_granted = 0;
 }
 
 r_video_decoder::~r_video_decoder()
@@ -137,9 +225,21 @@ r_video_decoder& r_video_decoder::operator=(r_video_decoder&& obj)
         _pos = std::move(obj._pos);
         obj._pos = nullptr;
         _remaining_size = std::move(obj._remaining_size);
+        _pts = std::move(obj._pts);
         _frame = std::move(obj._frame);
         obj._frame = nullptr;
         _scalers = std::move(obj._scalers);
+        _scaler_quality = std::move(obj._scaler_quality);
+        _scaler_threads = std::move(obj._scaler_threads);
+        _scaled_frame = std::move(obj._scaled_frame);
+        obj._scaled_frame = nullptr;
+        _thread_type = std::move(obj._thread_type);
+        _thread_count = std::move(obj._thread_count);
+        _threads_granted = std::move(obj._threads_granted);
+        obj._threads_granted = 0;
+        _low_delay = std::move(obj._low_delay);
+        _fidelity = std::move(obj._fidelity);
+        _draining = std::move(obj._draining);
         _codec_opened = std::move(obj._codec_opened);
     }
 
@@ -163,28 +263,128 @@ void r_video_decoder::set_extradata(const vector<uint8_t>& ed)
     memcpy(_context->extradata, ed.data(), ed.size());
 }
 
+void r_video_decoder::set_threading(r_decoder_threading threading, int thread_count)
+{
+    if(_codec_opened)
+        R_THROW(("Decoder threading must be set before the first decode."));
+    if(!_codec)
+        R_THROW(("Decoder has no codec."));
+
+    auto caps = _codec->capabilities;
+
+    switch(threading)
+    {
+        case R_DECODER_THREADING_SINGLE:
+            _thread_type = 0;
+            _low_delay = true;
+        break;
+        case R_DECODER_THREADING_LOW_LATENCY:
+            _thread_type = (caps & AV_CODEC_CAP_SLICE_THREADS) ? FF_THREAD_SLICE : 0;
+            _low_delay = true;
+        break;
+        case R_DECODER_THREADING_THROUGHPUT:
+            if(caps & AV_CODEC_CAP_FRAME_THREADS)
+                _thread_type = FF_THREAD_FRAME;
+            else if(caps & AV_CODEC_CAP_SLICE_THREADS)
+                _thread_type = FF_THREAD_SLICE;
+            else _thread_type = 0;
+            _low_delay = false;
+        break;
+    }
+
+    _thread_count = (_thread_type == 0) ? 1 : thread_count;
+}
+
+void r_video_decoder::set_thread_type(int thread_type, int thread_count)
+{
+    if(_codec_opened)
+        R_THROW(("Decoder threading must be set before the first decode."));
+
+    _thread_type = thread_type;
+    _thread_count = thread_count;
+    _low_delay = (thread_type & FF_THREAD_FRAME) == 0;
+}
+
+void r_video_decoder::set_fidelity(r_decode_fidelity fidelity)
+{
+    if(!_context)
+        R_THROW(("Context is not initialized"));
+
+    _fidelity = fidelity;
+
+    // The decoder reads these for every frame, so they take effect with the next packet.
+    _context->skip_loop_filter = (fidelity == R_DECODE_FIDELITY_FULL) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    _context->skip_frame = (fidelity == R_DECODE_FIDELITY_KEY_FRAMES) ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+
+    if(fidelity == R_DECODE_FIDELITY_FULL)
+        _context->flags2 &= ~AV_CODEC_FLAG2_FAST;
+    else _context->flags2 |= AV_CODEC_FLAG2_FAST;
+}
+
+int r_video_decoder::thread_count() const
+{
+    return (_threads_granted > 0) ? _threads_granted : 1;
+}
+
+void r_video_decoder::set_thread_budget(int threads)
+{
+    auto& b = _thread_budget();
+    lock_guard<mutex> g(b.lock);
+    b.budget = (threads > 0) ? threads : 1;
+}
+
+int r_video_decoder::threads_in_use()
+{
+    auto& b = _thread_budget();
+    lock_guard<mutex> g(b.lock);
+    return b.in_use;
+}
+
 void r_video_decoder::_open_codec()
 {
     if(_codec_opened)
         return;
 
+    auto wanted = _thread_count;
+    if(wanted <= 0)
+        wanted = (std::min)((std::max)((int)thread::hardware_concurrency(), 1), R_MAX_DECODER_THREADS);
+
+    _threads_granted = (_thread_type != 0 && wanted > 1) ? _acquire_threads(wanted) : 1;
+
+    if(_thread_type != 0)
+        _context->thread_type = _thread_type;
+    _context->thread_count = _threads_granted;
+
+    if(_fidelity != R_DECODE_FIDELITY_FULL && _codec->max_lowres > 0)
+        _context->lowres = 1;
+
+    // FFmpeg won't frame thread a low delay decoder.
+    if(_low_delay)
+        _context->flags |= AV_CODEC_FLAG_LOW_DELAY;  // Try reducing buffering
+    else _context->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+
     // Open the codec with explicit parameters
     AVDictionary* opts = nullptr;
     av_dict_set(&opts, "strict", "experimental", 0);  // Be more lenient with decoding
     int ret = avcodec_open2(_context, _codec, &opts);
     av_dict_free(&opts);
     if(ret < 0)
+    {
+        _release_threads(_threads_granted);
+        _threads_granted = 0;
         R_THROW(("Failed to open codec: %s", _ff_rc_to_msg(ret).c_str()));
+    }
 
     _codec_opened = true;
 }
 
-void r_video_decoder::attach_buffer(const uint8_t* data, size_t size)
+void r_video_decoder::attach_buffer(const uint8_t* data, size_t size, int64_t pts)
 {
     _buffer = data;
     _buffer_size = size;
     _pos = _buffer;
     _remaining_size = (int)_buffer_size;
+    _pts = pts;
 }
 
 r_codec_state r_video_decoder::decode()
@@ -206,7 +406,7 @@ r_codec_state r_video_decoder::decode()
             &out_size,
             _pos,
             _remaining_size,
-            AV_NOPTS_VALUE,
+            _pts,
             AV_NOPTS_VALUE,
             0
         );
@@ -230,12 +430,14 @@ r_codec_state r_video_decoder::decode()
 
         packet->data = out_data;
         packet->size = out_size;
+        packet->pts = _parser->pts;
     }
     else
     {
         // Direct mode - send buffer as-is
         packet->data = const_cast<uint8_t*>(_pos);
         packet->size = _remaining_size;
+        packet->pts = _pts;
     }
 
     // Send the packet to the decoder
@@ -290,22 +492,27 @@ r_codec_state r_video_decoder::flush()
 {
     _open_codec();
 
-    int ret = avcodec_send_packet(_context, nullptr);
-    if(ret == AVERROR(EAGAIN))
+    // Only the first flush() sends the end of the stream, every call after that returns another of
+    // the frames the decoder was still holding (a frame threaded decoder holds one per thread).
+    if(!_draining)
     {
-        auto rf_ret = avcodec_receive_frame(_context, _frame);
+        int ret = avcodec_send_packet(_context, nullptr);
+        if(ret == AVERROR(EAGAIN))
+        {
+            auto rf_ret = avcodec_receive_frame(_context, _frame);
 
-        if(rf_ret == AVERROR(EAGAIN) || rf_ret == AVERROR_EOF)
-            return R_CODEC_STATE_EOF;
-        else if(rf_ret < 0)
-            R_THROW(("Failed to flush decoder: %s", _ff_rc_to_msg(rf_ret).c_str()));
+            if(rf_ret == AVERROR(EAGAIN) || rf_ret == AVERROR_EOF)
+                return R_CODEC_STATE_EOF;
+            else if(rf_ret < 0)
+                R_THROW(("Failed to flush decoder: %s", _ff_rc_to_msg(rf_ret).c_str()));
+
+            return R_CODEC_STATE_HAS_OUTPUT;
+        }
+        else if(ret < 0 && ret != AVERROR_EOF)
+            R_THROW(("Failed to flush decoder: %s", _ff_rc_to_msg(ret).c_str()));
 
-        return R_CODEC_STATE_HAS_OUTPUT;
+        _draining = true;
     }
-    else if(ret == AVERROR_EOF)
-        return R_CODEC_STATE_EOF;
-    else if(ret < 0)
-        R_THROW(("Failed to flush decoder: %s", _ff_rc_to_msg(ret).c_str()));
 
     auto rf_ret = avcodec_receive_frame(_context, _frame);
     if(rf_ret == AVERROR(EAGAIN) || rf_ret == AVERROR_EOF)
@@ -316,7 +523,134 @@ r_codec_state r_video_decoder::flush()
     return R_CODEC_STATE_HAS_OUTPUT;
 }
 
+void r_video_decoder::reset()
+{
+    // avcodec_flush_buffers() also takes a drained (flushed) decoder out of EOF.
+    if(_codec_opened)
+        avcodec_flush_buffers(_context);
+    _draining = false;
+
+    if(_parser)
+    {
+        av_parser_close(_parser);
+        _parser = av_parser_init(_codec_id);
+    }
+
+    _buffer = nullptr;
+    _buffer_size = 0;
+    _pos = nullptr;
+    _remaining_size = 0;
+    _pts = AV_NOPTS_VALUE;
+}
+
 shared_ptr<vector<uint8_t>> r_video_decoder::get(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, int alignment)
+{
+    auto result = make_shared<vector<uint8_t>>(output_image_size(output_format, output_width, output_height, alignment));
+
+    _scale(output_format, output_width, output_height, result->data(), alignment);
+
+    return result;
+}
+
+shared_ptr<vector<uint8_t>> r_video_decoder::get(r_frame_pool& pool, AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, int alignment)
+{
+    auto output_size = output_image_size(output_format, output_width, output_height, alignment);
+
+    auto result = pool.get(output_size, [output_size](){return vector<uint8_t>(output_size);});
+
+    _scale(output_format, output_width, output_height, result->data(), alignment);
+
+    return result;
+}
+
+size_t r_video_decoder::get(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, uint8_t* output, size_t output_size, int alignment)
+{
+    auto needed = output_image_size(output_format, output_width, output_height, alignment);
+
+    if(output_size < needed)
+        R_THROW(("Output buffer is too small (%zu bytes, %zu needed).", output_size, needed));
+
+    _scale(output_format, output_width, output_height, output, alignment);
+
+    return needed;
+}
+
+size_t r_video_decoder::output_image_size(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, int alignment)
+{
+    auto size = av_image_get_buffer_size(output_format, output_width, output_height, alignment);
+
+    if(size < 0)
+        R_THROW(("Failed to get image size: %s", _ff_rc_to_msg(size).c_str()));
+
+    return (size_t)size;
+}
+
+const AVFrame* r_video_decoder::get_frame() const
+{
+    return _frame;
+}
+
+shared_ptr<AVFrame> r_video_decoder::ref_frame() const
+{
+    auto frame = av_frame_clone(_frame);
+    if(!frame)
+        R_THROW(("Failed to reference frame."));
+
+    return shared_ptr<AVFrame>(frame, [](AVFrame* f){av_frame_free(&f);});
+}
+
+uint16_t r_video_decoder::input_width() const
+{
+    return (uint16_t)_context->width;
+}
+
+uint16_t r_video_decoder::input_height() const
+{
+    return (uint16_t)_context->height;
+}
+
+void r_video_decoder::set_scaler_quality(r_scaler_quality quality)
+{
+    _scaler_quality = quality;
+}
+
+void r_video_decoder::set_scaler_threads(int threads)
+{
+    _scaler_threads = threads;
+}
+
+r_lru_cache_stats r_video_decoder::scaler_cache_stats() const
+{
+    return _scalers->stats();
+}
+
+shared_ptr<const shared_ptr<SwsContext>> r_video_decoder::_get_scaler(const r_scaler_state& state)
+{
+    return _scalers->get_or_create(state, [&state](){
+        auto ctx = sws_alloc_context();
+        if(!ctx)
+            R_THROW(("Failed to allocate scaler."));
+
+        shared_ptr<SwsContext> scaler(ctx, [](SwsContext* c){sws_freeContext(c);});
+
+        av_opt_set_int(ctx, "srcw", state.input_width, 0);
+        av_opt_set_int(ctx, "srch", state.input_height, 0);
+        av_opt_set_int(ctx, "src_format", state.input_format, 0);
+        av_opt_set_int(ctx, "dstw", state.output_width, 0);
+        av_opt_set_int(ctx, "dsth", state.output_height, 0);
+        av_opt_set_int(ctx, "dst_format", state.output_format, 0);
+        av_opt_set_int(ctx, "sws_flags", _sws_flags(state.quality), 0);
+        av_opt_set_int(ctx, "threads", state.threads, 0);
+
+        auto ret = sws_init_context(ctx, nullptr, nullptr);
+        if(ret < 0)
+            R_THROW(("Failed to create scaler: %s", _ff_rc_to_msg(ret).c_str()));
+
+        return scaler;
+    });
+}
+
+void r_video_decoder::_scale(AVPixelFormat output_format, uint16_t output_width, uint16_t output_height, uint8_t* output, int alignment)
 {
     r_scaler_state state;
     state.input_format = _context->pix_fmt;
@@ -325,66 +659,92 @@ shared_ptr<vector<uint8_t>> r_video_decoder::get(AVPixelFormat output_format, ui
     state.output_format = output_format;
     state.output_width = output_width;
     state.output_height = output_height;
+    state.quality = _scaler_quality;
+    state.threads = _scaler_threads;
 
-    auto found = _scalers.find(state);
-
-    if(found == end(_scalers))
+    if(state.threads <= 0)
     {
-        _scalers[state] = sws_getContext(
-            _context->width,
-            _context->height,
-            _context->pix_fmt,
-            output_width,
-            output_height,
-            output_format,
-            SWS_BILINEAR,
-            NULL,
-            NULL,
-            NULL
-        );
+        auto hw_threads = (int)thread::hardware_concurrency();
+        state.threads = ((std::max)(state.input_height, output_height) >= R_THREADED_SCALE_MIN_HEIGHT) ? (std::min)((std::max)(hw_threads, 1), R_MAX_SCALER_THREADS) : 1;
     }
 
-    auto output_image_size = av_image_get_buffer_size(output_format, output_width, output_height, alignment);
+#if LIBSWSCALE_VERSION_INT < AV_VERSION_INT(6, 1, 100)
+    // Slice threading needs sws_scale_frame() (FFmpeg 5), older FFmpeg scales on the calling thread.
+    state.threads = 1;
+#endif
 
-    auto result = make_shared<vector<uint8_t>>(output_image_size);
+    auto scaler = _get_scaler(state);
 
     uint8_t* fields[AV_NUM_DATA_POINTERS];
     int linesizes[AV_NUM_DATA_POINTERS];
 
-    auto ret = av_image_fill_arrays(fields, linesizes, result->data(), output_format, output_width, output_height, alignment);
+    auto ret = av_image_fill_arrays(fields, linesizes, output, output_format, output_width, output_height, alignment);
 
     if(ret < 0)
         R_THROW(("Failed to fill arrays for picture: %s", _ff_rc_to_msg(ret).c_str()));
 
-    ret = sws_scale(_scalers[state],
-                    _frame->data,
-                    _frame->linesize,
-                    0,
-                    _context->height,
-                    fields,
-                    linesizes);
+    if(state.threads == 1)
+    {
+        ret = sws_scale(scaler->get(),
+                        _frame->data,
+                        _frame->linesize,
+                        0,
+                        _context->height,
+                        fields,
+                        linesizes);
 
-    if(ret < 0)
-        R_THROW(("sws_scale() failed: %s", _ff_rc_to_msg(ret).c_str()));
+        if(ret < 0)
+            R_THROW(("sws_scale() failed: %s", _ff_rc_to_msg(ret).c_str()));
 
-    return result;
-}
+        return;
+    }
 
-uint16_t r_video_decoder::input_width() const
-{
-    return (uint16_t)_context->width;
-}
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    // sws_scale() only ever uses one thread, sws_scale_frame() splits the picture into slices across
+    // the scaler's threads. It wants its output in a frame, so output is wrapped in a buffer that
+    // doesn't free it.
+    if(!_scaled_frame)
+    {
+        _scaled_frame = av_frame_alloc();
+        if(!_scaled_frame)
+            R_THROW(("Failed to allocate frame"));
+    }
 
-uint16_t r_video_decoder::input_height() const
-{
-    return (uint16_t)_context->height;
+    _scaled_frame->buf[0] = av_buffer_create(output, (size_t)ret, _no_free, nullptr, 0);
+    if(!_scaled_frame->buf[0])
+        R_THROW(("Failed to wrap output buffer."));
+
+    for(int i = 0; i < AV_NUM_DATA_POINTERS; ++i)
+    {
+        _scaled_frame->data[i] = fields[i];
+        _scaled_frame->linesize[i] = linesizes[i];
+    }
+    _scaled_frame->format = output_format;
+    _scaled_frame->width = output_width;
+    _scaled_frame->height = output_height;
+
+    ret = sws_scale_frame(scaler->get(), _scaled_frame, _frame);
+
+    av_frame_unref(_scaled_frame);
+
+    if(ret < 0)
+        R_THROW(("sws_scale_frame() failed: %s", _ff_rc_to_msg(ret).c_str()));
+#endif
 }
 
 void r_video_decoder::_clear()
 {
-    for(auto s : _scalers)
-        sws_freeContext(s.second);
-    _scalers.clear();
+    if(_scalers)
+        _scalers->clear();
+
+    if(_scaled_frame)
+    {
+        av_frame_free(&_scaled_frame);
+        _scaled_frame = nullptr;
+    }
+
+    _release_threads(_threads_granted);
+    _threads_granted = 0;
 
     if(_frame)
     {
@@ -17,12 +17,28 @@ static string _ff_rc_to_msg(int rc)
     return string(msg_buffer);
 }
 
+// FFmpeg registers libwebp_anim ahead of libwebp, and the animated encoder only produces output when
+// it's drained, which means it can't be reused afterwards. For single images we want the still
+// encoder, it outputs a packet per frame.
+static const AVCodec* _find_encoder(AVCodecID codec_id)
+{
+    if(codec_id == AV_CODEC_ID_WEBP)
+    {
+        auto codec = avcodec_find_encoder_by_name("libwebp");
+        if(codec)
+            return codec;
+    }
+
+    return avcodec_find_encoder(codec_id);
+}
+
 r_video_encoder::r_video_encoder() :
     _codec_id(AV_CODEC_ID_NONE),
     _codec(nullptr),
     _context(nullptr),
     _pts(0),
     _frame_sent(false),
+    _drained(false),
     _buffer(),
     _pkt()
 {
@@ -43,10 +59,11 @@ r_video_encoder::r_video_encoder(
         const std::string& tune
     ) :
     _codec_id(codec_id),
-    _codec(avcodec_find_encoder(_codec_id)),
+    _codec(_find_encoder(_codec_id)),
     _context(avcodec_alloc_context3(_codec)),
     _pts(0),
     _frame_sent(false),
+    _drained(false),
     _buffer(),
     _pkt()
 {
@@ -91,6 +108,8 @@ r_video_encoder::r_video_encoder(r_video_encoder&& obj) :
     _codec(std::move(obj._codec)),
     _context(std::move(obj._context)),
     _pts(std::move(obj._pts)),
+    _frame_sent(std::move(obj._frame_sent)),
+    _drained(std::move(obj._drained)),
     _buffer(std::move(obj._buffer)),
     _pkt(std::move(obj._pkt))
 {
@@ -117,6 +136,8 @@ r_video_encoder& r_video_encoder::operator=(r_video_encoder&& obj)
         _context = std::move(obj._context);
         obj._context = nullptr;
         _pts = std::move(obj._pts);
+        _frame_sent = std::move(obj._frame_sent);
+        _drained = std::move(obj._drained);
         _buffer = std::move(obj._buffer);
         _pkt = std::move(obj._pkt);
     }
@@ -205,6 +226,8 @@ r_codec_state r_video_encoder::encode()
 
 r_codec_state r_video_encoder::flush()
 {
+    _drained = true;
+
     int ret = avcodec_send_frame(_context, nullptr);
     if(ret == AVERROR(EAGAIN))
     {
@@ -234,6 +257,30 @@ r_codec_state r_video_encoder::flush()
     return R_CODEC_STATE_HAS_OUTPUT;
 }
 
+bool r_video_encoder::reset()
+{
+    if(!_context)
+        return false;
+
+    if(_drained)
+    {
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+        if(!(_codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH))
+            return false;
+        avcodec_flush_buffers(_context);
+        _drained = false;
+#else
+        return false;
+#endif
+    }
+
+    _frame_sent = false;
+    _pts = 0;
+    _pkt = raii_ptr<AVPacket>();
+
+    return true;
+}
+
 r_packet_info r_video_encoder::get()
 {
     if(!_pkt)
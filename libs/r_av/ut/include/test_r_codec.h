@@ -7,6 +7,10 @@ public:
     RTF_FIXTURE(test_r_codec);
       TEST(test_r_codec::test_basic_video_decode);
       TEST(test_r_codec::test_basic_video_transcode);
+      TEST(test_r_codec::test_decoder_output_buffers);
+      TEST(test_r_codec::test_scaler_cache);
+      TEST(test_r_codec::test_decoder_threading);
+      TEST(test_r_codec::test_decoder_fidelity);
     RTF_FIXTURE_END();
 
     virtual ~test_r_codec() throw() {}
@@ -16,4 +20,8 @@ public:
 
     void test_basic_video_decode();
     void test_basic_video_transcode();
+    void test_decoder_output_buffers();
+    void test_scaler_cache();
+    void test_decoder_threading();
+    void test_decoder_fidelity();
 };
@@ -7,6 +7,7 @@ public:
     RTF_FIXTURE(test_r_mux);
       TEST(test_r_mux::test_basic_demux);
       TEST(test_r_mux::test_basic_mux);
+      TEST(test_r_mux::test_fmp4_concat);
     RTF_FIXTURE_END();
 
     virtual ~test_r_mux() throw() {}
@@ -16,4 +17,5 @@ public:
 
     void test_basic_demux();
     void test_basic_mux();
+    void test_fmp4_concat();
 };
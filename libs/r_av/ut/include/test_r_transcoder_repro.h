@@ -6,6 +6,7 @@ class test_r_transcoder_repro : public test_fixture
 public:
     RTF_FIXTURE(test_r_transcoder_repro);
       TEST(test_r_transcoder_repro::test_4k_transcode);
+      TEST(test_r_transcoder_repro::test_abr_ladder);
     RTF_FIXTURE_END();
 
     virtual ~test_r_transcoder_repro() throw() {}
@@ -14,4 +15,5 @@ public:
     virtual void teardown();
 
     void test_4k_transcode();
+    void test_abr_ladder();
 };
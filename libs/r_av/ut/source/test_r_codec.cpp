@@ -6,6 +6,9 @@
 #include "r_av/r_demuxer.h"
 #include "r_av/r_muxer.h"
 #include "r_utils/r_file.h"
+#include "r_utils/r_exception.h"
+#include <cstring>
+#include <thread>
 
 // Added to the global namespace by test_r_mux.cpp, so extern'd here:
 extern unsigned char true_north_mp4[];
@@ -21,6 +24,96 @@ using namespace r_av;
 
 REGISTER_TEST_FIXTURE(test_r_codec);
 
+// A decoder holding a decoded w x h picture (a JPEG of a gradient, so neighbouring pixels differ).
+static r_video_decoder _decoded_test_pattern(uint16_t w, uint16_t h)
+{
+    vector<uint8_t> yuv((size_t)w * h * 3 / 2);
+    for(size_t y = 0; y < h; ++y)
+        for(size_t x = 0; x < w; ++x)
+            yuv[(y * w) + x] = (uint8_t)((x + y) & 0xff);
+    for(size_t i = (size_t)w * h; i < yuv.size(); ++i)
+        yuv[i] = (uint8_t)(i & 0xff);
+
+    r_video_encoder encoder(AV_CODEC_ID_MJPEG, 100000, w, h, {1,1}, AV_PIX_FMT_YUVJ420P, 0, 1, 0, 0);
+    encoder.attach_buffer(yuv.data(), yuv.size(), 0);
+    if(encoder.encode() != R_CODEC_STATE_HAS_OUTPUT)
+        R_THROW(("Unable to encode test pattern."));
+    auto pi = encoder.get();
+
+    r_video_decoder decoder(AV_CODEC_ID_MJPEG);
+    decoder.attach_buffer(pi.data, pi.size);
+
+    auto ds = decoder.decode();
+    if(ds == R_CODEC_STATE_HUNGRY)
+        ds = decoder.flush();
+    if(ds != R_CODEC_STATE_HAS_OUTPUT && ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+        R_THROW(("Unable to decode test pattern."));
+
+    return decoder;
+}
+
+// Encodes n_frames of a moving w x h test pattern. Returns false if this FFmpeg has no encoder for
+// codec_id.
+static bool _encode_test_clip(AVCodecID codec_id, uint16_t w, uint16_t h, int n_frames, vector<vector<uint8_t>>& packets, vector<uint8_t>& extradata)
+{
+    if(!avcodec_find_encoder(codec_id))
+        return false;
+
+    auto h264 = (codec_id == AV_CODEC_ID_H264);
+
+    // zerolatency so that every frame comes straight back out (no lookahead or b frames to flush).
+    r_video_encoder encoder(codec_id, 4000000, w, h, {30,1}, AV_PIX_FMT_YUV420P, 0, 30, (h264) ? AV_PROFILE_H264_MAIN : AV_PROFILE_UNKNOWN, (h264) ? 41 : AV_LEVEL_UNKNOWN, "ultrafast", "zerolatency");
+
+    vector<uint8_t> yuv((size_t)w * h * 3 / 2);
+
+    for(int f = 0; f < n_frames; ++f)
+    {
+        for(size_t y = 0; y < h; ++y)
+            for(size_t x = 0; x < w; ++x)
+                yuv[(y * w) + x] = (uint8_t)((x + y + (f * 4)) & 0xff);
+        for(size_t i = (size_t)w * h; i < yuv.size(); ++i)
+            yuv[i] = (uint8_t)((i + f) & 0xff);
+
+        encoder.attach_buffer(yuv.data(), yuv.size(), f);
+
+        while(encoder.encode() == R_CODEC_STATE_HAS_OUTPUT)
+        {
+            auto pi = encoder.get();
+            packets.push_back(vector<uint8_t>(pi.data, pi.data + pi.size));
+        }
+    }
+
+    extradata = encoder.get_extradata();
+
+    return true;
+}
+
+// Decodes every packet then drains the decoder, returns the number of frames that came out.
+static int _decode_all(r_video_decoder& decoder, const vector<vector<uint8_t>>& packets)
+{
+    int n_frames = 0;
+
+    for(auto& p : packets)
+    {
+        decoder.attach_buffer(p.data(), p.size());
+
+        while(true)
+        {
+            auto ds = decoder.decode();
+            if(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+                ++n_frames;
+            // AGAIN_HAS_OUTPUT means the packet is still waiting to go in.
+            if(ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+                break;
+        }
+    }
+
+    while(decoder.flush() == R_CODEC_STATE_HAS_OUTPUT)
+        ++n_frames;
+
+    return n_frames;
+}
+
 void test_r_codec::setup()
 {
     r_fs::write_file(true_north_mp4, true_north_mp4_len, "true_north.mp4");
@@ -164,3 +257,212 @@ void test_r_codec::test_basic_video_transcode()
     RTF_ASSERT(vsi.resolution.second == 240);
 
 }
+
+void test_r_codec::test_decoder_output_buffers()
+{
+    // Scales every frame three ways (a new image each time, an image from a pool and a caller's
+    // buffer) and checks they agree.
+    r_demuxer demuxer("true_north.mp4", true);
+    auto video_stream_index = demuxer.get_video_stream_index();
+    auto vsi = demuxer.get_stream_info(video_stream_index);
+
+    r_video_decoder decoder(vsi.codec_id);
+    decoder.set_extradata(demuxer.get_extradata(video_stream_index));
+
+    const uint16_t w = 640, h = 360;
+
+    r_frame_pool pool(4);
+    vector<uint8_t> caller_buffer(r_video_decoder::output_image_size(AV_PIX_FMT_BGRA, w, h, 1));
+
+    // Like a UI that hangs on to a frame until it draws the next one.
+    shared_ptr<vector<uint8_t>> held;
+
+    int n_frames = 0;
+
+    while(demuxer.read_frame())
+    {
+        auto fi = demuxer.get_frame_info();
+
+        if(fi.index != video_stream_index)
+            continue;
+
+        decoder.attach_buffer(fi.data, fi.size);
+
+        r_codec_state decode_state = R_CODEC_STATE_INITIALIZED;
+
+        while(decode_state != R_CODEC_STATE_HUNGRY && decode_state != R_CODEC_STATE_EOF)
+        {
+            decode_state = decoder.decode();
+
+            if(decode_state != R_CODEC_STATE_HAS_OUTPUT && decode_state != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+                continue;
+
+            auto native = decoder.get_frame();
+            RTF_ASSERT(native->width == vsi.resolution.first);
+            RTF_ASSERT(native->height == vsi.resolution.second);
+            RTF_ASSERT(native->data[0] != nullptr && native->linesize[0] >= native->width);
+
+            auto allocated = decoder.get(AV_PIX_FMT_BGRA, w, h, 1);
+            auto pooled = decoder.get(pool, AV_PIX_FMT_BGRA, w, h, 1);
+            auto written = decoder.get(AV_PIX_FMT_BGRA, w, h, caller_buffer.data(), caller_buffer.size(), 1);
+
+            RTF_ASSERT(*pooled == *allocated);
+            RTF_ASSERT(written == allocated->size());
+            RTF_ASSERT(memcmp(caller_buffer.data(), allocated->data(), written) == 0);
+
+            held = pooled;
+            ++n_frames;
+        }
+    }
+
+    RTF_ASSERT(n_frames > 0);
+
+    // One image is held while the next is scaled, so the pool should only ever have made two.
+    auto stats = pool.stats();
+    RTF_ASSERT(stats.created <= 2);
+    RTF_ASSERT(stats.created + stats.reused == (uint64_t)n_frames);
+
+    RTF_ASSERT_THROWS(decoder.get(AV_PIX_FMT_BGRA, w, h, caller_buffer.data(), caller_buffer.size() - 1, 1), std::exception);
+}
+
+void test_r_codec::test_scaler_cache()
+{
+    auto decoder = _decoded_test_pattern(640, 360);
+
+    // A window being dragged through a dozen sizes only ever holds R_MAX_SCALERS scalers.
+    const uint16_t n_sizes = 12;
+    for(uint16_t i = 0; i < n_sizes; ++i)
+    {
+        auto frame = decoder.get(AV_PIX_FMT_BGRA, 320 + (i * 16), 180 + (i * 9), 1);
+        RTF_ASSERT(frame->size() == (size_t)(320 + (i * 16)) * (180 + (i * 9)) * 4);
+    }
+
+    auto stats = decoder.scaler_cache_stats();
+    RTF_ASSERT(stats.entries == R_MAX_SCALERS);
+    RTF_ASSERT(stats.misses == n_sizes);
+    RTF_ASSERT(stats.evictions == n_sizes - R_MAX_SCALERS);
+
+    // The same size again reuses its scaler, another quality needs its own.
+    decoder.get(AV_PIX_FMT_BGRA, 320 + ((n_sizes - 1) * 16), 180 + ((n_sizes - 1) * 9), 1);
+    RTF_ASSERT(decoder.scaler_cache_stats().hits == 1);
+
+    decoder.set_scaler_quality(R_SCALER_QUALITY_POINT);
+    decoder.get(AV_PIX_FMT_BGRA, 320 + ((n_sizes - 1) * 16), 180 + ((n_sizes - 1) * 9), 1);
+    RTF_ASSERT(decoder.scaler_cache_stats().misses == n_sizes + 1);
+
+    // Every quality works split across threads and not.
+    for(auto quality : {R_SCALER_QUALITY_BILINEAR, R_SCALER_QUALITY_FAST_BILINEAR, R_SCALER_QUALITY_POINT, R_SCALER_QUALITY_BICUBIC})
+    {
+        decoder.set_scaler_quality(quality);
+        for(auto threads : {1, R_MAX_SCALER_THREADS})
+        {
+            decoder.set_scaler_threads(threads);
+            auto frame = decoder.get(AV_PIX_FMT_YUV420P, 1280, 720, 1);
+            RTF_ASSERT(frame->size() == (size_t)1280 * 720 * 3 / 2);
+        }
+    }
+}
+
+void test_r_codec::test_decoder_threading()
+{
+    const int N_FRAMES = 30;
+
+    vector<vector<uint8_t>> packets;
+    vector<uint8_t> extradata;
+    RTF_ASSERT(_encode_test_clip(AV_CODEC_ID_H264, 640, 360, N_FRAMES, packets, extradata));
+
+    // Plenty, so each decoder gets what it asks for.
+    r_video_decoder::set_thread_budget(64);
+
+    // Every frame comes out whatever the threading, frame threads hold some back until the flush.
+    for(auto threading : {R_DECODER_THREADING_SINGLE, R_DECODER_THREADING_LOW_LATENCY, R_DECODER_THREADING_THROUGHPUT})
+    {
+        r_video_decoder decoder(AV_CODEC_ID_H264);
+        decoder.set_extradata(extradata);
+        decoder.set_threading(threading, 4);
+        RTF_ASSERT(_decode_all(decoder, packets) == N_FRAMES);
+        RTF_ASSERT(decoder.thread_count() == ((threading == R_DECODER_THREADING_SINGLE) ? 1 : 4));
+        RTF_ASSERT_THROWS(decoder.set_threading(R_DECODER_THREADING_SINGLE), std::exception);
+    }
+
+    RTF_ASSERT(r_video_decoder::threads_in_use() == 0);
+
+    // Decoders only get what is left of the budget, and give it back when they close.
+    r_video_decoder::set_thread_budget(3);
+
+    {
+        r_video_decoder first(AV_CODEC_ID_H264);
+        first.set_extradata(extradata);
+        first.set_threading(R_DECODER_THREADING_THROUGHPUT, 2);
+        RTF_ASSERT(_decode_all(first, packets) == N_FRAMES);
+        RTF_ASSERT(first.thread_count() == 2);
+        RTF_ASSERT(r_video_decoder::threads_in_use() == 2);
+
+        r_video_decoder second(AV_CODEC_ID_H264);
+        second.set_extradata(extradata);
+        second.set_threading(R_DECODER_THREADING_THROUGHPUT, 4);
+        RTF_ASSERT(_decode_all(second, packets) == N_FRAMES);
+        RTF_ASSERT(second.thread_count() == 1);
+        RTF_ASSERT(r_video_decoder::threads_in_use() == 2);
+
+        // Moving a decoder moves its threads with it.
+        r_video_decoder moved(std::move(first));
+        RTF_ASSERT(r_video_decoder::threads_in_use() == 2);
+    }
+
+    RTF_ASSERT(r_video_decoder::threads_in_use() == 0);
+
+    r_video_decoder::set_thread_budget((int)std::thread::hardware_concurrency());
+}
+
+void test_r_codec::test_decoder_fidelity()
+{
+    const int N_FRAMES = 60;
+
+    vector<vector<uint8_t>> packets;
+    vector<uint8_t> extradata;
+    RTF_ASSERT(_encode_test_clip(AV_CODEC_ID_H264, 640, 360, N_FRAMES, packets, extradata));
+
+    // Reduced still produces every frame (H.264 has no lower resolution decoding, so full size).
+    {
+        r_video_decoder decoder(AV_CODEC_ID_H264);
+        decoder.set_extradata(extradata);
+        decoder.set_fidelity(R_DECODE_FIDELITY_REDUCED);
+        RTF_ASSERT(_decode_all(decoder, packets) == N_FRAMES);
+        RTF_ASSERT(decoder.input_width() == 640 && decoder.input_height() == 360);
+    }
+
+    // Key frames only, with a GOP of 30.
+    {
+        r_video_decoder decoder(AV_CODEC_ID_H264);
+        decoder.set_extradata(extradata);
+        decoder.set_fidelity(R_DECODE_FIDELITY_KEY_FRAMES);
+        RTF_ASSERT(_decode_all(decoder, packets) == N_FRAMES / 30);
+    }
+
+    // Switching to key frames only and back to full mid stream.
+    {
+        r_video_decoder decoder(AV_CODEC_ID_H264);
+        decoder.set_extradata(extradata);
+        decoder.set_fidelity(R_DECODE_FIDELITY_KEY_FRAMES);
+        RTF_ASSERT(_decode_all(decoder, vector<vector<uint8_t>>(packets.begin(), packets.begin() + 30)) == 1);
+        decoder.reset();
+        decoder.set_fidelity(R_DECODE_FIDELITY_FULL);
+        RTF_ASSERT(_decode_all(decoder, vector<vector<uint8_t>>(packets.begin() + 30, packets.end())) == 30);
+    }
+
+    // MJPEG can decode at lower resolution, but only if asked before the decoder opens.
+    {
+        vector<uint8_t> yuv((size_t)640 * 480 * 3 / 2, 128);
+        r_video_encoder encoder(AV_CODEC_ID_MJPEG, 100000, 640, 480, {1,1}, AV_PIX_FMT_YUVJ420P, 0, 1, 0, 0);
+        encoder.attach_buffer(yuv.data(), yuv.size(), 0);
+        RTF_ASSERT(encoder.encode() == R_CODEC_STATE_HAS_OUTPUT);
+        auto pi = encoder.get();
+        vector<vector<uint8_t>> jpgs = {vector<uint8_t>(pi.data, pi.data + pi.size)};
+
+        r_video_decoder decoder(AV_CODEC_ID_MJPEG);
+        decoder.set_fidelity(R_DECODE_FIDELITY_REDUCED);
+        RTF_ASSERT(_decode_all(decoder, jpgs) == 1);
+        RTF_ASSERT(decoder.input_width() == 320 && decoder.input_height() == 240);
+    }
+}
@@ -2,6 +2,8 @@
 #include "test_r_mux.h"
 #include "r_av/r_demuxer.h"
 #include "r_av/r_muxer.h"
+#include "r_av/r_fmp4.h"
+#include "r_av/r_video_encoder.h"
 #include "r_utils/r_file.h"
 
 #include "true_north.h"
@@ -99,3 +101,93 @@ void test_r_mux::test_basic_mux()
 
     r_fs::remove_file("output69.mp4");
 }
+
+void test_r_mux::test_fmp4_concat()
+{
+    const uint16_t W = 320, H = 240;
+    const int GOP = 30, N_FRAMES = 90;
+    const AVRational TIME_BASE = {1, 30};
+
+    if(!avcodec_find_encoder(AV_CODEC_ID_H264))
+        return;
+
+    // Two pieces muxed on their own, the second starts at the second key frame.
+    vector<r_packet_info> packets;
+    vector<vector<uint8_t>> packet_data;
+    vector<uint8_t> extradata;
+    {
+        r_video_encoder encoder(AV_CODEC_ID_H264, 1000000, W, H, {30, 1}, AV_PIX_FMT_YUV420P, 0, GOP, AV_PROFILE_H264_MAIN, 41, "ultrafast", "zerolatency");
+
+        vector<uint8_t> yuv((size_t)W * H * 3 / 2);
+        for(int f = 0; f < N_FRAMES; ++f)
+        {
+            for(size_t i = 0; i < yuv.size(); ++i)
+                yuv[i] = (uint8_t)((i + (f * 4)) & 0xff);
+
+            encoder.attach_buffer(yuv.data(), yuv.size(), f);
+
+            while(encoder.encode() == R_CODEC_STATE_HAS_OUTPUT)
+            {
+                auto pi = encoder.get();
+                packet_data.push_back(vector<uint8_t>(pi.data, pi.data + pi.size));
+                packets.push_back(pi);
+            }
+        }
+
+        extradata = encoder.get_extradata();
+    }
+
+    RTF_ASSERT(packets.size() == (size_t)N_FRAMES);
+    RTF_ASSERT(packets[GOP].key);
+
+    auto mux_piece = [&](size_t first, size_t last){
+        r_muxer muxer("piece.mp4", true, "mp4");
+        muxer.add_video_stream({30, 1}, AV_CODEC_ID_H264, W, H, AV_PROFILE_H264_MAIN, 41);
+        muxer.set_video_extradata(extradata);
+        muxer.set_format_option("movflags", "frag_keyframe+empty_moov+default_base_moof");
+        muxer.open();
+        for(size_t i = first; i < last; ++i)
+            muxer.write_video_frame(packet_data[i].data(), packet_data[i].size(), (int64_t)(i - first), (int64_t)(i - first), TIME_BASE, packets[i].key);
+        muxer.finalize();
+        return vector<uint8_t>(muxer.buffer(), muxer.buffer() + muxer.buffer_size());
+    };
+
+    auto first_piece = mux_piece(0, GOP);
+    auto second_piece = mux_piece(GOP, N_FRAMES);
+
+    vector<uint8_t> joined;
+    r_fmp4_concat concat([&](const uint8_t* p, size_t size){
+        joined.insert(joined.end(), p, p + size);
+    });
+
+    concat.append(first_piece, 0, TIME_BASE);
+    concat.append(second_piece, GOP, TIME_BASE);
+
+    // frag_keyframe cuts a fragment at every key frame.
+    RTF_ASSERT(concat.n_fragments() == (size_t)(N_FRAMES / GOP));
+    RTF_ASSERT(concat.bytes_written() == joined.size());
+
+    r_fs::write_file(joined.data(), joined.size(), "joined.mp4");
+
+    {
+        r_demuxer demuxer("joined.mp4");
+        auto video_stream_index = demuxer.get_video_stream_index();
+        auto vsi = demuxer.get_stream_info(video_stream_index);
+
+        int64_t n_frames = 0;
+        while(demuxer.read_frame())
+        {
+            auto fi = demuxer.get_frame_info();
+            if(fi.index != video_stream_index)
+                continue;
+
+            // Frames past the join are where they were in the original, not back at 0.
+            RTF_ASSERT(av_rescale_q(fi.dts, vsi.time_base, TIME_BASE) == n_frames);
+            ++n_frames;
+        }
+
+        RTF_ASSERT(n_frames == N_FRAMES);
+    }
+
+    r_fs::remove_file("joined.mp4");
+}
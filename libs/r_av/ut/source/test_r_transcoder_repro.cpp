@@ -1,11 +1,14 @@
 
 #include "test_r_transcoder_repro.h"
 #include "r_av/r_transcoder.h"
+#include "r_av/r_abr_transcoder.h"
+#include "r_av/r_video_decoder.h"
 #include "r_av/r_video_encoder.h"
 #include "r_utils/r_file.h"
 #include <vector>
 #include <cstring>
 #include <thread>
+#include <mutex>
 
 using namespace std;
 using namespace r_av;
@@ -122,3 +125,88 @@ void test_r_transcoder_repro::test_4k_transcode()
         
     RTF_ASSERT(r_fs::file_size("repro_output.ts") > 0);
 }
+
+void test_r_transcoder_repro::test_abr_ladder()
+{
+    const uint16_t W = 1280, H = 720;
+    const int N_FRAMES = 60;
+    AVRational framerate = {30, 1};
+
+    r_video_encoder source_encoder(AV_CODEC_ID_H264, 4000000, W, H, framerate, AV_PIX_FMT_YUV420P, 0, 30, AV_PROFILE_H264_MAIN, 41, "ultrafast", "zerolatency");
+
+    vector<uint8_t> raw_frame((size_t)W * H * 3 / 2);
+    vector<vector<uint8_t>> packets;
+    for(int i = 0; i < N_FRAMES; ++i)
+    {
+        for(size_t p = 0; p < raw_frame.size(); ++p)
+            raw_frame[p] = (uint8_t)((p + (i * 4)) & 0xff);
+
+        source_encoder.attach_buffer(raw_frame.data(), raw_frame.size(), i);
+        while(source_encoder.encode() == R_CODEC_STATE_HAS_OUTPUT)
+        {
+            auto pkt = source_encoder.get();
+            packets.push_back(vector<uint8_t>(pkt.data, pkt.data + pkt.size));
+        }
+    }
+
+    vector<r_abr_rung> ladder = {{640, 360, 1000000}, {320, 180, 300000}};
+
+    mutex rendition_lock;
+    vector<vector<vector<uint8_t>>> renditions(ladder.size());
+
+    r_abr_transcoder abr(
+        AV_CODEC_ID_H264,
+        source_encoder.get_extradata(),
+        {1, 1000},
+        framerate,
+        ladder,
+        [&](size_t rung, const r_packet_info& pi){
+            lock_guard<mutex> g(rendition_lock);
+            renditions[rung].push_back(vector<uint8_t>(pi.data, pi.data + pi.size));
+        }
+    );
+
+    RTF_ASSERT(abr.n_rungs() == ladder.size());
+
+    abr.start();
+
+    for(size_t i = 0; i < packets.size(); ++i)
+    {
+        abr.write_frame(packets[i].data(), packets[i].size(), (int64_t)((i * 1000) / 30));
+        // Real time, so no rung falls far enough behind to drop.
+        std::this_thread::sleep_for(std::chrono::milliseconds(33));
+    }
+
+    abr.stop();
+
+    auto stats = abr.stats();
+    RTF_ASSERT(stats.size() == ladder.size());
+
+    for(size_t r = 0; r < ladder.size(); ++r)
+    {
+        RTF_ASSERT(stats[r].frames_encoded + stats[r].frames_dropped == (uint64_t)N_FRAMES);
+        RTF_ASSERT(stats[r].frames_encoded > 0);
+        RTF_ASSERT(stats[r].bytes_encoded > 0);
+        RTF_ASSERT(stats[r].encode_fps > 0.0);
+        RTF_ASSERT(stats[r].cpu_ms_per_frame > 0.0);
+        RTF_ASSERT(renditions[r].size() == stats[r].frames_encoded);
+
+        // Every rendition decodes at its own size.
+        r_video_decoder decoder(AV_CODEC_ID_H264);
+        decoder.set_extradata(abr.get_extradata(r));
+
+        bool decoded = false;
+        for(auto& p : renditions[r])
+        {
+            decoder.attach_buffer(p.data(), p.size());
+            auto ds = decoder.decode();
+            if(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+            {
+                RTF_ASSERT(decoder.get_frame()->width == ladder[r].width);
+                RTF_ASSERT(decoder.get_frame()->height == ladder[r].height);
+                decoded = true;
+            }
+        }
+        RTF_ASSERT(decoded);
+    }
+}
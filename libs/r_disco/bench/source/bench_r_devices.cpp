@@ -0,0 +1,174 @@
+
+#include "bench.h"
+#include "r_disco/r_devices.h"
+#include "r_utils/r_file.h"
+#include "r_utils/r_string_utils.h"
+#include "r_utils/r_exception.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+using namespace r_disco;
+
+static const char* TOP_DIR = "r_disco_bench";
+
+// r_devices keeps its database in TOP_DIR/db.
+static void _whack_files()
+{
+    for(auto f : {"r_disco_bench/db/cameras.db", "r_disco_bench/db/cameras.db-wal", "r_disco_bench/db/cameras.db-shm", "r_disco_bench/db/cameras.db-journal"})
+    {
+        if(r_fs::file_exists(f))
+            r_fs::remove_file(f);
+    }
+
+    for(auto d : {"r_disco_bench/db", "r_disco_bench"})
+    {
+        if(r_fs::is_dir(d))
+            r_fs::rmdir(d);
+    }
+}
+
+static vector<pair<r_stream_config, string>> _make_stream_configs(size_t n)
+{
+    vector<pair<r_stream_config, string>> configs;
+    for(size_t i = 0; i < n; ++i)
+    {
+        r_stream_config sc;
+        sc.id = r_string_utils::format("camera_%zu", i);
+        sc.camera_name.set_value(r_string_utils::format("Camera %zu", i));
+        sc.ipv4.set_value(r_string_utils::format("10.0.0.%zu", i + 1));
+        sc.rtsp_url.set_value(r_string_utils::format("rtsp://10.0.0.%zu/stream1", i + 1));
+        sc.video_codec.set_value("h264");
+        configs.push_back(make_pair(sc, hash_stream_config(sc)));
+    }
+    return configs;
+}
+
+static void _wait_for_cameras(r_devices& devices, size_t n)
+{
+    auto deadline = steady_clock::now() + seconds(10);
+    while(devices.get_all_cameras().size() < n && steady_clock::now() < deadline)
+        this_thread::sleep_for(milliseconds(10));
+    if(devices.get_all_cameras().size() < n)
+        R_THROW(("Cameras never showed up in r_devices."));
+}
+
+template<typename F>
+static double _us_per_call(size_t n, F f)
+{
+    auto start = steady_clock::now();
+    for(size_t i = 0; i < n; ++i)
+        f(i);
+    return (double)duration_cast<microseconds>(steady_clock::now() - start).count() / n;
+}
+
+// What a camera lookup costs from the in memory snapshot, on one thread and on several at once,
+// next to a call that still goes to the db thread (a queue hop plus a SELECT), which is what every
+// get_camera_by_id() used to cost.
+REGISTER_BENCH(devices_lookup)
+{
+    const size_t N_CAMERAS = 64;
+
+    _whack_files();
+    r_fs::mkdir(TOP_DIR);
+
+    {
+        r_devices devices(TOP_DIR);
+        devices.start();
+
+        devices.insert_or_update_devices(_make_stream_configs(N_CAMERAS));
+        _wait_for_cameras(devices, N_CAMERAS);
+
+        auto db_us = _us_per_call(500, [&](size_t i){
+            devices.get_credentials(r_string_utils::format("camera_%zu", i % N_CAMERAS));
+        });
+
+        const size_t N_SNAPSHOT = 100000;
+        auto snapshot_us = _us_per_call(N_SNAPSHOT, [&](size_t i){
+            devices.get_camera_by_id(r_string_utils::format("camera_%zu", i % N_CAMERAS));
+        });
+
+        // What /cameras costs.
+        auto all_us = _us_per_call(1000, [&](size_t){
+            devices.get_all_cameras();
+        });
+
+        // Readers on several threads at once, which used to serialize behind the db thread.
+        const size_t N_THREADS = 8;
+        vector<thread> threads;
+        auto mt_start = steady_clock::now();
+        for(size_t t = 0; t < N_THREADS; ++t)
+        {
+            threads.push_back(thread([&](){
+                for(size_t i = 0; i < N_SNAPSHOT / N_THREADS; ++i)
+                    devices.get_camera_by_id(r_string_utils::format("camera_%zu", i % N_CAMERAS));
+            }));
+        }
+        for(auto& t : threads)
+            t.join();
+        auto mt_us = (double)duration_cast<microseconds>(steady_clock::now() - mt_start).count() / N_SNAPSHOT;
+
+        printf("db thread %.2fus, snapshot %.3fus, snapshot %zu threads %.3fus, get_all_cameras(%zu) %.2fus\n",
+               db_us, snapshot_us, N_THREADS, mt_us, N_CAMERAS, all_us);
+
+        devices.stop();
+    }
+
+    _whack_files();
+}
+
+// What discovery costs the db: upserting every camera it found (one transaction), then updating them
+// all, a SELECT through the prepared statements, and get_modified_cameras() over every camera.
+REGISTER_BENCH(devices_db)
+{
+    const size_t N_CAMERAS = 500;
+
+    _whack_files();
+    r_fs::mkdir(TOP_DIR);
+
+    {
+        r_devices devices(TOP_DIR);
+        devices.start();
+
+        // The db thread works through its queue in order, so a blocking call posted right behind
+        // insert_or_update_devices() returns once the upserts are committed.
+        auto configs = _make_stream_configs(N_CAMERAS);
+        auto insert_start = steady_clock::now();
+        devices.insert_or_update_devices(configs);
+        devices.get_credentials("camera_0");
+        auto insert_ms = duration_cast<milliseconds>(steady_clock::now() - insert_start).count();
+
+        for(auto& c : configs)
+        {
+            c.first.ipv4.clear();
+            c.first.rtsp_url.set_value(c.first.rtsp_url.value() + "?profile=2");
+            c.second = hash_stream_config(c.first);
+        }
+
+        auto update_start = steady_clock::now();
+        devices.insert_or_update_devices(configs);
+        devices.get_credentials("camera_0");
+        auto update_ms = duration_cast<milliseconds>(steady_clock::now() - update_start).count();
+
+        auto select_us = _us_per_call(2000, [&](size_t i){
+            devices.get_credentials(r_string_utils::format("camera_%zu", i % N_CAMERAS));
+        });
+
+        auto cameras = devices.get_all_cameras();
+        auto modified_start = steady_clock::now();
+        devices.get_modified_cameras(cameras);
+        auto modified_ms = duration_cast<milliseconds>(steady_clock::now() - modified_start).count();
+
+        printf("insert %zu %lldms, update %zu %lldms, select %.2fus, get_modified_cameras(%zu) %lldms\n",
+               N_CAMERAS, (long long)insert_ms, N_CAMERAS, (long long)update_ms, select_us, cameras.size(), (long long)modified_ms);
+
+        devices.stop();
+    }
+
+    _whack_files();
+}
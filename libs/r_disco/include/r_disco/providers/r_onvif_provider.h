@@ -9,12 +9,28 @@
 
 #include <chrono>
 #include <map>
+#include <mutex>
 
 namespace r_disco
 {
 
 class r_agent;
 
+// Discovery sweeps interrogate up to this many cameras at once...
+constexpr size_t ONVIF_INTERROGATION_CONCURRENCY = 8;
+// ...and give each one this long to answer its ONVIF requests.
+constexpr std::chrono::milliseconds ONVIF_INTERROGATION_TIMEOUT = std::chrono::seconds(10);
+
+struct r_onvif_sweep_stats
+{
+    size_t discovered {0};
+    size_t interrogated {0};
+    size_t failed {0};
+    std::chrono::milliseconds discovery_duration {0};
+    std::chrono::milliseconds interrogation_duration {0};
+    std::chrono::milliseconds total_duration {0};
+};
+
 class r_onvif_provider
 {
 public:
@@ -23,6 +39,12 @@ public:
 
     R_API std::vector<r_stream_config> poll();
 
+    // Interrogates (in parallel) every config we have credentials for, filling in its stream url and
+    // codec info. Failures are logged and leave the config as it was.
+    R_API void interrogate_cameras(std::vector<r_stream_config>& configs, r_onvif_sweep_stats& stats);
+
+    R_API r_onvif_sweep_stats last_sweep_stats() const;
+
     R_API void interrogate_camera(
         r_stream_config& sc,
         r_utils::r_nullable<std::string> username,
@@ -41,7 +63,12 @@ public:
 
 private:
     std::vector<r_stream_config> _fetch_configs(const std::string& top_dir);
-    void _cache_check_expiration(const std::string& id);
+    bool _interrogate(
+        r_stream_config& sc,
+        const r_utils::r_nullable<std::string>& username,
+        const r_utils::r_nullable<std::string>& password
+    );
+    void _cache_check_expiration(const std::string& id, bool recording);
     std::string _top_dir;
     r_agent* _agent;
 
@@ -51,7 +78,12 @@ private:
         r_stream_config config;
     };
 
+    // Interrogations run on several threads at once.
+    mutable std::mutex _cache_lock;
     std::map<std::string, _r_onvif_provider_cache_entry> _cache;
+
+    mutable std::mutex _stats_lock;
+    r_onvif_sweep_stats _last_sweep_stats;
 };
 
 }
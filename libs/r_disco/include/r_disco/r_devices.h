@@ -11,6 +11,8 @@
 #include <thread>
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
 
 namespace r_disco
 {
@@ -43,6 +45,15 @@ struct r_devices_cmd_result
     std::pair<r_utils::r_nullable<std::string>, r_utils::r_nullable<std::string>> credentials;
 };
 
+// An immutable copy of the cameras table. The db thread builds a new one after every change and
+// atomically swaps it in, so readers never wait on the db thread (or on each other).
+struct r_camera_snapshot
+{
+    std::map<std::string, r_camera> by_id;
+    std::vector<r_camera> all;
+    std::vector<r_camera> assigned;
+};
+
 class r_devices
 {
 public:
@@ -60,6 +71,10 @@ public:
     // Non-blocking cached versions for UI thread (updated asynchronously)
     R_API std::vector<r_camera> get_all_cameras_cached() const;
     R_API std::vector<r_camera> get_assigned_cameras_cached() const;
+
+    // Returns the current camera snapshot (nullptr until start() has loaded the first one).
+    R_API std::shared_ptr<const r_camera_snapshot> snapshot() const;
+
     R_API void save_camera(const r_camera& camera);
     R_API void remove_camera(const r_camera& camera);
     R_API void assign_camera(r_camera& camera);
@@ -81,7 +96,7 @@ private:
     int _get_db_version(const r_db::r_sqlite_conn& conn) const;
     void _set_db_version(const r_db::r_sqlite_conn& conn, int version) const;
 
-    std::string _create_insert_or_update_query(const r_db::r_sqlite_conn& conn, const r_stream_config& stream_config, const std::string& hash) const;
+    r_db::r_sqlite_stmt& _prepared(const r_db::r_sqlite_conn& conn, const std::string& query) const;
     r_camera _create_camera(const std::map<std::string, r_utils::r_nullable<std::string>>& row) const;
 
     r_devices_cmd_result _insert_or_update_devices(const r_db::r_sqlite_conn& conn, const std::vector<std::pair<r_stream_config, std::string>>& stream_configs) const;
@@ -105,15 +120,18 @@ private:
     std::string _top_dir;
     r_utils::r_work_q<r_devices_cmd, r_devices_cmd_result> _db_work_q;
 
+    // Owned by the db thread, which opens the connection once at startup and keeps it (and every
+    // statement it has prepared on it) until it exits. _stmts must go before _conn.
+    std::unique_ptr<r_db::r_sqlite_conn> _conn;
+    mutable std::map<std::string, r_db::r_sqlite_stmt> _stmts;
+
     // Cached master key for encryption/decryption
     mutable std::vector<uint8_t> _master_key;
     mutable bool _master_key_loaded;
 
-    // Cached camera lists for non-blocking UI reads
-    mutable std::mutex _cache_mutex;
-    std::vector<r_camera> _all_cameras_cache;
-    std::vector<r_camera> _assigned_cameras_cache;
-    void _update_caches();
+    // Only ever accessed with std::atomic_load() / std::atomic_store()
+    std::shared_ptr<const r_camera_snapshot> _snapshot;
+    void _update_snapshot();
 };
 
 }
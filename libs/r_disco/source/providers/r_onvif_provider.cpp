@@ -7,7 +7,9 @@
 #include "r_utils/r_string_utils.h"
 #include "r_utils/r_md5.h"
 #include "r_utils/r_uuid.h"
+#include "r_utils/r_parallel_for.h"
 #include <string>
+#include <atomic>
 
 using namespace r_disco;
 using namespace r_utils;
@@ -19,7 +21,10 @@ using namespace std::chrono;
 r_onvif_provider::r_onvif_provider(const string& top_dir, r_agent* agent) :
     _top_dir(top_dir),
     _agent(agent),
-    _cache()
+    _cache_lock(),
+    _cache(),
+    _stats_lock(),
+    _last_sweep_stats()
 {
 }
 
@@ -29,92 +34,85 @@ r_onvif_provider::~r_onvif_provider()
 
 vector<r_stream_config> r_onvif_provider::poll()
 {
-    return _fetch_configs(_top_dir);
-}
+    r_onvif_sweep_stats stats;
+    auto sweep_start = steady_clock::now();
 
-void r_onvif_provider::interrogate_camera(
-    r_stream_config& sc,
-    r_utils::r_nullable<std::string> username,
-    r_utils::r_nullable<std::string> password
-)
-{
-    _cache_check_expiration(sc.id);
+    auto configs = _fetch_configs(_top_dir);
 
-    auto it = _cache.find(sc.id);
+    stats.discovered = configs.size();
+    stats.discovery_duration = duration_cast<milliseconds>(steady_clock::now() - sweep_start);
 
-    if(it == _cache.end())
-    {
-        if(_agent && _agent->_is_recording(sc.id))
-            return;
+    interrogate_cameras(configs, stats);
 
-        // Use discovered port and protocol instead of hardcoding port 80
-        int port = sc.port.is_null() ? 80 : sc.port.value();
-        string protocol = sc.protocol.is_null() ? "http" : sc.protocol.value();
+    stats.total_duration = duration_cast<milliseconds>(steady_clock::now() - sweep_start);
 
-        r_onvif::r_onvif_cam cam(sc.ipv4.value(), port, protocol, sc.xaddrs.value(), username, password);
+    R_LOG_INFO(
+        "ONVIF sweep: %zu discovered, %zu interrogated, %zu failed in %lldms (discovery %lldms, interrogation %lldms)",
+        stats.discovered,
+        stats.interrogated,
+        stats.failed,
+        (long long)stats.total_duration.count(),
+        (long long)stats.discovery_duration.count(),
+        (long long)stats.interrogation_duration.count()
+    );
 
-        auto caps = cam.get_camera_capabilities();
-        auto oms = cam.get_media_service(caps);
-        auto profile_tokens = cam.get_profile_tokens(oms);
+    lock_guard<mutex> g(_stats_lock);
+    _last_sweep_stats = stats;
 
-        // Select the profile with the highest resolution (main stream, not sub-stream)
-        if(profile_tokens.empty())
-            R_THROW(("No ONVIF profiles available for camera."));
+    return configs;
+}
 
-        size_t best_profile_idx = 0;
-        uint32_t best_resolution = 0;
+void r_onvif_provider::interrogate_cameras(vector<r_stream_config>& configs, r_onvif_sweep_stats& stats)
+{
+    auto start = steady_clock::now();
+    atomic<size_t> interrogated {0}, failed {0};
 
-        for(size_t i = 0; i < profile_tokens.size(); ++i)
+    // Almost all of the time here is spent waiting on cameras, so we talk to several at once.
+    r_parallel_for(configs.size(), ONVIF_INTERROGATION_CONCURRENCY, [&](size_t i){
+        auto& sc = configs[i];
+        try
         {
-            uint32_t resolution = (uint32_t)profile_tokens[i].width * (uint32_t)profile_tokens[i].height;
-            if(resolution > best_resolution)
+            if(!_agent)
+                return;
+
+            // Until someone enters credentials for a camera there is nothing we can ask it, it shows up
+            // as discovered and is interrogated when it is assigned.
+            auto credentials = _agent->_get_credentials(sc.id);
+            if(credentials.first.is_null() || credentials.second.is_null())
+                return;
+
+            auto candidate = sc;
+            if(_interrogate(candidate, credentials.first, credentials.second))
             {
-                best_resolution = resolution;
-                best_profile_idx = i;
+                sc = candidate;
+                ++interrogated;
             }
         }
-
-        R_LOG_INFO("Selected ONVIF profile %zu/%zu: %s (%dx%d)",
-                   best_profile_idx + 1, profile_tokens.size(),
-                   profile_tokens[best_profile_idx].encoding.c_str(),
-                   profile_tokens[best_profile_idx].width,
-                   profile_tokens[best_profile_idx].height);
-
-        auto stream_uri = cam.get_stream_uri(oms, profile_tokens[best_profile_idx].token);
-
-        sc.rtsp_url = stream_uri;
-
-        auto sdp_media = fetch_sdp_media(stream_uri, username, password);
-
-        if(sdp_media.find("video") == sdp_media.end())
-            R_THROW(("Unable to fetch video stream information for r_onvif_provider."));
-
-        string codec_name, codec_parameters;
-        int timebase;
-        tie(codec_name, codec_parameters, timebase) = sdp_media_map_to_s(VIDEO_MEDIA, sdp_media);
-
-        sc.video_codec = codec_name;
-        sc.video_timebase = timebase;
-        sc.video_codec_parameters.set_value(codec_parameters);
-
-        if(sdp_media.find("audio") != sdp_media.end())
+        catch(const std::exception& e)
         {
-            tie(codec_name, codec_parameters, timebase) = sdp_media_map_to_s(AUDIO_MEDIA, sdp_media);
-
-            sc.audio_codec = codec_name;
-            sc.audio_timebase = timebase;
-            sc.audio_codec_parameters = codec_parameters;
+            ++failed;
+            R_LOG_ERROR("Unable to interrogate camera %s: %s", sc.id.c_str(), e.what());
         }
+    });
 
-        _r_onvif_provider_cache_entry cache_entry;
-        cache_entry.created = steady_clock::now();
-        cache_entry.config = sc;
-        _cache[sc.id] = cache_entry;
-    }
-    else
-    {
-        sc = it->second.config;
-    }
+    stats.interrogated = interrogated;
+    stats.failed = failed;
+    stats.interrogation_duration = duration_cast<milliseconds>(steady_clock::now() - start);
+}
+
+r_onvif_sweep_stats r_onvif_provider::last_sweep_stats() const
+{
+    lock_guard<mutex> g(_stats_lock);
+    return _last_sweep_stats;
+}
+
+void r_onvif_provider::interrogate_camera(
+    r_stream_config& sc,
+    r_utils::r_nullable<std::string> username,
+    r_utils::r_nullable<std::string> password
+)
+{
+    _interrogate(sc, username, password);
 }
 
 r_utils::r_nullable<r_stream_config> r_onvif_provider::interrogate_camera(
@@ -136,88 +134,76 @@ r_utils::r_nullable<r_stream_config> r_onvif_provider::interrogate_camera(
     config.xaddrs = xaddrs;
     config.address = address;
 
-    _cache_check_expiration(id);
-
-    auto it = _cache.find(id);
-
-    if(it == _cache.end())
-    {
-        if(_agent && _agent->_is_recording(config.id))
-            return r_nullable<r_stream_config>();
+    if(!_interrogate(config, username, password))
+        return r_nullable<r_stream_config>();
 
-        // Use discovered port and protocol instead of hardcoding port 80
-        int port = config.port.is_null() ? 80 : config.port.value();
-        string protocol = config.protocol.is_null() ? "http" : config.protocol.value();
+    config_nullable.set_value(config);
 
-        r_onvif::r_onvif_cam cam(config.ipv4.value(), port, protocol, xaddrs, username, password);
+    return config_nullable;
+}
 
-        auto caps = cam.get_camera_capabilities();
-        auto oms = cam.get_media_service(caps);
-        auto profile_tokens = cam.get_profile_tokens(oms);
+bool r_onvif_provider::_interrogate(
+    r_stream_config& sc,
+    const r_utils::r_nullable<std::string>& username,
+    const r_utils::r_nullable<std::string>& password
+)
+{
+    auto recording = _agent && _agent->_is_recording(sc.id);
 
-        // Select the profile with the highest resolution (main stream, not sub-stream)
-        if(profile_tokens.empty())
-            R_THROW(("No ONVIF profiles available for camera."));
+    {
+        lock_guard<mutex> g(_cache_lock);
 
-        size_t best_profile_idx = 0;
-        uint32_t best_resolution = 0;
+        _cache_check_expiration(sc.id, recording);
 
-        for(size_t i = 0; i < profile_tokens.size(); ++i)
+        auto it = _cache.find(sc.id);
+        if(it != _cache.end())
         {
-            uint32_t resolution = (uint32_t)profile_tokens[i].width * (uint32_t)profile_tokens[i].height;
-            if(resolution > best_resolution)
-            {
-                best_resolution = resolution;
-                best_profile_idx = i;
-            }
+            sc = it->second.config;
+            return true;
         }
+    }
 
-        R_LOG_INFO("Selected ONVIF profile %zu/%zu: %s (%dx%d)",
-                   best_profile_idx + 1, profile_tokens.size(),
-                   profile_tokens[best_profile_idx].encoding.c_str(),
-                   profile_tokens[best_profile_idx].width,
-                   profile_tokens[best_profile_idx].height);
-
-        auto stream_uri = cam.get_stream_uri(oms, profile_tokens[best_profile_idx].token);
+    if(recording)
+        return false;
 
-        config.rtsp_url = stream_uri;
+    // Use discovered port and protocol instead of hardcoding port 80
+    int port = sc.port.is_null() ? 80 : sc.port.value();
+    string protocol = sc.protocol.is_null() ? "http" : sc.protocol.value();
 
-        auto sdp_media = fetch_sdp_media(stream_uri, username, password);
+    auto info = r_onvif::interrogate(sc.ipv4.value(), port, protocol, sc.xaddrs.value(), username, password, ONVIF_INTERROGATION_TIMEOUT);
 
-        if(sdp_media.find("video") == sdp_media.end())
-            R_THROW(("Unable to fetch video stream information for r_onvif_provider."));
+    sc.rtsp_url = info.rtsp_url;
 
-        string codec_name, codec_parameters;
-        int timebase;
-        tie(codec_name, codec_parameters, timebase) = sdp_media_map_to_s(VIDEO_MEDIA, sdp_media);
+    auto sdp_media = fetch_sdp_media(info.rtsp_url, username, password);
 
-        config.video_codec = codec_name;
-        config.video_timebase = timebase;
-        config.video_codec_parameters.set_value(codec_parameters);
+    if(sdp_media.find("video") == sdp_media.end())
+        R_THROW(("Unable to fetch video stream information for r_onvif_provider."));
 
-        if(sdp_media.find("audio") != sdp_media.end())
-        {
-            tie(codec_name, codec_parameters, timebase) = sdp_media_map_to_s(AUDIO_MEDIA, sdp_media);
+    string codec_name, codec_parameters;
+    int timebase;
+    tie(codec_name, codec_parameters, timebase) = sdp_media_map_to_s(VIDEO_MEDIA, sdp_media);
 
-            config.audio_codec = codec_name;
-            config.audio_timebase = timebase;
-            config.audio_codec_parameters = codec_parameters;
-        }
+    sc.video_codec = codec_name;
+    sc.video_timebase = timebase;
+    sc.video_codec_parameters.set_value(codec_parameters);
 
-        _r_onvif_provider_cache_entry cache_entry;
-        cache_entry.created = steady_clock::now();
-        cache_entry.config = config;
-        _cache[id] = cache_entry;
-    }
-    else
+    if(sdp_media.find("audio") != sdp_media.end())
     {
-        config = it->second.config;
+        tie(codec_name, codec_parameters, timebase) = sdp_media_map_to_s(AUDIO_MEDIA, sdp_media);
+
+        sc.audio_codec = codec_name;
+        sc.audio_timebase = timebase;
+        sc.audio_codec_parameters = codec_parameters;
     }
 
-    config_nullable.set_value(config);
+    _r_onvif_provider_cache_entry cache_entry;
+    cache_entry.created = steady_clock::now();
+    cache_entry.config = sc;
 
-    return config_nullable;
+    lock_guard<mutex> g(_cache_lock);
+    _cache[sc.id] = cache_entry;
 
+    return true;
 }
 
 vector<r_stream_config> r_onvif_provider::_fetch_configs(const string& top_dir)
@@ -239,8 +225,7 @@ vector<r_stream_config> r_onvif_provider::_fetch_configs(const string& top_dir)
             hash.update((uint8_t*)di.address.c_str(), di.address.size());
             hash.finalize();
             auto id = hash.get_as_uuid();
-            auto credentials = _agent->_get_credentials(id);
-            
+
             config.id = id;
             config.camera_name.set_value(di.camera_name);
             config.ipv4.set_value(di.host);
@@ -259,12 +244,18 @@ vector<r_stream_config> r_onvif_provider::_fetch_configs(const string& top_dir)
     return configs;
 }
 
-void r_onvif_provider::_cache_check_expiration(const string& id)
+void r_onvif_provider::_cache_check_expiration(const string& id, bool recording)
 {
     auto it = _cache.find(id);
     if(it != _cache.end())
     {
         if(duration_cast<minutes>(steady_clock::now() - it->second.created).count() > 60 + (rand() % 10))
-            _cache.erase(it);
+        {
+            // A recording camera isn't interrogated again, so dropping its entry would hand back the
+            // bare discovered config. That hashes differently and would restart its recording.
+            if(recording)
+                it->second.created = steady_clock::now();
+            else _cache.erase(it);
+        }
     }
 }
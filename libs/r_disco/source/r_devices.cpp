@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <iterator>
 #include <chrono>
+#include <memory>
+#include <atomic>
 
 using namespace r_disco;
 using namespace r_db;
@@ -18,12 +20,76 @@ using namespace r_utils::r_string_utils;
 using namespace r_utils::r_funky;
 using namespace std;
 
+static const int64_t DEVICES_DB_MMAP_SIZE = 64 * 1024 * 1024;
+
+static const string UPSERT_DEVICE_QUERY =
+    "INSERT INTO cameras (id, camera_name, ipv4, xaddrs, address, rtsp_url, video_codec, video_codec_parameters, "
+                         "video_timebase, audio_codec, audio_codec_parameters, audio_timebase, state, last_update_time, stream_config_hash) "
+    "VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, 'discovered', unixepoch(), ?13) "
+    // On update only overwrite the columns we have values for (and leave state alone).
+    "ON CONFLICT(id) DO UPDATE SET "
+        "camera_name=COALESCE(excluded.camera_name, camera_name), "
+        "ipv4=COALESCE(excluded.ipv4, ipv4), "
+        "xaddrs=COALESCE(excluded.xaddrs, xaddrs), "
+        "address=COALESCE(excluded.address, address), "
+        "rtsp_url=COALESCE(excluded.rtsp_url, rtsp_url), "
+        "video_codec=COALESCE(excluded.video_codec, video_codec), "
+        "video_codec_parameters=COALESCE(excluded.video_codec_parameters, video_codec_parameters), "
+        "video_timebase=COALESCE(excluded.video_timebase, video_timebase), "
+        "audio_codec=COALESCE(excluded.audio_codec, audio_codec), "
+        "audio_codec_parameters=COALESCE(excluded.audio_codec_parameters, audio_codec_parameters), "
+        "audio_timebase=COALESCE(excluded.audio_timebase, audio_timebase), "
+        "last_update_time=excluded.last_update_time, "
+        "stream_config_hash=excluded.stream_config_hash;";
+
+static const string SELECT_CAMERA_BY_ID_QUERY = "SELECT * FROM cameras WHERE id=?1;";
+static const string SELECT_ALL_CAMERAS_QUERY = "SELECT * FROM cameras;";
+static const string SELECT_ASSIGNED_CAMERAS_QUERY = "SELECT * FROM cameras WHERE state='assigned';";
+static const string SELECT_ASSIGNED_IDS_QUERY = "SELECT id FROM cameras WHERE state='assigned';";
+static const string SELECT_MODIFIED_CAMERA_QUERY = "SELECT * FROM cameras WHERE id=?1 AND stream_config_hash != ?2;";
+static const string SELECT_CREDENTIALS_QUERY = "SELECT rtsp_username, rtsp_password FROM cameras WHERE id=?1;";
+static const string DELETE_CAMERA_QUERY = "DELETE FROM cameras WHERE id=?1;";
+
+static void _bind(r_sqlite_stmt& stmt, int index, const r_nullable<string>& value)
+{
+    if(value.is_null())
+        stmt.bind_null(index);
+    else stmt.bind(index, value.value());
+}
+
+static void _bind(r_sqlite_stmt& stmt, int index, const r_nullable<int>& value)
+{
+    if(value.is_null())
+        stmt.bind_null(index);
+    else stmt.bind(index, value.value());
+}
+
+// Cached statements are reset before they are handed out, but we also reset them once we have
+// their results so that a finished statement never holds on to a read snapshot.
+static vector<map<string, r_nullable<string>>> _exec(r_sqlite_stmt& stmt)
+{
+    try
+    {
+        auto results = stmt.exec();
+        stmt.reset();
+        return results;
+    }
+    catch(...)
+    {
+        stmt.reset();
+        throw;
+    }
+}
+
 r_devices::r_devices(const string& top_dir) :
     _th(),
     _running(false),
     _top_dir(top_dir),
+    _conn(),
+    _stmts(),
     _master_key(),
-    _master_key_loaded(false)
+    _master_key_loaded(false),
+    _snapshot()
 {
 }
 
@@ -68,6 +134,15 @@ r_nullable<r_camera> r_devices::get_camera_by_id(const string& id)
 {
     r_nullable<r_camera> camera;
 
+    auto snap = snapshot();
+    if(snap)
+    {
+        auto found = snap->by_id.find(id);
+        if(found != snap->by_id.end())
+            camera.set_value(found->second);
+        return camera;
+    }
+
     try
     {
         r_devices_cmd cmd;
@@ -89,6 +164,10 @@ r_nullable<r_camera> r_devices::get_camera_by_id(const string& id)
 
 vector<r_camera> r_devices::get_all_cameras()
 {
+    auto snap = snapshot();
+    if(snap)
+        return snap->all;
+
     vector<r_camera> cameras;
 
     try
@@ -107,6 +186,10 @@ vector<r_camera> r_devices::get_all_cameras()
 
 vector<r_camera> r_devices::get_assigned_cameras()
 {
+    auto snap = snapshot();
+    if(snap)
+        return snap->assigned;
+
     vector<r_camera> cameras;
 
     try
@@ -125,14 +208,19 @@ vector<r_camera> r_devices::get_assigned_cameras()
 
 vector<r_camera> r_devices::get_all_cameras_cached() const
 {
-    lock_guard<mutex> g(_cache_mutex);
-    return _all_cameras_cache;
+    auto snap = snapshot();
+    return (snap) ? snap->all : vector<r_camera>();
 }
 
 vector<r_camera> r_devices::get_assigned_cameras_cached() const
 {
-    lock_guard<mutex> g(_cache_mutex);
-    return _assigned_cameras_cache;
+    auto snap = snapshot();
+    return (snap) ? snap->assigned : vector<r_camera>();
+}
+
+shared_ptr<const r_camera_snapshot> r_devices::snapshot() const
+{
+    return std::atomic_load(&_snapshot);
 }
 
 void r_devices::save_camera(const r_camera& camera)
@@ -249,17 +337,27 @@ vector<r_camera> r_devices::get_assigned_cameras_removed(const vector<r_camera>&
     return removed_cameras;
 }
 
-void r_devices::_update_caches()
+void r_devices::_update_snapshot()
 {
-    auto conn = _open_db(_top_dir, false);
+    try
+    {
+        auto& conn = *_conn;
 
-    auto all_result = _get_all_cameras(conn);
-    auto assigned_result = _get_assigned_cameras(conn);
+        auto snap = make_shared<r_camera_snapshot>();
+        snap->all = _get_all_cameras(conn).cameras;
 
+        for(auto& c : snap->all)
+        {
+            snap->by_id[c.id] = c;
+            if(c.state == "assigned")
+                snap->assigned.push_back(c);
+        }
+
+        std::atomic_store(&_snapshot, shared_ptr<const r_camera_snapshot>(std::move(snap)));
+    }
+    catch(const std::exception& e)
     {
-        lock_guard<mutex> g(_cache_mutex);
-        _all_cameras_cache = std::move(all_result.cameras);
-        _assigned_cameras_cache = std::move(assigned_result.cameras);
+        R_LOG_EXCEPTION_AT(e, __FILE__, __LINE__);
     }
 }
 
@@ -267,72 +365,83 @@ void r_devices::_entry_point()
 {
     _create_db(_top_dir);
 
-    // Initialize caches immediately on startup
-    _update_caches();
+    _conn = make_unique<r_sqlite_conn>(_open_db(_top_dir));
+
+    // Initialize the snapshot immediately on startup
+    _update_snapshot();
 
     while(_running)
     {
         auto maybe_cmd = _db_work_q.poll(chrono::seconds(2));
-        if(!maybe_cmd.is_null())
+        if(maybe_cmd.is_null())
+        {
+            // Nothing to do, so pick up any changes made to the db outside of this object.
+            _update_snapshot();
+        }
+        else
         {
             auto cmd = maybe_cmd.take();
 
             try
             {
-                // XXX how about open for read only for the read only operations?
-
                 if(cmd.first.type == INSERT_OR_UPDATE_DEVICES)
                 {
-                    auto conn = _open_db(_top_dir);
-                    cmd.second.set_value(_insert_or_update_devices(conn, cmd.first.configs));
+                    auto& conn = *_conn;
+                    auto result = _insert_or_update_devices(conn, cmd.first.configs);
+                    _update_snapshot();
+                    cmd.second.set_value(result);
                 }
                 else if(cmd.first.type == GET_CAMERA_BY_ID)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     cmd.second.set_value(_get_camera_by_id(conn, cmd.first.id));
                 }
                 else if(cmd.first.type == GET_ALL_CAMERAS)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     cmd.second.set_value(_get_all_cameras(conn));
                 }
                 else if(cmd.first.type == GET_ASSIGNED_CAMERAS)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     cmd.second.set_value(_get_assigned_cameras(conn));
                 }
                 else if(cmd.first.type == SAVE_CAMERA)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     if(cmd.first.cameras.empty())
                         R_THROW(("No cameras passed to SAVE_CAMERA."));
-                    cmd.second.set_value(_save_camera(conn, cmd.first.cameras.front()));
+                    auto result = _save_camera(conn, cmd.first.cameras.front());
+                    _update_snapshot();
+                    cmd.second.set_value(result);
                 }
                 else if(cmd.first.type == REMOVE_CAMERA)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     if(cmd.first.cameras.empty())
                         R_THROW(("No cameras passed to REMOVE_CAMERA."));
-                    cmd.second.set_value(_remove_camera(conn, cmd.first.cameras.front()));
+                    auto result = _remove_camera(conn, cmd.first.cameras.front());
+                    _update_snapshot();
+                    cmd.second.set_value(result);
                 }
                 else if(cmd.first.type == GET_MODIFIED_CAMERAS)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     cmd.second.set_value(_get_modified_cameras(conn, cmd.first.cameras));
                 }
                 else if(cmd.first.type == GET_ASSIGNED_CAMERAS_ADDED)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     cmd.second.set_value(_get_assigned_cameras_added(conn, cmd.first.cameras));
                 }
                 else if(cmd.first.type == GET_ASSIGNED_CAMERAS_REMOVED)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     cmd.second.set_value(_get_assigned_cameras_removed(conn, cmd.first.cameras));
                 }
                 else if(cmd.first.type == GET_CREDENTIALS_BY_ID)
                 {
-                    auto conn = _open_db(_top_dir);
+                    auto& conn = *_conn;
                     cmd.second.set_value(_get_credentials(conn, cmd.first.id));
                 }
                 else R_THROW(("Unknown work q command."));
@@ -351,10 +460,10 @@ void r_devices::_entry_point()
                 }
             }
         }
-
-        // Update caches periodically (every 2 seconds when poll times out, or after processing commands)
-        _update_caches();
     }
+
+    _stmts.clear();
+    _conn.reset();
 }
 
 void r_devices::_create_db(const std::string& top_dir) const
@@ -400,7 +509,25 @@ void r_devices::_create_db(const std::string& top_dir) const
 r_sqlite_conn r_devices::_open_db(const std::string& top_dir, bool rw) const
 {
     auto db_dir = top_dir + PATH_SLASH + "db";
-    return r_sqlite_conn(db_dir + PATH_SLASH + "cameras.db", rw);
+    auto conn = r_sqlite_conn(db_dir + PATH_SLASH + "cameras.db", rw);
+
+    // The connection is WAL already. In WAL mode synchronous=NORMAL is still safe against
+    // corruption (a power loss can only lose the most recent commits) and saves an fsync per
+    // transaction. The whole cameras table fits comfortably in the mmap window.
+    conn.exec("PRAGMA synchronous=NORMAL;");
+    conn.exec("PRAGMA temp_store=MEMORY;");
+    conn.exec("PRAGMA mmap_size=" + to_string(DEVICES_DB_MMAP_SIZE) + ";");
+
+    return conn;
+}
+
+r_sqlite_stmt& r_devices::_prepared(const r_sqlite_conn& conn, const string& query) const
+{
+    auto found = _stmts.find(query);
+    if(found == _stmts.end())
+        found = _stmts.emplace(query, conn.prepare(query)).first;
+    else found->second.reset();
+    return found->second;
 }
 
 void r_devices::_upgrade_db(const r_sqlite_conn& conn) const
@@ -455,86 +582,6 @@ void r_devices::_set_db_version(const r_db::r_sqlite_conn& conn, int version) co
     conn.exec("PRAGMA user_version=" + to_string(version) + ";");
 }
 
-string r_devices::_create_insert_or_update_query(const r_db::r_sqlite_conn& conn, const r_stream_config& stream_config, const std::string& hash) const
-{
-    // Why not replace into? Because replace into replaces the whole row, and for the update case here we need
-    // to make sure we only update the columns we have values for.
-    auto result = conn.exec("SELECT * FROM cameras WHERE id='" + stream_config.id + "';");
-
-    string query;
-
-    if(result.empty())
-    {
-        query = r_string_utils::format(
-            "INSERT INTO cameras (id, %s%s%s%s%s%s%s%s%s%s%sstate, last_update_time, stream_config_hash) "
-            "VALUES('%s', %s%s%s%s%s%s%s%s%s%s%s'discovered', %s, '%s');",
-
-            (!stream_config.camera_name.is_null())?"camera_name, ":"",
-            (!stream_config.ipv4.is_null())?"ipv4, ":"",
-            (!stream_config.xaddrs.is_null())?"xaddrs, ":"",
-            (!stream_config.address.is_null())?"address, ":"",
-            (!stream_config.rtsp_url.is_null())?"rtsp_url, ":"",
-            (!stream_config.video_codec.is_null())?"video_codec, ":"",
-            (!stream_config.video_codec_parameters.is_null())?"video_codec_parameters, ":"",
-            (!stream_config.video_timebase.is_null())?"video_timebase, ":"",
-            (!stream_config.audio_codec.is_null())?"audio_codec, ":"",
-            (!stream_config.audio_codec_parameters.is_null())?"audio_codec_parameters, ":"",
-            (!stream_config.audio_timebase.is_null())?"audio_timebase, ":"",
-
-            stream_config.id.c_str(),
-            (!stream_config.camera_name.is_null())?r_string_utils::format("'%s', ", stream_config.camera_name.value().c_str()).c_str():"",
-            (!stream_config.ipv4.is_null())?r_string_utils::format("'%s', ", stream_config.ipv4.value().c_str()).c_str():"",
-            (!stream_config.xaddrs.is_null())?r_string_utils::format("'%s', ", stream_config.xaddrs.value().c_str()).c_str():"",
-            (!stream_config.address.is_null())?r_string_utils::format("'%s', ", stream_config.address.value().c_str()).c_str():"",
-            (!stream_config.rtsp_url.is_null())?r_string_utils::format("'%s', ", stream_config.rtsp_url.value().c_str()).c_str():"",
-            (!stream_config.video_codec.is_null())?r_string_utils::format("'%s', ", stream_config.video_codec.value().c_str()).c_str():"",
-            (!stream_config.video_codec_parameters.is_null())?r_string_utils::format("'%s', ", stream_config.video_codec_parameters.value().c_str()).c_str():"",
-            (!stream_config.video_timebase.is_null())?r_string_utils::format("'%d', ", stream_config.video_timebase.value()).c_str():"",
-            (!stream_config.audio_codec.is_null())?r_string_utils::format("'%s', ", stream_config.audio_codec.value().c_str()).c_str():"",
-            (!stream_config.audio_codec_parameters.is_null())?r_string_utils::format("'%s', ", stream_config.audio_codec_parameters.value().c_str()).c_str():"",
-            (!stream_config.audio_timebase.is_null())?r_string_utils::format("'%d', ", stream_config.audio_timebase.value()).c_str():"",
-            "unixepoch()",
-            hash.c_str()
-        );
-    }
-    else
-    {
-        query = r_string_utils::format(
-            "UPDATE cameras SET "
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "%s"
-                "last_update_time=%s, "
-                "stream_config_hash='%s' "
-            "WHERE id='%s';",
-            (!stream_config.camera_name.is_null())?r_string_utils::format("camera_name='%s', ", stream_config.camera_name.value().c_str()).c_str():"",
-            (!stream_config.ipv4.is_null())?r_string_utils::format("ipv4='%s', ", stream_config.ipv4.value().c_str()).c_str():"",
-            (!stream_config.xaddrs.is_null())?r_string_utils::format("xaddrs='%s', ", stream_config.xaddrs.value().c_str()).c_str():"",
-            (!stream_config.address.is_null())?r_string_utils::format("address='%s', ", stream_config.address.value().c_str()).c_str():"",
-            (!stream_config.rtsp_url.is_null())?r_string_utils::format("rtsp_url='%s', ", stream_config.rtsp_url.value().c_str()).c_str():"",
-            (!stream_config.video_codec.is_null())?r_string_utils::format("video_codec='%s', ", stream_config.video_codec.value().c_str()).c_str():"",
-            (!stream_config.video_codec_parameters.is_null())?r_string_utils::format("video_codec_parameters='%s', ", stream_config.video_codec_parameters.value().c_str()).c_str():"",
-            (!stream_config.video_timebase.is_null())?r_string_utils::format("video_timebase='%d', ", stream_config.video_timebase.value()).c_str():"",
-            (!stream_config.audio_codec.is_null())?r_string_utils::format("audio_codec='%s', ", stream_config.audio_codec.value().c_str()).c_str():"",
-            (!stream_config.audio_codec_parameters.is_null())?r_string_utils::format("audio_codec_parameters='%s', ", stream_config.audio_codec_parameters.value().c_str()).c_str():"",
-            (!stream_config.audio_timebase.is_null())?r_string_utils::format("audio_timebase='%d', ", stream_config.audio_timebase.value()).c_str():"",
-            "unixepoch()",
-            hash.c_str(),
-            stream_config.id.c_str()
-        );
-    }
-
-    return query;
-}
-
 r_camera r_devices::_create_camera(const map<string, r_nullable<string>>& row) const
 {
     r_camera camera;
@@ -608,10 +655,24 @@ r_camera r_devices::_create_camera(const map<string, r_nullable<string>>& row) c
 r_devices_cmd_result r_devices::_insert_or_update_devices(const r_db::r_sqlite_conn& conn, const vector<pair<r_stream_config, string>>& stream_configs) const
 {
     r_sqlite_transaction(conn, true, [&](const r_sqlite_conn& conn){
+        auto& stmt = _prepared(conn, UPSERT_DEVICE_QUERY);
         for(auto& sc : stream_configs)
         {
-            auto q = _create_insert_or_update_query(conn, sc.first, sc.second);
-            conn.exec(q);
+            const auto& c = sc.first;
+            stmt.bind(1, c.id);
+            _bind(stmt, 2, c.camera_name);
+            _bind(stmt, 3, c.ipv4);
+            _bind(stmt, 4, c.xaddrs);
+            _bind(stmt, 5, c.address);
+            _bind(stmt, 6, c.rtsp_url);
+            _bind(stmt, 7, c.video_codec);
+            _bind(stmt, 8, c.video_codec_parameters);
+            _bind(stmt, 9, c.video_timebase);
+            _bind(stmt, 10, c.audio_codec);
+            _bind(stmt, 11, c.audio_codec_parameters);
+            _bind(stmt, 12, c.audio_timebase);
+            stmt.bind(13, sc.second);
+            _exec(stmt);
         }
     });
 
@@ -622,7 +683,9 @@ r_devices_cmd_result r_devices::_get_camera_by_id(const r_sqlite_conn& conn, con
 {
     r_devices_cmd_result result;
     r_sqlite_transaction(conn, false, [&](const r_sqlite_conn& conn){
-        auto qr = conn.exec("SELECT * FROM cameras WHERE id='" + id + "';");
+        auto& stmt = _prepared(conn, SELECT_CAMERA_BY_ID_QUERY);
+        stmt.bind(1, id);
+        auto qr = _exec(stmt);
         if(!qr.empty())
             result.cameras.push_back(_create_camera(qr.front()));
     });
@@ -633,7 +696,7 @@ r_devices_cmd_result r_devices::_get_all_cameras(const r_sqlite_conn& conn) cons
 {
     r_devices_cmd_result result;
     r_sqlite_transaction(conn, false, [&](const r_sqlite_conn& conn){
-        auto cameras = conn.exec("SELECT * FROM cameras;");
+        auto cameras = _exec(_prepared(conn, SELECT_ALL_CAMERAS_QUERY));
         for(auto& c : cameras)
             result.cameras.push_back(_create_camera(c));
     });
@@ -646,7 +709,7 @@ r_devices_cmd_result r_devices::_get_assigned_cameras(const r_sqlite_conn& conn)
     r_devices_cmd_result result;
 
     r_sqlite_transaction(conn, false, [&](const r_sqlite_conn& conn){
-        auto cameras = conn.exec("SELECT * FROM cameras WHERE state=\"assigned\";");
+        auto cameras = _exec(_prepared(conn, SELECT_ASSIGNED_CAMERAS_QUERY));
         for(auto& c : cameras)
             result.cameras.push_back(_create_camera(c));
     });
@@ -785,7 +848,9 @@ r_devices_cmd_result r_devices::_save_camera(const r_sqlite_conn& conn, const r_
 r_devices_cmd_result r_devices::_remove_camera(const r_sqlite_conn& conn, const r_camera& camera) const
 {
     r_sqlite_transaction(conn, true, [&](const r_sqlite_conn& conn){
-        conn.exec("DELETE FROM cameras WHERE id='" + camera.id + "';");
+        auto& stmt = _prepared(conn, DELETE_CAMERA_QUERY);
+        stmt.bind(1, camera.id);
+        _exec(stmt);
     });
 
     return r_devices_cmd_result();
@@ -795,15 +860,13 @@ r_devices_cmd_result r_devices::_get_modified_cameras(const r_sqlite_conn& conn,
 {
     vector<r_camera> out_cameras;
     r_sqlite_transaction(conn, false, [&](const r_sqlite_conn& conn){
+        auto& stmt = _prepared(conn, SELECT_MODIFIED_CAMERA_QUERY);
         for(auto& c : cameras)
         {
-            auto query = r_string_utils::format(
-                "SELECT * FROM cameras WHERE id=\"%s\" AND stream_config_hash != \"%s\";",
-                c.id.c_str(),
-                c.stream_config_hash.c_str()
-            );
+            stmt.bind(1, c.id);
+            stmt.bind(2, c.stream_config_hash);
 
-            auto modified = conn.exec(query);
+            auto modified = _exec(stmt);
             if(!modified.empty())
                 out_cameras.push_back(_create_camera(modified.front()));
         }
@@ -820,7 +883,7 @@ r_devices_cmd_result r_devices::_get_assigned_cameras_added(const r_sqlite_conn&
     vector<string> input_ids;
     transform(begin(cameras), end(cameras), back_inserter(input_ids),[](const r_camera& c){return c.id;});
 
-    auto qr = conn.exec("SELECT id FROM cameras WHERE state='assigned';");
+    auto qr = _exec(_prepared(conn, SELECT_ASSIGNED_IDS_QUERY));
 
     vector<string> db_ids;
     transform(begin(qr), end(qr), back_inserter(db_ids), [](const map<string, r_nullable<string>>& r){return r.at("id").value();});
@@ -830,9 +893,11 @@ r_devices_cmd_result r_devices::_get_assigned_cameras_added(const r_sqlite_conn&
 
     r_devices_cmd_result result;
 
+    auto& stmt = _prepared(conn, SELECT_CAMERA_BY_ID_QUERY);
     for(auto added_id : added_ids)
     {
-        qr = conn.exec("SELECT * FROM cameras WHERE id='" + added_id + "';");
+        stmt.bind(1, added_id);
+        qr = _exec(stmt);
         if(!qr.empty())
             result.cameras.push_back(_create_camera(qr.front()));
     }
@@ -849,7 +914,7 @@ r_devices_cmd_result r_devices::_get_assigned_cameras_removed(const r_sqlite_con
     vector<string> input_ids;
     transform(begin(cameras), end(cameras), back_inserter(input_ids),[](const r_camera& c){return c.id;});
 
-    auto qr = conn.exec("SELECT id FROM cameras WHERE state='assigned';");
+    auto qr = _exec(_prepared(conn, SELECT_ASSIGNED_IDS_QUERY));
 
     vector<string> db_ids;
     transform(begin(qr), end(qr), back_inserter(db_ids), [](const map<string, r_nullable<string>>& r){return r.at("id").value();});
@@ -867,7 +932,9 @@ r_devices_cmd_result r_devices::_get_credentials(const r_sqlite_conn& conn, cons
 {
     r_devices_cmd_result result;
     r_sqlite_transaction(conn, false, [&](const r_sqlite_conn& conn){
-        auto qr = conn.exec("SELECT rtsp_username, rtsp_password FROM cameras WHERE id='" + id + "';");
+        auto& stmt = _prepared(conn, SELECT_CREDENTIALS_QUERY);
+        stmt.bind(1, id);
+        auto qr = _exec(stmt);
         if(!qr.empty())
         {
             auto row = qr.front();
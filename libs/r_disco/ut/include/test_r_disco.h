@@ -6,6 +6,9 @@ class test_r_disco : public test_fixture
 public:
     RTF_FIXTURE(test_r_disco);
       TEST(test_r_disco::test_r_disco_r_agent_basics);
+      TEST(test_r_disco::test_r_disco_r_devices_snapshot);
+      TEST(test_r_disco::test_r_disco_r_devices_lookup);
+      TEST(test_r_disco::test_r_disco_r_devices_db_upserts);
     RTF_FIXTURE_END();
 
     virtual ~test_r_disco() throw() {}
@@ -14,4 +17,7 @@ public:
     virtual void teardown();
 
     void test_r_disco_r_agent_basics();
+    void test_r_disco_r_devices_snapshot();
+    void test_r_disco_r_devices_lookup();
+    void test_r_disco_r_devices_db_upserts();
 };
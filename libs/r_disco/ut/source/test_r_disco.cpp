@@ -3,6 +3,11 @@
 #include "r_disco/r_agent.h"
 #include "r_disco/r_devices.h"
 #include "r_utils/r_file.h"
+#include "r_utils/r_string_utils.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 using namespace std;
 using namespace r_utils;
@@ -49,3 +54,196 @@ void test_r_disco::test_r_disco_r_agent_basics()
         printf("stream_config: %s\n", stream_config.first.rtsp_url.value().c_str());
     }
 }
+
+static vector<pair<r_stream_config, string>> _make_stream_configs(size_t n)
+{
+    vector<pair<r_stream_config, string>> configs;
+    for(size_t i = 0; i < n; ++i)
+    {
+        r_stream_config sc;
+        sc.id = r_string_utils::format("camera_%zu", i);
+        sc.camera_name.set_value(r_string_utils::format("Camera %zu", i));
+        sc.ipv4.set_value(r_string_utils::format("10.0.0.%zu", i + 1));
+        sc.rtsp_url.set_value(r_string_utils::format("rtsp://10.0.0.%zu/stream1", i + 1));
+        sc.video_codec.set_value("h264");
+        configs.push_back(make_pair(sc, hash_stream_config(sc)));
+    }
+    return configs;
+}
+
+static void _wait_for_cameras(r_devices& devices, size_t n)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while(devices.get_all_cameras().size() < n && chrono::steady_clock::now() < deadline)
+        this_thread::sleep_for(chrono::milliseconds(10));
+}
+
+void test_r_disco::test_r_disco_r_devices_snapshot()
+{
+    r_devices devices("top_dir");
+    devices.start();
+
+    devices.insert_or_update_devices(_make_stream_configs(4));
+    _wait_for_cameras(devices, 4);
+
+    RTF_ASSERT(devices.get_all_cameras().size() == 4);
+    RTF_ASSERT(devices.get_assigned_cameras().empty());
+
+    auto before = devices.snapshot();
+    RTF_ASSERT(before);
+
+    auto maybe_camera = devices.get_camera_by_id("camera_2");
+    RTF_ASSERT(!maybe_camera.is_null());
+    RTF_ASSERT(maybe_camera.value().ipv4.value() == "10.0.0.3");
+    RTF_ASSERT(devices.get_camera_by_id("no_such_camera").is_null());
+
+    // Mutations are visible as soon as they return...
+    auto camera = maybe_camera.value();
+    devices.assign_camera(camera);
+    RTF_ASSERT(devices.get_assigned_cameras().size() == 1);
+    RTF_ASSERT(devices.get_camera_by_id("camera_2").value().state == "assigned");
+
+    devices.remove_camera(camera);
+    RTF_ASSERT(devices.get_camera_by_id("camera_2").is_null());
+    RTF_ASSERT(devices.get_all_cameras().size() == 3);
+
+    // ...and never modify a snapshot someone is already holding.
+    RTF_ASSERT(before->all.size() == 4);
+    RTF_ASSERT(before->assigned.empty());
+    RTF_ASSERT(before->by_id.find("camera_2") != before->by_id.end());
+
+    devices.stop();
+}
+
+void test_r_disco::test_r_disco_r_devices_lookup()
+{
+    const size_t N_CAMERAS = 64;
+
+    r_devices devices("top_dir");
+    devices.start();
+
+    devices.insert_or_update_devices(_make_stream_configs(N_CAMERAS));
+    _wait_for_cameras(devices, N_CAMERAS);
+
+    // Every camera is found by its id, with the fields it was stored with.
+    for(size_t i = 0; i < N_CAMERAS; ++i)
+    {
+        auto id = r_string_utils::format("camera_%zu", i);
+        auto camera = devices.get_camera_by_id(id);
+        RTF_ASSERT(!camera.is_null());
+        RTF_ASSERT(camera.value().id == id);
+        RTF_ASSERT(camera.value().camera_name.value() == r_string_utils::format("Camera %zu", i));
+        RTF_ASSERT(camera.value().ipv4.value() == r_string_utils::format("10.0.0.%zu", i + 1));
+        RTF_ASSERT(camera.value().rtsp_url.value() == r_string_utils::format("rtsp://10.0.0.%zu/stream1", i + 1));
+    }
+
+    RTF_ASSERT(devices.get_camera_by_id("camera_64").is_null());
+    RTF_ASSERT(devices.get_camera_by_id("").is_null());
+
+    auto all = devices.get_all_cameras();
+    RTF_ASSERT(all.size() == N_CAMERAS);
+    for(size_t i = 0; i < N_CAMERAS; ++i)
+    {
+        auto id = r_string_utils::format("camera_%zu", i);
+        RTF_ASSERT(find_if(all.begin(), all.end(), [&](const r_camera& c){return c.id == id;}) != all.end());
+    }
+
+    // Readers on several threads at once, while another thread assigns cameras, all see whole cameras.
+    const size_t N_THREADS = 8;
+    const size_t N_LOOKUPS = 1000;
+    vector<thread> threads;
+    atomic<size_t> mt_found(0);
+    for(size_t t = 0; t < N_THREADS; ++t)
+    {
+        threads.push_back(thread([&](){
+            for(size_t i = 0; i < N_LOOKUPS; ++i)
+            {
+                auto id = r_string_utils::format("camera_%zu", i % N_CAMERAS);
+                auto camera = devices.get_camera_by_id(id);
+                if(!camera.is_null() && camera.value().id == id && camera.value().ipv4.value() == r_string_utils::format("10.0.0.%zu", (i % N_CAMERAS) + 1))
+                    ++mt_found;
+            }
+        }));
+    }
+
+    for(size_t i = 0; i < N_CAMERAS; i += 2)
+    {
+        auto camera = devices.get_camera_by_id(r_string_utils::format("camera_%zu", i)).value();
+        devices.assign_camera(camera);
+    }
+
+    for(auto& t : threads)
+        t.join();
+
+    RTF_ASSERT(mt_found == N_LOOKUPS * N_THREADS);
+    RTF_ASSERT(devices.get_assigned_cameras().size() == N_CAMERAS / 2);
+    RTF_ASSERT(devices.get_camera_by_id("camera_2").value().state == "assigned");
+    RTF_ASSERT(devices.get_camera_by_id("camera_3").value().state != "assigned");
+
+    devices.stop();
+}
+
+void test_r_disco::test_r_disco_r_devices_db_upserts()
+{
+    const size_t N_CAMERAS = 500;
+
+    r_devices devices("top_dir");
+    devices.start();
+
+    // The db thread works through its queue in order, so a blocking call posted right behind
+    // insert_or_update_devices() returns once the upserts are committed.
+
+    // Discovery reports everything it found in one call, which becomes one transaction.
+    auto configs = _make_stream_configs(N_CAMERAS);
+    devices.insert_or_update_devices(configs);
+    devices.get_credentials("camera_0");
+
+    RTF_ASSERT(devices.get_all_cameras().size() == N_CAMERAS);
+    for(size_t i = 0; i < N_CAMERAS; ++i)
+    {
+        auto camera = devices.get_camera_by_id(configs[i].first.id);
+        RTF_ASSERT(!camera.is_null());
+        RTF_ASSERT(camera.value().rtsp_url.value() == configs[i].first.rtsp_url.value());
+        RTF_ASSERT(camera.value().stream_config_hash == configs[i].second);
+    }
+
+    auto before_update = devices.get_all_cameras();
+
+    auto camera = devices.get_camera_by_id("camera_7").value();
+    devices.assign_camera(camera);
+
+    // Updates only overwrite the fields the stream config has values for, and never the state.
+    for(auto& c : configs)
+    {
+        c.first.ipv4.clear();
+        c.first.rtsp_url.set_value(c.first.rtsp_url.value() + "?profile=2");
+        c.second = hash_stream_config(c.first);
+    }
+
+    devices.insert_or_update_devices(configs);
+    devices.get_credentials("camera_0");
+
+    auto updated = devices.get_camera_by_id("camera_7").value();
+    RTF_ASSERT(updated.ipv4.value() == "10.0.0.8");
+    RTF_ASSERT(updated.rtsp_url.value() == "rtsp://10.0.0.8/stream1?profile=2");
+    RTF_ASSERT(updated.state == "assigned");
+    RTF_ASSERT(updated.stream_config_hash == configs[7].second);
+    RTF_ASSERT(devices.get_all_cameras().size() == N_CAMERAS);
+
+    // Every SELECT goes through the same prepared statement, rebound each time.
+    for(size_t i = 0; i < N_CAMERAS; ++i)
+    {
+        auto credentials = devices.get_credentials(configs[i].first.id);
+        RTF_ASSERT(credentials.first.is_null() && credentials.second.is_null());
+    }
+
+    // Cameras as they are now aren't modified, the ones from before the update all are.
+    RTF_ASSERT(devices.get_modified_cameras(devices.get_all_cameras()).empty());
+    auto modified = devices.get_modified_cameras(before_update);
+    RTF_ASSERT(modified.size() == N_CAMERAS);
+    auto found = find_if(modified.begin(), modified.end(), [](const r_camera& c){return c.id == "camera_7";});
+    RTF_ASSERT(found != modified.end());
+    RTF_ASSERT(found->stream_config_hash == configs[7].second);
+
+    devices.stop();
+}
@@ -55,6 +55,10 @@ public:
     R_API bool is_get_request() const;
     R_API bool is_delete_request() const;
 
+    // HTTP/1.1 connections stay open unless the client sends "Connection: close", HTTP/1.0 ones
+    // close unless it sends "Connection: keep-alive".
+    R_API bool wants_keep_alive() const;
+
     R_API void register_chunk_callback(server_chunk_callback cb);
 
 private:
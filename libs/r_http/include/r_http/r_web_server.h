@@ -30,6 +30,12 @@
 namespace r_http
 {
 
+// After a response a keep-alive connection waits this long for the client's next request before it
+// is closed, and no connection serves more than R_WEB_SERVER_MAX_KEEP_ALIVE_REQUESTS requests (each
+// open connection holds a server thread).
+constexpr uint64_t R_WEB_SERVER_KEEP_ALIVE_MILLIS = 5000;
+constexpr int R_WEB_SERVER_MAX_KEEP_ALIVE_REQUESTS = 100;
+
 template<class SOK_T>
 class r_web_server;
 
@@ -79,8 +85,42 @@ public:
 private:
     void _server_conn_cb(SOK_T& conn)
     {
-        r_server_request request;
-        request.read_request(conn);
+        int n_requests = 0;
+        bool keep_alive = true;
+
+        while(keep_alive && conn.valid())
+        {
+            if(n_requests > 0)
+            {
+                uint64_t idle_millis = R_WEB_SERVER_KEEP_ALIVE_MILLIS;
+                if(!conn.wait_till_recv_wont_block(idle_millis))
+                    return;
+            }
+
+            r_server_request request;
+
+            try
+            {
+                request.read_request(conn);
+            }
+            catch(...)
+            {
+                // A client closing a kept alive connection between requests is how they end.
+                if(n_requests > 0)
+                    return;
+                throw;
+            }
+
+            ++n_requests;
+
+            keep_alive = _handle_request(conn, request, request.wants_keep_alive() && n_requests < R_WEB_SERVER_MAX_KEEP_ALIVE_REQUESTS);
+        }
+    }
+
+    // Returns true if the connection can take another request.
+    bool _handle_request(SOK_T& conn, const r_server_request& request, bool keep_alive)
+    {
+        bool can_continue = false;
 
         r_uri ruri = request.get_uri();
 
@@ -106,8 +146,14 @@ private:
 
             auto response = foundRoute->second(*this, conn, request);
 
+            // A route that wrote its own response (or took the connection over) has to be closed,
+            // as do error responses.
             if(!response.written() && conn.valid())
+            {
+                response.set_connection_close(!keep_alive);
                 response.write_response(conn);
+                can_continue = keep_alive;
+            }
         }
         WS_CATCH(r_http_400_exception, response_bad_request)
         WS_CATCH(r_http_401_exception, response_unauthorized)
@@ -141,6 +187,8 @@ private:
 
             R_LOG_NOTICE("An unknown exception has occurred in our web server.");
         }
+
+        return can_continue;
     }
 
     std::map<int, std::map<std::string, http_cb>> _cbs;
@@ -136,6 +136,18 @@ bool r_server_request::is_delete_request() const
     return get_method() == METHOD_DELETE;
 }
 
+bool r_server_request::wants_keep_alive() const
+{
+    auto connection = get_header("connection");
+    auto value = (connection.is_null()) ? string() : r_string_utils::to_lower(connection.value());
+
+    auto version = get_header("http_version");
+    if(!version.is_null() && r_string_utils::to_upper(version.value()) == "HTTP/1.0")
+        return r_string_utils::contains(value, "keep-alive");
+
+    return !r_string_utils::contains(value, "close");
+}
+
 int r_server_request::get_method() const
 {
     auto h = get_header("method");
@@ -293,6 +293,9 @@ string r_server_response::_get_status_message(status_code sc) const
     case response_reset_content:
         return string("Reset Content");
 
+    case response_not_modified:
+        return string("Not Modified");
+
     case response_bad_request:
         return string("Bad Request");
 
@@ -18,6 +18,7 @@ public:
       TEST(test_r_http::test_client_request_chunked_multiple);
       TEST(test_r_http::test_server_request_chunked_accumulate);
       TEST(test_r_http::test_server_request_chunked_callback);
+      TEST(test_r_http::test_web_server_keep_alive);
     RTF_FIXTURE_END();
 
     virtual ~test_r_http() throw() {}
@@ -38,4 +39,5 @@ public:
     void test_client_request_chunked_multiple();
     void test_server_request_chunked_accumulate();
     void test_server_request_chunked_callback();
+    void test_web_server_keep_alive();
 };
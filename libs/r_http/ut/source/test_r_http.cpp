@@ -5,6 +5,7 @@
 #include "r_http/r_server_request.h"
 #include "r_http/r_client_response.h"
 #include "r_http/r_server_response.h"
+#include "r_http/r_web_server.h"
 
 #include <chrono>
 #include <thread>
@@ -597,3 +598,50 @@ void test_r_http::test_server_request_chunked_callback()
     if(serverException)
         std::rethrow_exception(serverException);
 }
+
+void test_r_http::test_web_server_keep_alive()
+{
+    int port = RTF_NEXT_PORT();
+
+    r_web_server<r_socket> ws(port);
+    ws.add_route(METHOD_GET, "/hello", [](const r_web_server<r_socket>&, r_socket&, const r_server_request&){
+        r_server_response response;
+        response.set_body("hello");
+        return response;
+    });
+    ws.start();
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    r_socket socket;
+    socket.connect("127.0.0.1", port);
+
+    // Several requests on the one connection, each answered without closing it.
+    for(int i = 0; i < 5; ++i)
+    {
+        r_client_request request("127.0.0.1", port);
+        request.set_uri("/hello");
+        request.write_request(socket);
+
+        r_client_response response;
+        response.read_response(socket);
+
+        RTF_ASSERT(response.get_status() == 200);
+        RTF_ASSERT(response.get_body_as_string() == "hello");
+        RTF_ASSERT(response.get_header("connection").find("close") == string::npos);
+    }
+
+    // Asking for the connection to be closed is honored.
+    r_client_request request("127.0.0.1", port);
+    request.set_uri("/hello");
+    request.add_header("Connection", "close");
+    request.write_request(socket);
+
+    r_client_response response;
+    response.read_response(socket);
+
+    RTF_ASSERT(response.get_body_as_string() == "hello");
+    RTF_ASSERT(response.get_header("connection") == "close");
+
+    ws.stop();
+}
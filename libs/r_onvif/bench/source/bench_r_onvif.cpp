@@ -0,0 +1,258 @@
+
+#include "bench.h"
+#include "r_onvif/r_onvif_session.h"
+#include "r_onvif/r_ws_discovery.h"
+#include "r_http/r_web_server.h"
+#include "r_utils/r_parallel_for.h"
+#include "r_utils/r_string_utils.h"
+#include "r_utils/r_socket.h"
+#include "r_utils/r_udp_socket.h"
+#include "r_utils/r_udp_sender.h"
+#include "r_utils/r_socket_address.h"
+#include "r_utils/r_exception.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <ctime>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_onvif;
+using namespace r_utils;
+using namespace r_http;
+
+static const int MOCK_CAMERA_PORT = 18080;
+static const int RESPONDER_PORT = 18081;
+
+static string _soap_envelope(const string& body)
+{
+    return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+           "<SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
+           "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\" "
+           "xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" "
+           "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+           "<SOAP-ENV:Body>" + body + "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
+}
+
+// _mock_onvif_camera answers just enough of the device and media services for r_onvif::interrogate(),
+// optionally sleeping before every response to stand in for a slow camera.
+class _mock_onvif_camera final
+{
+public:
+    _mock_onvif_camera(int port, milliseconds delay) :
+        _port(port),
+        _delay(delay),
+        _ws(port)
+    {
+        auto cb = [this](const r_web_server<r_socket>&, r_socket&, const r_server_request& request){
+            return _respond(request.get_body_as_string());
+        };
+
+        _ws.add_route(METHOD_POST, "/onvif/device_service", cb);
+        _ws.add_route(METHOD_POST, "/onvif/media_service", cb);
+        _ws.start();
+
+        // r_server_threaded binds on its own thread.
+        this_thread::sleep_for(milliseconds(250));
+    }
+
+    int port() const { return _port; }
+
+private:
+    r_server_response _respond(const string& request) const
+    {
+        if(_delay.count() > 0)
+            this_thread::sleep_for(_delay);
+
+        string body;
+
+        if(request.find("GetSystemDateAndTime") != string::npos)
+        {
+            auto now = time(nullptr);
+            struct tm utc;
+#ifdef IS_WINDOWS
+            gmtime_s(&utc, &now);
+#else
+            gmtime_r(&now, &utc);
+#endif
+
+            body = r_string_utils::format(
+                "<tds:GetSystemDateAndTimeResponse><tds:SystemDateAndTime>"
+                "<tt:DateTimeType>NTP</tt:DateTimeType><tt:DaylightSavings>false</tt:DaylightSavings>"
+                "<tt:TimeZone><tt:TZ>GMT+00:00</tt:TZ></tt:TimeZone>"
+                "<tt:UTCDateTime><tt:Time><tt:Hour>%d</tt:Hour><tt:Minute>%d</tt:Minute><tt:Second>%d</tt:Second></tt:Time>"
+                "<tt:Date><tt:Year>%d</tt:Year><tt:Month>%d</tt:Month><tt:Day>%d</tt:Day></tt:Date></tt:UTCDateTime>"
+                "</tds:SystemDateAndTime></tds:GetSystemDateAndTimeResponse>",
+                utc.tm_hour, utc.tm_min, utc.tm_sec, utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday
+            );
+        }
+        else if(request.find("GetCapabilities") != string::npos)
+        {
+            // The Device XAddr comes first so that the Media XAddr has to be found by its ancestor.
+            body = r_string_utils::format(
+                "<tds:GetCapabilitiesResponse><tds:Capabilities>"
+                "<tt:Device><tt:XAddr>http://127.0.0.1:%d/onvif/device_service</tt:XAddr></tt:Device>"
+                "<tt:Media><tt:XAddr>http://127.0.0.1:%d/onvif/media_service</tt:XAddr>"
+                "<tt:StreamingCapabilities><tt:RTPMulticast>false</tt:RTPMulticast></tt:StreamingCapabilities></tt:Media>"
+                "</tds:Capabilities></tds:GetCapabilitiesResponse>",
+                _port, _port
+            );
+        }
+        else if(request.find("GetProfiles") != string::npos)
+        {
+            body =
+                "<trt:GetProfilesResponse>"
+                "<trt:Profiles token=\"sub\" fixed=\"true\"><tt:Name>sub</tt:Name>"
+                "<tt:AudioEncoderConfiguration token=\"a0\"><tt:Encoding>G711</tt:Encoding></tt:AudioEncoderConfiguration>"
+                "<tt:VideoEncoderConfiguration token=\"v1\"><tt:Encoding>H264</tt:Encoding>"
+                "<tt:Resolution><tt:Width>640</tt:Width><tt:Height>360</tt:Height></tt:Resolution></tt:VideoEncoderConfiguration>"
+                "</trt:Profiles>"
+                "<trt:Profiles token=\"main\" fixed=\"true\"><tt:Name>main</tt:Name>"
+                "<tt:VideoEncoderConfiguration token=\"v0\"><tt:Encoding>H265</tt:Encoding>"
+                "<tt:Resolution><tt:Width>1920</tt:Width><tt:Height>1080</tt:Height></tt:Resolution></tt:VideoEncoderConfiguration>"
+                "<tt:AudioEncoderConfiguration token=\"a0\"><tt:Encoding>AAC</tt:Encoding></tt:AudioEncoderConfiguration>"
+                "</trt:Profiles>"
+                "</trt:GetProfilesResponse>";
+        }
+        else if(request.find("GetStreamUri") != string::npos)
+        {
+            auto profile = (request.find(">main<") != string::npos)?"main":"sub";
+
+            body = r_string_utils::format(
+                "<trt:GetStreamUriResponse><trt:MediaUri>"
+                "<tt:Uri>rtsp://127.0.0.1:554/%s?channel=1&amp;subtype=0</tt:Uri>"
+                "<tt:InvalidAfterConnect>false</tt:InvalidAfterConnect></trt:MediaUri></trt:GetStreamUriResponse>",
+                profile
+            );
+        }
+        else
+        {
+            r_server_response response;
+            response.set_status_code(response_bad_request);
+            return response;
+        }
+
+        r_server_response response(response_ok, "application/soap+xml; charset=utf-8");
+        response.set_body(_soap_envelope(body));
+        return response;
+    }
+
+    int _port;
+    milliseconds _delay;
+    r_web_server<r_socket> _ws;
+};
+
+static string _probe_match_message(size_t device)
+{
+    return r_string_utils::format(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
+        "xmlns:wsa=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\" "
+        "xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\">"
+        "<SOAP-ENV:Header><wsa:To>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</wsa:To></SOAP-ENV:Header>"
+        "<SOAP-ENV:Body><d:ProbeMatches><d:ProbeMatch>"
+        "<wsa:EndpointReference><wsa:Address>urn:uuid:device-%zu</wsa:Address></wsa:EndpointReference>"
+        "<d:Types>dn:NetworkVideoTransmitter</d:Types>"
+        "<d:Scopes>onvif://www.onvif.org/name/Camera%zu onvif://www.onvif.org/hardware/HW%zu</d:Scopes>"
+        "<d:XAddrs>http://10.0.%zu.%zu/onvif/device_service http://[fe80::1]/onvif/device_service</d:XAddrs>"
+        "<d:MetadataVersion>1</d:MetadataVersion>"
+        "</d:ProbeMatch></d:ProbeMatches></SOAP-ENV:Body></SOAP-ENV:Envelope>",
+        device, device, device, device / 250, (device % 250) + 1
+    );
+}
+
+// The time to interrogate 16 cameras that take 50ms to answer each request, one after another and
+// 8 at a time (as the ONVIF discovery provider does).
+REGISTER_BENCH(onvif_interrogation)
+{
+    r_raw_socket::socket_startup();
+
+    _mock_onvif_camera camera(MOCK_CAMERA_PORT, milliseconds(50));
+
+    r_nullable<string> username, password;
+    username = "admin";
+    password = "secret";
+
+    const size_t N_CAMERAS = 16;
+
+    auto interrogate_one = [&](size_t){
+        auto info = r_onvif::interrogate("127.0.0.1", camera.port(), "http", "/onvif/device_service", username, password);
+        if(info.profile.token != "main")
+            R_THROW(("Unexpected profile selected."));
+    };
+
+    auto start = steady_clock::now();
+    for(size_t i = 0; i < N_CAMERAS; ++i)
+        interrogate_one(i);
+    auto sequential = duration_cast<milliseconds>(steady_clock::now() - start);
+
+    start = steady_clock::now();
+    r_parallel_for(N_CAMERAS, 8, interrogate_one);
+    auto parallel = duration_cast<milliseconds>(steady_clock::now() - start);
+
+    printf("interrogated %zu cameras: sequential=%lldms, parallel(8)=%lldms\n",
+           N_CAMERAS, (long long)sequential.count(), (long long)parallel.count());
+}
+
+// How WS-Discovery copes with a subnet full of cameras: a local responder answers the probe for 400
+// devices, twice each (as WS-Discovery devices are allowed to), in bursts of 100.
+REGISTER_BENCH(ws_discovery_burst)
+{
+    const size_t N_DEVICES = 400;
+    const size_t BURST_SIZE = 100;
+
+    r_raw_socket::socket_startup();
+
+    r_udp_socket responder;
+    r_socket_address responder_addr(RESPONDER_PORT, "127.0.0.1");
+    if(::bind(responder.fd(), responder_addr.get_sock_addr(), responder_addr.sock_addr_size()) != 0)
+        R_THROW(("Unable to bind the WS-Discovery responder."));
+
+    auto responder_th = thread([&](){
+        vector<uint8_t> buffer(8192);
+
+        while(true)
+        {
+            r_socket_address from(0);
+            auto len = responder.recvfrom(buffer.data(), buffer.size(), from);
+            if(len <= 0)
+                continue;
+
+            string request((char*)buffer.data(), len);
+            if(request.find("Probe") == string::npos)
+                break;
+
+            size_t sent = 0;
+            for(size_t repeat = 0; repeat < 2; ++repeat)
+            {
+                for(size_t device = 0; device < N_DEVICES; ++device)
+                {
+                    auto reply = _probe_match_message(device);
+                    responder.sendto((const uint8_t*)reply.c_str(), reply.length(), from);
+
+                    if(++sent % BURST_SIZE == 0)
+                        this_thread::sleep_for(milliseconds(2));
+                }
+            }
+        }
+    });
+
+    r_ws_discovery_stats stats;
+    auto discovered = ws_discovery_probe(
+        {"127.0.0.1"},
+        "<d:Probe xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"/>",
+        "127.0.0.1",
+        RESPONDER_PORT,
+        milliseconds(1500),
+        stats
+    );
+
+    r_udp_sender quit("127.0.0.1", RESPONDER_PORT);
+    string quit_msg = "quit";
+    quit.send((void*)quit_msg.c_str(), quit_msg.length());
+    responder_th.join();
+
+    printf("%zu devices, %zu datagrams, %zu duplicates, %zu receive calls in %lldms (1500ms timeout)\n",
+           discovered.size(), stats.datagrams, stats.duplicates, stats.receive_calls, (long long)stats.duration.count());
+}
@@ -4,16 +4,22 @@
 
 #include "r_utils/r_nullable.h"
 #include "r_utils/r_macro.h"
+#include "r_onvif/r_ws_discovery.h"
 #include <array>
 #include <vector>
 #include <stdbool.h>
 #include <functional>
+#include <chrono>
 #include <pugixml.hpp>
 
 namespace r_onvif
 {
 
-R_API std::vector<std::string> discover(const std::string& uuid);
+// Each ONVIF request (connect, send and receive) gives up after this long.
+constexpr std::chrono::milliseconds ONVIF_DEFAULT_TIMEOUT = std::chrono::seconds(30);
+
+// Returns the raw ProbeMatches messages from every device that answered (once per device).
+R_API std::vector<std::string> discover(const std::string& uuid, std::chrono::milliseconds timeout = WS_DISCOVERY_DEFAULT_TIMEOUT);
 
 struct discovered_info
 {
@@ -56,7 +62,9 @@ enum class auth_mode
 class r_onvif_cam
 {
 public:
-    R_API r_onvif_cam(const std::string& host, int port, const std::string& protocol, const std::string& uri, const r_utils::r_nullable<std::string>& username, const r_utils::r_nullable<std::string>& password);
+    R_API r_onvif_cam(const std::string& host, int port, const std::string& protocol, const std::string& uri, const r_utils::r_nullable<std::string>& username, const r_utils::r_nullable<std::string>& password, std::chrono::milliseconds timeout = ONVIF_DEFAULT_TIMEOUT);
+
+    R_API void set_timeout(std::chrono::milliseconds timeout) { _timeout = timeout; }
 
     R_API time_t get_camera_system_date_and_time();
 
@@ -89,8 +97,29 @@ private:
     int _time_offset_seconds;
     mutable soap_version _soap_ver;
     mutable auth_mode _auth_mode;
+    std::chrono::milliseconds _timeout;
+};
+
+struct onvif_stream_info
+{
+    std::string rtsp_url;
+    onvif_profile_info profile;
 };
 
+// Does everything needed to find a camera's main stream: reads the camera clock (for the auth
+// header), its capabilities, media service and profiles, and returns the stream uri of the highest
+// resolution profile. Each request only gets what remains of timeout, so the whole interrogation
+// is bounded by it.
+R_API onvif_stream_info interrogate(
+    const std::string& host,
+    int port,
+    const std::string& protocol,
+    const std::string& uri,
+    const r_utils::r_nullable<std::string>& username,
+    const r_utils::r_nullable<std::string>& password,
+    std::chrono::milliseconds timeout = ONVIF_DEFAULT_TIMEOUT
+);
+
 }
 
 #endif
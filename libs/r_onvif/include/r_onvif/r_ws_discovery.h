@@ -0,0 +1,54 @@
+#ifndef __r_onvif_r_ws_discovery_h
+#define __r_onvif_r_ws_discovery_h
+
+#include "r_utils/r_macro.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+
+namespace r_onvif
+{
+
+const std::string WS_DISCOVERY_MULTICAST_ADDRESS = "239.255.255.250";
+constexpr int WS_DISCOVERY_PORT = 3702;
+constexpr std::chrono::milliseconds WS_DISCOVERY_DEFAULT_TIMEOUT = std::chrono::seconds(5);
+
+struct r_ws_discovery_stats
+{
+    size_t interfaces {0};
+    size_t datagrams {0};
+    size_t duplicates {0};
+    size_t truncated {0};
+    size_t receive_calls {0};
+    std::chrono::milliseconds duration {0};
+};
+
+struct r_probe_match
+{
+    // EndpointReference Address of the first ProbeMatch, identifies the device across interfaces.
+    std::string address;
+    std::vector<std::string> xaddrs;
+    std::string scopes;
+};
+
+// Pulls the interesting fields out of a ProbeMatches message. Missing fields are left empty, throws
+// if the message isn't even well formed enough to tokenize.
+R_API r_probe_match parse_probe_match(const std::string& message);
+
+// Sends probe_message to destination_ip:destination_port from a socket on each of interface_ips (all
+// at once) and collects every reply that arrives within timeout. Replies are deduplicated by their
+// endpoint reference address, so a device seen on two interfaces (or answering twice) is returned
+// once. On Linux the sockets are serviced by epoll and drained with recvmmsg().
+R_API std::vector<std::string> ws_discovery_probe(
+    const std::vector<std::string>& interface_ips,
+    const std::string& probe_message,
+    const std::string& destination_ip,
+    int destination_port,
+    std::chrono::milliseconds timeout,
+    r_ws_discovery_stats& stats
+);
+
+}
+
+#endif
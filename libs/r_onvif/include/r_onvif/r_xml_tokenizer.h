@@ -0,0 +1,65 @@
+#ifndef __r_onvif_r_xml_tokenizer_h
+#define __r_onvif_r_xml_tokenizer_h
+
+#include "r_utils/r_macro.h"
+#include <string>
+#include <string_view>
+
+namespace r_onvif
+{
+
+enum class r_xml_token_type
+{
+    start_element,
+    end_element,
+    text
+};
+
+struct r_xml_token
+{
+    r_xml_token_type type {r_xml_token_type::text};
+
+    // Qualified name (e.g. "tt:Uri") and the same name with any prefix removed ("Uri").
+    std::string_view name;
+    std::string_view local_name;
+
+    // Raw attribute text of a start element, use r_xml_tokenizer::attribute() to pick one out.
+    std::string_view attributes;
+
+    // Raw (still escaped) character data of a text token. Whitespace only text is skipped.
+    std::string_view text;
+};
+
+// r_xml_tokenizer is a minimal pull tokenizer for the small SOAP responses we get back from ONVIF
+// cameras. It never allocates: every token is a view into the document, which must outlive the
+// tokenizer. It does not build a tree, resolve namespaces or validate anything. Processing
+// instructions, comments and DOCTYPEs are skipped, CDATA sections come back as text and a self
+// closing element comes back as a start_element immediately followed by its end_element.
+//
+// next() returns false at the end of the document and throws if the markup is truncated.
+
+class r_xml_tokenizer final
+{
+public:
+    R_API r_xml_tokenizer(std::string_view doc);
+
+    R_API bool next(r_xml_token& token);
+
+    // Returns the (still escaped) value of the attribute whose local name is name, or an empty view.
+    R_API static std::string_view attribute(std::string_view attributes, std::string_view name);
+
+private:
+    std::string_view _doc;
+    size_t _pos;
+    bool _pending_end;
+    std::string_view _pending_name;
+};
+
+R_API std::string_view xml_local_name(std::string_view name);
+
+// Replaces the five predefined entities and numeric character references.
+R_API std::string xml_unescape(std::string_view text);
+
+}
+
+#endif
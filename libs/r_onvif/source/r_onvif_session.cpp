@@ -5,6 +5,8 @@
 #include <thread>
 #include <sstream>
 #include <map>
+#include <algorithm>
+#include <chrono>
 #include "r_http/r_client_request.h"
 #include "r_http/r_methods.h"
 #include "r_utils/r_sha1.h"
@@ -17,6 +19,8 @@
 #include <math.h>
 #include <sys/stat.h>
 #include "r_onvif/r_onvif_session.h"
+#include "r_onvif/r_xml_tokenizer.h"
+#include "r_onvif/r_ws_discovery.h"
 #include "r_utils/r_socket.h"
 #include "r_utils/r_ssl_socket.h"
 #include "r_utils/r_string_utils.h"
@@ -62,6 +66,7 @@ using namespace r_utils::r_std_utils;
 using namespace std;
 
 static const int MAX_REDIRECTS = 5;
+static const uint64_t DEFAULT_CONNECT_TIMEOUT_MILLIS = 5000;
 
 static pair<int, string> _http_interact(
     string host,
@@ -70,7 +75,8 @@ static pair<int, string> _http_interact(
     string uri,
     string body,
     soap_version soap_ver = soap_version::unknown,
-    const string& soap_action = ""
+    const string& soap_action = "",
+    uint64_t timeout_millis = (uint64_t)ONVIF_DEFAULT_TIMEOUT.count()
 )
 {
     int redirect_count = 0;
@@ -83,10 +89,21 @@ retry:
 
     std::unique_ptr<r_utils::r_socket_base> sock;
 
+    // Connecting never waits longer than it always has, but a short timeout cuts it short too.
+    auto connect_timeout_millis = std::min<uint64_t>(timeout_millis, DEFAULT_CONNECT_TIMEOUT_MILLIS);
+
     if (port == 443)
-        sock = std::make_unique<r_utils::r_ssl_socket>();
+    {
+        auto ssl_sock = std::make_unique<r_utils::r_ssl_socket>();
+        ssl_sock->set_io_timeout(connect_timeout_millis);
+        sock = std::move(ssl_sock);
+    }
     else
-        sock = std::make_unique<r_utils::r_socket>();
+    {
+        auto plain_sock = std::make_unique<r_utils::r_socket>();
+        plain_sock->set_io_timeout(connect_timeout_millis);
+        sock = std::move(plain_sock);
+    }
 
     sock->connect(host, port);
 
@@ -118,10 +135,10 @@ retry:
     // User-Agent - some stacks behave differently with empty UA
     request.add_header("User-Agent", "ONVIF-Client/1.0");
 
-    request.write_request(*sock, 30000);
+    request.write_request(*sock, timeout_millis);
 
     r_http::r_client_response response;
-    response.read_response(*sock, 30000);
+    response.read_response(*sock, timeout_millis);
 
     //sock->close();
 
@@ -169,151 +186,160 @@ retry:
     return make_pair(response.get_status(), maybe_body.value());
 }
 
+// Called from the parallel interrogation threads, so it must not touch TZ (setenv() + tzset() races
+// with every other thread converting times).
 static time_t _portable_timegm(struct tm* t)
 {
 #ifdef IS_WINDOWS
-    // Windows implementation
-    return _mkgmtime(t); // Windows has _mkgmtime for UTC time
-#elif defined(IS_MACOS)
-    // macOS has timegm
-    return timegm(t);
+    return _mkgmtime(t);
 #else
-    // Linux/POSIX implementation
-    char* tz = getenv("TZ");
-    setenv("TZ", "UTC", 1);
-    tzset();
-    time_t result = mktime(t);
-    if (tz)
-        setenv("TZ", tz, 1);
-    else unsetenv("TZ");
-    tzset();
-    return result;
+    return timegm(t);
 #endif
 }
 
-// Forward declarations for namespace-agnostic XPath helpers (defined later)
-static string _xpath_local(const string& local_name, const string& ns_uri = "");
-static pugi::xpath_node _select_node_local(const pugi::xml_node& parent, const string& local_name, const string& ns_uri = "");
-static pugi::xpath_node _select_node_local_abs(const pugi::xml_document& doc, const string& local_name, const string& ns_uri = "");
+// Text of the first element named name (by local name) that is inside an element named ancestor.
+static r_nullable<string> _first_text_within(const string& xml, string_view ancestor, string_view name)
+{
+    r_xml_tokenizer tokenizer(xml);
+    r_xml_token token;
+    int ancestor_depth = 0;
+    bool in_name = false;
+
+    while(tokenizer.next(token))
+    {
+        if(token.type == r_xml_token_type::start_element)
+        {
+            if(token.local_name == ancestor)
+                ++ancestor_depth;
+            else if(ancestor_depth > 0 && token.local_name == name)
+                in_name = true;
+        }
+        else if(token.type == r_xml_token_type::end_element)
+        {
+            if(in_name && token.local_name == name)
+                return r_nullable<string>(string());
+            if(token.local_name == ancestor)
+                --ancestor_depth;
+        }
+        else if(in_name)
+            return r_nullable<string>(xml_unescape(token.text));
+    }
+
+    return r_nullable<string>();
+}
+
+struct _onvif_date_time_fields
+{
+    bool present {false};
+    bool in_date {false};
+    bool in_time {false};
+    // Year, Month, Day, Hour, Minute, Second
+    int values[6] {0, 0, 0, 0, 0, 0};
+    bool found[6] {false, false, false, false, false, false};
 
-// Namespace constant - defined here, used throughout
-static const char* NS_SCHEMA = "http://www.onvif.org/ver10/schema";
+    bool has_date() const { return found[0] && found[1] && found[2]; }
+    bool has_time() const { return found[3] && found[4] && found[5]; }
+};
 
 static r_nullable<time_t> _parse_onvif_date_time(const std::string& xmlResponse)
 {
     r_nullable<time_t> response;
 
-    pugi::xml_document doc;
-    doc.load_string(xmlResponse.c_str());
-
-    // Check for DaylightSavings using namespace-agnostic XPath
     bool daylightSavings = false;
-    pugi::xpath_node dstNode = _select_node_local_abs(doc, "DaylightSavings", NS_SCHEMA);
-    if (dstNode)
-    {
-        std::string dstValue = dstNode.node().child_value();
-        daylightSavings = (dstValue == "true" || dstValue == "1");
-    }
-
-    // Try to get timezone information
     std::string timezone;
-    pugi::xpath_node tzNode = _select_node_local_abs(doc, "TZ", NS_SCHEMA);
-    if (tzNode)
-    {
-        timezone = tzNode.node().child_value();
-    }
+    _onvif_date_time_fields utc, local;
 
-    // First try to get UTCDateTime
-    struct tm timeinfo = {};
-    bool useUtc = false;
-
-    pugi::xpath_node utcNode = _select_node_local_abs(doc, "UTCDateTime", NS_SCHEMA);
-    if (utcNode)
+    try
     {
-        pugi::xml_node utcElement = utcNode.node();
+        r_xml_tokenizer tokenizer(xmlResponse);
+        r_xml_token token;
+        _onvif_date_time_fields* current = nullptr;
+        string_view leaf;
+        bool seen_dst = false, seen_tz = false;
 
-        // Get year, month, day
-        pugi::xpath_node dateNode = _select_node_local(utcElement, "Date", NS_SCHEMA);
-        if (dateNode)
+        while(tokenizer.next(token))
         {
-            pugi::xml_node dateElement = dateNode.node();
-
-            pugi::xpath_node yearNode = _select_node_local(dateElement, "Year", NS_SCHEMA);
-            pugi::xpath_node monthNode = _select_node_local(dateElement, "Month", NS_SCHEMA);
-            pugi::xpath_node dayNode = _select_node_local(dateElement, "Day", NS_SCHEMA);
-
-            if (yearNode && monthNode && dayNode)
+            if(token.type == r_xml_token_type::start_element)
             {
-                timeinfo.tm_year = std::stoi(yearNode.node().child_value()) - 1900;
-                timeinfo.tm_mon = std::stoi(monthNode.node().child_value()) - 1;
-                timeinfo.tm_mday = std::stoi(dayNode.node().child_value());
+                leaf = token.local_name;
+
+                if(leaf == "UTCDateTime" && !utc.present)
+                    current = &utc;
+                else if(leaf == "LocalDateTime" && !local.present)
+                    current = &local;
+                else if(current && leaf == "Date")
+                    current->in_date = true;
+                else if(current && leaf == "Time")
+                    current->in_time = true;
+
+                if(current)
+                    current->present = true;
             }
-        }
-
-        // Get hour, minute, second
-        pugi::xpath_node timeNode = _select_node_local(utcElement, "Time", NS_SCHEMA);
-        if (timeNode)
-        {
-            pugi::xml_node timeElement = timeNode.node();
-
-            pugi::xpath_node hourNode = _select_node_local(timeElement, "Hour", NS_SCHEMA);
-            pugi::xpath_node minuteNode = _select_node_local(timeElement, "Minute", NS_SCHEMA);
-            pugi::xpath_node secondNode = _select_node_local(timeElement, "Second", NS_SCHEMA);
-
-            if (hourNode && minuteNode && secondNode)
+            else if(token.type == r_xml_token_type::end_element)
             {
-                timeinfo.tm_hour = std::stoi(hourNode.node().child_value());
-                timeinfo.tm_min = std::stoi(minuteNode.node().child_value());
-                timeinfo.tm_sec = std::stoi(secondNode.node().child_value());
+                if(current)
+                {
+                    if(token.local_name == "UTCDateTime" || token.local_name == "LocalDateTime")
+                        current = nullptr;
+                    else if(token.local_name == "Date")
+                        current->in_date = false;
+                    else if(token.local_name == "Time")
+                        current->in_time = false;
+                }
+                leaf = string_view();
             }
-        }
-
-        useUtc = true;
-    }
-
-    // If no UTCDateTime, try LocalDateTime
-    if (!useUtc)
-    {
-        pugi::xpath_node localNode = _select_node_local_abs(doc, "LocalDateTime", NS_SCHEMA);
-        if (localNode)
-        {
-            pugi::xml_node localElement = localNode.node();
-
-            // Get year, month, day
-            pugi::xpath_node dateNode = _select_node_local(localElement, "Date", NS_SCHEMA);
-            if (dateNode)
+            else
             {
-                pugi::xml_node dateElement = dateNode.node();
-
-                pugi::xpath_node yearNode = _select_node_local(dateElement, "Year", NS_SCHEMA);
-                pugi::xpath_node monthNode = _select_node_local(dateElement, "Month", NS_SCHEMA);
-                pugi::xpath_node dayNode = _select_node_local(dateElement, "Day", NS_SCHEMA);
-
-                if (yearNode && monthNode && dayNode)
+                if(leaf == "DaylightSavings" && !seen_dst)
+                {
+                    daylightSavings = (token.text == "true" || token.text == "1");
+                    seen_dst = true;
+                }
+                else if(leaf == "TZ" && !seen_tz)
                 {
-                    timeinfo.tm_year = std::stoi(yearNode.node().child_value()) - 1900;
-                    timeinfo.tm_mon = std::stoi(monthNode.node().child_value()) - 1;
-                    timeinfo.tm_mday = std::stoi(dayNode.node().child_value());
+                    timezone = xml_unescape(token.text);
+                    seen_tz = true;
+                }
+                else if(current)
+                {
+                    static const char* names[] = {"Year", "Month", "Day", "Hour", "Minute", "Second"};
+                    int first = (current->in_date)?0:(current->in_time)?3:-1;
+                    for(int i = first; first >= 0 && i < first + 3; ++i)
+                    {
+                        if(leaf == names[i] && !current->found[i])
+                        {
+                            current->values[i] = std::stoi(string(token.text));
+                            current->found[i] = true;
+                        }
+                    }
                 }
             }
+        }
+    }
+    catch(const std::exception& e)
+    {
+        // Be as forgiving of garbage here as we have always been, we just use whatever we found.
+        R_LOG_ERROR("Unable to parse ONVIF date and time: %s", e.what());
+    }
 
-            // Get hour, minute, second
-            pugi::xpath_node timeNode = _select_node_local(localElement, "Time", NS_SCHEMA);
-            if (timeNode)
-            {
-                pugi::xml_node timeElement = timeNode.node();
+    struct tm timeinfo = {};
+    bool useUtc = utc.present;
+    auto& fields = (useUtc)?utc:local;
 
-                pugi::xpath_node hourNode = _select_node_local(timeElement, "Hour", NS_SCHEMA);
-                pugi::xpath_node minuteNode = _select_node_local(timeElement, "Minute", NS_SCHEMA);
-                pugi::xpath_node secondNode = _select_node_local(timeElement, "Second", NS_SCHEMA);
+    if(fields.present)
+    {
+        if(fields.has_date())
+        {
+            timeinfo.tm_year = fields.values[0] - 1900;
+            timeinfo.tm_mon = fields.values[1] - 1;
+            timeinfo.tm_mday = fields.values[2];
+        }
 
-                if (hourNode && minuteNode && secondNode)
-                {
-                    timeinfo.tm_hour = std::stoi(hourNode.node().child_value());
-                    timeinfo.tm_min = std::stoi(minuteNode.node().child_value());
-                    timeinfo.tm_sec = std::stoi(secondNode.node().child_value());
-                }
-            }
+        if(fields.has_time())
+        {
+            timeinfo.tm_hour = fields.values[3];
+            timeinfo.tm_min = fields.values[4];
+            timeinfo.tm_sec = fields.values[5];
         }
     }
 
@@ -380,50 +406,6 @@ static r_nullable<time_t> _parse_onvif_date_time(const std::string& xmlResponse)
     return response;
 }
 
-// Build namespace-agnostic XPath query using local-name() and namespace-uri()
-// Example: _xpath_local("Media", "http://www.onvif.org/ver10/device/wsdl")
-//   returns: "*[local-name()='Media' and namespace-uri()='http://www.onvif.org/ver10/device/wsdl']"
-static string _xpath_local(const string& local_name, const string& ns_uri)
-{
-    if (ns_uri.empty())
-        return "*[local-name()='" + local_name + "']";
-    else
-        return "*[local-name()='" + local_name + "' and namespace-uri()='" + ns_uri + "']";
-}
-
-// Common ONVIF namespace URIs (NS_SCHEMA defined earlier for use by _parse_onvif_date_time)
-static const char* NS_DEVICE = "http://www.onvif.org/ver10/device/wsdl";
-static const char* NS_MEDIA = "http://www.onvif.org/ver10/media/wsdl";
-static const char* NS_SOAP12 = "http://www.w3.org/2003/05/soap-envelope";
-static const char* NS_SOAP11 = "http://schemas.xmlsoap.org/soap/envelope/";
-
-// Helper to select node with namespace-agnostic XPath, with fallback
-static pugi::xpath_node _select_node_local(const pugi::xml_node& parent, const string& local_name, const string& ns_uri)
-{
-    string xpath = ".//" + _xpath_local(local_name, ns_uri);
-    pugi::xpath_node node = parent.select_node(xpath.c_str());
-    if (!node && !ns_uri.empty())
-    {
-        // Fallback without namespace constraint
-        xpath = ".//" + _xpath_local(local_name, "");
-        node = parent.select_node(xpath.c_str());
-    }
-    return node;
-}
-
-static pugi::xpath_node _select_node_local_abs(const pugi::xml_document& doc, const string& local_name, const string& ns_uri)
-{
-    string xpath = "//" + _xpath_local(local_name, ns_uri);
-    pugi::xpath_node node = doc.select_node(xpath.c_str());
-    if (!node && !ns_uri.empty())
-    {
-        // Fallback without namespace constraint
-        xpath = "//" + _xpath_local(local_name, "");
-        node = doc.select_node(xpath.c_str());
-    }
-    return node;
-}
-
 static r_nullable<string> _get_scope_field(const string& scope, const string& field_name)
 {
     r_nullable<string> output;
@@ -450,179 +432,6 @@ static bool _is_link_local_address(const string& host)
     return host.find("169.254.") == 0;
 }
 
-// Helper function to discover ONVIF devices on a specific interface
-static vector<string> _discover_on_interface(const string& interface_ip, const string& broadcast_message)
-{
-    vector<string> discovered;
-
-#ifdef IS_WINDOWS
-    SOCKET sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock == INVALID_SOCKET)
-        return discovered;
-
-    // Enable address reuse
-    BOOL reuse = TRUE;
-    ::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
-
-    // Set receive timeout
-    DWORD recvTimeout = 5000; // 5 seconds
-    ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&recvTimeout, sizeof(recvTimeout));
-
-    // Convert interface IP string to IN_ADDR
-    IN_ADDR iface_addr;
-    inet_pton(AF_INET, interface_ip.c_str(), &iface_addr);
-
-    // Bind to ANY address on a dynamic port
-    struct sockaddr_in localAddr;
-    memset(&localAddr, 0, sizeof(localAddr));
-    localAddr.sin_family = AF_INET;
-    localAddr.sin_port = htons(0);
-    localAddr.sin_addr.s_addr = INADDR_ANY;
-
-    if (::bind(sock, (struct sockaddr*)&localAddr, sizeof(localAddr)) != 0) {
-        closesocket(sock);
-        return discovered;
-    }
-
-    // Set multicast interface
-    ::setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&iface_addr, sizeof(iface_addr));
-
-    // Join multicast group on this interface
-    struct ip_mreq mreq;
-    mreq.imr_multiaddr.s_addr = inet_addr("239.255.255.250");
-    mreq.imr_interface = iface_addr;
-    ::setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*)&mreq, sizeof(mreq));
-
-    // Set multicast TTL
-    DWORD ttl = 1;
-    ::setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
-
-    // Multicast destination
-    struct sockaddr_in multicastAddr;
-    memset(&multicastAddr, 0, sizeof(multicastAddr));
-    multicastAddr.sin_family = AF_INET;
-    multicastAddr.sin_port = htons(3702);
-    multicastAddr.sin_addr.s_addr = inet_addr("239.255.255.250");
-
-    // Send discovery message
-    int bytesSent = ::sendto(sock, broadcast_message.c_str(), (int)broadcast_message.length(), 0,
-                            (struct sockaddr*)&multicastAddr, sizeof(multicastAddr));
-
-    if (bytesSent < 0) {
-        closesocket(sock);
-        return discovered;
-    }
-
-    // Receive responses
-    char buf[8192];
-    int timeoutCounts = 0;
-    while (timeoutCounts < 2) {
-        struct sockaddr_in fromAddr;
-        int fromAddrLen = sizeof(fromAddr);
-        int len = ::recvfrom(sock, buf, sizeof(buf) - 1, 0, (struct sockaddr*)&fromAddr, &fromAddrLen);
-
-        if (len < 0) {
-            int error = WSAGetLastError();
-            if (error == WSAETIMEDOUT)
-                timeoutCounts++;
-            else
-                break;
-        }
-        else if (len > 0) {
-            buf[len] = '\0';
-            discovered.push_back(string(buf, len));
-        }
-    }
-
-    closesocket(sock);
-#endif
-
-#if defined(IS_LINUX) || defined(IS_MACOS)
-    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock < 0)
-        return discovered;
-
-    // Enable address reuse
-    int reuse = 1;
-    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-
-    // Set receive timeout
-    struct timeval recvTimeout;
-    recvTimeout.tv_sec = 5;
-    recvTimeout.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &recvTimeout, sizeof(recvTimeout));
-
-    // Convert interface IP string to in_addr
-    struct in_addr iface_addr;
-    inet_pton(AF_INET, interface_ip.c_str(), &iface_addr);
-
-    // Bind to ANY address on a dynamic port
-    struct sockaddr_in localAddr;
-    memset(&localAddr, 0, sizeof(localAddr));
-    localAddr.sin_family = AF_INET;
-    localAddr.sin_port = htons(0);
-    localAddr.sin_addr.s_addr = INADDR_ANY;
-
-    if (::bind(sock, (struct sockaddr*)&localAddr, sizeof(localAddr)) < 0) {
-        close(sock);
-        return discovered;
-    }
-
-    // Set multicast interface
-    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &iface_addr, sizeof(iface_addr));
-
-    // Join multicast group on this interface
-    struct ip_mreq mreq;
-    mreq.imr_multiaddr.s_addr = inet_addr("239.255.255.250");
-    mreq.imr_interface = iface_addr;
-    setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
-
-    // Set multicast TTL
-    int ttl = 1;
-    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
-
-    // Multicast destination
-    struct sockaddr_in multicastAddr;
-    memset(&multicastAddr, 0, sizeof(multicastAddr));
-    multicastAddr.sin_family = AF_INET;
-    multicastAddr.sin_port = htons(3702);
-    multicastAddr.sin_addr.s_addr = inet_addr("239.255.255.250");
-
-    // Send discovery message
-    int bytesSent = sendto(sock, broadcast_message.c_str(), broadcast_message.length(), 0,
-                          (struct sockaddr*)&multicastAddr, sizeof(multicastAddr));
-
-    if (bytesSent < 0) {
-        close(sock);
-        return discovered;
-    }
-
-    // Receive responses
-    char buf[8192];
-    int timeoutCounts = 0;
-    while (timeoutCounts < 2) {
-        struct sockaddr_in fromAddr;
-        socklen_t fromAddrLen = sizeof(fromAddr);
-        int len = recvfrom(sock, buf, sizeof(buf) - 1, 0, (struct sockaddr*)&fromAddr, &fromAddrLen);
-
-        if (len < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-                timeoutCounts++;
-            else
-                break;
-        }
-        else if (len > 0) {
-            buf[len] = '\0';
-            discovered.push_back(string(buf, len));
-        }
-    }
-
-    close(sock);
-#endif
-
-    return discovered;
-}
-
 // New function that supports both SHA-256 and SHA-1
 // use_sha256: true = use SHA-256, false = use SHA-1 (default for compatibility)
 static void _add_username_digest_header_with_algorithm(
@@ -865,26 +674,25 @@ static void _add_username_text_header(
     createdElem.text().set(time_buffer);
 }
 
-vector<string> r_onvif::discover(const string& uuid)
+vector<string> r_onvif::discover(const string& uuid, chrono::milliseconds timeout)
 {
     auto id = r_string_utils::format("urn:uuid:%s", uuid.c_str());
 
     string broadcast_message =
     "<SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:a=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\"><SOAP-ENV:Header><a:Action SOAP-ENV:mustUnderstand=\"1\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</a:Action><a:MessageID>" + id + "</a:MessageID><a:ReplyTo><a:Address>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</a:Address></a:ReplyTo><a:To SOAP-ENV:mustUnderstand=\"1\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</a:To></SOAP-ENV:Header><SOAP-ENV:Body><p:Probe xmlns:p=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"><d:Types xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\" xmlns:dp0=\"http://www.onvif.org/ver10/network/wsdl\">dp0:NetworkVideoTransmitter</d:Types></p:Probe></SOAP-ENV:Body></SOAP-ENV:Envelope>";
 
-    vector<string> all_discovered;
+    // Probe from every interface (UP, not loopback, multicast capable, with IPv4) at once.
+    vector<string> interface_ips;
+    for (const auto& adapter : r_utils::r_networking::r_get_adapters())
+        interface_ips.push_back(adapter.ipv4_addr);
 
-    // Get all available network adapters (UP, not loopback, multicast capable, with IPv4)
-    auto adapters = r_utils::r_networking::r_get_adapters();
+    r_ws_discovery_stats stats;
+    auto discovered = ws_discovery_probe(interface_ips, broadcast_message, WS_DISCOVERY_MULTICAST_ADDRESS, WS_DISCOVERY_PORT, timeout, stats);
 
-    // Send discovery probe on each interface and collect responses
-    for (const auto& adapter : adapters)
-    {
-        auto responses = _discover_on_interface(adapter.ipv4_addr, broadcast_message);
-        all_discovered.insert(all_discovered.end(), responses.begin(), responses.end());
-    }
+    R_LOG_INFO("WS-Discovery: %zu devices (%zu datagrams, %zu duplicates, %zu truncated) on %zu interfaces in %lldms",
+               discovered.size(), stats.datagrams, stats.duplicates, stats.truncated, stats.interfaces, (long long)stats.duration.count());
 
-    return all_discovered;
+    return discovered;
 }
 
 std::vector<discovered_info> r_onvif::filter_discovered(const std::vector<std::string>& discovered)
@@ -895,61 +703,12 @@ std::vector<discovered_info> r_onvif::filter_discovered(const std::vector<std::s
     {
         try
         {
-            pugi::xml_document doc;
-            pugi::xml_parse_result result = doc.load_string(d.c_str());
-            if (!result)
-                throw std::runtime_error("Failed to parse XML: " + std::string(result.description()));
-            
-            // Define namespaces
-            const char* d_ns_uri = "http://schemas.xmlsoap.org/ws/2005/04/discovery";
-            const char* s_ns_uri = "http://www.w3.org/2003/05/soap-envelope";
-            const char* a_ns_uri = "http://schemas.xmlsoap.org/ws/2004/08/addressing";
-            
-            // Use XPath with namespace to find XAddrs nodes
-            std::string xpath_query = "//*[local-name()='XAddrs' and namespace-uri()='" + std::string(d_ns_uri) + "']";
-            pugi::xpath_query query(xpath_query.c_str());
-            pugi::xpath_node_set nodes = query.evaluate_node_set(doc);
-            
-            // Use XPath to find Address node
-            std::string addr_xpath = "//*[local-name()='Body' and namespace-uri()='" + std::string(s_ns_uri) + "']"
-                                    "/*[local-name()='ProbeMatches' and namespace-uri()='" + std::string(d_ns_uri) + "']"
-                                    "/*[local-name()='ProbeMatch' and namespace-uri()='" + std::string(d_ns_uri) + "']"
-                                    "/*[local-name()='EndpointReference' and namespace-uri()='" + std::string(a_ns_uri) + "']"
-                                    "/*[local-name()='Address' and namespace-uri()='" + std::string(a_ns_uri) + "']";
-            
-            pugi::xpath_query addr_query(addr_xpath.c_str());
-            pugi::xpath_node addr_node = addr_query.evaluate_node(doc);
-            
-            // Get the address value
-            std::string address = "";
-            if (addr_node)
-            {
-                address = addr_node.node().text().get();
-            }
-            
-            // Use XPath to find Scopes node
-            std::string scopes_xpath = "//*[local-name()='Body' and namespace-uri()='" + std::string(s_ns_uri) + "']"
-                                      "/*[local-name()='ProbeMatches' and namespace-uri()='" + std::string(d_ns_uri) + "']"
-                                      "/*[local-name()='ProbeMatch' and namespace-uri()='" + std::string(d_ns_uri) + "']"
-                                      "/*[local-name()='Scopes' and namespace-uri()='" + std::string(d_ns_uri) + "']";
-            
-            pugi::xpath_query scopes_query(scopes_xpath.c_str());
-            pugi::xpath_node scopes_node = scopes_query.evaluate_node(doc);
-            
-            // Get the scopes value
-            std::string scopes = "";
-            if (scopes_node)
-            {
-                scopes = scopes_node.node().text().get();
-            }
-            
-            std::vector<std::string> xaddrs_services;
-            for (pugi::xpath_node node : nodes)
-            {
-                std::string text = node.node().text().get();
-                std::vector<std::string> addresses = r_string_utils::split(text, " ");
-                xaddrs_services.insert(end(xaddrs_services), begin(addresses), end(addresses));
-            }
+            auto match = parse_probe_match(d);
+
+            auto& address = match.address;
+            auto& scopes = match.scopes;
+            auto& xaddrs_services = match.xaddrs;
+
             if (xaddrs_services.empty())
                 throw std::runtime_error("No ONVIF services found1.");
 
@@ -1063,7 +822,7 @@ std::vector<discovered_info> r_onvif::filter_discovered(const std::vector<std::s
     return filtered;
 }
 
-r_onvif::r_onvif_cam::r_onvif_cam(const std::string& host, int port, const std::string& protocol, const std::string& uri, const r_utils::r_nullable<std::string>& username, const r_utils::r_nullable<std::string>& password)
+r_onvif::r_onvif_cam::r_onvif_cam(const std::string& host, int port, const std::string& protocol, const std::string& uri, const r_utils::r_nullable<std::string>& username, const r_utils::r_nullable<std::string>& password, std::chrono::milliseconds timeout)
 {
     _service_host = host;
     _service_port = port;
@@ -1071,6 +830,7 @@ r_onvif::r_onvif_cam::r_onvif_cam(const std::string& host, int port, const std::
     _service_uri = uri;
     _soap_ver = soap_version::unknown;
     _auth_mode = auth_mode::unknown;
+    _timeout = timeout;
 
     auto now = chrono::system_clock::to_time_t(chrono::system_clock::now());
     auto camera_time = get_camera_system_date_and_time();
@@ -1200,7 +960,7 @@ pair<int, string> r_onvif::r_onvif_cam::_soap_request(
             string body = _build_soap_envelope(ver, auth, build_body, _username, _password, _time_offset_seconds);
 
             // Pass SOAP version and action to set appropriate headers
-            result = _http_interact(host, port, "POST", uri, body, ver, soap_action);
+            result = _http_interact(host, port, "POST", uri, body, ver, soap_action, (uint64_t)_timeout.count());
 
             // Check if successful
             if (result.first == 200)
@@ -1282,51 +1042,12 @@ r_onvif::onvif_capabilities r_onvif::r_onvif_cam::get_camera_capabilities()
 
 r_onvif::onvif_media_service r_onvif::r_onvif_cam::get_media_service(const r_onvif::onvif_capabilities& capabilities) const
 {
-    pugi::xml_document doc;
-    if (!doc.load_string(capabilities.c_str()))
-        throw std::runtime_error("Failed to parse capabilities XML");
-
-    // Use namespace-agnostic XPath: find Media element then XAddr within it
-    // Try multiple namespace combinations since cameras vary
-
-    pugi::xpath_node node;
-
-    // Try 1: Media in schema namespace (most common in GetCapabilitiesResponse)
-    string xpath = "//" + _xpath_local("Media", NS_SCHEMA) + "//" + _xpath_local("XAddr", NS_SCHEMA);
-    node = doc.select_node(xpath.c_str());
-
-    // Try 2: Media in device namespace
-    if (!node)
-    {
-        xpath = "//" + _xpath_local("Media", NS_DEVICE) + "//" + _xpath_local("XAddr", NS_SCHEMA);
-        node = doc.select_node(xpath.c_str());
-    }
-
-    // Try 3: Media in schema namespace, XAddr without namespace
-    if (!node)
-    {
-        xpath = "//" + _xpath_local("Media", NS_SCHEMA) + "//" + _xpath_local("XAddr");
-        node = doc.select_node(xpath.c_str());
-    }
-
-    // Try 4: Media in device namespace, XAddr without namespace
-    if (!node)
-    {
-        xpath = "//" + _xpath_local("Media", NS_DEVICE) + "//" + _xpath_local("XAddr");
-        node = doc.select_node(xpath.c_str());
-    }
-
-    // Try 5: No namespace constraints at all
-    if (!node)
-    {
-        xpath = "//" + _xpath_local("Media") + "//" + _xpath_local("XAddr");
-        node = doc.select_node(xpath.c_str());
-    }
+    auto xaddr = _first_text_within(capabilities, "Media", "XAddr");
 
-    if (!node)
+    if (xaddr.is_null())
         throw std::runtime_error("Media XAddr not found in capabilities");
 
-    return node.node().child_value();
+    return xaddr.value();
 }
 
 std::vector<r_onvif::onvif_profile_info> r_onvif::r_onvif_cam::get_profile_tokens(r_onvif::onvif_media_service media_service)
@@ -1349,101 +1070,71 @@ std::vector<r_onvif::onvif_profile_info> r_onvif::r_onvif_cam::get_profile_token
     vector<onvif_profile_info> profiles;
     try
     {
-        // Parse the response
-        pugi::xml_document response_doc;
-        pugi::xml_parse_result parse_result = response_doc.load_string(result.second.c_str());
-        if (!parse_result)
-            throw std::runtime_error("XML parsing failed: " + std::string(parse_result.description()));
-
-        // Use namespace-agnostic XPath to find Profiles elements
-        string profiles_xpath = "//" + _xpath_local("Profiles", NS_MEDIA);
-        pugi::xpath_node_set profileNodes = response_doc.select_nodes(profiles_xpath.c_str());
-
-        if (profileNodes.empty())
-        {
-            // Fallback without namespace constraint
-            profiles_xpath = "//" + _xpath_local("Profiles");
-            profileNodes = response_doc.select_nodes(profiles_xpath.c_str());
-        }
-
-        // Process each profile
-        for (const auto& profileNode : profileNodes)
+        r_xml_tokenizer tokenizer(result.second);
+        r_xml_token token;
+        string_view leaf;
+        bool in_profile = false, in_encoder = false, in_resolution = false;
+        bool seen_encoder = false, seen_resolution = false, seen_encoding = false, seen_width = false, seen_height = false;
+
+        // We want the first Encoding and Resolution of the first VideoEncoderConfiguration in each Profiles
+        // element (an AudioEncoderConfiguration has an Encoding too).
+        while(tokenizer.next(token))
         {
-            pugi::xml_node profileElement = profileNode.node();
-            onvif_profile_info profile;
+            if(token.type == r_xml_token_type::start_element)
+            {
+                leaf = token.local_name;
 
-            // Get profile token
-            profile.token = profileElement.attribute("token").value();
+                if(leaf == "Profiles")
+                {
+                    onvif_profile_info profile;
+                    profile.token = xml_unescape(r_xml_tokenizer::attribute(token.attributes, "token"));
 
-            // Default values in case we can't find the data
-            profile.encoding = "Unknown";
-            profile.width = 0;
-            profile.height = 0;
+                    // Default values in case we can't find the data
+                    profile.encoding = "Unknown";
+                    profile.width = 0;
+                    profile.height = 0;
 
-            // Get video encoder configuration using namespace-agnostic XPath
-            string vec_xpath = ".//" + _xpath_local("VideoEncoderConfiguration", NS_SCHEMA);
-            pugi::xpath_node videoEncoderConfigNode = profileElement.select_node(vec_xpath.c_str());
+                    profiles.push_back(profile);
 
-            if (!videoEncoderConfigNode)
+                    in_profile = true;
+                    in_encoder = in_resolution = false;
+                    seen_encoder = seen_resolution = seen_encoding = seen_width = seen_height = false;
+                }
+                else if(in_profile && !seen_encoder && leaf == "VideoEncoderConfiguration")
+                    in_encoder = seen_encoder = true;
+                else if(in_encoder && !seen_resolution && leaf == "Resolution")
+                    in_resolution = seen_resolution = true;
+            }
+            else if(token.type == r_xml_token_type::end_element)
             {
-                // Fallback without namespace
-                vec_xpath = ".//" + _xpath_local("VideoEncoderConfiguration");
-                videoEncoderConfigNode = profileElement.select_node(vec_xpath.c_str());
+                if(token.local_name == "Profiles")
+                    in_profile = in_encoder = in_resolution = false;
+                else if(token.local_name == "VideoEncoderConfiguration")
+                    in_encoder = in_resolution = false;
+                else if(token.local_name == "Resolution")
+                    in_resolution = false;
+                leaf = string_view();
             }
-
-            if (videoEncoderConfigNode)
+            else if(in_encoder)
             {
-                pugi::xml_node videoEncoderConfigElement = videoEncoderConfigNode.node();
+                auto& profile = profiles.back();
 
-                // Get encoding
-                string enc_xpath = ".//" + _xpath_local("Encoding", NS_SCHEMA);
-                pugi::xpath_node encodingNode = videoEncoderConfigElement.select_node(enc_xpath.c_str());
-                if (!encodingNode)
+                if(!in_resolution && !seen_encoding && leaf == "Encoding")
                 {
-                    enc_xpath = ".//" + _xpath_local("Encoding");
-                    encodingNode = videoEncoderConfigElement.select_node(enc_xpath.c_str());
+                    profile.encoding = xml_unescape(token.text);
+                    seen_encoding = true;
                 }
-                if (encodingNode)
-                    profile.encoding = encodingNode.node().child_value();
-
-                // Get resolution
-                string res_xpath = ".//" + _xpath_local("Resolution", NS_SCHEMA);
-                pugi::xpath_node resolutionNode = videoEncoderConfigElement.select_node(res_xpath.c_str());
-                if (!resolutionNode)
+                else if(in_resolution && !seen_width && leaf == "Width")
                 {
-                    res_xpath = ".//" + _xpath_local("Resolution");
-                    resolutionNode = videoEncoderConfigElement.select_node(res_xpath.c_str());
+                    profile.width = static_cast<uint16_t>(std::stoi(string(token.text)));
+                    seen_width = true;
                 }
-
-                if (resolutionNode)
+                else if(in_resolution && !seen_height && leaf == "Height")
                 {
-                    pugi::xml_node resolutionElement = resolutionNode.node();
-
-                    string w_xpath = ".//" + _xpath_local("Width", NS_SCHEMA);
-                    string h_xpath = ".//" + _xpath_local("Height", NS_SCHEMA);
-                    pugi::xpath_node widthNode = resolutionElement.select_node(w_xpath.c_str());
-                    pugi::xpath_node heightNode = resolutionElement.select_node(h_xpath.c_str());
-
-                    if (!widthNode)
-                    {
-                        w_xpath = ".//" + _xpath_local("Width");
-                        widthNode = resolutionElement.select_node(w_xpath.c_str());
-                    }
-                    if (!heightNode)
-                    {
-                        h_xpath = ".//" + _xpath_local("Height");
-                        heightNode = resolutionElement.select_node(h_xpath.c_str());
-                    }
-
-                    if (widthNode)
-                        profile.width = static_cast<uint16_t>(std::stoi(widthNode.node().child_value()));
-                    if (heightNode)
-                        profile.height = static_cast<uint16_t>(std::stoi(heightNode.node().child_value()));
+                    profile.height = static_cast<uint16_t>(std::stoi(string(token.text)));
+                    seen_height = true;
                 }
             }
-
-            // Add the profile to our list
-            profiles.push_back(profile);
         }
     }
     catch (const std::exception& exc)
@@ -1484,23 +1175,70 @@ string r_onvif::r_onvif_cam::get_stream_uri(onvif_media_service media_service, o
     if(result.first != 200)
         throw std::runtime_error("Failed to get stream uri");
 
-    // Use namespace-agnostic XPath
-    pugi::xml_document doc;
-    if (!doc.load_string(result.second.c_str()))
-        throw std::runtime_error("Failed to parse GetStreamUri response");
+    auto stream_uri = _first_text_within(result.second, "GetStreamUriResponse", "Uri");
+
+    if (stream_uri.is_null())
+        throw std::runtime_error("Uri not found in GetStreamUri response");
+
+    return stream_uri.value();
+}
 
-    string xpath = "//" + _xpath_local("GetStreamUriResponse", NS_MEDIA) + "//" + _xpath_local("Uri", NS_SCHEMA);
-    pugi::xpath_node node = doc.select_node(xpath.c_str());
+r_onvif::onvif_stream_info r_onvif::interrogate(
+    const std::string& host,
+    int port,
+    const std::string& protocol,
+    const std::string& uri,
+    const r_utils::r_nullable<std::string>& username,
+    const r_utils::r_nullable<std::string>& password,
+    std::chrono::milliseconds timeout
+)
+{
+    auto deadline = chrono::steady_clock::now() + timeout;
 
-    if (!node)
+    auto remaining = [&](){
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+        if(left.count() <= 0)
+            throw std::runtime_error("Timed out interrogating ONVIF camera at " + host);
+        return left;
+    };
+
+    r_onvif_cam cam(host, port, protocol, uri, username, password, remaining());
+
+    cam.set_timeout(remaining());
+    auto caps = cam.get_camera_capabilities();
+    auto oms = cam.get_media_service(caps);
+
+    cam.set_timeout(remaining());
+    auto profile_tokens = cam.get_profile_tokens(oms);
+
+    // Select the profile with the highest resolution (main stream, not sub-stream)
+    if(profile_tokens.empty())
+        throw std::runtime_error("No ONVIF profiles available for camera.");
+
+    size_t best_profile_idx = 0;
+    uint32_t best_resolution = 0;
+
+    for(size_t i = 0; i < profile_tokens.size(); ++i)
     {
-        // Fallback: try without namespace constraint
-        xpath = "//" + _xpath_local("GetStreamUriResponse") + "//" + _xpath_local("Uri");
-        node = doc.select_node(xpath.c_str());
+        uint32_t resolution = (uint32_t)profile_tokens[i].width * (uint32_t)profile_tokens[i].height;
+        if(resolution > best_resolution)
+        {
+            best_resolution = resolution;
+            best_profile_idx = i;
+        }
     }
 
-    if (!node)
-        throw std::runtime_error("Uri not found in GetStreamUri response");
+    R_LOG_INFO("Selected ONVIF profile %zu/%zu: %s (%dx%d)",
+               best_profile_idx + 1, profile_tokens.size(),
+               profile_tokens[best_profile_idx].encoding.c_str(),
+               profile_tokens[best_profile_idx].width,
+               profile_tokens[best_profile_idx].height);
+
+    onvif_stream_info info;
+    info.profile = profile_tokens[best_profile_idx];
+
+    cam.set_timeout(remaining());
+    info.rtsp_url = cam.get_stream_uri(oms, info.profile.token);
 
-    return node.node().child_value();
+    return info;
 }
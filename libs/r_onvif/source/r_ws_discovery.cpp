@@ -0,0 +1,387 @@
+#ifdef IS_WINDOWS
+#define _WINSOCK_DEPRECATED_NO_WARNINGS 1
+#endif
+
+#include "r_onvif/r_ws_discovery.h"
+#include "r_onvif/r_xml_tokenizer.h"
+#include "r_utils/r_exception.h"
+#include "r_utils/r_logger.h"
+#include <set>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#ifdef IS_WINDOWS
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+#endif
+
+#ifdef IS_LINUX
+    #include <sys/epoll.h>
+#endif
+
+using namespace r_onvif;
+using namespace r_utils;
+using namespace std;
+using namespace std::chrono;
+
+#ifdef IS_WINDOWS
+typedef SOCKET _sok_t;
+static const _sok_t _BAD_SOK = INVALID_SOCKET;
+static void _close_sok(_sok_t sok) { closesocket(sok); }
+#else
+typedef int _sok_t;
+static const _sok_t _BAD_SOK = -1;
+static void _close_sok(_sok_t sok) { ::close(sok); }
+#endif
+
+static const size_t MAX_DATAGRAM_SIZE = 8192;
+
+// Probe matches arrive in a burst right after the probe goes out, give the kernel room to hold it
+// while we drain.
+static const int DISCOVERY_RECV_BUF_SIZE = 1024 * 1024;
+
+#ifdef IS_LINUX
+static const unsigned int RECV_BATCH_SIZE = 64;
+#endif
+
+typedef function<void(const char* p, size_t len)> _datagram_cb;
+
+r_probe_match r_onvif::parse_probe_match(const string& message)
+{
+    r_probe_match match;
+
+    r_xml_tokenizer tokenizer(message);
+    r_xml_token token;
+
+    vector<string_view> path;
+    int probe_matches = 0;
+    bool in_first_match = false;
+
+    while(tokenizer.next(token))
+    {
+        if(token.type == r_xml_token_type::start_element)
+        {
+            path.push_back(token.local_name);
+
+            if(token.local_name == "ProbeMatch")
+                in_first_match = (++probe_matches == 1);
+        }
+        else if(token.type == r_xml_token_type::end_element)
+        {
+            if(!path.empty())
+                path.pop_back();
+
+            if(token.local_name == "ProbeMatch")
+                in_first_match = false;
+        }
+        else if(!path.empty())
+        {
+            auto leaf = path.back();
+
+            if(leaf == "XAddrs")
+            {
+                auto text = xml_unescape(token.text);
+                size_t pos = 0;
+                while(pos < text.size())
+                {
+                    auto end = text.find_first_of(" \t\r\n", pos);
+                    if(end == string::npos)
+                        end = text.size();
+                    if(end > pos)
+                        match.xaddrs.push_back(text.substr(pos, end - pos));
+                    pos = end + 1;
+                }
+            }
+            else if(in_first_match && leaf == "Address" && path.size() >= 2 && path[path.size() - 2] == "EndpointReference" && match.address.empty())
+                match.address = xml_unescape(token.text);
+            else if(in_first_match && leaf == "Scopes" && match.scopes.empty())
+                match.scopes = xml_unescape(token.text);
+        }
+    }
+
+    return match;
+}
+
+static _sok_t _open_probe_socket(const string& interface_ip)
+{
+    _sok_t sok = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(sok == _BAD_SOK)
+        return _BAD_SOK;
+
+    int reuse = 1;
+    setsockopt(sok, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    int recv_buf_size = DISCOVERY_RECV_BUF_SIZE;
+    setsockopt(sok, SOL_SOCKET, SO_RCVBUF, (const char*)&recv_buf_size, sizeof(recv_buf_size));
+
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(0);
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+
+    if(::bind(sok, (struct sockaddr*)&local_addr, sizeof(local_addr)) != 0)
+    {
+        _close_sok(sok);
+        return _BAD_SOK;
+    }
+
+    // The probe leaves through this interface, replies come back unicast to our ephemeral port.
+    struct in_addr iface_addr;
+    if(inet_pton(AF_INET, interface_ip.c_str(), &iface_addr) == 1)
+        setsockopt(sok, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&iface_addr, sizeof(iface_addr));
+
+    int ttl = 1;
+    setsockopt(sok, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+
+#ifdef IS_WINDOWS
+    u_long non_blocking = 1;
+    ioctlsocket(sok, FIONBIO, &non_blocking);
+#else
+    fcntl(sok, F_SETFL, fcntl(sok, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+    return sok;
+}
+
+#ifdef IS_LINUX
+
+static void _receive(const vector<_sok_t>& soks, steady_clock::time_point deadline, const _datagram_cb& cb, r_ws_discovery_stats& stats)
+{
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if(ep < 0)
+        R_THROW(("Unable to create epoll instance for WS-Discovery: %s", strerror(errno)));
+
+    for(auto sok : soks)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = sok;
+        epoll_ctl(ep, EPOLL_CTL_ADD, sok, &ev);
+    }
+
+    vector<char> buffers(RECV_BATCH_SIZE * MAX_DATAGRAM_SIZE);
+    vector<struct mmsghdr> msgs(RECV_BATCH_SIZE);
+    vector<struct iovec> iovs(RECV_BATCH_SIZE);
+    vector<struct epoll_event> events((std::max)(soks.size(), (size_t)1));
+
+    while(true)
+    {
+        auto remaining = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+        if(remaining <= 0)
+            break;
+
+        int n_events = epoll_wait(ep, events.data(), (int)events.size(), (int)remaining);
+        if(n_events < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        for(int e = 0; e < n_events; ++e)
+        {
+            auto sok = events[e].data.fd;
+
+            // Drain the socket a batch at a time, a short batch means it's empty.
+            while(true)
+            {
+                for(unsigned int i = 0; i < RECV_BATCH_SIZE; ++i)
+                {
+                    iovs[i].iov_base = &buffers[i * MAX_DATAGRAM_SIZE];
+                    iovs[i].iov_len = MAX_DATAGRAM_SIZE;
+                    memset(&msgs[i], 0, sizeof(msgs[i]));
+                    msgs[i].msg_hdr.msg_iov = &iovs[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+
+                int n_received = recvmmsg(sok, msgs.data(), RECV_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+                ++stats.receive_calls;
+
+                if(n_received <= 0)
+                    break;
+
+                for(int i = 0; i < n_received; ++i)
+                {
+                    if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                    {
+                        ++stats.truncated;
+                        continue;
+                    }
+
+                    cb(&buffers[i * MAX_DATAGRAM_SIZE], msgs[i].msg_len);
+                }
+
+                if((unsigned int)n_received < RECV_BATCH_SIZE)
+                    break;
+            }
+        }
+    }
+
+    ::close(ep);
+}
+
+#else
+
+static void _receive(const vector<_sok_t>& soks, steady_clock::time_point deadline, const _datagram_cb& cb, r_ws_discovery_stats& stats)
+{
+    vector<char> buffer(MAX_DATAGRAM_SIZE);
+
+    while(true)
+    {
+        auto remaining = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+        if(remaining <= 0)
+            break;
+
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        _sok_t max_sok = 0;
+        for(auto sok : soks)
+        {
+            FD_SET(sok, &read_fds);
+            max_sok = (std::max)(max_sok, sok);
+        }
+
+        struct timeval tv;
+        tv.tv_sec = (long)(remaining / 1000);
+        tv.tv_usec = (long)((remaining % 1000) * 1000);
+
+        int n_ready = ::select((int)max_sok + 1, &read_fds, nullptr, nullptr, &tv);
+        if(n_ready < 0)
+        {
+#ifndef IS_WINDOWS
+            if(errno == EINTR)
+                continue;
+#endif
+            break;
+        }
+
+        if(n_ready == 0)
+            break;
+
+        for(auto sok : soks)
+        {
+            if(!FD_ISSET(sok, &read_fds))
+                continue;
+
+            while(true)
+            {
+                auto len = ::recvfrom(sok, buffer.data(), (int)buffer.size(), 0, nullptr, nullptr);
+                ++stats.receive_calls;
+
+                if(len <= 0)
+                    break;
+
+                cb(buffer.data(), (size_t)len);
+            }
+        }
+    }
+}
+
+#endif
+
+vector<string> r_onvif::ws_discovery_probe(
+    const vector<string>& interface_ips,
+    const string& probe_message,
+    const string& destination_ip,
+    int destination_port,
+    milliseconds timeout,
+    r_ws_discovery_stats& stats
+)
+{
+    auto start = steady_clock::now();
+    auto deadline = start + timeout;
+
+    stats = r_ws_discovery_stats();
+
+    struct sockaddr_in destination;
+    memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons((uint16_t)destination_port);
+    if(inet_pton(AF_INET, destination_ip.c_str(), &destination.sin_addr) != 1)
+        R_STHROW(r_invalid_argument_exception, ("Invalid WS-Discovery destination: %s", destination_ip.c_str()));
+
+    vector<_sok_t> soks;
+
+    for(const auto& interface_ip : interface_ips)
+    {
+        auto sok = _open_probe_socket(interface_ip);
+        if(sok == _BAD_SOK)
+        {
+            R_LOG_ERROR("Unable to open WS-Discovery socket on %s", interface_ip.c_str());
+            continue;
+        }
+
+        auto sent = ::sendto(sok, probe_message.c_str(), (int)probe_message.length(), 0, (struct sockaddr*)&destination, sizeof(destination));
+        if(sent < 0)
+        {
+            R_LOG_ERROR("Unable to send WS-Discovery probe on %s", interface_ip.c_str());
+            _close_sok(sok);
+            continue;
+        }
+
+        soks.push_back(sok);
+    }
+
+    stats.interfaces = soks.size();
+
+    vector<string> responses;
+    set<string> seen;
+
+    auto cb = [&](const char* p, size_t len){
+        ++stats.datagrams;
+
+        string message(p, len);
+
+        string key;
+        try
+        {
+            key = parse_probe_match(message).address;
+        }
+        catch(...)
+        {
+            // Not something filter_discovered() could use anyway.
+            return;
+        }
+
+        if(key.empty())
+            key = message;
+
+        if(!seen.insert(key).second)
+        {
+            ++stats.duplicates;
+            return;
+        }
+
+        responses.push_back(std::move(message));
+    };
+
+    try
+    {
+        if(!soks.empty())
+            _receive(soks, deadline, cb, stats);
+    }
+    catch(...)
+    {
+        for(auto sok : soks)
+            _close_sok(sok);
+        throw;
+    }
+
+    for(auto sok : soks)
+        _close_sok(sok);
+
+    stats.duration = duration_cast<milliseconds>(steady_clock::now() - start);
+
+    return responses;
+}
@@ -0,0 +1,282 @@
+#include "r_onvif/r_xml_tokenizer.h"
+#include "r_utils/r_exception.h"
+#include <cstring>
+#include <cstdlib>
+
+using namespace r_onvif;
+using namespace r_utils;
+using namespace std;
+
+static bool _is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool _all_space(string_view sv)
+{
+    for(auto c : sv)
+    {
+        if(!_is_space(c))
+            return false;
+    }
+    return true;
+}
+
+static size_t _find(string_view doc, size_t pos, const char* s)
+{
+    auto found = doc.find(s, pos);
+    if(found == string_view::npos)
+        R_THROW(("Truncated XML: expected \"%s\".", s));
+    return found;
+}
+
+r_xml_tokenizer::r_xml_tokenizer(string_view doc) :
+    _doc(doc),
+    _pos(0),
+    _pending_end(false),
+    _pending_name()
+{
+}
+
+bool r_xml_tokenizer::next(r_xml_token& token)
+{
+    if(_pending_end)
+    {
+        _pending_end = false;
+        token.type = r_xml_token_type::end_element;
+        token.name = _pending_name;
+        token.local_name = xml_local_name(_pending_name);
+        token.attributes = string_view();
+        token.text = string_view();
+        return true;
+    }
+
+    while(_pos < _doc.size())
+    {
+        if(_doc[_pos] != '<')
+        {
+            auto end = _doc.find('<', _pos);
+            if(end == string_view::npos)
+                end = _doc.size();
+
+            auto text = _doc.substr(_pos, end - _pos);
+            _pos = end;
+
+            if(_all_space(text))
+                continue;
+
+            token.type = r_xml_token_type::text;
+            token.name = string_view();
+            token.local_name = string_view();
+            token.attributes = string_view();
+            token.text = text;
+            return true;
+        }
+
+        auto rest = _doc.substr(_pos);
+
+        if(rest.compare(0, 4, "<!--") == 0)
+        {
+            _pos = _find(_doc, _pos + 4, "-->") + 3;
+            continue;
+        }
+
+        if(rest.compare(0, 9, "<![CDATA[") == 0)
+        {
+            auto end = _find(_doc, _pos + 9, "]]>");
+            token.type = r_xml_token_type::text;
+            token.name = string_view();
+            token.local_name = string_view();
+            token.attributes = string_view();
+            token.text = _doc.substr(_pos + 9, end - (_pos + 9));
+            _pos = end + 3;
+            return true;
+        }
+
+        if(rest.compare(0, 2, "<?") == 0)
+        {
+            _pos = _find(_doc, _pos + 2, "?>") + 2;
+            continue;
+        }
+
+        if(rest.compare(0, 2, "<!") == 0)
+        {
+            _pos = _find(_doc, _pos + 2, ">") + 1;
+            continue;
+        }
+
+        // A '>' can legally appear inside a quoted attribute value, so find the end of the tag by hand.
+        size_t end = _pos + 1;
+        char quote = 0;
+        for(; end < _doc.size(); ++end)
+        {
+            auto c = _doc[end];
+            if(quote)
+            {
+                if(c == quote)
+                    quote = 0;
+            }
+            else if(c == '"' || c == '\'')
+                quote = c;
+            else if(c == '>')
+                break;
+        }
+
+        if(end >= _doc.size())
+            R_THROW(("Truncated XML: unterminated tag."));
+
+        auto tag = _doc.substr(_pos + 1, end - (_pos + 1));
+        _pos = end + 1;
+
+        bool closing = !tag.empty() && tag.front() == '/';
+        if(closing)
+            tag.remove_prefix(1);
+
+        bool self_closing = !closing && !tag.empty() && tag.back() == '/';
+        if(self_closing)
+            tag.remove_suffix(1);
+
+        size_t name_end = 0;
+        while(name_end < tag.size() && !_is_space(tag[name_end]))
+            ++name_end;
+
+        if(name_end == 0)
+            R_THROW(("Malformed XML: empty tag name."));
+
+        token.type = (closing)?r_xml_token_type::end_element:r_xml_token_type::start_element;
+        token.name = tag.substr(0, name_end);
+        token.local_name = xml_local_name(token.name);
+        token.attributes = (closing)?string_view():tag.substr(name_end);
+        token.text = string_view();
+
+        if(self_closing)
+        {
+            _pending_end = true;
+            _pending_name = token.name;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+string_view r_xml_tokenizer::attribute(string_view attributes, string_view name)
+{
+    size_t pos = 0;
+    while(pos < attributes.size())
+    {
+        while(pos < attributes.size() && _is_space(attributes[pos]))
+            ++pos;
+
+        auto eq = attributes.find('=', pos);
+        if(eq == string_view::npos)
+            break;
+
+        auto attr_name = attributes.substr(pos, eq - pos);
+        while(!attr_name.empty() && _is_space(attr_name.back()))
+            attr_name.remove_suffix(1);
+
+        auto q = eq + 1;
+        while(q < attributes.size() && _is_space(attributes[q]))
+            ++q;
+
+        if(q >= attributes.size() || (attributes[q] != '"' && attributes[q] != '\''))
+            break;
+
+        auto close = attributes.find(attributes[q], q + 1);
+        if(close == string_view::npos)
+            break;
+
+        if(xml_local_name(attr_name) == name)
+            return attributes.substr(q + 1, close - (q + 1));
+
+        pos = close + 1;
+    }
+
+    return string_view();
+}
+
+string_view r_onvif::xml_local_name(string_view name)
+{
+    auto colon = name.find(':');
+    return (colon == string_view::npos)?name:name.substr(colon + 1);
+}
+
+static void _append_utf8(string& out, uint32_t cp)
+{
+    if(cp < 0x80)
+        out += (char)cp;
+    else if(cp < 0x800)
+    {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else if(cp < 0x10000)
+    {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+string r_onvif::xml_unescape(string_view text)
+{
+    string out;
+    out.reserve(text.size());
+
+    size_t pos = 0;
+    while(pos < text.size())
+    {
+        auto amp = text.find('&', pos);
+        if(amp == string_view::npos)
+        {
+            out.append(text.substr(pos));
+            break;
+        }
+
+        out.append(text.substr(pos, amp - pos));
+
+        auto semi = text.find(';', amp);
+        if(semi == string_view::npos)
+        {
+            out.append(text.substr(amp));
+            break;
+        }
+
+        auto entity = text.substr(amp + 1, semi - (amp + 1));
+
+        if(entity == "amp")
+            out += '&';
+        else if(entity == "lt")
+            out += '<';
+        else if(entity == "gt")
+            out += '>';
+        else if(entity == "quot")
+            out += '"';
+        else if(entity == "apos")
+            out += '\'';
+        else if(entity.size() > 1 && entity[0] == '#')
+        {
+            bool hex = entity[1] == 'x' || entity[1] == 'X';
+            auto digits = string(entity.substr((hex)?2:1));
+            char* endp = nullptr;
+            auto cp = strtoul(digits.c_str(), &endp, (hex)?16:10);
+            if(digits.empty() || *endp != '\0')
+                out.append(text.substr(amp, semi - amp + 1));
+            else _append_utf8(out, (uint32_t)cp);
+        }
+        else out.append(text.substr(amp, semi - amp + 1));
+
+        pos = semi + 1;
+    }
+
+    return out;
+}
@@ -6,6 +6,12 @@ class test_r_onvif : public test_fixture
 public:
     RTF_FIXTURE(test_r_onvif);
       TEST(test_r_onvif::test_r_onvif_session_basic);
+      TEST(test_r_onvif::test_r_onvif_xml_tokenizer);
+      TEST(test_r_onvif::test_r_onvif_interrogate_mock);
+      TEST(test_r_onvif::test_r_onvif_interrogate_timeout);
+      TEST(test_r_onvif::test_r_onvif_parallel_interrogation);
+      TEST(test_r_onvif::test_r_onvif_parse_probe_match);
+      TEST(test_r_onvif::test_r_onvif_ws_discovery_burst);
     RTF_FIXTURE_END();
 
     virtual ~test_r_onvif() throw() {}
@@ -14,4 +20,10 @@ public:
     virtual void teardown();
 
     void test_r_onvif_session_basic();
+    void test_r_onvif_xml_tokenizer();
+    void test_r_onvif_interrogate_mock();
+    void test_r_onvif_interrogate_timeout();
+    void test_r_onvif_parallel_interrogation();
+    void test_r_onvif_parse_probe_match();
+    void test_r_onvif_ws_discovery_burst();
 };
@@ -1,19 +1,190 @@
 
 #include "test_r_onvif.h"
 #include "r_onvif/r_onvif_session.h"
+#include "r_onvif/r_xml_tokenizer.h"
+#include "r_onvif/r_ws_discovery.h"
+#include "r_http/r_web_server.h"
+#include "r_utils/r_parallel_for.h"
 #include "r_utils/r_string_utils.h"
 #include "r_utils/r_sha1.h"
 #include "r_utils/r_uuid.h"
 #include "r_utils/r_socket.h"
+#include "r_utils/r_udp_socket.h"
+#include "r_utils/r_udp_sender.h"
+#include "r_utils/r_socket_address.h"
+#include "r_utils/r_exception.h"
 #include <string.h>
 #include <map>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <ctime>
 
 using namespace std;
 using namespace r_onvif;
 using namespace r_utils;
+using namespace r_http;
 
 REGISTER_TEST_FIXTURE(test_r_onvif);
 
+static string _soap_envelope(const string& body)
+{
+    return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+           "<SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
+           "xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\" "
+           "xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" "
+           "xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+           "<SOAP-ENV:Body>" + body + "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
+}
+
+// _mock_onvif_camera answers just enough of the device and media services for r_onvif::interrogate(),
+// optionally sleeping before every response to stand in for a slow camera.
+class _mock_onvif_camera final
+{
+public:
+    _mock_onvif_camera(int port, chrono::milliseconds delay) :
+        _port(port),
+        _delay(delay),
+        _in_flight(0),
+        _max_in_flight(0),
+        _ws(port)
+    {
+        auto cb = [this](const r_web_server<r_socket>&, r_socket&, const r_server_request& request){
+            return _respond(request.get_body_as_string());
+        };
+
+        _ws.add_route(METHOD_POST, "/onvif/device_service", cb);
+        _ws.add_route(METHOD_POST, "/onvif/media_service", cb);
+        _ws.start();
+
+        // r_server_threaded binds on its own thread.
+        this_thread::sleep_for(chrono::milliseconds(250));
+    }
+
+    int port() const { return _port; }
+
+    // The most requests this camera was ever answering at once.
+    int max_in_flight() const { return _max_in_flight; }
+
+private:
+    r_server_response _respond(const string& request) const
+    {
+        auto in_flight = ++_in_flight;
+        auto max_in_flight = _max_in_flight.load();
+        while(in_flight > max_in_flight && !_max_in_flight.compare_exchange_weak(max_in_flight, in_flight));
+
+        auto response = _respond_to(request);
+
+        --_in_flight;
+
+        return response;
+    }
+
+    r_server_response _respond_to(const string& request) const
+    {
+        if(_delay.count() > 0)
+            this_thread::sleep_for(_delay);
+
+        string body;
+
+        if(request.find("GetSystemDateAndTime") != string::npos)
+        {
+            auto now = time(nullptr);
+            struct tm utc;
+#ifdef IS_WINDOWS
+            gmtime_s(&utc, &now);
+#else
+            gmtime_r(&now, &utc);
+#endif
+
+            body = r_string_utils::format(
+                "<tds:GetSystemDateAndTimeResponse><tds:SystemDateAndTime>"
+                "<tt:DateTimeType>NTP</tt:DateTimeType><tt:DaylightSavings>false</tt:DaylightSavings>"
+                "<tt:TimeZone><tt:TZ>GMT+00:00</tt:TZ></tt:TimeZone>"
+                "<tt:UTCDateTime><tt:Time><tt:Hour>%d</tt:Hour><tt:Minute>%d</tt:Minute><tt:Second>%d</tt:Second></tt:Time>"
+                "<tt:Date><tt:Year>%d</tt:Year><tt:Month>%d</tt:Month><tt:Day>%d</tt:Day></tt:Date></tt:UTCDateTime>"
+                "</tds:SystemDateAndTime></tds:GetSystemDateAndTimeResponse>",
+                utc.tm_hour, utc.tm_min, utc.tm_sec, utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday
+            );
+        }
+        else if(request.find("GetCapabilities") != string::npos)
+        {
+            // The Device XAddr comes first so that the Media XAddr has to be found by its ancestor.
+            body = r_string_utils::format(
+                "<tds:GetCapabilitiesResponse><tds:Capabilities>"
+                "<tt:Device><tt:XAddr>http://127.0.0.1:%d/onvif/device_service</tt:XAddr></tt:Device>"
+                "<tt:Media><tt:XAddr>http://127.0.0.1:%d/onvif/media_service</tt:XAddr>"
+                "<tt:StreamingCapabilities><tt:RTPMulticast>false</tt:RTPMulticast></tt:StreamingCapabilities></tt:Media>"
+                "</tds:Capabilities></tds:GetCapabilitiesResponse>",
+                _port, _port
+            );
+        }
+        else if(request.find("GetProfiles") != string::npos)
+        {
+            body =
+                "<trt:GetProfilesResponse>"
+                "<trt:Profiles token=\"sub\" fixed=\"true\"><tt:Name>sub</tt:Name>"
+                "<tt:AudioEncoderConfiguration token=\"a0\"><tt:Encoding>G711</tt:Encoding></tt:AudioEncoderConfiguration>"
+                "<tt:VideoEncoderConfiguration token=\"v1\"><tt:Encoding>H264</tt:Encoding>"
+                "<tt:Resolution><tt:Width>640</tt:Width><tt:Height>360</tt:Height></tt:Resolution></tt:VideoEncoderConfiguration>"
+                "</trt:Profiles>"
+                "<trt:Profiles token=\"main\" fixed=\"true\"><tt:Name>main</tt:Name>"
+                "<tt:VideoEncoderConfiguration token=\"v0\"><tt:Encoding>H265</tt:Encoding>"
+                "<tt:Resolution><tt:Width>1920</tt:Width><tt:Height>1080</tt:Height></tt:Resolution></tt:VideoEncoderConfiguration>"
+                "<tt:AudioEncoderConfiguration token=\"a0\"><tt:Encoding>AAC</tt:Encoding></tt:AudioEncoderConfiguration>"
+                "</trt:Profiles>"
+                "</trt:GetProfilesResponse>";
+        }
+        else if(request.find("GetStreamUri") != string::npos)
+        {
+            auto profile = (request.find(">main<") != string::npos)?"main":"sub";
+
+            body = r_string_utils::format(
+                "<trt:GetStreamUriResponse><trt:MediaUri>"
+                "<tt:Uri>rtsp://127.0.0.1:554/%s?channel=1&amp;subtype=0</tt:Uri>"
+                "<tt:InvalidAfterConnect>false</tt:InvalidAfterConnect></trt:MediaUri></trt:GetStreamUriResponse>",
+                profile
+            );
+        }
+        else
+        {
+            r_server_response response;
+            response.set_status_code(response_bad_request);
+            return response;
+        }
+
+        r_server_response response(response_ok, "application/soap+xml; charset=utf-8");
+        response.set_body(_soap_envelope(body));
+        return response;
+    }
+
+    int _port;
+    chrono::milliseconds _delay;
+    mutable atomic<int> _in_flight;
+    mutable atomic<int> _max_in_flight;
+    r_web_server<r_socket> _ws;
+};
+
+static string _probe_match_message(size_t device)
+{
+    return r_string_utils::format(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" "
+        "xmlns:wsa=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\" "
+        "xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\">"
+        "<SOAP-ENV:Header><wsa:To>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</wsa:To></SOAP-ENV:Header>"
+        "<SOAP-ENV:Body><d:ProbeMatches><d:ProbeMatch>"
+        "<wsa:EndpointReference><wsa:Address>urn:uuid:device-%zu</wsa:Address></wsa:EndpointReference>"
+        "<d:Types>dn:NetworkVideoTransmitter</d:Types>"
+        "<d:Scopes>onvif://www.onvif.org/name/Camera%zu onvif://www.onvif.org/hardware/HW%zu</d:Scopes>"
+        "<d:XAddrs>http://10.0.%zu.%zu/onvif/device_service http://[fe80::1]/onvif/device_service</d:XAddrs>"
+        "<d:MetadataVersion>1</d:MetadataVersion>"
+        "</d:ProbeMatch></d:ProbeMatches></SOAP-ENV:Body></SOAP-ENV:Envelope>",
+        device, device, device, device / 250, (device % 250) + 1
+    );
+}
+
 void test_r_onvif::setup()
 {
     r_raw_socket::socket_startup();
@@ -130,3 +301,215 @@ void test_r_onvif::test_r_onvif_session_basic()
     RTF_ASSERT(foundSomething);
 #endif
 }
+
+void test_r_onvif::test_r_onvif_xml_tokenizer()
+{
+    string doc =
+        "<?xml version=\"1.0\"?><!-- leading comment -->"
+        "<a:Root xmlns:a=\"urn:a\">\n"
+        "  <a:Item a:token='x>y' size=\"3\"/>\n"
+        "  <Text>fish &amp; chips &#x41;&#66;</Text>"
+        "  <Data><![CDATA[<not a tag>]]></Data>"
+        "</a:Root>";
+
+    r_xml_tokenizer tokenizer(doc);
+    r_xml_token token;
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::start_element);
+    RTF_ASSERT(token.name == "a:Root");
+    RTF_ASSERT(token.local_name == "Root");
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::start_element);
+    RTF_ASSERT(token.local_name == "Item");
+    RTF_ASSERT(r_xml_tokenizer::attribute(token.attributes, "token") == "x>y");
+    RTF_ASSERT(r_xml_tokenizer::attribute(token.attributes, "size") == "3");
+    RTF_ASSERT(r_xml_tokenizer::attribute(token.attributes, "missing").empty());
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::end_element);
+    RTF_ASSERT(token.local_name == "Item");
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::start_element);
+    RTF_ASSERT(token.local_name == "Text");
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::text);
+    RTF_ASSERT(xml_unescape(token.text) == "fish & chips AB");
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::end_element);
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.local_name == "Data");
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::text);
+    RTF_ASSERT(token.text == "<not a tag>");
+
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(tokenizer.next(token));
+    RTF_ASSERT(token.type == r_xml_token_type::end_element);
+    RTF_ASSERT(token.name == "a:Root");
+
+    RTF_ASSERT(!tokenizer.next(token));
+
+    r_xml_tokenizer truncated("<a><b attr=\"1");
+    RTF_ASSERT(truncated.next(token));
+    RTF_ASSERT_THROWS(truncated.next(token), r_exception);
+}
+
+void test_r_onvif::test_r_onvif_interrogate_mock()
+{
+    _mock_onvif_camera camera(RTF_NEXT_PORT(), chrono::milliseconds(0));
+
+    r_nullable<string> username, password;
+    username = "admin";
+    password = "secret";
+
+    auto info = r_onvif::interrogate("127.0.0.1", camera.port(), "http", "/onvif/device_service", username, password);
+
+    RTF_ASSERT(info.profile.token == "main");
+    RTF_ASSERT(info.profile.encoding == "H265");
+    RTF_ASSERT(info.profile.width == 1920);
+    RTF_ASSERT(info.profile.height == 1080);
+    RTF_ASSERT(info.rtsp_url == "rtsp://127.0.0.1:554/main?channel=1&subtype=0");
+}
+
+void test_r_onvif::test_r_onvif_interrogate_timeout()
+{
+    _mock_onvif_camera camera(RTF_NEXT_PORT(), chrono::milliseconds(2000));
+
+    r_nullable<string> username, password;
+    username = "admin";
+    password = "secret";
+
+    // The camera answers a valid response after 2 seconds, so only giving up early throws.
+    bool threw = false;
+    try
+    {
+        r_onvif::interrogate("127.0.0.1", camera.port(), "http", "/onvif/device_service", username, password, chrono::milliseconds(500));
+    }
+    catch(const std::exception&)
+    {
+        threw = true;
+    }
+
+    RTF_ASSERT(threw);
+}
+
+void test_r_onvif::test_r_onvif_parallel_interrogation()
+{
+    // Every request takes 50ms, long enough that parallel interrogations overlap at the camera.
+    _mock_onvif_camera camera(RTF_NEXT_PORT(), chrono::milliseconds(50));
+
+    r_nullable<string> username, password;
+    username = "admin";
+    password = "secret";
+
+    const size_t N_CAMERAS = 16;
+
+    vector<onvif_stream_info> infos(N_CAMERAS);
+    r_parallel_for(N_CAMERAS, 8, [&](size_t i){
+        infos[i] = r_onvif::interrogate("127.0.0.1", camera.port(), "http", "/onvif/device_service", username, password);
+    });
+
+    for(auto& info : infos)
+    {
+        RTF_ASSERT(info.profile.token == "main");
+        RTF_ASSERT(info.profile.encoding == "H265");
+        RTF_ASSERT(info.rtsp_url == "rtsp://127.0.0.1:554/main?channel=1&subtype=0");
+    }
+
+    RTF_ASSERT(camera.max_in_flight() > 1);
+}
+
+void test_r_onvif::test_r_onvif_parse_probe_match()
+{
+    auto match = parse_probe_match(_probe_match_message(7));
+
+    RTF_ASSERT(match.address == "urn:uuid:device-7");
+    RTF_ASSERT(match.scopes.find("onvif://www.onvif.org/name/Camera7") != string::npos);
+    RTF_ASSERT(match.xaddrs.size() == 2);
+    RTF_ASSERT(match.xaddrs[0] == "http://10.0.0.8/onvif/device_service");
+
+    auto filtered = filter_discovered({_probe_match_message(7)});
+    RTF_ASSERT(filtered.size() == 1);
+    RTF_ASSERT(filtered[0].host == "10.0.0.8");
+    RTF_ASSERT(filtered[0].uri == "/onvif/device_service");
+    RTF_ASSERT(filtered[0].address == "urn:uuid:device-7");
+    RTF_ASSERT(filtered[0].camera_name == "Camera7");
+}
+
+void test_r_onvif::test_r_onvif_ws_discovery_burst()
+{
+    // A local responder stands in for a subnet full of cameras: every device answers the probe
+    // twice (as WS-Discovery devices are allowed to) and the answers go out in bursts.
+    const size_t N_DEVICES = 400;
+    const size_t BURST_SIZE = 100;
+
+    int port = RTF_NEXT_PORT();
+
+    r_udp_socket responder;
+    r_socket_address responder_addr(port, "127.0.0.1");
+    RTF_ASSERT(::bind(responder.fd(), responder_addr.get_sock_addr(), responder_addr.sock_addr_size()) == 0);
+
+    auto responder_th = thread([&](){
+        vector<uint8_t> buffer(8192);
+
+        while(true)
+        {
+            r_socket_address from(0);
+            auto len = responder.recvfrom(buffer.data(), buffer.size(), from);
+            if(len <= 0)
+                continue;
+
+            string request((char*)buffer.data(), len);
+            if(request.find("Probe") == string::npos)
+                break;
+
+            size_t sent = 0;
+            for(size_t repeat = 0; repeat < 2; ++repeat)
+            {
+                for(size_t device = 0; device < N_DEVICES; ++device)
+                {
+                    auto reply = _probe_match_message(device);
+                    responder.sendto((const uint8_t*)reply.c_str(), reply.length(), from);
+
+                    if(++sent % BURST_SIZE == 0)
+                        this_thread::sleep_for(chrono::milliseconds(2));
+                }
+            }
+        }
+    });
+
+    r_ws_discovery_stats stats;
+    auto discovered = ws_discovery_probe(
+        {"127.0.0.1"},
+        "<d:Probe xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"/>",
+        "127.0.0.1",
+        port,
+        chrono::milliseconds(1500),
+        stats
+    );
+
+    r_udp_sender quit("127.0.0.1", port);
+    string quit_msg = "quit";
+    quit.send((void*)quit_msg.c_str(), quit_msg.length());
+    responder_th.join();
+
+    RTF_ASSERT(stats.interfaces == 1);
+    RTF_ASSERT(discovered.size() == N_DEVICES);
+    RTF_ASSERT(stats.datagrams == N_DEVICES * 2);
+    RTF_ASSERT(stats.duplicates == N_DEVICES);
+
+#ifdef IS_LINUX
+    // recvmmsg() should be pulling many datagrams per call out of each burst.
+    RTF_ASSERT(stats.receive_calls < stats.datagrams / 2);
+#endif
+
+    auto filtered = filter_discovered(discovered);
+    RTF_ASSERT(filtered.size() == N_DEVICES);
+}
@@ -0,0 +1,158 @@
+
+#include "bench.h"
+#include "r_pipeline/r_gst_source.h"
+#include "r_pipeline/r_arg.h"
+#include "r_pipeline/r_bitrate_cache.h"
+#include "r_pipeline/r_stream_info.h"
+#include "r_fakey/r_fake_camera.h"
+#include "r_av/r_abr_transcoder.h"
+#include "r_utils/r_std_utils.h"
+#include "r_utils/r_string_utils.h"
+#include "r_utils/r_exception.h"
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_pipeline;
+using namespace r_fakey;
+using namespace r_utils;
+using namespace r_av;
+
+static const int FAKE_CAMERA_PORT = 18554;
+
+// Serves file_name out of the directory named by FAKEY_ROOT (the same media the r_pipeline unit
+// tests use).
+static shared_ptr<r_fake_camera> _start_fake_camera(const string& file_name)
+{
+    auto fr = r_std_utils::get_env("FAKEY_ROOT");
+    if(fr.empty())
+        R_THROW(("Set FAKEY_ROOT to the directory holding the fake camera's media."));
+
+    auto fc = make_shared<r_fake_camera>(fr, vector<string>{file_name}, FAKE_CAMERA_PORT);
+
+    thread([fc](){
+        fc->start();
+    }).detach();
+
+    return fc;
+}
+
+// How long fetch_bytes_per_second() takes to measure a stream, and to answer again from the bitrate
+// cache (it only reads the SDP).
+REGISTER_BENCH(bitrate_probe)
+{
+    r_pipeline::gstreamer_init();
+
+    auto fc = _start_fake_camera("true_north_h264_aac.mkv");
+
+    auto url = r_string_utils::format("rtsp://127.0.0.1:%d/true_north_h264_aac.mkv", FAKE_CAMERA_PORT);
+
+    bitrate_cache().clear();
+
+    auto start = steady_clock::now();
+    auto bytes_per_second = fetch_bytes_per_second(url, 15);
+    auto measure_duration = steady_clock::now() - start;
+
+    start = steady_clock::now();
+    auto cached_bytes_per_second = fetch_bytes_per_second(url, 15);
+    auto cached_duration = steady_clock::now() - start;
+
+    fc->quit();
+
+    printf("measured %lld bytes/sec in %lldms, cached lookup (%lld bytes/sec) took %lldms\n",
+           (long long)bytes_per_second,
+           (long long)duration_cast<milliseconds>(measure_duration).count(),
+           (long long)cached_bytes_per_second,
+           (long long)duration_cast<milliseconds>(cached_duration).count());
+}
+
+// What each rung of a two rung ABR ladder costs to encode, fed 10 seconds of the fake camera.
+REGISTER_BENCH(abr_ladder)
+{
+    r_pipeline::gstreamer_init();
+
+    GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
+    thread loop_thread([&] {
+        g_main_loop_run(loop);
+    });
+
+    auto fc = _start_fake_camera("true_north_h264_aac_no_bf.mp4");
+
+    vector<r_arg> arguments;
+    add_argument(arguments, "url", r_string_utils::format("rtsp://127.0.0.1:%d/true_north_h264_aac_no_bf.mp4", FAKE_CAMERA_PORT));
+
+    vector<r_abr_rung> ladder = {{640, 360, 1000000}, {320, 180, 300000}};
+
+    unique_ptr<r_abr_transcoder> abr;
+
+    r_gst_source src;
+    src.set_args(arguments);
+    src.set_video_sample_cb(
+        [&](const sample_context& ctx, const r_gst_buffer& buffer, bool key, int64_t pts){
+            if(!abr)
+            {
+                if(!key)
+                    return;
+
+                string params;
+                auto sps = ctx.sprop_sps();
+                auto pps = ctx.sprop_pps();
+                if(!sps.is_null())
+                    params += "sprop-sps=" + sps.value();
+                if(!pps.is_null())
+                    params += ", sprop-pps=" + pps.value();
+
+                auto fr = ctx.framerate();
+                AVRational framerate = av_d2q((fr.is_null()) ? 30.0 : fr.value(), 1000);
+
+                abr = make_unique<r_abr_transcoder>(
+                    AV_CODEC_ID_H264,
+                    make_h264_extradata(get_h264_sps(params), get_h264_pps(params)),
+                    AVRational{1, 1000},
+                    framerate,
+                    ladder,
+                    [](size_t, const r_packet_info&){}
+                );
+                abr->start();
+            }
+
+            auto mi = buffer.map(r_gst_buffer::MT_READ);
+            abr->write_frame(mi.data(), mi.size(), pts);
+        }
+    );
+
+    src.play();
+
+    this_thread::sleep_for(seconds(10));
+
+    src.stop();
+
+    g_main_loop_quit(loop);
+    loop_thread.join();
+    g_main_loop_unref(loop);
+
+    fc->quit();
+
+    if(!abr)
+        R_THROW(("The camera never sent a key frame."));
+
+    abr->stop();
+
+    auto stats = abr->stats();
+
+    for(size_t i = 0; i < ladder.size(); ++i)
+    {
+        printf("rung %ux%u: %llu frames (%llu dropped), %.1f fps, %.2f ms cpu/frame, %.0f%% of a core\n",
+               ladder[i].width,
+               ladder[i].height,
+               (unsigned long long)stats[i].frames_encoded,
+               (unsigned long long)stats[i].frames_dropped,
+               stats[i].encode_fps,
+               stats[i].cpu_ms_per_frame,
+               stats[i].cpu_load * 100.0);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef r_pipeline_r_bitrate_cache_h
+#define r_pipeline_r_bitrate_cache_h
+
+#include "r_pipeline/r_stream_info.h"
+#include "r_utils/r_nullable.h"
+#include "r_utils/r_macro.h"
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+namespace r_pipeline
+{
+
+constexpr std::chrono::milliseconds BITRATE_CACHE_DEFAULT_TTL = std::chrono::hours(1);
+
+// Weight given to a new live observation when it is blended into an existing estimate.
+constexpr double BITRATE_CACHE_LIVE_WEIGHT = 0.25;
+
+struct r_bitrate_cache_stats
+{
+    uint64_t hits {0};
+    uint64_t misses {0};
+    uint64_t probes {0};
+    uint64_t refinements {0};
+    size_t entries {0};
+};
+
+// r_bitrate_cache remembers the measured byte rate of a stream, keyed by its rtsp url and a
+// signature of its codec parameters (so a camera that is reconfigured to a new resolution or codec
+// is measured again). Entries come from probes (put()) and are then kept honest by the byte counts
+// of the stream while it records (refine()). An entry that hasn't been touched for ttl is ignored.
+
+class r_bitrate_cache final
+{
+public:
+    R_API r_bitrate_cache(std::chrono::milliseconds ttl = BITRATE_CACHE_DEFAULT_TTL);
+
+    R_API r_utils::r_nullable<int64_t> get(const std::string& rtsp_url, const std::string& codec_signature);
+
+    // Stores the result of a probe, replacing whatever was there.
+    R_API void put(const std::string& rtsp_url, const std::string& codec_signature, int64_t bytes_per_second);
+
+    // Blends an observed rate from a recording stream into the entry (or creates it).
+    R_API void refine(const std::string& rtsp_url, const std::string& codec_signature, int64_t bytes_per_second);
+
+    R_API void clear();
+
+    R_API r_bitrate_cache_stats stats() const;
+
+private:
+    struct _entry
+    {
+        int64_t bytes_per_second {0};
+        std::chrono::steady_clock::time_point updated;
+    };
+
+    void _expire(std::chrono::steady_clock::time_point now);
+
+    mutable std::mutex _lock;
+    std::chrono::milliseconds _ttl;
+    std::map<std::pair<std::string, std::string>, _entry> _entries;
+    r_bitrate_cache_stats _stats;
+};
+
+// The process wide cache used by fetch_bytes_per_second() and fetch_camera_params().
+R_API r_bitrate_cache& bitrate_cache();
+
+// Both forms produce the same string for the same stream, the first from an SDP and the second
+// from the codec fields stored with a camera (which were themselves produced by sdp_media_to_s()).
+R_API std::string codec_signature(const std::map<std::string, r_sdp_media>& sdp_medias);
+R_API std::string codec_signature(
+    const std::string& video_codec,
+    const std::string& video_codec_parameters,
+    const std::string& audio_codec,
+    const std::string& audio_codec_parameters
+);
+
+}
+
+#endif
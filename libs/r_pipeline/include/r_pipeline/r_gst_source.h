@@ -53,13 +53,34 @@ R_API std::map<std::string, r_sdp_media> fetch_sdp_media(
     const r_utils::r_nullable<std::string>& password = r_utils::r_nullable<std::string>()
 );
 
+// Bitrate probes stop as soon as their estimate settles (or after max_measured_duration_seconds) and
+// their results are cached in bitrate_cache(), so a stream whose codec parameters haven't changed is
+// only measured once. At most max_concurrent_bitrate_probes run at a time across the whole process,
+// callers beyond that wait their turn.
+constexpr size_t DEFAULT_MAX_CONCURRENT_BITRATE_PROBES = 4;
+
+R_API void set_max_concurrent_bitrate_probes(size_t max_probes);
+
 R_API int64_t fetch_bytes_per_second(
     const std::string& rtsp_url,
-    int measured_duration_seconds = 15,
+    int max_measured_duration_seconds = 15,
     const r_utils::r_nullable<std::string>& username = r_utils::r_nullable<std::string>(),
     const r_utils::r_nullable<std::string>& password = r_utils::r_nullable<std::string>()
 );
 
+struct r_bitrate_probe
+{
+    std::string rtsp_url;
+    r_utils::r_nullable<std::string> username;
+    r_utils::r_nullable<std::string> password;
+};
+
+// Probes all of the streams concurrently. A stream that can't be measured gets 0.
+R_API std::vector<int64_t> fetch_bytes_per_second(
+    const std::vector<r_bitrate_probe>& probes,
+    int max_measured_duration_seconds = 15
+);
+
 R_API r_camera_params fetch_camera_params(
     const std::string& rtsp_url,
     const r_utils::r_nullable<std::string>& username = r_utils::r_nullable<std::string>(),
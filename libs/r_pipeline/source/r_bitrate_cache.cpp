@@ -0,0 +1,132 @@
+#include "r_pipeline/r_bitrate_cache.h"
+#include <tuple>
+
+using namespace r_pipeline;
+using namespace r_utils;
+using namespace std;
+using namespace std::chrono;
+
+r_bitrate_cache::r_bitrate_cache(milliseconds ttl) :
+    _lock(),
+    _ttl(ttl),
+    _entries(),
+    _stats()
+{
+}
+
+r_nullable<int64_t> r_bitrate_cache::get(const string& rtsp_url, const string& codec_signature)
+{
+    lock_guard<mutex> g(_lock);
+
+    _expire(steady_clock::now());
+
+    r_nullable<int64_t> result;
+
+    auto found = _entries.find(make_pair(rtsp_url, codec_signature));
+    if(found != _entries.end())
+    {
+        result.set_value(found->second.bytes_per_second);
+        ++_stats.hits;
+    }
+    else ++_stats.misses;
+
+    return result;
+}
+
+void r_bitrate_cache::put(const string& rtsp_url, const string& codec_signature, int64_t bytes_per_second)
+{
+    if(bytes_per_second <= 0)
+        return;
+
+    lock_guard<mutex> g(_lock);
+
+    auto& e = _entries[make_pair(rtsp_url, codec_signature)];
+    e.bytes_per_second = bytes_per_second;
+    e.updated = steady_clock::now();
+
+    ++_stats.probes;
+}
+
+void r_bitrate_cache::refine(const string& rtsp_url, const string& codec_signature, int64_t bytes_per_second)
+{
+    if(bytes_per_second <= 0)
+        return;
+
+    lock_guard<mutex> g(_lock);
+
+    auto now = steady_clock::now();
+    _expire(now);
+
+    auto key = make_pair(rtsp_url, codec_signature);
+
+    auto found = _entries.find(key);
+    if(found == _entries.end())
+    {
+        _entry e;
+        e.bytes_per_second = bytes_per_second;
+        e.updated = now;
+        _entries[key] = e;
+    }
+    else
+    {
+        auto& e = found->second;
+        e.bytes_per_second = (int64_t)((BITRATE_CACHE_LIVE_WEIGHT * (double)bytes_per_second) + ((1.0 - BITRATE_CACHE_LIVE_WEIGHT) * (double)e.bytes_per_second));
+        e.updated = now;
+    }
+
+    ++_stats.refinements;
+}
+
+void r_bitrate_cache::clear()
+{
+    lock_guard<mutex> g(_lock);
+    _entries.clear();
+}
+
+r_bitrate_cache_stats r_bitrate_cache::stats() const
+{
+    lock_guard<mutex> g(_lock);
+    auto s = _stats;
+    s.entries = _entries.size();
+    return s;
+}
+
+void r_bitrate_cache::_expire(steady_clock::time_point now)
+{
+    for(auto i = _entries.begin(); i != _entries.end();)
+    {
+        if((now - i->second.updated) > _ttl)
+            i = _entries.erase(i);
+        else ++i;
+    }
+}
+
+r_bitrate_cache& r_pipeline::bitrate_cache()
+{
+    static r_bitrate_cache cache;
+    return cache;
+}
+
+string r_pipeline::codec_signature(const map<string, r_sdp_media>& sdp_medias)
+{
+    string video_codec, video_codec_parameters, audio_codec, audio_codec_parameters;
+    int timebase;
+
+    if(sdp_medias.find("video") != sdp_medias.end())
+        tie(video_codec, video_codec_parameters, timebase) = sdp_media_map_to_s(VIDEO_MEDIA, sdp_medias);
+
+    if(sdp_medias.find("audio") != sdp_medias.end())
+        tie(audio_codec, audio_codec_parameters, timebase) = sdp_media_map_to_s(AUDIO_MEDIA, sdp_medias);
+
+    return codec_signature(video_codec, video_codec_parameters, audio_codec, audio_codec_parameters);
+}
+
+string r_pipeline::codec_signature(
+    const string& video_codec,
+    const string& video_codec_parameters,
+    const string& audio_codec,
+    const string& audio_codec_parameters
+)
+{
+    return video_codec + ";" + video_codec_parameters + "|" + audio_codec + ";" + audio_codec_parameters;
+}
@@ -1,16 +1,23 @@
 
 #include "r_pipeline/r_gst_source.h"
+#include "r_pipeline/r_bitrate_cache.h"
 #include "r_utils/r_exception.h"
 #include "r_utils/r_string_utils.h"
 #include "r_utils/r_std_utils.h"
 #include "r_utils/r_work_q.h"
 #include "r_utils/r_logger.h"
 #include "r_utils/r_file.h"
+#include "r_utils/r_parallel_for.h"
 #include <gst/rtsp/gstrtsptransport.h>
 #include <memory>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
 
 using namespace r_pipeline;
 using namespace r_utils;
@@ -94,68 +101,77 @@ map<string, r_sdp_media> r_pipeline::fetch_sdp_media(
     return medias;
 }
 
-int64_t r_pipeline::fetch_bytes_per_second(
-    const std::string& rtsp_url,
-    int measured_duration_seconds,
-    const r_utils::r_nullable<std::string>& username,
-    const r_utils::r_nullable<std::string>& password
-)
-{
-    vector<r_arg> arguments;
-    add_argument(arguments, "url", rtsp_url);
+static const int PROBE_MIN_SECONDS = 4;
+static const size_t PROBE_CONVERGENCE_SAMPLES = 3;
+static const double PROBE_CONVERGENCE_TOLERANCE = 0.05;
 
-    if(!username.is_null())
-        add_argument(arguments, "username", username.value());
+static mutex _probe_slots_lok;
+static condition_variable _probe_slots_cond;
+static size_t _max_probes = DEFAULT_MAX_CONCURRENT_BITRATE_PROBES;
+static size_t _active_probes = 0;
 
-    if(!password.is_null())
-        add_argument(arguments, "password", password.value());
-
-    r_gst_source src;
-    src.set_args(arguments);
-
-    bool done = false;
-
-    int64_t audio_byte_total = 0;
-    src.set_audio_sample_cb([&](const sample_context& sc, const r_gst_buffer& buffer, bool key, int64_t pts){
-        auto mi = buffer.map(r_gst_buffer::MT_READ);
-        if(!done)
-            audio_byte_total += mi.size();
-    });
+// Holds one of the process wide bitrate probe slots for its lifetime.
+class _probe_slot final
+{
+public:
+    _probe_slot()
+    {
+        unique_lock<mutex> g(_probe_slots_lok);
+        _probe_slots_cond.wait(g, [](){return _active_probes < _max_probes;});
+        ++_active_probes;
+    }
 
-    bool stream_start_time_set = false;
-    system_clock::time_point stream_start_time;    
+    _probe_slot(const _probe_slot&) = delete;
+    _probe_slot& operator=(const _probe_slot&) = delete;
 
-    int64_t video_byte_total = 0;
-    src.set_video_sample_cb([&](const sample_context& sc, const r_gst_buffer& buffer, bool key, int64_t pts){
-        auto mi = buffer.map(r_gst_buffer::MT_READ);
-        if(!stream_start_time_set)
+    ~_probe_slot() noexcept
+    {
         {
-            stream_start_time_set = true;
-            stream_start_time = system_clock::now();
+            lock_guard<mutex> g(_probe_slots_lok);
+            --_active_probes;
         }
-        if(!done)
-            video_byte_total += mi.size();
-    });
-
-    src.play();
+        _probe_slots_cond.notify_all();
+    }
+};
 
-    std::this_thread::sleep_for(std::chrono::seconds(measured_duration_seconds));
+struct _probe_result
+{
+    int64_t bytes_per_second {0};
+    map<string, r_sdp_media> medias;
+    vector<uint8_t> video_key_frame;
+    sample_context sample_ctx;
+};
 
-    done = true;
+// The running average is taken from the first video sample, so it swings around while the first few
+// GOPs arrive and then settles. We call it settled once the last few once-a-second estimates agree.
+static bool _converged(const vector<double>& estimates)
+{
+    if(estimates.size() < PROBE_CONVERGENCE_SAMPLES)
+        return false;
 
-    auto delta = system_clock::now() - stream_start_time;
+    auto latest = estimates.back();
+    if(latest <= 0.0)
+        return false;
 
-    src.stop();
+    for(size_t i = estimates.size() - PROBE_CONVERGENCE_SAMPLES; i < estimates.size(); ++i)
+    {
+        if(fabs(estimates[i] - latest) > (latest * PROBE_CONVERGENCE_TOLERANCE))
+            return false;
+    }
 
-    return (int64_t)(((double)(audio_byte_total + video_byte_total)) / (double)duration_cast<seconds>(delta).count());
+    return true;
 }
 
-r_camera_params r_pipeline::fetch_camera_params(
-    const std::string& rtsp_url,
-    const r_utils::r_nullable<std::string>& username,
-    const r_utils::r_nullable<std::string>& password
+static _probe_result _probe(
+    const string& rtsp_url,
+    int max_measured_duration_seconds,
+    bool want_key_frame,
+    const r_nullable<string>& username,
+    const r_nullable<string>& password
 )
 {
+    _probe_slot slot;
+
     vector<r_arg> arguments;
     add_argument(arguments, "url", rtsp_url);
 
@@ -168,39 +184,48 @@ r_camera_params r_pipeline::fetch_camera_params(
     r_gst_source src;
     src.set_args(arguments);
 
-    bool done = false;
+    mutex lok;
+    condition_variable cond;
 
+    bool have_sdp = false;
     map<string, r_sdp_media> medias;
     src.set_sdp_media_cb([&](const map<string, r_sdp_media>& sdp_medias){
+        lock_guard<mutex> g(lok);
         medias = sdp_medias;
+        have_sdp = true;
+        cond.notify_one();
     });
 
-    int64_t audio_byte_total = 0;
-    src.set_audio_sample_cb([&](const sample_context& sc, const r_gst_buffer& buffer, bool key, int64_t pts){
+    bool stream_started = false;
+    steady_clock::time_point stream_start_time;
+    int64_t byte_total = 0;
+
+    src.set_audio_sample_cb([&](const sample_context&, const r_gst_buffer& buffer, bool, int64_t){
         auto mi = buffer.map(r_gst_buffer::MT_READ);
-        if(!done)
-            audio_byte_total += mi.size();
+        lock_guard<mutex> g(lok);
+        if(stream_started)
+            byte_total += mi.size();
     });
 
-    bool stream_start_time_set = false;
-    system_clock::time_point stream_start_time;
-
     vector<uint8_t> video_key_frame;
     sample_context captured_sample_ctx;
     int key_frame_count = 0;
 
-    int64_t video_byte_total = 0;
-    src.set_video_sample_cb([&](const sample_context& sc, const r_gst_buffer& buffer, bool key, int64_t pts){
+    src.set_video_sample_cb([&](const sample_context& sc, const r_gst_buffer& buffer, bool key, int64_t){
         auto mi = buffer.map(r_gst_buffer::MT_READ);
-        if(!stream_start_time_set)
+        lock_guard<mutex> g(lok);
+
+        if(!stream_started)
         {
-            stream_start_time_set = true;
-            stream_start_time = system_clock::now();
+            stream_started = true;
+            stream_start_time = steady_clock::now();
         }
 
+        byte_total += mi.size();
+
         // Capture the second keyframe - the first one from some cameras has unusual
         // NAL structure (duplicate SPS/PPS, etc.) that can confuse decoders
-        if(key)
+        if(want_key_frame && key)
         {
             ++key_frame_count;
             if(key_frame_count == 2)
@@ -208,28 +233,153 @@ r_camera_params r_pipeline::fetch_camera_params(
                 video_key_frame.resize(mi.size());
                 memcpy(&video_key_frame[0], mi.data(), mi.size());
                 captured_sample_ctx = sc;
+                cond.notify_one();
             }
         }
-
-        if(!done)
-            video_byte_total += mi.size();
     });
 
     src.play();
 
-    std::this_thread::sleep_for(std::chrono::seconds(15));
+    auto deadline = steady_clock::now() + seconds(max_measured_duration_seconds);
+
+    string signature;
+    r_nullable<int64_t> cached;
+    vector<double> estimates;
+    steady_clock::time_point next_estimate;
+    double measured = 0.0;
+
+    {
+        unique_lock<mutex> g(lok);
+
+        while(true)
+        {
+            auto now = steady_clock::now();
+
+            // Once we know what the stream is we may already know its rate, in which case all we
+            // still need from it is (maybe) a key frame.
+            if(have_sdp && signature.empty())
+            {
+                try
+                {
+                    signature = codec_signature(medias);
+                    cached = bitrate_cache().get(rtsp_url, signature);
+                }
+                catch(const exception& e)
+                {
+                    R_LOG_ERROR("Unable to determine codec signature: %s", e.what());
+                    signature = "?";
+                }
+            }
+
+            bool have_key_frame = !want_key_frame || key_frame_count >= 2;
+
+            if(!cached.is_null() && have_key_frame)
+                break;
 
-    done = true;
+            if(stream_started)
+            {
+                auto elapsed = now - stream_start_time;
+                auto elapsed_millis = duration_cast<milliseconds>(elapsed).count();
+                if(elapsed_millis > 0)
+                    measured = ((double)byte_total * 1000.0) / (double)elapsed_millis;
 
-    auto delta = system_clock::now() - stream_start_time;
+                if(elapsed >= seconds(1) && now >= next_estimate)
+                {
+                    estimates.push_back(measured);
+                    next_estimate = now + seconds(1);
+                }
+
+                if(have_key_frame && elapsed >= seconds(PROBE_MIN_SECONDS) && _converged(estimates))
+                    break;
+            }
+
+            if(now >= deadline)
+                break;
+
+            cond.wait_until(g, (std::min)(deadline, now + milliseconds(250)));
+        }
+    }
 
     src.stop();
 
+    _probe_result result;
+    result.medias = medias;
+    result.video_key_frame = video_key_frame;
+    result.sample_ctx = captured_sample_ctx;
+
+    if(!cached.is_null())
+        result.bytes_per_second = cached.value();
+    else
+    {
+        result.bytes_per_second = (int64_t)measured;
+
+        if(!signature.empty() && signature != "?")
+            bitrate_cache().put(rtsp_url, signature, result.bytes_per_second);
+    }
+
+    return result;
+}
+
+void r_pipeline::set_max_concurrent_bitrate_probes(size_t max_probes)
+{
+    {
+        lock_guard<mutex> g(_probe_slots_lok);
+        _max_probes = (std::max)(max_probes, (size_t)1);
+    }
+    _probe_slots_cond.notify_all();
+}
+
+int64_t r_pipeline::fetch_bytes_per_second(
+    const std::string& rtsp_url,
+    int max_measured_duration_seconds,
+    const r_utils::r_nullable<std::string>& username,
+    const r_utils::r_nullable<std::string>& password
+)
+{
+    return _probe(rtsp_url, max_measured_duration_seconds, false, username, password).bytes_per_second;
+}
+
+vector<int64_t> r_pipeline::fetch_bytes_per_second(
+    const vector<r_bitrate_probe>& probes,
+    int max_measured_duration_seconds
+)
+{
+    size_t max_threads = 0;
+    {
+        lock_guard<mutex> g(_probe_slots_lok);
+        max_threads = _max_probes;
+    }
+
+    // The probe slots are what actually enforce the limit (other callers may be probing too), this
+    // just avoids starting threads that would only wait on them.
+    vector<int64_t> results(probes.size(), 0);
+    r_parallel_for(probes.size(), max_threads, [&](size_t i){
+        try
+        {
+            results[i] = fetch_bytes_per_second(probes[i].rtsp_url, max_measured_duration_seconds, probes[i].username, probes[i].password);
+        }
+        catch(const exception& e)
+        {
+            R_LOG_ERROR("Unable to measure bitrate of %s: %s", probes[i].rtsp_url.c_str(), e.what());
+        }
+    });
+
+    return results;
+}
+
+r_camera_params r_pipeline::fetch_camera_params(
+    const std::string& rtsp_url,
+    const r_utils::r_nullable<std::string>& username,
+    const r_utils::r_nullable<std::string>& password
+)
+{
+    auto result = _probe(rtsp_url, 15, true, username, password);
+
     r_camera_params cp;
-    cp.bytes_per_second = (int64_t)(((double)(audio_byte_total + video_byte_total)) / (double)duration_cast<seconds>(delta).count());
-    cp.sdp_medias = medias;
-    cp.video_key_frame = video_key_frame;
-    cp.sample_ctx = captured_sample_ctx;
+    cp.bytes_per_second = result.bytes_per_second;
+    cp.sdp_medias = result.medias;
+    cp.video_key_frame = result.video_key_frame;
+    cp.sample_ctx = result.sample_ctx;
     return cp;
 }
 
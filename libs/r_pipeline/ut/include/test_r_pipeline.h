@@ -5,7 +5,10 @@ class test_r_pipeline : public test_fixture
 {
 public:
     RTF_FIXTURE(test_r_pipeline);
+      // Ahead of test_gst_source_h264_aac, which deinitializes gstreamer.
+      TEST(test_r_pipeline::test_abr_transcoder);
       TEST(test_r_pipeline::test_gst_source_h264_aac);
+      TEST(test_r_pipeline::test_bitrate_cache);
 #if 0
       TEST(test_r_pipeline::test_gst_source_h265_aac);
       TEST(test_r_pipeline::test_gst_source_h264_mulaw);
@@ -27,6 +30,8 @@ public:
     virtual void teardown();
 
     void test_gst_source_h264_aac();
+    void test_bitrate_cache();
+    void test_abr_transcoder();
 #if 0
     void test_gst_source_h265_aac();
     void test_gst_source_h264_mulaw();
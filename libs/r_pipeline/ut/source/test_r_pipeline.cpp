@@ -5,7 +5,9 @@
 #include "r_pipeline/r_gst_source.h"
 #include "r_pipeline/r_arg.h"
 #include "r_pipeline/r_stream_info.h"
+#include "r_pipeline/r_bitrate_cache.h"
 #include "r_fakey/r_fake_camera.h"
+#include "r_av/r_abr_transcoder.h"
 #include "r_utils/r_string_utils.h"
 #include "r_utils/r_work_q.h"
 #include "r_utils/r_std_utils.h"
@@ -31,6 +33,7 @@ using namespace std::chrono;
 using namespace r_pipeline;
 using namespace r_fakey;
 using namespace r_utils;
+using namespace r_av;
 
 REGISTER_TEST_FIXTURE(test_r_pipeline);
 
@@ -346,24 +349,202 @@ void test_r_pipeline::test_gst_source_bframes()
     fc->quit();
 }
 
-void test_r_pipeline::test_gst_source_fetch_bytes_per_second()
+void test_r_pipeline::test_abr_transcoder()
 {
+    GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
+    std::thread loopThread([&] {
+        g_main_loop_run(loop);
+    });
+
     int port = RTF_NEXT_PORT();
 
     auto fc = _create_fc(port);
     if(!fc)
+    {
+        g_main_loop_quit(loop);
+        loopThread.join();
+        g_main_loop_unref(loop);
         return;
+    }
 
     auto fct = thread([&](){
         fc->start();
     });
     fct.detach();
 
-    auto bytes_per_second = fetch_bytes_per_second(r_string_utils::format("rtsp://127.0.0.1:%d/true_north_h264_aac.mkv", port), 15);
+    vector<r_arg> arguments;
+    add_argument(arguments, "url", r_string_utils::format("rtsp://127.0.0.1:%d/true_north_h264_aac_no_bf.mp4", port));
+
+    vector<r_abr_rung> ladder = {{640, 360, 1000000}, {320, 180, 300000}};
+
+    mutex packets_lock;
+    vector<size_t> n_packets(ladder.size());
+    vector<bool> starts_with_key(ladder.size());
+
+    unique_ptr<r_abr_transcoder> abr;
+
+    r_gst_source src;
+    src.set_args(arguments);
+    src.set_video_sample_cb(
+        [&](const sample_context& ctx, const r_gst_buffer& buffer, bool key, int64_t pts){
+            if(!abr)
+            {
+                if(!key)
+                    return;
+
+                string params;
+                auto sps = ctx.sprop_sps();
+                auto pps = ctx.sprop_pps();
+                if(!sps.is_null())
+                    params += "sprop-sps=" + sps.value();
+                if(!pps.is_null())
+                    params += ", sprop-pps=" + pps.value();
+
+                auto fr = ctx.framerate();
+                AVRational framerate = av_d2q((fr.is_null()) ? 30.0 : fr.value(), 1000);
+
+                abr = make_unique<r_abr_transcoder>(
+                    AV_CODEC_ID_H264,
+                    make_h264_extradata(get_h264_sps(params), get_h264_pps(params)),
+                    AVRational{1, 1000},
+                    framerate,
+                    ladder,
+                    [&](size_t rung, const r_packet_info& pi){
+                        lock_guard<mutex> g(packets_lock);
+                        if(n_packets[rung] == 0)
+                            starts_with_key[rung] = pi.key;
+                        ++n_packets[rung];
+                    }
+                );
+                abr->start();
+            }
+
+            auto mi = buffer.map(r_gst_buffer::MT_READ);
+            abr->write_frame(mi.data(), mi.size(), pts);
+        }
+    );
+
+    src.play();
+
+    std::this_thread::sleep_for(std::chrono::seconds(10));
+
+    src.stop();
+
+    g_main_loop_quit(loop);
+    loopThread.join();
+    g_main_loop_unref(loop);
 
     fc->quit();
 
+    RTF_ASSERT(abr);
+
+    abr->stop();
+
+    auto stats = abr->stats();
+    RTF_ASSERT(stats.size() == ladder.size());
+
+    for(size_t i = 0; i < ladder.size(); ++i)
+    {
+        RTF_ASSERT(stats[i].frames_encoded > 0);
+        RTF_ASSERT(stats[i].bytes_encoded > 0);
+        RTF_ASSERT(n_packets[i] > 0);
+        RTF_ASSERT(starts_with_key[i]);
+
+        // stop() flushed the encoders, so every frame a rung encoded reached the callback.
+        RTF_ASSERT(n_packets[i] == stats[i].frames_encoded);
+    }
+
+    // Every rung saw the same decoded frames, encoding or dropping each one.
+    RTF_ASSERT(stats[0].frames_encoded + stats[0].frames_dropped == stats[1].frames_encoded + stats[1].frames_dropped);
+
+    // The smaller rung has the lower bitrate.
+    RTF_ASSERT(stats[1].bytes_encoded < stats[0].bytes_encoded);
+}
+
+void test_r_pipeline::test_bitrate_cache()
+{
+    {
+        r_bitrate_cache cache;
+
+        RTF_ASSERT(cache.get("rtsp://a", "h264").is_null());
+
+        cache.put("rtsp://a", "h264", 100000);
+        RTF_ASSERT(cache.get("rtsp://a", "h264").value() == 100000);
+
+        // Same camera, new codec parameters: that's a different stream as far as we're concerned.
+        RTF_ASSERT(cache.get("rtsp://a", "h265").is_null());
+        RTF_ASSERT(cache.get("rtsp://b", "h264").is_null());
+
+        // Live observations are blended in rather than replacing the estimate outright.
+        cache.refine("rtsp://a", "h264", 200000);
+        auto refined = cache.get("rtsp://a", "h264").value();
+        RTF_ASSERT(refined > 100000 && refined < 200000);
+
+        for(int i = 0; i < 50; ++i)
+            cache.refine("rtsp://a", "h264", 200000);
+        RTF_ASSERT(cache.get("rtsp://a", "h264").value() > 199000);
+
+        // A refine of a stream we never probed creates the entry, zero rates are ignored.
+        cache.refine("rtsp://c", "h264", 50000);
+        RTF_ASSERT(cache.get("rtsp://c", "h264").value() == 50000);
+        cache.put("rtsp://d", "h264", 0);
+        RTF_ASSERT(cache.get("rtsp://d", "h264").is_null());
+
+        auto stats = cache.stats();
+        RTF_ASSERT(stats.probes == 1);
+        RTF_ASSERT(stats.refinements == 52);
+        RTF_ASSERT(stats.entries == 2);
+    }
+
+    {
+        r_bitrate_cache cache(milliseconds(50));
+        cache.put("rtsp://a", "h264", 100000);
+        RTF_ASSERT(!cache.get("rtsp://a", "h264").is_null());
+        this_thread::sleep_for(milliseconds(100));
+        RTF_ASSERT(cache.get("rtsp://a", "h264").is_null());
+    }
+
+    RTF_ASSERT(codec_signature("h264", "sprop-parameter-sets=abc", "", "") != codec_signature("h264", "sprop-parameter-sets=abd", "", ""));
+}
+
+void test_r_pipeline::test_gst_source_fetch_bytes_per_second()
+{
+    int port = RTF_NEXT_PORT();
+
+    auto fc = _create_fc(port);
+    if(!fc)
+        return;
+
+    auto fct = thread([&](){
+        fc->start();
+    });
+    fct.detach();
+
+    auto url = r_string_utils::format("rtsp://127.0.0.1:%d/true_north_h264_aac.mkv", port);
+
+    bitrate_cache().clear();
+    auto before = bitrate_cache().stats();
+
+    auto bytes_per_second = fetch_bytes_per_second(url, 15);
+
     RTF_ASSERT(bytes_per_second >= 16000 && bytes_per_second <= 24000);
+
+    // The first probe measured the stream and stored what it found.
+    auto measured = bitrate_cache().stats();
+    RTF_ASSERT(measured.misses == before.misses + 1);
+    RTF_ASSERT(measured.probes == before.probes + 1);
+    RTF_ASSERT(measured.entries == 1);
+
+    // The second probe of the same stream only has to read its SDP.
+    auto cached_bytes_per_second = fetch_bytes_per_second(url, 15);
+
+    fc->quit();
+
+    RTF_ASSERT(cached_bytes_per_second == bytes_per_second);
+
+    auto cached = bitrate_cache().stats();
+    RTF_ASSERT(cached.hits == measured.hits + 1);
+    RTF_ASSERT(cached.probes == measured.probes);
 }
 
 void test_r_pipeline::test_stream_info_get_info_frames()
@@ -8,11 +8,32 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <climits>
 
 namespace r_storage
 {
 
+// A frame handed to a visit() callback. data points into the storage file and is only valid until
+// the callback returns.
+struct r_storage_frame_ref
+{
+    int64_t ts;
+    r_storage_media_type stream_id;
+    bool key;
+    const uint8_t* data;
+    size_t size;
+};
+
+struct r_storage_codec_info
+{
+    std::string video_codec_name;
+    std::string video_codec_parameters;
+    std::string audio_codec_name;
+    std::string audio_codec_parameters;
+    bool has_audio {false};
+};
+
 class r_storage_file_reader final
 {
 public:
@@ -31,6 +52,25 @@ public:
 
     R_API std::vector<uint8_t> query_key(r_storage_media_type media_type, int64_t ts);
 
+    // query_key_frames() returns video key frames only (in the same format as query()), starting at the
+    // key frame at or before start_ts and taking at most one key frame per min_interval milliseconds
+    // before end_ts. After each pick the iterator jumps (find()) to pick + min_interval and steps from
+    // there to the next key frame, so the frames in between are never visited. min_interval <= 0
+    // returns every key frame.
+    R_API std::vector<uint8_t> query_key_frames(int64_t start_ts, int64_t end_ts, int64_t min_interval);
+
+    // codec_info() returns the codecs recorded at the video key frame at or before start_ts, and
+    // whether there is any audio in [start_ts, end_ts). No frame data is read.
+    R_API r_storage_codec_info codec_info(int64_t start_ts, int64_t end_ts);
+
+    // visit() calls cb with the video and audio frames in [start_ts, end_ts) in timestamp order,
+    // without copying them. Video starts at the key frame at or before start_ts, audio at start_ts.
+    R_API void visit(int64_t start_ts, int64_t end_ts, const std::function<void(const r_storage_frame_ref&)>& cb);
+
+    // visit_video() calls cb with the video frames from the first at or after start_ts onwards, in
+    // order and without copying them, until cb returns false or the recording runs out.
+    R_API void visit_video(int64_t start_ts, const std::function<bool(const r_storage_frame_ref&)>& cb);
+
     R_API std::vector<std::pair<int64_t, int64_t>> query_segments(int64_t start_ts = 0, int64_t end_ts = LLONG_MAX);
 
     R_API std::vector<std::pair<int64_t, int64_t>> query_blocks(int64_t start_ts = 0, int64_t end_ts = LLONG_MAX);
@@ -38,6 +78,9 @@ public:
     // key_frame_start_times() returns an array of key frame timestamps
     R_API std::vector<int64_t> key_frame_start_times(r_storage_media_type media_type, int64_t start_ts = 0, int64_t end_ts = LLONG_MAX);
 
+    // key_frame_ts() returns the timestamp of the key frame at or before ts without reading any frame data
+    R_API r_utils::r_nullable<int64_t> key_frame_ts(r_storage_media_type media_type, int64_t ts);
+
     R_API r_utils::r_nullable<int64_t> last_ts();
     R_API r_utils::r_nullable<int64_t> first_ts();
 
@@ -2,6 +2,7 @@
 #include "r_utils/r_exception.h"
 #include "r_utils/r_string_utils.h"
 #include "r_utils/r_logger.h"
+#include "r_utils/r_metrics.h"
 #include "r_utils/3rdparty/json/json.h"
 #include <memory>
 
@@ -76,7 +77,16 @@ void r_storage_file::write_frame(const r_storage_write_context& ctx, r_storage_m
     
     uint8_t flags = key ? 1 : 0;
 
-    _writer->write(*ctx.wc, p, size, ts, flags);
+    static auto& write_duration = metrics().histogram("revere_storage_write_duration_seconds", "Time taken to write a frame to storage.", {}, R_METRICS_MICROSECONDS);
+    static auto& video_bytes = metrics().counter("revere_storage_write_bytes_total", "Bytes of media written to storage.", {{"media", "video"}});
+    static auto& audio_bytes = metrics().counter("revere_storage_write_bytes_total", "Bytes of media written to storage.", {{"media", "audio"}});
+
+    {
+        r_histogram_timer timer(write_duration);
+        _writer->write(*ctx.wc, p, size, ts, flags);
+    }
+
+    ((media_type == R_STORAGE_MEDIA_TYPE_VIDEO) ? video_bytes : audio_bytes).inc(size);
 }
 
 size_t r_storage_file::remove_blocks(const std::string& file_name, int64_t start_ts, int64_t end_ts)
@@ -197,6 +197,214 @@ vector<uint8_t> r_storage_file_reader::query_key(r_storage_media_type media_type
     return r_blob_tree::serialize(bt, 1);
 }
 
+vector<uint8_t> r_storage_file_reader::query_key_frames(int64_t start_ts, int64_t end_ts, int64_t min_interval)
+{
+    r_blob_tree bt;
+
+    string video_codec_name, video_codec_parameters;
+    string audio_codec_name, audio_codec_parameters;
+    bool has_video_metadata = false;
+
+    auto base_name = _file_name.substr(0, (_file_name.find_last_of('.')));
+    auto nanots_file_name = base_name + ".nts";
+
+    size_t fi = 0;
+    try {
+        nanots_iterator iterator(nanots_file_name, "video");
+        iterator.find(start_ts);
+
+        // Back up to find previous key frame
+        while (iterator.valid() && iterator->flags == 0) {
+            --iterator;
+            if (!iterator.valid()) break;
+        }
+
+        if (!iterator.valid())
+            iterator.find(start_ts);
+
+        int64_t next_ts = LLONG_MIN;
+
+        while (iterator.valid() && iterator->timestamp < end_ts) {
+            if (iterator->flags == 0 || iterator->timestamp < next_ts) {
+                ++iterator;
+                continue;
+            }
+
+            vector<uint8_t> frame_data(iterator->size);
+            memcpy(frame_data.data(), iterator->data, iterator->size);
+
+            bt["frames"][fi]["ind_block_ts"] = r_string_utils::int64_to_s(iterator->timestamp);
+            bt["frames"][fi]["data"] = frame_data;
+            bt["frames"][fi]["ts"] = r_string_utils::int64_to_s(iterator->timestamp);
+            bt["frames"][fi]["key"] = string("true");
+            bt["frames"][fi]["stream_id"] = r_string_utils::uint8_to_s(R_STORAGE_MEDIA_TYPE_VIDEO);
+            ++fi;
+
+            if (!has_video_metadata) {
+                auto metadata = iterator.current_metadata();
+                if (!metadata.empty()) {
+                    _extract_codec_info(metadata, video_codec_name, video_codec_parameters,
+                                      audio_codec_name, audio_codec_parameters);
+                    has_video_metadata = true;
+                }
+            }
+
+            if (min_interval <= 0) {
+                ++iterator;
+                continue;
+            }
+
+            next_ts = iterator->timestamp + min_interval;
+            if (next_ts >= end_ts)
+                break;
+
+            // Jump to the next pick rather than stepping over every frame in between.
+            iterator.find(next_ts);
+        }
+    } catch (const nanots_exception&) {
+        // Handle case where stream doesn't exist
+    }
+
+    bt["video_codec_name"] = video_codec_name;
+    bt["video_codec_parameters"] = video_codec_parameters;
+    bt["audio_codec_name"] = string();
+    bt["audio_codec_parameters"] = string();
+    bt["has_audio"] = string("false");
+
+    return r_blob_tree::serialize(bt, 1);
+}
+
+r_storage_codec_info r_storage_file_reader::codec_info(int64_t start_ts, int64_t end_ts)
+{
+    r_storage_codec_info info;
+
+    auto base_name = _file_name.substr(0, (_file_name.find_last_of('.')));
+    auto nanots_file_name = base_name + ".nts";
+
+    try {
+        nanots_iterator video_iterator(nanots_file_name, "video");
+        video_iterator.find(start_ts);
+
+        while (video_iterator.valid() && video_iterator->flags == 0) {
+            --video_iterator;
+            if (!video_iterator.valid()) break;
+        }
+
+        if (video_iterator.valid()) {
+            auto metadata = video_iterator.current_metadata();
+            if (!metadata.empty())
+                _extract_codec_info(metadata, info.video_codec_name, info.video_codec_parameters,
+                                    info.audio_codec_name, info.audio_codec_parameters);
+        }
+    } catch (const nanots_exception&) {
+        // No video stream
+    }
+
+    try {
+        nanots_iterator audio_iterator(nanots_file_name, "audio");
+        audio_iterator.find(start_ts);
+
+        if (audio_iterator.valid() && audio_iterator->timestamp < end_ts) {
+            info.has_audio = true;
+
+            auto metadata = audio_iterator.current_metadata();
+            if (!metadata.empty()) {
+                string video_codec_name, video_codec_parameters;
+                _extract_codec_info(metadata, video_codec_name, video_codec_parameters,
+                                    info.audio_codec_name, info.audio_codec_parameters);
+            }
+        }
+    } catch (const nanots_exception&) {
+        // No audio stream
+    }
+
+    return info;
+}
+
+void r_storage_file_reader::visit(int64_t start_ts, int64_t end_ts, const function<void(const r_storage_frame_ref&)>& cb)
+{
+    auto base_name = _file_name.substr(0, (_file_name.find_last_of('.')));
+    auto nanots_file_name = base_name + ".nts";
+
+    unique_ptr<nanots_iterator> video_iterator;
+    unique_ptr<nanots_iterator> audio_iterator;
+
+    try {
+        video_iterator = make_unique<nanots_iterator>(nanots_file_name, "video");
+        video_iterator->find(start_ts);
+
+        // Back up to find previous key frame
+        while (video_iterator->valid() && (*video_iterator)->flags == 0) {
+            --(*video_iterator);
+            if (!video_iterator->valid()) break;
+        }
+
+        if (!video_iterator->valid())
+            video_iterator->find(start_ts);
+    } catch (const nanots_exception&) {
+        video_iterator.reset();
+    }
+
+    try {
+        audio_iterator = make_unique<nanots_iterator>(nanots_file_name, "audio");
+        audio_iterator->find(start_ts);
+    } catch (const nanots_exception&) {
+        audio_iterator.reset();
+    }
+
+    auto more = [end_ts](const unique_ptr<nanots_iterator>& i) {
+        return i && i->valid() && (*i)->timestamp < end_ts;
+    };
+
+    while (more(video_iterator) || more(audio_iterator)) {
+        // Video goes first on a tie, as in _merge_frames().
+        bool take_video = more(video_iterator) &&
+                          (!more(audio_iterator) || (*video_iterator)->timestamp <= (*audio_iterator)->timestamp);
+
+        auto& iterator = (take_video) ? *video_iterator : *audio_iterator;
+
+        r_storage_frame_ref frame;
+        frame.ts = iterator->timestamp;
+        frame.stream_id = (take_video) ? R_STORAGE_MEDIA_TYPE_VIDEO : R_STORAGE_MEDIA_TYPE_AUDIO;
+        frame.key = iterator->flags > 0;
+        frame.data = (const uint8_t*)iterator->data;
+        frame.size = iterator->size;
+
+        cb(frame);
+
+        ++iterator;
+    }
+}
+
+void r_storage_file_reader::visit_video(int64_t start_ts, const function<bool(const r_storage_frame_ref&)>& cb)
+{
+    auto base_name = _file_name.substr(0, (_file_name.find_last_of('.')));
+    auto nanots_file_name = base_name + ".nts";
+
+    unique_ptr<nanots_iterator> iterator;
+
+    try {
+        iterator = make_unique<nanots_iterator>(nanots_file_name, "video");
+        iterator->find(start_ts);
+    } catch (const nanots_exception&) {
+        return;
+    }
+
+    while (iterator->valid()) {
+        r_storage_frame_ref frame;
+        frame.ts = (*iterator)->timestamp;
+        frame.stream_id = R_STORAGE_MEDIA_TYPE_VIDEO;
+        frame.key = (*iterator)->flags > 0;
+        frame.data = (const uint8_t*)(*iterator)->data;
+        frame.size = (*iterator)->size;
+
+        if (!cb(frame))
+            break;
+
+        ++(*iterator);
+    }
+}
+
 vector<pair<int64_t, int64_t>> r_storage_file_reader::query_segments(int64_t start_ts, int64_t end_ts)
 {
     vector<pair<int64_t, int64_t>> segments;
@@ -317,6 +525,36 @@ vector<int64_t> r_storage_file_reader::key_frame_start_times(r_storage_media_typ
     return key_frame_times;
 }
 
+r_nullable<int64_t> r_storage_file_reader::key_frame_ts(r_storage_media_type media_type, int64_t ts)
+{
+    if (media_type == R_STORAGE_MEDIA_TYPE_ALL || media_type >= R_STORAGE_MEDIA_TYPE_MAX)
+        R_THROW(("Invalid storage media type."));
+
+    r_nullable<int64_t> result;
+
+    auto base_name = _file_name.substr(0, (_file_name.find_last_of('.')));
+    auto nanots_file_name = base_name + ".nts";
+
+    try {
+        string stream_tag = (media_type == R_STORAGE_MEDIA_TYPE_VIDEO) ? "video" : "audio";
+        nanots_iterator iterator(nanots_file_name, stream_tag);
+        iterator.find(ts);
+
+        // Back up to find the closest previous key frame
+        while (iterator.valid() && iterator->flags == 0) {
+            --iterator;
+            if (!iterator.valid()) break;
+        }
+
+        if (iterator.valid() && iterator->flags > 0)
+            result.set_value(iterator->timestamp);
+    } catch (const nanots_exception&) {
+        // Stream doesn't exist or no key frame found
+    }
+
+    return result;
+}
+
 r_nullable<int64_t> r_storage_file_reader::last_ts()
 {
     r_nullable<int64_t> result;
@@ -5,6 +5,7 @@ class test_r_storage : public test_fixture
 {
 public:
     RTF_FIXTURE(test_r_storage);
+      TEST(test_r_storage::test_r_storage_file_query_key_frames);
 #if 0
       TEST(test_r_storage::test_r_dumbdex_writing);
       TEST(test_r_storage::test_r_dumbdex_consistency);
@@ -38,6 +39,8 @@ public:
     virtual void setup();
     virtual void teardown();
 
+    void test_r_storage_file_query_key_frames();
+
 #if 0
     void test_r_dumbdex_writing();
     void test_r_dumbdex_consistency();
@@ -9,6 +9,7 @@
 #include "r_utils/r_exception.h"
 #include "r_utils/r_algorithms.h"
 #include "r_utils/r_file.h"
+#include "r_utils/r_blob_tree.h"
 //#include "r_utils/r_blob_tree.h"
 //#include "r_pipeline/r_gst_source.h"
 //#include "r_pipeline/r_arg.h"
@@ -56,6 +57,8 @@ static void _whack_files()
         r_fs::remove_file("nanots_test_16mb.nts");
     if(r_fs::file_exists("nanots_test_4mb.nts"))
         r_fs::remove_file("nanots_test_4mb.nts");
+    if(r_fs::file_exists("key_frames_test.nts"))
+        r_fs::remove_file("key_frames_test.nts");
 
 //    if(r_fs::file_exists("test_file.rvd"))
 //        r_fs::remove_file("test_file.rvd");
@@ -86,6 +89,68 @@ void test_r_storage::teardown()
     _whack_files();
 }
 
+static vector<int64_t> _key_frame_times(r_storage_file_reader& sfr, int64_t start_ts, int64_t end_ts, int64_t min_interval)
+{
+    auto result = sfr.query_key_frames(start_ts, end_ts, min_interval);
+
+    uint32_t version = 0;
+    auto bt = r_blob_tree::deserialize(result.data(), result.size(), version);
+
+    vector<int64_t> times;
+    if(!bt.has_key("frames"))
+        return times;
+
+    for(size_t i = 0; i < bt["frames"].size(); ++i)
+    {
+        RTF_ASSERT(bt["frames"][i]["key"].get_string() == "true");
+        times.push_back(r_string_utils::s_to_int64(bt["frames"][i]["ts"].get_string()));
+    }
+
+    return times;
+}
+
+void test_r_storage::test_r_storage_file_query_key_frames()
+{
+    // 20 seconds of 10 fps video with a key frame every second: key frames at 1000, 2000 ... 20000.
+    {
+        r_storage_file::allocate("key_frames_test.rvd", 65536, 10);
+
+        r_storage_file sf("key_frames_test.rvd");
+
+        auto wc = sf.create_write_context("h264", string("params"), R_STORAGE_MEDIA_TYPE_VIDEO);
+
+        vector<uint8_t> frame(256);
+        std::iota(begin(frame), end(frame), 0);
+
+        for(int i = 0; i < 200; ++i)
+        {
+            int64_t ts = 1000 + (i * 100);
+            sf.write_frame(wc, R_STORAGE_MEDIA_TYPE_VIDEO, frame.data(), frame.size(), (i % 10) == 0, ts, ts);
+        }
+    }
+
+    r_storage_file_reader sfr("key_frames_test.rvd");
+
+    // No interval returns every key frame in the range.
+    auto all = _key_frame_times(sfr, 1000, 21000, 0);
+    RTF_ASSERT(all.size() == 20);
+    RTF_ASSERT(all.front() == 1000);
+    RTF_ASSERT(all.back() == 20000);
+
+    // One key frame per 3 seconds, stopping once the next pick would be at or past end_ts.
+    RTF_ASSERT(_key_frame_times(sfr, 1000, 21000, 3000) == vector<int64_t>({1000, 4000, 7000, 10000, 13000, 16000, 19000}));
+
+    // A start in the middle of a GOP begins at that GOP's key frame, and end_ts is exclusive.
+    RTF_ASSERT(_key_frame_times(sfr, 2500, 9000, 2000) == vector<int64_t>({2000, 4000, 6000, 8000}));
+    RTF_ASSERT(_key_frame_times(sfr, 2000, 8000, 2000) == vector<int64_t>({2000, 4000, 6000}));
+
+    // A step that lands between key frames moves on to the next key frame.
+    RTF_ASSERT(_key_frame_times(sfr, 1000, 8000, 1500) == vector<int64_t>({1000, 3000, 5000, 7000}));
+
+    // A range that ends before the first frame returns nothing.
+    RTF_ASSERT(_key_frame_times(sfr, 0, 500, 1000).empty());
+}
+
 #if 0
 
 static int _random()
@@ -13,6 +13,19 @@ namespace r_ui_utils
 // Forward declaration for ImGui compatibility
 struct ImTextureID;
 
+// The planes of a 4:2:0 picture, as a decoder leaves them. I420 has separate U and V planes, NV12
+// has one plane of interleaved U and V (in u, v is unused).
+struct yuv_planes
+{
+    bool nv12 = false;
+    const uint8_t* y = nullptr;
+    int y_pitch = 0;
+    const uint8_t* u = nullptr;
+    int u_pitch = 0;
+    const uint8_t* v = nullptr;
+    int v_pitch = 0;
+};
+
 class texture final
 {
 public:
@@ -48,12 +61,27 @@ public:
         uint16_t h,
         bool rgba = true);
 
+    // Create texture from YUV planes. The renderer converts to RGB when it draws (in its shaders,
+    // if it has_native_format() for the planes).
+    R_API static std::shared_ptr<texture> create_from_yuv(
+        SDL_Renderer* renderer,
+        const yuv_planes& planes,
+        uint16_t w,
+        uint16_t h);
+
+    // True if renderer takes textures of format as they are. Otherwise SDL converts them to RGB on
+    // the CPU, and uploading YUV saves nothing.
+    R_API static bool has_native_format(SDL_Renderer* renderer, Uint32 format);
+
     // Update existing texture with new RGBA pixel data
     R_API bool update_rgba(const uint8_t* pixels, uint16_t w, uint16_t h);
 
     // Update existing texture with new RGB pixel data
     R_API bool update_rgb(const uint8_t* pixels, uint16_t w, uint16_t h);
 
+    // Update existing texture with new YUV planes (the texture becomes a YUV texture if it wasn't)
+    R_API bool update_yuv(const yuv_planes& planes, uint16_t w, uint16_t h);
+
     // Get dimensions
     R_API uint16_t width() const { return _width; }
     R_API uint16_t height() const { return _height; }
@@ -74,6 +102,7 @@ private:
     uint16_t _width = 0;
     uint16_t _height = 0;
     bool _is_rgba = true;
+    Uint32 _format = SDL_PIXELFORMAT_ARGB8888;
 };
 
 } // namespace r_ui_utils
@@ -19,7 +19,8 @@ enum load_type
     load_type_destroy_texture,
     load_type_image_file,
     load_type_image_memory,
-    load_type_rgb_memory
+    load_type_rgb_memory,
+    load_type_yuv_memory
 };
 
 struct texture_load_request
@@ -31,6 +32,7 @@ struct texture_load_request
     size_t size;
     uint16_t width;
     uint16_t height;
+    yuv_planes planes;
     SDL_Renderer* renderer;
 };
 
@@ -55,6 +57,8 @@ public:
     R_API std::pair<uint16_t, uint16_t> load_texture_from_image_memory(std::shared_ptr<texture> tex, const uint8_t* data, size_t size);
     R_API std::pair<uint16_t, uint16_t> load_texture_from_image_file(std::shared_ptr<texture> tex, const std::string& filename);
     R_API void load_texture_from_rgb_memory(std::shared_ptr<texture> tex, const uint8_t* data, size_t size, uint16_t width, uint16_t height);
+    // The planes are uploaded as they are (no conversion to RGB on the CPU), into tex.
+    R_API void load_texture_from_yuv_memory(std::shared_ptr<texture> tex, const yuv_planes& planes, uint16_t width, uint16_t height);
 
     R_API void work();
 
@@ -9,7 +9,8 @@ texture::texture() :
     _renderer(nullptr),
     _width(0),
     _height(0),
-    _is_rgba(true)
+    _is_rgba(true),
+    _format(SDL_PIXELFORMAT_ARGB8888)
 {
 }
 
@@ -27,7 +28,8 @@ texture::texture(texture&& other) noexcept :
     _renderer(other._renderer),
     _width(other._width),
     _height(other._height),
-    _is_rgba(other._is_rgba)
+    _is_rgba(other._is_rgba),
+    _format(other._format)
 {
     other._sdl_texture = nullptr;
     other._renderer = nullptr;
@@ -47,6 +49,7 @@ texture& texture::operator=(texture&& other) noexcept
         _width = other._width;
         _height = other._height;
         _is_rgba = other._is_rgba;
+        _format = other._format;
 
         other._sdl_texture = nullptr;
         other._renderer = nullptr;
@@ -151,6 +154,47 @@ std::shared_ptr<texture> texture::create_from_rgb(
     return tex;
 }
 
+std::shared_ptr<texture> texture::create_from_yuv(
+    SDL_Renderer* renderer,
+    const yuv_planes& planes,
+    uint16_t w,
+    uint16_t h)
+{
+    if (!renderer || !planes.y || !planes.u || (!planes.nv12 && !planes.v) || w == 0 || h == 0)
+    {
+        R_LOG_ERROR("Invalid parameters for create_from_yuv");
+        return nullptr;
+    }
+
+    auto tex = std::make_shared<texture>();
+    tex->_renderer = renderer;
+    tex->_is_rgba = false;
+
+    if (!tex->update_yuv(planes, w, h))
+        return nullptr;
+
+    return tex;
+}
+
+bool texture::has_native_format(SDL_Renderer* renderer, Uint32 format)
+{
+    SDL_RendererInfo info;
+    if (!renderer || SDL_GetRendererInfo(renderer, &info) != 0)
+        return false;
+
+    // The software renderer lists no YUV formats, but check anyway: its conversion is on the CPU.
+    if ((info.flags & SDL_RENDERER_SOFTWARE) != 0)
+        return false;
+
+    for (Uint32 i = 0; i < info.num_texture_formats; i++)
+    {
+        if (info.texture_formats[i] == format)
+            return true;
+    }
+
+    return false;
+}
+
 std::shared_ptr<texture> texture::create_streaming(
     SDL_Renderer* renderer,
     uint16_t w,
@@ -207,7 +251,7 @@ bool texture::update_rgba(const uint8_t* pixels, uint16_t w, uint16_t h)
     }
 
     // If dimensions changed, recreate the texture
-    if (w != _width || h != _height)
+    if (w != _width || h != _height || _format != SDL_PIXELFORMAT_ARGB8888)
     {
         SDL_DestroyTexture(_sdl_texture);
 
@@ -230,6 +274,7 @@ bool texture::update_rgba(const uint8_t* pixels, uint16_t w, uint16_t h)
         SDL_SetTextureBlendMode(_sdl_texture, SDL_BLENDMODE_BLEND);
         _width = w;
         _height = h;
+        _format = SDL_PIXELFORMAT_ARGB8888;
     }
 
     if (SDL_UpdateTexture(_sdl_texture, nullptr, pixels, w * 4) != 0)
@@ -250,7 +295,7 @@ bool texture::update_rgb(const uint8_t* pixels, uint16_t w, uint16_t h)
     }
 
     // If dimensions changed, recreate the texture
-    if (w != _width || h != _height)
+    if (w != _width || h != _height || _format != SDL_PIXELFORMAT_ARGB8888)
     {
         R_LOG_INFO("Texture dimensions changed from %dx%d to %dx%d, recreating", _width, _height, w, h);
         SDL_DestroyTexture(_sdl_texture);
@@ -273,6 +318,7 @@ bool texture::update_rgb(const uint8_t* pixels, uint16_t w, uint16_t h)
 
         _width = w;
         _height = h;
+        _format = SDL_PIXELFORMAT_ARGB8888;
     }
 
     if (SDL_UpdateTexture(_sdl_texture, nullptr, pixels, w * 4) != 0)
@@ -283,3 +329,53 @@ bool texture::update_rgb(const uint8_t* pixels, uint16_t w, uint16_t h)
 
     return true;
 }
+
+bool texture::update_yuv(const yuv_planes& planes, uint16_t w, uint16_t h)
+{
+    if (!_renderer || !planes.y || !planes.u || (!planes.nv12 && !planes.v))
+    {
+        R_LOG_ERROR("Invalid texture or planes in update_yuv");
+        return false;
+    }
+
+    Uint32 format = (planes.nv12) ? SDL_PIXELFORMAT_NV12 : SDL_PIXELFORMAT_IYUV;
+
+    // If dimensions or format changed, recreate the texture
+    if (!_sdl_texture || w != _width || h != _height || format != _format)
+    {
+        if (_sdl_texture)
+            SDL_DestroyTexture(_sdl_texture);
+
+        _sdl_texture = SDL_CreateTexture(
+            _renderer,
+            format,
+            SDL_TEXTUREACCESS_STREAMING,
+            w,
+            h
+        );
+
+        if (!_sdl_texture)
+        {
+            R_LOG_ERROR("Failed to create YUV texture: %s", SDL_GetError());
+            _width = 0;
+            _height = 0;
+            return false;
+        }
+
+        _width = w;
+        _height = h;
+        _format = format;
+    }
+
+    int result = (planes.nv12) ?
+        SDL_UpdateNVTexture(_sdl_texture, nullptr, planes.y, planes.y_pitch, planes.u, planes.u_pitch) :
+        SDL_UpdateYUVTexture(_sdl_texture, nullptr, planes.y, planes.y_pitch, planes.u, planes.u_pitch, planes.v, planes.v_pitch);
+
+    if (result != 0)
+    {
+        R_LOG_ERROR("Failed to update YUV texture: %s", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
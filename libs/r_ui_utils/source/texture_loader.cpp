@@ -79,6 +79,21 @@ void texture_loader::load_texture_from_rgb_memory(shared_ptr<texture> tex, const
         R_THROW(("texture_loader::load_texture_from_rgb_memory: failed to load texture"));
 }
 
+void texture_loader::load_texture_from_yuv_memory(shared_ptr<texture> tex, const yuv_planes& planes, uint16_t width, uint16_t height)
+{
+    texture_load_request r;
+    r.type = load_type_yuv_memory;
+    r.tex = tex;
+    r.planes = planes;
+    r.width = width;
+    r.height = height;
+    r.renderer = _renderer;
+
+    auto result = _load_q.post(r).get();
+    if(!result.success)
+        R_THROW(("texture_loader::load_texture_from_yuv_memory: failed to load texture"));
+}
+
 void texture_loader::work()
 {
     bool done = false;
@@ -185,6 +200,27 @@ void texture_loader::work()
                 }
                 break;
 
+                case load_type_yuv_memory:
+                {
+                    auto tex = texture::create_from_yuv(
+                        w.raw().first.renderer,
+                        w.raw().first.planes,
+                        w.raw().first.width,
+                        w.raw().first.height
+                    );
+
+                    if(tex && w.raw().first.tex)
+                        *w.raw().first.tex = std::move(*tex);
+
+                    texture_load_response response;
+                    response.success = (tex != nullptr);
+                    response.width = w.raw().first.width;
+                    response.height = w.raw().first.height;
+                    response.tex = w.raw().first.tex;
+                    w.raw().second.set_value(response);
+                }
+                break;
+
                 default:
                     R_THROW(("texture_loader::work: unknown load type"));
             }
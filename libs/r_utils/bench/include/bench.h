@@ -0,0 +1,31 @@
+
+#ifndef __bench_h
+#define __bench_h
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+// Benchmarks print numbers for a person to read, they don't pass or fail. They're kept out of the
+// unit tests so that ut runs stay quick and don't depend on how busy the machine is. Build them with
+// -DREVERE_BUILD_BENCHMARKS=ON and run the bench executable, optionally naming the benchmarks to run.
+
+typedef std::function<void()> bench_fn;
+
+std::vector<std::pair<std::string, bench_fn>>& registered_benches();
+
+struct bench_registrar
+{
+    bench_registrar(const std::string& name, bench_fn fn)
+    {
+        registered_benches().push_back(std::make_pair(name, fn));
+    }
+};
+
+#define REGISTER_BENCH(name) \
+    static void name(); \
+    static bench_registrar name##_registrar(#name, name); \
+    static void name()
+
+#endif
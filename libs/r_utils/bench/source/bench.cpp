@@ -0,0 +1,46 @@
+
+#include "bench.h"
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+std::vector<std::pair<std::string, bench_fn>>& registered_benches()
+{
+    static std::vector<std::pair<std::string, bench_fn>> benches;
+    return benches;
+}
+
+int main(int argc, char* argv[])
+{
+    int n_failed = 0;
+
+    for(auto& b : registered_benches())
+    {
+        bool selected = (argc < 2);
+        for(int i = 1; i < argc; ++i)
+        {
+            if(b.first == argv[i])
+                selected = true;
+        }
+
+        if(!selected)
+            continue;
+
+        printf("[%s]\n", b.first.c_str());
+        fflush(stdout);
+
+        try
+        {
+            b.second();
+        }
+        catch(const std::exception& ex)
+        {
+            printf("%s failed: %s\n", b.first.c_str(), ex.what());
+            ++n_failed;
+        }
+
+        fflush(stdout);
+    }
+
+    return (n_failed > 0) ? 1 : 0;
+}
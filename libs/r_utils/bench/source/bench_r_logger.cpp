@@ -0,0 +1,54 @@
+
+#include "bench.h"
+#include "r_utils/r_logger.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+
+static vector<int64_t> _log_call_latencies_ns(int n)
+{
+    vector<int64_t> latencies;
+    latencies.reserve(n);
+    for(int i = 0; i < n; ++i)
+    {
+        auto before = steady_clock::now();
+        R_LOG_INFO("motion metadata for camera %d at %lld", i % 8, (long long)i);
+        latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - before).count());
+    }
+    sort(begin(latencies), end(latencies));
+    return latencies;
+}
+
+// The latency a hot thread sees per log call when the sink is slow (a backed up syslog socket, a
+// full terminal), first logging synchronously and then asynchronously.
+REGISTER_BENCH(logger_async_latency)
+{
+    r_logger::set_log_callback([](r_logger::LOG_LEVEL, const string&){
+        this_thread::sleep_for(microseconds(200));
+    });
+
+    auto sync_latencies = _log_call_latencies_ns(200);
+
+    r_logger::async_logging_config config;
+    config.max_per_second_per_callsite = 0;
+    r_logger::start_async_logging(config);
+
+    // Stay under the ring size so we're measuring handoff rather than drops.
+    auto async_latencies = _log_call_latencies_ns(2000);
+
+    r_logger::stop_async_logging();
+    r_logger::clear_log_callback();
+
+    auto pct = [](const vector<int64_t>& v, double p){return v[(size_t)(p * (double)(v.size() - 1))];};
+
+    printf("log call latency (slow sink) sync: p50 %lldns p99 %lldns, async: p50 %lldns p99 %lldns\n",
+           (long long)pct(sync_latencies, 0.5), (long long)pct(sync_latencies, 0.99),
+           (long long)pct(async_latencies, 0.5), (long long)pct(async_latencies, 0.99));
+}
@@ -0,0 +1,88 @@
+
+#include "bench.h"
+#include "r_utils/r_ring_q.h"
+#include "r_utils/r_blocking_q.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+
+template<typename Q, typename DRAIN>
+static double _queue_items_per_second(Q& q, int n_producers, int n_per_producer, DRAIN drain)
+{
+    auto start = steady_clock::now();
+
+    // Producers retry when the queue is full, so every item is delivered and we're timing the
+    // consumer actually getting them rather than how fast a full queue can drop.
+    vector<thread> producers;
+    for(int p = 0; p < n_producers; ++p)
+    {
+        producers.push_back(thread([&](){
+            for(int i = 0; i < n_per_producer; ++i)
+            {
+                while(!q.post(i))
+                    this_thread::yield();
+            }
+        }));
+    }
+
+    int64_t total = (int64_t)n_producers * n_per_producer, delivered = 0;
+    while(delivered < total)
+        delivered += drain();
+
+    for(auto& t : producers)
+        t.join();
+
+    auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start).count();
+    return (double)total / elapsed;
+}
+
+// How the ring queues hold up against r_blocking_q as the number of producers feeding a single
+// consumer grows.
+REGISTER_BENCH(ring_q_contention)
+{
+    const int N_TOTAL = 400000;
+    const size_t CAPACITY = 1024;
+
+    for(auto n_producers : {1, 4, 16})
+    {
+        auto n_per_producer = N_TOTAL / n_producers;
+
+        r_blocking_q<int> blocking(CAPACITY, r_queue_full_policy::drop_newest);
+        auto blocking_rate = _queue_items_per_second(blocking, n_producers, n_per_producer, [&](){
+            return blocking.poll(milliseconds(10)).is_null() ? 0 : 1;
+        });
+
+        r_mpmc_q<int> mpmc(CAPACITY, r_queue_full_policy::drop_newest);
+        auto mpmc_rate = _queue_items_per_second(mpmc, n_producers, n_per_producer, [&](){
+            return mpmc.poll(milliseconds(10)).is_null() ? 0 : 1;
+        });
+
+        vector<int> batch;
+        r_mpmc_q<int> mpmc_batched(CAPACITY, r_queue_full_policy::drop_newest);
+        auto mpmc_batched_rate = _queue_items_per_second(mpmc_batched, n_producers, n_per_producer, [&](){
+            batch.clear();
+            auto n = mpmc_batched.pop_all(batch);
+            if(n == 0 && !mpmc_batched.poll(milliseconds(10)).is_null())
+                ++n;
+            return (int)n;
+        });
+
+        printf("%2d producer(s): r_blocking_q %.0f/s, r_mpmc_q %.0f/s, r_mpmc_q + pop_all() %.0f/s", n_producers, blocking_rate, mpmc_rate, mpmc_batched_rate);
+
+        if(n_producers == 1)
+        {
+            r_spsc_q<int> spsc(CAPACITY, r_queue_full_policy::drop_newest);
+            printf(", r_spsc_q %.0f/s", _queue_items_per_second(spsc, n_producers, n_per_producer, [&](){
+                return spsc.poll(milliseconds(10)).is_null() ? 0 : 1;
+            }));
+        }
+
+        printf("\n");
+    }
+}
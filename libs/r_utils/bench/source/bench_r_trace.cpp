@@ -0,0 +1,33 @@
+
+#include "bench.h"
+#include "r_utils/r_trace.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+
+// What a span costs with tracing off (the normal case) and on.
+REGISTER_BENCH(trace_overhead)
+{
+    const int N = 2000000;
+
+    auto per_span_ns = [&](){
+        auto start = steady_clock::now();
+        for(int i = 0; i < N; ++i)
+        {
+            R_TRACE_SPAN("bench.overhead");
+        }
+        return (double)duration_cast<nanoseconds>(steady_clock::now() - start).count() / (double)N;
+    };
+
+    r_trace::stop_tracing();
+    auto off_ns = per_span_ns();
+
+    r_trace::start_tracing();
+    auto on_ns = per_span_ns();
+    r_trace::stop_tracing();
+
+    printf("trace span cost: off %.1fns, on %.1fns\n", off_ns, on_ns);
+}
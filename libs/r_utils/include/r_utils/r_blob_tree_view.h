@@ -0,0 +1,189 @@
+#ifndef _r_utils_r_blob_tree_view_h
+#define _r_utils_r_blob_tree_view_h
+
+#include "r_utils/r_blob_tree.h"
+#include "r_utils/r_exception.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <type_traits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace r_utils
+{
+
+// A read only run of bytes inside the buffer an r_blob_tree_view was made from.
+class r_blob_span
+{
+public:
+    r_blob_span() = default;
+    r_blob_span(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+    const uint8_t* data() const noexcept { return _data; }
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+
+    const uint8_t* begin() const noexcept { return _data; }
+    const uint8_t* end() const noexcept { return _data + _size; }
+
+    std::vector<uint8_t> to_vector() const { return std::vector<uint8_t>(begin(), end()); }
+
+private:
+    const uint8_t* _data {nullptr};
+    size_t _size {0};
+};
+
+// r_blob_tree_view reads the output of r_blob_tree::serialize() in place. Construction walks the
+// buffer once to validate it and builds a flat index of its nodes (a single allocation). After that
+// lookups, iteration and leaf access don't allocate, and payloads are handed out as spans into the
+// buffer rather than copied. The buffer must outlive the view and anything taken from it.
+//
+// The children of a node sit next to each other in the index, so arrays are indexed directly and
+// objects are a binary search over their keys (r_blob_tree writes them in order).
+
+class r_blob_tree_view
+{
+    struct _entry
+    {
+        const char* key {nullptr};
+        const uint8_t* payload {nullptr};
+        uint32_t count {0};        // children for objects and arrays, payload bytes for leaves
+        uint32_t first_child {0};
+        uint16_t key_size {0};
+        r_blob_tree::node_type type {r_blob_tree::NT_LEAF};
+        bool sorted {true};        // object keys are in order, so we can binary search them
+    };
+
+public:
+    class node
+    {
+        friend class r_blob_tree_view;
+
+    public:
+        class iterator
+        {
+        public:
+            iterator(const r_blob_tree_view* view, uint32_t index) : _view(view), _index(index) {}
+
+            node operator*() const { return node(_view, _index); }
+            iterator& operator++() { ++_index; return *this; }
+            bool operator==(const iterator& other) const { return _index == other._index; }
+            bool operator!=(const iterator& other) const { return _index != other._index; }
+
+        private:
+            const r_blob_tree_view* _view;
+            uint32_t _index;
+        };
+
+        r_blob_tree::node_type type() const noexcept { return _e().type; }
+
+        // ------------ object access ------------
+        R_API node at(std::string_view key) const;
+        R_API bool has_key(std::string_view key) const;
+        node operator[](std::string_view key) const { return at(key); }
+
+        // ------------ array access ------------
+        R_API node at(size_t index) const;
+        bool has_index(size_t index) const { _expect_type(r_blob_tree::NT_ARRAY); return index < _e().count; }
+        node operator[](size_t index) const { return at(index); }
+
+        size_t size() const noexcept { return (_e().type == r_blob_tree::NT_LEAF) ? 0 : _e().count; }
+
+        // Children of an object or array, in order.
+        iterator begin() const { return iterator(_view, (_e().type == r_blob_tree::NT_LEAF) ? 0 : _e().first_child); }
+        iterator end() const { return iterator(_view, (_e().type == r_blob_tree::NT_LEAF) ? 0 : _e().first_child + _e().count); }
+
+        // This node's key in its parent object (empty for array elements and the root).
+        std::string_view key() const noexcept { return std::string_view(_e().key, _e().key_size); }
+
+        // ------------ leaf getters ------------
+        r_blob_span get_blob() const { _expect_type(r_blob_tree::NT_LEAF); return r_blob_span(_e().payload, _e().count); }
+        std::string_view get_string_view() const { _expect_type(r_blob_tree::NT_LEAF); return std::string_view(reinterpret_cast<const char*>(_e().payload), _e().count); }
+        std::string get_string() const { return std::string(get_string_view()); }
+        template<typename T> T get_value() const;
+
+    private:
+        node(const r_blob_tree_view* view, uint32_t index) : _view(view), _index(index) {}
+
+        const _entry& _e() const noexcept { return _view->_entries[_index]; }
+        R_API uint32_t _find(std::string_view key) const;
+        R_API void _expect_type(r_blob_tree::node_type nt) const;
+
+        const r_blob_tree_view* _view;
+        uint32_t _index;
+    };
+
+    R_API r_blob_tree_view(const uint8_t* p, size_t size, uint32_t& version);
+
+    r_blob_tree_view(const r_blob_tree_view&) = delete;
+    r_blob_tree_view(r_blob_tree_view&&) = default;
+
+    r_blob_tree_view& operator=(const r_blob_tree_view&) = delete;
+    r_blob_tree_view& operator=(r_blob_tree_view&&) = default;
+
+    node root() const { return node(this, 0); }
+
+    // The root is almost always an object, so these save a root() at the call site.
+    r_blob_tree::node_type type() const noexcept { return root().type(); }
+    node at(std::string_view key) const { return root().at(key); }
+    bool has_key(std::string_view key) const { return root().has_key(key); }
+    node operator[](std::string_view key) const { return root().at(key); }
+    size_t size() const noexcept { return root().size(); }
+
+    size_t n_nodes() const noexcept { return _entries.size(); }
+
+private:
+    static uint32_t _count_nodes(const uint8_t*& p, const uint8_t* end, size_t depth);
+    void _index_node(const uint8_t*& p, uint32_t index, uint32_t& next_free);
+
+    std::vector<_entry> _entries;
+};
+
+template<typename T>
+T r_blob_tree_view::node::get_value() const
+{
+    static_assert(std::is_arithmetic<T>::value, "r_blob_tree_view::node::get_value() is for numbers");
+
+    auto s = get_string_view();
+
+    // Be as forgiving as the stringstream in r_blob_tree::get_value().
+    size_t pos = 0;
+    while(pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\r' || s[pos] == '\n'))
+        ++pos;
+    if(pos < s.size() && s[pos] == '+')
+        ++pos;
+
+    T v{};
+
+    if constexpr(std::is_integral<T>::value && !std::is_same<T, bool>::value)
+    {
+        auto res = std::from_chars(s.data() + pos, s.data() + s.size(), v);
+        if(res.ec != std::errc())
+            R_THROW(("r_blob_tree_view::get_value conversion failed"));
+    }
+    else
+    {
+        // Floating point from_chars() isn't everywhere yet.
+        char buffer[64];
+        auto n = s.size() - pos;
+        if(n == 0 || n >= sizeof(buffer))
+            R_THROW(("r_blob_tree_view::get_value conversion failed"));
+        std::memcpy(buffer, s.data() + pos, n);
+        buffer[n] = 0;
+
+        char* parse_end = nullptr;
+        auto d = std::strtod(buffer, &parse_end);
+        if(parse_end == buffer)
+            R_THROW(("r_blob_tree_view::get_value conversion failed"));
+        v = static_cast<T>(d);
+    }
+
+    return v;
+}
+
+} // namespace r_utils
+
+#endif // _r_utils_r_blob_tree_view_h
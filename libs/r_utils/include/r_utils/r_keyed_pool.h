@@ -0,0 +1,187 @@
+#ifndef r_utils_r_keyed_pool_h
+#define r_utils_r_keyed_pool_h
+
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace r_utils
+{
+
+struct r_keyed_pool_stats
+{
+    uint64_t created {0};
+    uint64_t reused {0};
+    uint64_t discarded {0};
+    size_t idle {0};
+    size_t checked_out {0};
+};
+
+// r_keyed_pool keeps idle, expensive to construct objects (codecs, mostly) around for reuse. Unlike
+// r_pool the objects are not interchangeable: each one is filed under a key describing how it was
+// configured, and get() only hands out an idle object with a matching key (constructing a new one
+// with create() if there isn't one).
+//
+// get() returns a shared_ptr that, when the last copy goes away, runs the recycle function on the
+// object and puts it back in the pool. If recycle returns false (or throws) the object is
+// destroyed instead. At most max_idle objects (across all keys) are kept, the least recently
+// returned are destroyed first. Objects that are checked out do not count against max_idle.
+//
+// If max_checked_out isn't 0, get() blocks while that many objects (across all keys) are checked
+// out, so a burst of callers can't have more than that many codecs open at once. A thread must not
+// call get() while holding an object from the same pool, it could wait for itself.
+//
+// The pool may be destroyed while objects are checked out, they are simply destroyed when released.
+
+template<typename K, typename T>
+class r_keyed_pool final
+{
+public:
+    r_keyed_pool(size_t max_idle, std::function<bool(T&)> recycle = [](T&){return true;}, size_t max_checked_out = 0) :
+        _state(std::make_shared<_pool_state>())
+    {
+        _state->max_idle = max_idle;
+        _state->max_checked_out = max_checked_out;
+        _state->recycle = recycle;
+    }
+
+    r_keyed_pool(const r_keyed_pool&) = delete;
+    r_keyed_pool(r_keyed_pool&&) = delete;
+    r_keyed_pool& operator=(const r_keyed_pool&) = delete;
+    r_keyed_pool& operator=(r_keyed_pool&&) = delete;
+
+    std::shared_ptr<T> get(const K& key, const std::function<T()>& create)
+    {
+        std::unique_ptr<T> obj;
+
+        {
+            std::unique_lock<std::mutex> g(_state->lock);
+
+            if(_state->max_checked_out > 0)
+            {
+                auto s = _state.get();
+                s->cond.wait(g, [s](){return s->checked_out < s->max_checked_out;});
+            }
+
+            ++_state->checked_out;
+
+            for(auto i = _state->idle.begin(); i != _state->idle.end(); ++i)
+            {
+                if(i->first == key)
+                {
+                    obj = std::move(i->second);
+                    _state->idle.erase(i);
+                    ++_state->stats.reused;
+                    break;
+                }
+            }
+        }
+
+        if(!obj)
+        {
+            try
+            {
+                obj = std::make_unique<T>(create());
+            }
+            catch(...)
+            {
+                _checked_in(*_state);
+                throw;
+            }
+
+            std::lock_guard<std::mutex> g(_state->lock);
+            ++_state->stats.created;
+        }
+
+        std::weak_ptr<_pool_state> ws = _state;
+
+        return std::shared_ptr<T>(obj.release(), [ws, key](T* p){
+            std::unique_ptr<T> returned(p);
+
+            auto s = ws.lock();
+            if(!s)
+                return;
+
+            bool ok = false;
+            try
+            {
+                ok = s->recycle(*returned);
+            }
+            catch(...)
+            {
+            }
+
+            // Destroyed once the lock is released.
+            std::list<std::pair<K, std::unique_ptr<T>>> evicted;
+
+            {
+                std::lock_guard<std::mutex> g(s->lock);
+
+                --s->checked_out;
+
+                if(ok)
+                {
+                    s->idle.emplace_front(key, std::move(returned));
+
+                    while(s->idle.size() > s->max_idle)
+                    {
+                        evicted.splice(evicted.begin(), s->idle, std::prev(s->idle.end()));
+                        ++s->stats.discarded;
+                    }
+                }
+                else ++s->stats.discarded;
+            }
+
+            s->cond.notify_one();
+        });
+    }
+
+    void clear()
+    {
+        std::list<std::pair<K, std::unique_ptr<T>>> idle;
+        std::lock_guard<std::mutex> g(_state->lock);
+        idle.swap(_state->idle);
+    }
+
+    r_keyed_pool_stats stats() const
+    {
+        std::lock_guard<std::mutex> g(_state->lock);
+        auto s = _state->stats;
+        s.idle = _state->idle.size();
+        s.checked_out = _state->checked_out;
+        return s;
+    }
+
+private:
+    struct _pool_state
+    {
+        std::mutex lock;
+        std::condition_variable cond;
+        std::list<std::pair<K, std::unique_ptr<T>>> idle;
+        size_t max_idle {0};
+        size_t max_checked_out {0};
+        size_t checked_out {0};
+        std::function<bool(T&)> recycle;
+        r_keyed_pool_stats stats;
+    };
+
+    static void _checked_in(_pool_state& s)
+    {
+        {
+            std::lock_guard<std::mutex> g(s.lock);
+            --s.checked_out;
+        }
+        s.cond.notify_one();
+    }
+
+    std::shared_ptr<_pool_state> _state;
+};
+
+}
+
+#endif
@@ -11,6 +11,8 @@
 #endif
 #include <string>
 #include <functional>
+#include <mutex>
+#include <cstdint>
 
 namespace r_utils
 {
@@ -31,6 +33,8 @@ enum LOG_LEVEL
 
 using log_callback_t = std::function<void(LOG_LEVEL level, const std::string& message)>;
 
+struct async_backend;
+
 // All mutable logger state lives here
 struct logger_state
 {
@@ -41,6 +45,34 @@ struct logger_state
     log_callback_t log_callback = nullptr;
     std::chrono::system_clock::time_point last_flush_time{};
     bool is_sandboxed = false;
+
+    // Members below were added after the ones above, keep new ones at the end so a plugin built
+    // against an older r_logger.h still finds the original members where it expects them.
+
+    // Serializes writes to the callback, log file and syslog (recursive since a callback may log).
+    std::recursive_mutex sink_lock;
+    // Non null once start_async_logging() has been called (lives for the rest of the process).
+    async_backend* async = nullptr;
+};
+
+struct async_logging_config
+{
+    // Each logging thread gets its own ring of this many messages.
+    size_t records_per_thread = 4096;
+    // Upper bound on the bytes of message text waiting for the flusher, across all threads.
+    size_t memory_budget_bytes = 8 * 1024 * 1024;
+    // Messages from one R_LOG_* line beyond this many in a second are dropped (0 means no limit).
+    uint32_t max_per_second_per_callsite = 100;
+    std::chrono::milliseconds flush_interval {100};
+};
+
+struct logger_stats
+{
+    uint64_t written {0};
+    uint64_t dropped {0};
+    uint64_t suppressed {0};
+    size_t queued_bytes {0};
+    size_t threads {0};
 };
 
 #define R_LOG_CRITICAL(format, ...) r_utils::r_logger::write(r_utils::r_logger::LOG_LEVEL_CRITICAL, __LINE__, __FILE__, format,  ##__VA_ARGS__)
@@ -58,6 +90,20 @@ R_API void install_logger(const std::string& log_dir, const std::string& log_pre
 R_API void uninstall_logger();
 R_API void install_terminate();
 
+// Once started, R_LOG_* formats the message on the calling thread and hands it to a per thread
+// ring, a background thread does the actual writing. When a ring or the memory budget is full the
+// message is dropped and counted (the flusher logs how many). R_LOG_CRITICAL is still written
+// synchronously (after anything already queued) since it usually comes right before an abort().
+// While async logging is on the log callback is called from the flusher thread (or from whichever
+// thread calls flush_log() / R_LOG_CRITICAL), not from the thread that logged the message.
+R_API void start_async_logging(const async_logging_config& config = async_logging_config());
+// Writes everything still queued and goes back to synchronous logging. uninstall_logger() calls this.
+R_API void stop_async_logging();
+// Writes everything queued so far before returning.
+R_API void flush_log();
+R_API logger_stats get_logger_stats();
+
+// See start_async_logging() for which thread the callback runs on.
 R_API void set_log_callback(log_callback_t callback);
 R_API void clear_log_callback();
 
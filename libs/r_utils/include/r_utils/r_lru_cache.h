@@ -0,0 +1,199 @@
+#ifndef r_utils_r_lru_cache_h
+#define r_utils_r_lru_cache_h
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <functional>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+
+namespace r_utils
+{
+
+struct r_lru_cache_stats
+{
+    uint64_t hits {0};
+    uint64_t misses {0};
+    uint64_t coalesced {0};
+    uint64_t evictions {0};
+    size_t entries {0};
+    size_t cost {0};
+};
+
+// r_lru_cache is a thread safe, bounded, least recently used cache. Every value has a cost (by
+// default 1, so max_cost is an entry count) and the least recently used values are evicted until
+// the total cost fits in max_cost.
+//
+// get_or_create() coalesces concurrent misses on the same key: the first caller runs create() and
+// everyone else who asks for that key while it is running waits for (and shares) its result. If
+// create() throws, the exception is delivered to every waiter and nothing is cached.
+//
+// Values are handed out as shared_ptr<const V>, so an evicted value stays alive for as long as
+// someone is still using it.
+
+template<typename K, typename V>
+class r_lru_cache final
+{
+public:
+    r_lru_cache(size_t max_cost, std::function<size_t(const V&)> cost_fn = [](const V&){return (size_t)1;}) :
+        _lock(),
+        _lru(),
+        _entries(),
+        _in_flight(),
+        _max_cost(max_cost),
+        _cost_fn(cost_fn),
+        _stats()
+    {
+    }
+
+    r_lru_cache(const r_lru_cache&) = delete;
+    r_lru_cache(r_lru_cache&&) = delete;
+    r_lru_cache& operator=(const r_lru_cache&) = delete;
+    r_lru_cache& operator=(r_lru_cache&&) = delete;
+
+    // Returns nullptr if key is not cached. Does not count as a hit or miss.
+    std::shared_ptr<const V> get(const K& key)
+    {
+        std::lock_guard<std::mutex> g(_lock);
+        auto found = _entries.find(key);
+        if(found == _entries.end())
+            return nullptr;
+        _lru.splice(_lru.begin(), _lru, found->second.pos);
+        return found->second.value;
+    }
+
+    std::shared_ptr<const V> get_or_create(const K& key, const std::function<V()>& create)
+    {
+        std::unique_lock<std::mutex> g(_lock);
+
+        auto found = _entries.find(key);
+        if(found != _entries.end())
+        {
+            ++_stats.hits;
+            _lru.splice(_lru.begin(), _lru, found->second.pos);
+            return found->second.value;
+        }
+
+        auto in_flight = _in_flight.find(key);
+        if(in_flight != _in_flight.end())
+        {
+            ++_stats.coalesced;
+            auto f = in_flight->second;
+            g.unlock();
+            return f.get();
+        }
+
+        ++_stats.misses;
+
+        std::promise<std::shared_ptr<const V>> p;
+        _in_flight.emplace(key, p.get_future().share());
+        g.unlock();
+
+        std::shared_ptr<const V> value;
+        try
+        {
+            value = std::make_shared<const V>(create());
+        }
+        catch(...)
+        {
+            g.lock();
+            _in_flight.erase(key);
+            g.unlock();
+            p.set_exception(std::current_exception());
+            throw;
+        }
+
+        g.lock();
+        _in_flight.erase(key);
+        _insert(key, value);
+        g.unlock();
+
+        p.set_value(value);
+
+        return value;
+    }
+
+    void put(const K& key, const V& value)
+    {
+        std::lock_guard<std::mutex> g(_lock);
+        _insert(key, std::make_shared<const V>(value));
+    }
+
+    void erase(const K& key)
+    {
+        std::lock_guard<std::mutex> g(_lock);
+        auto found = _entries.find(key);
+        if(found != _entries.end())
+            _remove(found);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> g(_lock);
+        _lru.clear();
+        _entries.clear();
+        _stats.cost = 0;
+    }
+
+    r_lru_cache_stats stats() const
+    {
+        std::lock_guard<std::mutex> g(_lock);
+        auto s = _stats;
+        s.entries = _entries.size();
+        return s;
+    }
+
+private:
+    struct _entry
+    {
+        std::shared_ptr<const V> value;
+        size_t cost;
+        typename std::list<K>::iterator pos;
+    };
+
+    void _insert(const K& key, std::shared_ptr<const V> value)
+    {
+        auto found = _entries.find(key);
+        if(found != _entries.end())
+            _remove(found);
+
+        auto cost = _cost_fn(*value);
+
+        // A value that can never fit would just flush everything else out.
+        if(cost > _max_cost)
+            return;
+
+        _lru.push_front(key);
+        _entries[key] = {value, cost, _lru.begin()};
+        _stats.cost += cost;
+
+        while(_stats.cost > _max_cost && !_lru.empty())
+        {
+            _remove(_entries.find(_lru.back()));
+            ++_stats.evictions;
+        }
+    }
+
+    void _remove(typename std::map<K, _entry>::iterator it)
+    {
+        _stats.cost -= it->second.cost;
+        _lru.erase(it->second.pos);
+        _entries.erase(it);
+    }
+
+    mutable std::mutex _lock;
+    std::list<K> _lru;
+    std::map<K, _entry> _entries;
+    std::map<K, std::shared_future<std::shared_ptr<const V>>> _in_flight;
+    size_t _max_cost;
+    std::function<size_t(const V&)> _cost_fn;
+    r_lru_cache_stats _stats;
+};
+
+}
+
+#endif
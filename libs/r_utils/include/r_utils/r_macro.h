@@ -17,6 +17,9 @@
 
 #define R_MACRO_END_LOOP_FOREVER }while(1)
 
+// Pad hot atomics out to this so threads hammering neighbouring ones don't share a line.
+#define R_CACHE_LINE_SIZE 64
+
 #define ACCESS_ONCE(x) (*(volatile typeof(x) *)&(x))
 
 #ifdef IS_WINDOWS
@@ -0,0 +1,241 @@
+#ifndef r_utils_r_metrics_h
+#define r_utils_r_metrics_h
+
+#include "r_utils/r_macro.h"
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace r_utils
+{
+
+// Metrics are split into this many shards, each on its own cache line(s). A thread always records
+// into the same shard and threads are dealt out round robin, so up to this many threads never
+// contend. Reading a metric adds the shards up.
+constexpr size_t R_METRICS_SHARDS = 8;
+
+// For latency histograms: r_histogram_timer records microseconds, Prometheus wants seconds.
+constexpr double R_METRICS_MICROSECONDS = 0.000001;
+
+R_API size_t r_metrics_next_shard();
+
+inline size_t r_metrics_shard() noexcept
+{
+    static thread_local size_t shard = r_metrics_next_shard();
+    return shard;
+}
+
+// A monotonically increasing count (frames, bytes, requests).
+class r_counter final
+{
+public:
+    r_counter() = default;
+    r_counter(const r_counter&) = delete;
+    r_counter& operator=(const r_counter&) = delete;
+
+    void inc(uint64_t n = 1) noexcept
+    {
+        _shards[r_metrics_shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const noexcept
+    {
+        uint64_t total = 0;
+        for(auto& s : _shards)
+            total += s.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct alignas(R_CACHE_LINE_SIZE) _shard
+    {
+        std::atomic<uint64_t> value {0};
+    };
+
+    _shard _shards[R_METRICS_SHARDS];
+};
+
+// A value that goes up and down (queue depth, connected clients). Gauges are usually set from one
+// place, so they aren't sharded.
+class r_gauge final
+{
+public:
+    r_gauge() = default;
+    r_gauge(const r_gauge&) = delete;
+    r_gauge& operator=(const r_gauge&) = delete;
+
+    void set(int64_t v) noexcept { _value.store(v, std::memory_order_relaxed); }
+    void add(int64_t n = 1) noexcept { _value.fetch_add(n, std::memory_order_relaxed); }
+    void sub(int64_t n = 1) noexcept { _value.fetch_sub(n, std::memory_order_relaxed); }
+    int64_t value() const noexcept { return _value.load(std::memory_order_relaxed); }
+
+private:
+    alignas(R_CACHE_LINE_SIZE) std::atomic<int64_t> _value {0};
+};
+
+struct r_histogram_snapshot
+{
+    std::vector<uint64_t> buckets;
+    uint64_t count {0};
+    uint64_t sum {0};
+
+    // Upper bound of the bucket holding the q'th (0..1) quantile, in recorded units.
+    R_API uint64_t percentile(double q) const;
+};
+
+// r_histogram counts values into log linear buckets (HDR histogram style): every power of two is
+// split into 4 buckets, so any value is placed within 25% of where it really is, from 1 up to
+// 2^64, with no configuration. Bucket i holds the values in (upper_bound(i - 1), upper_bound(i)] so
+// powers of two are exact bucket edges.
+//
+// Values are unsigned integers in whatever unit suits the caller (microseconds, bytes). The scale
+// the histogram is registered with converts them to the exported unit.
+class r_histogram final
+{
+public:
+    static constexpr size_t SUB_BUCKETS = 4;
+    static constexpr size_t N_BUCKETS = 1 + SUB_BUCKETS + (62 * SUB_BUCKETS);
+
+    r_histogram() = default;
+    r_histogram(const r_histogram&) = delete;
+    r_histogram& operator=(const r_histogram&) = delete;
+
+    void observe(uint64_t v) noexcept
+    {
+        auto& s = _shards[r_metrics_shard()];
+        s.buckets[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+        s.sum.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    R_API r_histogram_snapshot snapshot() const;
+
+    static size_t bucket_of(uint64_t v) noexcept
+    {
+        if(v <= SUB_BUCKETS)
+            return (size_t)v;
+
+        auto x = v - 1;
+        auto e = _log2(x);
+        auto sub = (x >> (e - 2)) & (SUB_BUCKETS - 1);
+        return 1 + SUB_BUCKETS + ((e - 2) * SUB_BUCKETS) + sub;
+    }
+
+    // The largest value that lands in bucket i (saturates at 2^64 - 1).
+    R_API static uint64_t upper_bound(size_t i) noexcept;
+
+private:
+    static unsigned _log2(uint64_t v) noexcept
+    {
+#ifdef IS_WINDOWS
+        unsigned long idx;
+        _BitScanReverse64(&idx, v);
+        return (unsigned)idx;
+#else
+        return 63 - (unsigned)__builtin_clzll(v);
+#endif
+    }
+
+    struct alignas(R_CACHE_LINE_SIZE) _shard
+    {
+        std::atomic<uint64_t> buckets[N_BUCKETS] {};
+        std::atomic<uint64_t> sum {0};
+    };
+
+    _shard _shards[R_METRICS_SHARDS];
+};
+
+// Records the microseconds between its construction and destruction into a histogram.
+class r_histogram_timer final
+{
+public:
+    explicit r_histogram_timer(r_histogram& h) : _h(h), _start(std::chrono::steady_clock::now()) {}
+    r_histogram_timer(const r_histogram_timer&) = delete;
+    r_histogram_timer& operator=(const r_histogram_timer&) = delete;
+    ~r_histogram_timer() noexcept
+    {
+        auto elapsed = std::chrono::steady_clock::now() - _start;
+        _h.observe((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+private:
+    r_histogram& _h;
+    std::chrono::steady_clock::time_point _start;
+};
+
+enum r_metric_type
+{
+    R_METRIC_COUNTER,
+    R_METRIC_GAUGE,
+    R_METRIC_HISTOGRAM
+};
+
+typedef std::vector<std::pair<std::string, std::string>> r_metric_labels;
+
+// r_metrics is a registry of named metrics. Looking a metric up takes a lock, so do it once (a
+// member, or a function local static) and keep the reference: metrics are never destroyed, and
+// recording into one never locks or allocates.
+//
+// Asking for a name and label set that already exists returns the existing metric. A name is one
+// metric type for life, asking for it as another type throws.
+//
+// Stats that already live somewhere else (cache hit counts, say) can be exported with
+// add_callback(), the function is called every time the registry is rendered. It is called with
+// the registry locked, so it must not use the registry itself. After remove_callback() returns the
+// function will not be called again.
+class r_metrics final
+{
+public:
+    R_API r_metrics();
+    r_metrics(const r_metrics&) = delete;
+    r_metrics& operator=(const r_metrics&) = delete;
+
+    R_API r_counter& counter(const std::string& name, const std::string& help, const r_metric_labels& labels = {});
+    R_API r_gauge& gauge(const std::string& name, const std::string& help, const r_metric_labels& labels = {});
+    R_API r_histogram& histogram(const std::string& name, const std::string& help, const r_metric_labels& labels = {}, double scale = 1.0);
+
+    // type must be R_METRIC_COUNTER or R_METRIC_GAUGE.
+    R_API uint64_t add_callback(r_metric_type type, const std::string& name, const std::string& help, const r_metric_labels& labels, std::function<double()> fn);
+    R_API void remove_callback(uint64_t id);
+
+    // Everything in the registry in the Prometheus text exposition format (version 0.0.4).
+    R_API std::string render_prometheus() const;
+
+private:
+    struct _series
+    {
+        std::unique_ptr<r_counter> counter;
+        std::unique_ptr<r_gauge> gauge;
+        std::unique_ptr<r_histogram> histogram;
+        std::function<double()> fn;
+        uint64_t callback_id {0};
+    };
+
+    struct _family
+    {
+        r_metric_type type {R_METRIC_COUNTER};
+        std::string help;
+        double scale {1.0};
+        std::map<std::string, _series> series;
+    };
+
+    _series& _get_series(r_metric_type type, const std::string& name, const std::string& help, const r_metric_labels& labels, double scale);
+
+    mutable std::mutex _lock;
+    std::map<std::string, _family> _families;
+    uint64_t _next_callback_id;
+};
+
+// The process wide registry served on /metrics.
+R_API r_metrics& metrics();
+
+}
+
+#endif
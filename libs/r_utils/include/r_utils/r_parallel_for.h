@@ -0,0 +1,68 @@
+#ifndef r_utils_r_parallel_for_h
+#define r_utils_r_parallel_for_h
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+
+namespace r_utils
+{
+
+// r_parallel_for() calls f(i) for every i in [0, n) using at most max_threads threads (the calling
+// thread is one of them) and returns once every call has returned. Work is handed out one index at
+// a time, so a few slow calls don't hold up the rest.
+//
+// If a call throws, no further indexes are started and the first exception is rethrown once the
+// calls already running have finished.
+
+template<typename F>
+void r_parallel_for(size_t n, size_t max_threads, F f)
+{
+    std::atomic<size_t> next {0};
+    std::atomic<bool> failed {false};
+    std::exception_ptr first_exception;
+    std::mutex exception_lock;
+
+    auto worker = [&](){
+        while(!failed)
+        {
+            auto i = next.fetch_add(1);
+            if(i >= n)
+                break;
+
+            try
+            {
+                f(i);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> g(exception_lock);
+                if(!first_exception)
+                    first_exception = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    auto n_threads = std::min(n, std::max(max_threads, (size_t)1));
+
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < n_threads; ++i)
+        threads.push_back(std::thread(worker));
+
+    worker();
+
+    for(auto& t : threads)
+        t.join();
+
+    if(first_exception)
+        std::rethrow_exception(first_exception);
+}
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef r_utils_r_ring_q_h
+#define r_utils_r_ring_q_h
+
+#include "r_utils/r_blocking_q.h"
+#include "r_utils/r_nullable.h"
+#include "r_utils/r_macro.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace r_utils
+{
+
+// r_ring_q is a fixed capacity queue built on a ring of slots that each carry a sequence number
+// (the bounded queue described by Dmitry Vyukov). Producers and consumers only ever touch their
+// own index and the slot they claimed, so post() and try_pop() never take a lock. When producers
+// or consumers are known to be single threaded the CAS on their index becomes a plain store.
+//
+// The full policies match r_blocking_q: drop_newest refuses the new item, drop_oldest makes room
+// by popping the oldest one from the posting thread (so with drop_oldest the consuming side always
+// uses a CAS, even in r_spsc_q).
+//
+// poll() blocks for as long as r_blocking_q::poll() would. Producers only touch the mutex when a
+// consumer is actually asleep, so an uncontended queue never makes a system call.
+//
+// Prefer r_blocking_q for unbounded queues and for queues that see a handful of items a second,
+// this is for the per frame paths where several threads hit the same queue.
+
+template<typename DATA, bool SINGLE_PRODUCER, bool SINGLE_CONSUMER>
+class r_ring_q final
+{
+public:
+    explicit r_ring_q(size_t capacity, r_queue_full_policy policy = r_queue_full_policy::drop_oldest) :
+        _capacity((std::max)(capacity, (size_t)1)),
+        _policy(policy),
+        _slots(new _slot[_capacity])
+    {
+        for(size_t i = 0; i < _capacity; ++i)
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    r_ring_q(const r_ring_q&) = delete;
+    r_ring_q(r_ring_q&&) = delete;
+
+    ~r_ring_q() noexcept
+    {
+        while(_pop([](DATA&&){}));
+    }
+
+    r_ring_q& operator=(const r_ring_q&) = delete;
+    r_ring_q& operator=(r_ring_q&&) = delete;
+
+    // Returns true if item was added, false if dropped due to queue full
+    bool post(const DATA& d)
+    {
+        return _post(d);
+    }
+
+    bool post(DATA&& d)
+    {
+        return _post(std::move(d));
+    }
+
+    bool try_pop(DATA& out)
+    {
+        return _pop([&](DATA&& v){out = std::move(v);});
+    }
+
+    // Appends at most n items to out and returns how many were appended.
+    size_t try_pop_n(std::vector<DATA>& out, size_t n)
+    {
+        size_t popped = 0;
+        while(popped < n && _pop([&](DATA&& v){out.push_back(std::move(v));}))
+            ++popped;
+        return popped;
+    }
+
+    // Appends whatever is in the queue right now to out. Bounded by the capacity so a producer that
+    // keeps up with us can't keep us here forever.
+    size_t pop_all(std::vector<DATA>& out)
+    {
+        return try_pop_n(out, _capacity);
+    }
+
+    r_utils::r_nullable<DATA> poll(std::chrono::milliseconds d = {})
+    {
+        r_utils::r_nullable<DATA> result;
+        auto consume = [&](DATA&& v){result.assign(std::move(v));};
+
+        if(_pop(consume))
+            return result;
+
+        auto deadline = std::chrono::steady_clock::now() + d;
+
+        std::unique_lock<std::mutex> g(_sleep_lock);
+        auto wakes = _wakes;
+
+        _sleepers.fetch_add(1);
+        // Pairs with the fence in _notify(), either they see us sleeping or we see their item.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while(!_pop(consume))
+        {
+            auto ready = [&](){return this->_readable() || this->_wakes != wakes;};
+
+            if(d == std::chrono::milliseconds {})
+                _cond.wait(g, ready);
+            else if(!_cond.wait_until(g, deadline, ready))
+                break;
+
+            // Woken with nothing for us, or another consumer got to the item first.
+            if(_wakes != wakes)
+            {
+                _pop(consume);
+                break;
+            }
+        }
+
+        _sleepers.fetch_sub(1);
+
+        return result;
+    }
+
+    void wake()
+    {
+        std::unique_lock<std::mutex> g(_sleep_lock);
+        ++_wakes;
+        _cond.notify_all();
+    }
+
+    // Must be called from the consuming side.
+    void clear()
+    {
+        while(_pop([](DATA&&){}));
+        wake();
+    }
+
+    // Approximate while producers or consumers are active.
+    size_t size() const
+    {
+        auto dequeue_pos = _dequeue_pos.load(std::memory_order_acquire);
+        auto enqueue_pos = _enqueue_pos.load(std::memory_order_acquire);
+        return (enqueue_pos > dequeue_pos) ? (std::min)(enqueue_pos - dequeue_pos, _capacity) : 0;
+    }
+
+    size_t dropped_count() const
+    {
+        return _dropped_count.load(std::memory_order_relaxed);
+    }
+
+    void reset_dropped_count()
+    {
+        _dropped_count.store(0, std::memory_order_relaxed);
+    }
+
+    size_t max_size() const
+    {
+        return _capacity;
+    }
+
+private:
+    struct _slot
+    {
+        std::atomic<size_t> seq {0};
+        alignas(DATA) unsigned char storage[sizeof(DATA)];
+    };
+
+    template<typename U>
+    bool _post(U&& d)
+    {
+        while(!_push(std::forward<U>(d)))
+        {
+            if(_policy == r_queue_full_policy::drop_newest)
+            {
+                _dropped_count.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            if(_pop([](DATA&&){}))
+                _dropped_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        _notify();
+        return true;
+    }
+
+    template<typename U>
+    bool _push(U&& d)
+    {
+        _slot* slot = nullptr;
+        auto pos = _enqueue_pos.load(std::memory_order_relaxed);
+
+        while(true)
+        {
+            slot = &_slots[pos % _capacity];
+            auto seq = slot->seq.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)pos;
+
+            if(diff == 0)
+            {
+                if(SINGLE_PRODUCER)
+                {
+                    _enqueue_pos.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+
+                if(_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+                return false;
+            else pos = _enqueue_pos.load(std::memory_order_relaxed);
+        }
+
+        new (slot->storage) DATA(std::forward<U>(d));
+        slot->seq.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    template<typename F>
+    bool _pop(F&& consume)
+    {
+        // With drop_oldest producers pop too, so even a single consumer has company.
+        const bool exclusive = SINGLE_CONSUMER && _policy == r_queue_full_policy::drop_newest;
+
+        _slot* slot = nullptr;
+        auto pos = _dequeue_pos.load(std::memory_order_relaxed);
+
+        while(true)
+        {
+            slot = &_slots[pos % _capacity];
+            auto seq = slot->seq.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if(diff == 0)
+            {
+                if(exclusive)
+                {
+                    _dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+
+                if(_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+                return false;
+            else pos = _dequeue_pos.load(std::memory_order_relaxed);
+        }
+
+        auto item = std::launder(reinterpret_cast<DATA*>(slot->storage));
+        consume(std::move(*item));
+        item->~DATA();
+        slot->seq.store(pos + _capacity, std::memory_order_release);
+
+        return true;
+    }
+
+    bool _readable() const
+    {
+        auto pos = _dequeue_pos.load(std::memory_order_relaxed);
+        return _slots[pos % _capacity].seq.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    void _notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(_sleepers.load(std::memory_order_relaxed) > 0)
+        {
+            std::unique_lock<std::mutex> g(_sleep_lock);
+            _cond.notify_one();
+        }
+    }
+
+    const size_t _capacity;
+    const r_queue_full_policy _policy;
+    std::unique_ptr<_slot[]> _slots;
+
+    alignas(R_CACHE_LINE_SIZE) std::atomic<size_t> _enqueue_pos {0};
+    alignas(R_CACHE_LINE_SIZE) std::atomic<size_t> _dequeue_pos {0};
+    alignas(R_CACHE_LINE_SIZE) std::atomic<size_t> _dropped_count {0};
+    alignas(R_CACHE_LINE_SIZE) std::atomic<int> _sleepers {0};
+    std::mutex _sleep_lock;
+    std::condition_variable _cond;
+    uint64_t _wakes {0};
+};
+
+template<typename DATA>
+using r_spsc_q = r_ring_q<DATA, true, true>;
+
+template<typename DATA>
+using r_mpmc_q = r_ring_q<DATA, false, false>;
+
+}
+
+#endif
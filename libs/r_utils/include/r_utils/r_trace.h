@@ -0,0 +1,83 @@
+#ifndef r_utils_r_trace_h
+#define r_utils_r_trace_h
+
+#include "r_utils/r_macro.h"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace r_utils
+{
+
+namespace r_trace
+{
+
+// Each thread that records a span while tracing is on gets a ring of this many spans, when it
+// fills the oldest are overwritten (so a dump is always the most recent activity).
+constexpr size_t DEFAULT_SPANS_PER_THREAD = 8192;
+
+// R_TRACE_SPAN("name") records the time from where it is declared to the end of the enclosing
+// scope as a Chrome trace "complete" event on the calling thread. name must outlive the process
+// (a string literal, or something from intern()). When tracing is off a span costs one relaxed
+// load and a branch.
+#define R_TRACE_CONCAT_INNER(a, b) a##b
+#define R_TRACE_CONCAT(a, b) R_TRACE_CONCAT_INNER(a, b)
+#define R_TRACE_SPAN(name) r_utils::r_trace::r_trace_span R_TRACE_CONCAT(_r_trace_span_, __LINE__)(name)
+
+R_API bool enabled() noexcept;
+
+// Discards anything recorded so far and starts recording.
+R_API void start_tracing(size_t spans_per_thread = DEFAULT_SPANS_PER_THREAD);
+// Stops recording, what was recorded is kept for dump_json() until the next start_tracing().
+R_API void stop_tracing();
+
+// Everything recorded, as Chrome trace event JSON (load it in chrome://tracing or ui.perfetto.dev).
+R_API std::string dump_json();
+R_API void dump_to_file(const std::string& path);
+
+// Names the calling thread in dumps.
+R_API void set_thread_name(const std::string& name);
+
+// Returns a pointer to a copy of name that lives for the rest of the process, for span names that
+// aren't literals. Interning the same name twice returns the same pointer.
+R_API const char* intern(const std::string& name);
+
+// POSIX only: SIGUSR2 starts tracing, the next SIGUSR2 writes the trace to dump_dir and stops.
+R_API void install_trace_signal(const std::string& dump_dir);
+
+R_API int64_t now_ns() noexcept;
+R_API void record(const char* name, int64_t begin_ns, int64_t end_ns) noexcept;
+
+class r_trace_span final
+{
+public:
+    explicit r_trace_span(const char* name) noexcept :
+        _name(nullptr),
+        _begin_ns(0)
+    {
+        if(enabled())
+        {
+            _name = name;
+            _begin_ns = now_ns();
+        }
+    }
+
+    r_trace_span(const r_trace_span&) = delete;
+    r_trace_span& operator=(const r_trace_span&) = delete;
+
+    ~r_trace_span() noexcept
+    {
+        if(_name)
+            record(_name, _begin_ns, now_ns());
+    }
+
+private:
+    const char* _name;
+    int64_t _begin_ns;
+};
+
+}
+
+}
+
+#endif
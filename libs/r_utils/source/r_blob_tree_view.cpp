@@ -0,0 +1,188 @@
+#include "r_utils/r_blob_tree_view.h"
+#include "r_utils/r_socket.h"   // for r_networking helpers
+#include <algorithm>
+
+using namespace r_utils;
+using namespace std;
+
+namespace
+{
+    constexpr uint32_t RBT_MAGIC = 0x52425430; // "RBT0"
+
+    // Deeper than anything we write, keeps a hostile buffer from blowing the stack.
+    constexpr size_t MAX_DEPTH = 256;
+
+    constexpr uint32_t NOT_FOUND = 0xffffffff;
+
+    inline void need(const uint8_t* p, const uint8_t* end, size_t n)
+    {
+        if(static_cast<size_t>(end - p) < n)
+            R_STHROW(r_invalid_argument_exception,("r_blob_tree_view buffer overrun"));
+    }
+
+    inline uint32_t read_u32(const uint8_t*& p)
+    {
+        uint32_t net; std::memcpy(&net, p, sizeof(net)); p += sizeof(net);
+        return r_networking::r_ntohl(net);
+    }
+
+    inline uint16_t read_u16(const uint8_t*& p)
+    {
+        uint16_t net; std::memcpy(&net, p, sizeof(net)); p += sizeof(net);
+        return r_networking::r_ntohs(net);
+    }
+}
+
+r_blob_tree_view::r_blob_tree_view(const uint8_t* p, size_t size, uint32_t& version) :
+    _entries()
+{
+    const uint8_t* end = p + size;
+    if(size < 8)
+        R_STHROW(r_invalid_argument_exception,("r_blob_tree buffer too small"));
+    uint32_t magic = read_u32(p);
+    if(magic != RBT_MAGIC)
+        R_STHROW(r_invalid_argument_exception,("r_blob_tree bad magic"));
+    version = read_u32(p);
+
+    // First pass validates the buffer and tells us how big the index is, second pass fills it.
+    const uint8_t* counter = p;
+    auto n_nodes = _count_nodes(counter, end, 0);
+
+    _entries.resize(n_nodes);
+
+    uint32_t next_free = 1;
+    _index_node(p, 0, next_free);
+}
+
+uint32_t r_blob_tree_view::_count_nodes(const uint8_t*& p, const uint8_t* end, size_t depth)
+{
+    if(depth > MAX_DEPTH)
+        R_STHROW(r_invalid_argument_exception,("r_blob_tree_view nesting too deep"));
+
+    need(p, end, 5);
+    auto type = *p++;
+    auto cnt = read_u32(p);
+
+    uint32_t n = 1;
+
+    if(type == r_blob_tree::NT_OBJECT)
+    {
+        for(uint32_t i = 0; i < cnt; ++i)
+        {
+            need(p, end, 2);
+            auto klen = read_u16(p);
+            need(p, end, klen);
+            p += klen;
+            n += _count_nodes(p, end, depth + 1);
+        }
+    }
+    else if(type == r_blob_tree::NT_ARRAY)
+    {
+        for(uint32_t i = 0; i < cnt; ++i)
+            n += _count_nodes(p, end, depth + 1);
+    }
+    else if(type == r_blob_tree::NT_LEAF)
+    {
+        need(p, end, cnt);
+        p += cnt;
+    }
+    else R_STHROW(r_invalid_argument_exception,("r_blob_tree_view bad node type"));
+
+    return n;
+}
+
+// The buffer was validated by _count_nodes(), so no bounds checks here.
+void r_blob_tree_view::_index_node(const uint8_t*& p, uint32_t index, uint32_t& next_free)
+{
+    auto& e = _entries[index];
+    e.type = static_cast<r_blob_tree::node_type>(*p++);
+    e.count = read_u32(p);
+
+    if(e.type == r_blob_tree::NT_LEAF)
+    {
+        e.payload = p;
+        p += e.count;
+        return;
+    }
+
+    // Reserve a contiguous block for our children before any of them claim blocks of their own.
+    e.first_child = next_free;
+    next_free += e.count;
+
+    auto first_child = e.first_child;
+    auto count = e.count;
+    auto type = e.type;
+
+    string_view prev_key;
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(type == r_blob_tree::NT_OBJECT)
+        {
+            auto& child = _entries[first_child + i];
+            child.key_size = read_u16(p);
+            child.key = reinterpret_cast<const char*>(p);
+            p += child.key_size;
+
+            string_view key(child.key, child.key_size);
+            if(i > 0 && !(prev_key < key))
+                _entries[index].sorted = false;
+            prev_key = key;
+        }
+
+        _index_node(p, first_child + i, next_free);
+    }
+}
+
+r_blob_tree_view::node r_blob_tree_view::node::at(string_view key) const
+{
+    auto found = _find(key);
+    if(found == NOT_FOUND)
+        R_STHROW(r_not_found_exception,("r_blob_tree_view key not found: %s", string(key).c_str()));
+
+    return node(_view, found);
+}
+
+bool r_blob_tree_view::node::has_key(string_view key) const
+{
+    return _find(key) != NOT_FOUND;
+}
+
+r_blob_tree_view::node r_blob_tree_view::node::at(size_t index) const
+{
+    _expect_type(r_blob_tree::NT_ARRAY);
+
+    auto& e = _e();
+    if(index >= e.count)
+        R_STHROW(r_not_found_exception,("r_blob_tree_view index out of range"));
+
+    return node(_view, e.first_child + static_cast<uint32_t>(index));
+}
+
+uint32_t r_blob_tree_view::node::_find(string_view key) const
+{
+    _expect_type(r_blob_tree::NT_OBJECT);
+
+    auto& e = _e();
+    auto first = _view->_entries.begin() + e.first_child;
+    auto last = first + e.count;
+
+    auto key_of = [](const _entry& c){return string_view(c.key, c.key_size);};
+
+    auto found = last;
+    if(e.sorted)
+    {
+        found = lower_bound(first, last, key, [&](const _entry& c, string_view k){return key_of(c) < k;});
+        if(found != last && key_of(*found) != key)
+            found = last;
+    }
+    else found = find_if(first, last, [&](const _entry& c){return key_of(c) == key;});
+
+    return (found == last) ? NOT_FOUND : static_cast<uint32_t>(found - _view->_entries.begin());
+}
+
+void r_blob_tree_view::node::_expect_type(r_blob_tree::node_type nt) const
+{
+    if(_e().type != nt)
+        R_STHROW(r_internal_exception,("r_blob_tree node type mismatch"));
+}
@@ -4,8 +4,15 @@
 #include "r_utils/r_exception.h"
 #include "r_utils/r_file.h"
 #include "r_utils/r_time_utils.h"
+#include "r_utils/r_ring_q.h"
 #include <exception>
 #include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <shared_mutex>
 #include <algorithm>
 #include <cstring>
 #include <chrono>
@@ -23,9 +30,13 @@
 
 using namespace r_utils;
 using namespace std;
+using namespace std::chrono;
 
 static const uint32_t MAX_LOG_FILE_SIZE = ((1024*1024) * 10);
 
+// Call sites are hashed into this many rate limiting slots, call sites that collide share a budget.
+static const size_t CALLSITE_SLOTS = 1024;
+
 // The actual state - owned by whichever module is the "host"
 static r_logger::logger_state _owned_state;
 
@@ -127,12 +138,11 @@ static void open_log_file(const string& filename)
         R_THROW(("Unable to open logger."));
 }
 
-void r_utils::r_logger::write(LOG_LEVEL level,
-                              int line,
-                              const char* file,
-                              const char* format,
-                              ...)
+// Caller must hold _state->sink_lock.
+static void _write_to_sinks(r_logger::LOG_LEVEL level, const string& msg, system_clock::time_point now)
 {
+    using namespace r_utils::r_logger;
+
     if(_state->approx_bytes_logged > MAX_LOG_FILE_SIZE)
     {
         _state->approx_bytes_logged = 0;
@@ -142,25 +152,11 @@ void r_utils::r_logger::write(LOG_LEVEL level,
         open_log_file(log_path);
     }
 
-    va_list args;
-    va_start(args, format);
-    r_logger::write(level, line, nullptr, format, args);
-    va_end(args);
-}
-
-void r_utils::r_logger::write(LOG_LEVEL level,
-                              int line,
-                              const char* file,
-                              const char* format,
-                              va_list& args)
-{
-    auto msg = r_string_utils::format(format, args);
     _state->approx_bytes_logged += (uint32_t)msg.length();
     auto lines = r_string_utils::split(msg, "\n");
 
 #if defined(IS_WINDOWS) || defined(IS_LINUX)
     // Add timestamp for file logging (Windows, or Linux in Flatpak mode)
-    auto now = std::chrono::system_clock::now();
     auto timestamp = r_time_utils::tp_to_iso_8601(now, false);
 #endif
 
@@ -242,7 +238,6 @@ void r_utils::r_logger::write(LOG_LEVEL level,
 
 #ifdef IS_MACOS
     {
-        auto now = std::chrono::system_clock::now();
         auto timestamp = r_time_utils::tp_to_iso_8601(now, false);
         for(auto l : lines)
         {
@@ -254,6 +249,295 @@ void r_utils::r_logger::write(LOG_LEVEL level,
 #endif
 }
 
+namespace r_utils
+{
+
+namespace r_logger
+{
+
+struct _log_record
+{
+    LOG_LEVEL level {LOG_LEVEL_INFO};
+    system_clock::time_point time;
+    string message;
+};
+
+struct _thread_ring
+{
+    explicit _thread_ring(size_t capacity) :
+        records(capacity, r_queue_full_policy::drop_newest)
+    {
+    }
+
+    r_spsc_q<_log_record> records;
+    // Set when the owning thread exits, the flusher forgets the ring once it's empty.
+    atomic<bool> retired {false};
+    // Flusher only.
+    size_t drops_seen {0};
+};
+
+struct _callsite
+{
+    atomic<uint64_t> window {0};
+    atomic<uint32_t> count {0};
+};
+
+struct async_backend
+{
+    async_logging_config config;
+    atomic<bool> running {false};
+
+    // Shared by writers from their check of running until their message is in a ring, exclusive
+    // while stop_async_logging() clears running. Once stop has had it, nobody is still enqueuing.
+    shared_mutex gate;
+
+    mutex lock;
+    condition_variable cond;
+    bool wake_now {false};
+    vector<shared_ptr<_thread_ring>> rings;
+    thread flusher;
+
+    // Held by whoever is draining the rings, they each have a single consumer. Recursive because a
+    // log callback may itself log something critical.
+    recursive_mutex drain_lock;
+
+    atomic<size_t> queued_bytes {0};
+    atomic<uint64_t> written {0};
+    atomic<uint64_t> dropped {0};
+    atomic<uint64_t> suppressed {0};
+    uint64_t dropped_reported {0};
+    uint64_t suppressed_reported {0};
+
+    _callsite callsites[CALLSITE_SLOTS];
+};
+
+}
+
+}
+
+struct _thread_ring_handle
+{
+    ~_thread_ring_handle() noexcept
+    {
+        if(ring)
+            ring->retired = true;
+    }
+
+    r_logger::async_backend* owner {nullptr};
+    shared_ptr<r_logger::_thread_ring> ring;
+};
+
+static thread_local _thread_ring_handle _this_thread_ring;
+
+static size_t _record_cost(const string& message)
+{
+    return sizeof(r_logger::_log_record) + message.size();
+}
+
+static bool _callsite_allowed(r_logger::async_backend& b, const char* file, int line, system_clock::time_point now)
+{
+    auto limit = b.config.max_per_second_per_callsite;
+    if(limit == 0)
+        return true;
+
+    auto h = (hash<const void*>()(file) * 31) ^ hash<int>()(line);
+    auto& cs = b.callsites[h % CALLSITE_SLOTS];
+
+    // +1 so that a zeroed slot never looks like the current window.
+    uint64_t window = (uint64_t)duration_cast<seconds>(now.time_since_epoch()).count() + 1;
+
+    auto current = cs.window.load(memory_order_relaxed);
+    if(current != window && cs.window.compare_exchange_strong(current, window, memory_order_relaxed))
+        cs.count.store(0, memory_order_relaxed);
+
+    if(cs.count.fetch_add(1, memory_order_relaxed) < limit)
+        return true;
+
+    b.suppressed.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+static void _enqueue(r_logger::async_backend& b, r_logger::LOG_LEVEL level, string&& msg, system_clock::time_point now)
+{
+    auto& h = _this_thread_ring;
+    if(h.owner != &b)
+    {
+        h.owner = &b;
+        h.ring = make_shared<r_logger::_thread_ring>(b.config.records_per_thread);
+
+        lock_guard<mutex> g(b.lock);
+        b.rings.push_back(h.ring);
+    }
+
+    auto cost = _record_cost(msg);
+    if(b.queued_bytes.fetch_add(cost, memory_order_relaxed) + cost > b.config.memory_budget_bytes)
+    {
+        b.queued_bytes.fetch_sub(cost, memory_order_relaxed);
+        b.dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    r_logger::_log_record record;
+    record.level = level;
+    record.time = now;
+    record.message = std::move(msg);
+
+    // A full ring counts the drop itself, the flusher picks it up from there.
+    if(!h.ring->records.post(std::move(record)))
+    {
+        b.queued_bytes.fetch_sub(cost, memory_order_relaxed);
+        return;
+    }
+
+    if(level <= r_logger::LOG_LEVEL_ERROR)
+    {
+        {
+            lock_guard<mutex> g(b.lock);
+            b.wake_now = true;
+        }
+        b.cond.notify_one();
+    }
+}
+
+static void _drain(r_logger::async_backend& b)
+{
+    lock_guard<recursive_mutex> dg(b.drain_lock);
+
+    vector<shared_ptr<r_logger::_thread_ring>> rings;
+    {
+        lock_guard<mutex> g(b.lock);
+        rings = b.rings;
+    }
+
+    vector<r_logger::_log_record> batch;
+    vector<r_logger::_thread_ring*> finished;
+
+    for(auto& ring : rings)
+    {
+        // Check before popping, anything posted before the thread exited is then in this pop.
+        bool retired = ring->retired.load();
+
+        ring->records.pop_all(batch);
+
+        auto drops = ring->records.dropped_count();
+        if(drops > ring->drops_seen)
+        {
+            b.dropped.fetch_add(drops - ring->drops_seen, memory_order_relaxed);
+            ring->drops_seen = drops;
+        }
+
+        if(retired)
+            finished.push_back(ring.get());
+    }
+
+    // Each ring is in order, this puts the threads back together.
+    stable_sort(begin(batch), end(batch), [](const r_logger::_log_record& a, const r_logger::_log_record& b){return a.time < b.time;});
+
+    size_t cost = 0;
+    auto now = system_clock::now();
+    auto dropped = b.dropped.load(memory_order_relaxed);
+    auto suppressed = b.suppressed.load(memory_order_relaxed);
+
+    {
+        lock_guard<recursive_mutex> g(_state->sink_lock);
+
+        for(auto& r : batch)
+        {
+            _write_to_sinks(r.level, r.message, r.time);
+            cost += _record_cost(r.message);
+        }
+
+        if(dropped > b.dropped_reported)
+        {
+            _write_to_sinks(r_logger::LOG_LEVEL_WARNING, r_string_utils::format("r_logger: dropped %llu log messages, logging is falling behind.", (unsigned long long)(dropped - b.dropped_reported)), now);
+            b.dropped_reported = dropped;
+        }
+
+        if(suppressed > b.suppressed_reported)
+        {
+            _write_to_sinks(r_logger::LOG_LEVEL_WARNING, r_string_utils::format("r_logger: suppressed %llu log messages from call sites logging more than %u per second.", (unsigned long long)(suppressed - b.suppressed_reported), b.config.max_per_second_per_callsite), now);
+            b.suppressed_reported = suppressed;
+        }
+    }
+
+    b.queued_bytes.fetch_sub(cost, memory_order_relaxed);
+    b.written.fetch_add(batch.size(), memory_order_relaxed);
+
+    if(!finished.empty())
+    {
+        lock_guard<mutex> g(b.lock);
+        b.rings.erase(
+            remove_if(
+                begin(b.rings),
+                end(b.rings),
+                [&](const shared_ptr<r_logger::_thread_ring>& ring){
+                    return find(begin(finished), end(finished), ring.get()) != end(finished);
+                }
+            ),
+            end(b.rings)
+        );
+    }
+}
+
+static void _flusher_entry_point(r_logger::async_backend* b)
+{
+    while(b->running)
+    {
+        {
+            unique_lock<mutex> g(b->lock);
+            b->cond.wait_for(g, b->config.flush_interval, [b](){return b->wake_now || !b->running;});
+            b->wake_now = false;
+        }
+
+        _drain(*b);
+    }
+}
+
+void r_utils::r_logger::write(LOG_LEVEL level,
+                              int line,
+                              const char* file,
+                              const char* format,
+                              ...)
+{
+    va_list args;
+    va_start(args, format);
+    r_logger::write(level, line, file, format, args);
+    va_end(args);
+}
+
+void r_utils::r_logger::write(LOG_LEVEL level,
+                              int line,
+                              const char* file,
+                              const char* format,
+                              va_list& args)
+{
+    auto now = system_clock::now();
+    auto b = _state->async;
+
+    if(b && level != LOG_LEVEL_CRITICAL)
+    {
+        shared_lock<shared_mutex> g(b->gate);
+
+        if(b->running.load(memory_order_acquire))
+        {
+            if(!_callsite_allowed(*b, file, line, now))
+                return;
+
+            _enqueue(*b, level, r_string_utils::format(format, args), now);
+            return;
+        }
+    }
+
+    auto msg = r_string_utils::format(format, args);
+
+    // Whatever is queued happened first.
+    if(b && b->running)
+        _drain(*b);
+
+    lock_guard<recursive_mutex> g(_state->sink_lock);
+    _write_to_sinks(level, msg, now);
+}
+
 void r_utils_terminate()
 {
     R_LOG_CRITICAL("r_utils terminate handler called!");
@@ -277,6 +561,7 @@ void r_utils_terminate()
         }
     }
 
+    r_logger::flush_log();
     fflush(stdout);
 
     std::abort();
@@ -311,6 +596,10 @@ void r_utils::r_logger::install_logger(const std::string& log_dir, const std::st
 
 void r_utils::r_logger::uninstall_logger()
 {
+    stop_async_logging();
+
+    lock_guard<recursive_mutex> g(_state->sink_lock);
+
     if(_state->log_file)
     {
         fclose(_state->log_file);
@@ -318,6 +607,68 @@ void r_utils::r_logger::uninstall_logger()
     }
 }
 
+void r_utils::r_logger::start_async_logging(const async_logging_config& config)
+{
+    // Never freed, threads that are mid write when logging stops may still be looking at it.
+    if(!_state->async)
+        _state->async = new async_backend();
+
+    auto b = _state->async;
+
+    if(b->running)
+        return;
+
+    b->config = config;
+    b->running.store(true, memory_order_release);
+    b->flusher = thread(_flusher_entry_point, b);
+}
+
+void r_utils::r_logger::stop_async_logging()
+{
+    auto b = _state->async;
+    if(!b || !b->running)
+        return;
+
+    {
+        unique_lock<shared_mutex> gg(b->gate);
+        lock_guard<mutex> g(b->lock);
+        b->running = false;
+    }
+    b->cond.notify_one();
+
+    b->flusher.join();
+
+    // Every writer that saw running set has finished enqueuing (we had the gate) and every later one
+    // writes synchronously, so this picks up the last of the queued messages. Not done while holding
+    // the gate since a callback that logs would then block on it.
+    _drain(*b);
+}
+
+void r_utils::r_logger::flush_log()
+{
+    if(_state->async)
+        _drain(*_state->async);
+}
+
+r_logger::logger_stats r_utils::r_logger::get_logger_stats()
+{
+    logger_stats stats;
+
+    auto b = _state->async;
+    if(b)
+    {
+        stats.written = b->written;
+        stats.dropped = b->dropped;
+        stats.suppressed = b->suppressed;
+        stats.queued_bytes = b->queued_bytes;
+
+        lock_guard<mutex> g(b->lock);
+        stats.threads = b->rings.size();
+    }
+
+    return stats;
+}
+
 void r_utils::r_logger::install_terminate()
 {
     set_terminate(r_utils_terminate);
@@ -325,11 +676,13 @@ void r_utils::r_logger::install_terminate()
 
 void r_utils::r_logger::set_log_callback(log_callback_t callback)
 {
+    lock_guard<recursive_mutex> g(_state->sink_lock);
     _state->log_callback = callback;
 }
 
 void r_utils::r_logger::clear_log_callback()
 {
+    lock_guard<recursive_mutex> g(_state->sink_lock);
     _state->log_callback = nullptr;
 }
 
@@ -0,0 +1,314 @@
+#include "r_utils/r_metrics.h"
+#include "r_utils/r_exception.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace r_utils;
+using namespace std;
+
+// Cumulative Prometheus buckets are rendered at every power of two from 2^0 to 2^this. The
+// histogram itself is finer than that, but a scrape doesn't need 253 lines per series.
+static const size_t EXPORTED_MAX_POW = 32;
+
+static bool _valid_name(const string& name, bool allow_colon)
+{
+    if(name.empty())
+        return false;
+
+    for(size_t i = 0; i < name.size(); ++i)
+    {
+        auto c = name[i];
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (allow_colon && c == ':') || (i > 0 && c >= '0' && c <= '9');
+        if(!ok)
+            return false;
+    }
+
+    return true;
+}
+
+static string _escape(const string& s, bool quote)
+{
+    string out;
+    out.reserve(s.size());
+    for(auto c : s)
+    {
+        if(c == '\\')
+            out += "\\\\";
+        else if(c == '\n')
+            out += "\\n";
+        else if(quote && c == '"')
+            out += "\\\"";
+        else out += c;
+    }
+    return out;
+}
+
+// Labels are sorted by name so the same set given in a different order is the same series.
+static string _format_labels(r_metric_labels labels)
+{
+    sort(labels.begin(), labels.end());
+
+    string out;
+    for(auto& l : labels)
+    {
+        if(!_valid_name(l.first, false) || l.first.compare(0, 2, "__") == 0 || l.first == "le")
+            R_STHROW(r_invalid_argument_exception, ("Invalid metric label name: %s", l.first.c_str()));
+
+        if(!out.empty())
+            out += ",";
+        out += l.first + "=\"" + _escape(l.second, true) + "\"";
+    }
+    return out;
+}
+
+static string _format_double(double v)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.15g", v);
+    return buffer;
+}
+
+static void _append_sample(string& out, const string& name, const string& labels, const string& value)
+{
+    out += name;
+    if(!labels.empty())
+        out += "{" + labels + "}";
+    out += " " + value + "\n";
+}
+
+static const char* _type_name(r_metric_type type)
+{
+    switch(type)
+    {
+        case R_METRIC_COUNTER: return "counter";
+        case R_METRIC_GAUGE: return "gauge";
+        case R_METRIC_HISTOGRAM: return "histogram";
+    }
+    return "untyped";
+}
+
+size_t r_utils::r_metrics_next_shard()
+{
+    static atomic<size_t> next {0};
+    return next.fetch_add(1, memory_order_relaxed) % R_METRICS_SHARDS;
+}
+
+uint64_t r_histogram_snapshot::percentile(double q) const
+{
+    if(count == 0)
+        return 0;
+
+    q = (std::min)((std::max)(q, 0.0), 1.0);
+    auto rank = (uint64_t)(q * (double)count);
+    if(rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if(seen >= rank)
+            return r_histogram::upper_bound(i);
+    }
+
+    return r_histogram::upper_bound(buckets.size() - 1);
+}
+
+r_histogram_snapshot r_histogram::snapshot() const
+{
+    r_histogram_snapshot snap;
+    snap.buckets.resize(N_BUCKETS);
+
+    for(auto& s : _shards)
+    {
+        for(size_t i = 0; i < N_BUCKETS; ++i)
+        {
+            auto n = s.buckets[i].load(memory_order_relaxed);
+            snap.buckets[i] += n;
+            snap.count += n;
+        }
+        snap.sum += s.sum.load(memory_order_relaxed);
+    }
+
+    return snap;
+}
+
+uint64_t r_histogram::upper_bound(size_t i) noexcept
+{
+    if(i <= SUB_BUCKETS)
+        return (uint64_t)i;
+
+    auto group = (i - 1 - SUB_BUCKETS) / SUB_BUCKETS;
+    auto sub = (i - 1 - SUB_BUCKETS) % SUB_BUCKETS;
+    uint64_t base = SUB_BUCKETS + 1 + sub;
+
+    if(base > (UINT64_MAX >> group))
+        return UINT64_MAX;
+
+    return base << group;
+}
+
+r_metrics::r_metrics() :
+    _lock(),
+    _families(),
+    _next_callback_id(1)
+{
+}
+
+r_counter& r_metrics::counter(const string& name, const string& help, const r_metric_labels& labels)
+{
+    lock_guard<mutex> g(_lock);
+    auto& s = _get_series(R_METRIC_COUNTER, name, help, labels, 1.0);
+    if(!s.counter)
+    {
+        if(s.fn)
+            R_STHROW(r_invalid_argument_exception, ("Metric %s is exported by a callback.", name.c_str()));
+        s.counter = make_unique<r_counter>();
+    }
+    return *s.counter;
+}
+
+r_gauge& r_metrics::gauge(const string& name, const string& help, const r_metric_labels& labels)
+{
+    lock_guard<mutex> g(_lock);
+    auto& s = _get_series(R_METRIC_GAUGE, name, help, labels, 1.0);
+    if(!s.gauge)
+    {
+        if(s.fn)
+            R_STHROW(r_invalid_argument_exception, ("Metric %s is exported by a callback.", name.c_str()));
+        s.gauge = make_unique<r_gauge>();
+    }
+    return *s.gauge;
+}
+
+r_histogram& r_metrics::histogram(const string& name, const string& help, const r_metric_labels& labels, double scale)
+{
+    lock_guard<mutex> g(_lock);
+    auto& s = _get_series(R_METRIC_HISTOGRAM, name, help, labels, scale);
+    if(!s.histogram)
+        s.histogram = make_unique<r_histogram>();
+    return *s.histogram;
+}
+
+uint64_t r_metrics::add_callback(r_metric_type type, const string& name, const string& help, const r_metric_labels& labels, function<double()> fn)
+{
+    if(type == R_METRIC_HISTOGRAM)
+        R_STHROW(r_invalid_argument_exception, ("Histograms cannot be exported by a callback."));
+
+    lock_guard<mutex> g(_lock);
+    auto& s = _get_series(type, name, help, labels, 1.0);
+    if(s.counter || s.gauge || s.fn)
+        R_STHROW(r_invalid_argument_exception, ("Metric %s already exists.", name.c_str()));
+
+    s.fn = fn;
+    s.callback_id = _next_callback_id++;
+    return s.callback_id;
+}
+
+void r_metrics::remove_callback(uint64_t id)
+{
+    lock_guard<mutex> g(_lock);
+
+    for(auto fi = _families.begin(); fi != _families.end(); ++fi)
+    {
+        auto& series = fi->second.series;
+        for(auto si = series.begin(); si != series.end(); ++si)
+        {
+            if(si->second.callback_id == id)
+            {
+                series.erase(si);
+                if(series.empty())
+                    _families.erase(fi);
+                return;
+            }
+        }
+    }
+}
+
+string r_metrics::render_prometheus() const
+{
+    lock_guard<mutex> g(_lock);
+
+    string out;
+
+    for(auto& fp : _families)
+    {
+        auto& name = fp.first;
+        auto& f = fp.second;
+
+        out += "# HELP " + name + " " + _escape(f.help, false) + "\n";
+        out += string("# TYPE ") + name + " " + _type_name(f.type) + "\n";
+
+        for(auto& sp : f.series)
+        {
+            auto& labels = sp.first;
+            auto& s = sp.second;
+
+            if(s.fn)
+            {
+                double v = 0.0;
+                try
+                {
+                    v = s.fn();
+                }
+                catch(...)
+                {
+                    continue;
+                }
+                _append_sample(out, name, labels, _format_double(v));
+            }
+            else if(s.counter)
+                _append_sample(out, name, labels, to_string(s.counter->value()));
+            else if(s.gauge)
+                _append_sample(out, name, labels, to_string(s.gauge->value()));
+            else if(s.histogram)
+            {
+                auto snap = s.histogram->snapshot();
+                auto prefix = labels.empty() ? string() : labels + ",";
+
+                uint64_t cumulative = 0;
+                size_t bi = 0;
+                for(size_t pow = 0; pow <= EXPORTED_MAX_POW; ++pow)
+                {
+                    uint64_t le = 1ULL << pow;
+                    while(bi < snap.buckets.size() && r_histogram::upper_bound(bi) <= le)
+                        cumulative += snap.buckets[bi++];
+                    _append_sample(out, name + "_bucket", prefix + "le=\"" + _format_double((double)le * f.scale) + "\"", to_string(cumulative));
+                }
+                _append_sample(out, name + "_bucket", prefix + "le=\"+Inf\"", to_string(snap.count));
+                _append_sample(out, name + "_sum", labels, _format_double((double)snap.sum * f.scale));
+                _append_sample(out, name + "_count", labels, to_string(snap.count));
+            }
+        }
+    }
+
+    return out;
+}
+
+r_metrics::_series& r_metrics::_get_series(r_metric_type type, const string& name, const string& help, const r_metric_labels& labels, double scale)
+{
+    if(!_valid_name(name, true))
+        R_STHROW(r_invalid_argument_exception, ("Invalid metric name: %s", name.c_str()));
+
+    auto key = _format_labels(labels);
+
+    auto found = _families.find(name);
+    if(found == _families.end())
+    {
+        _family f;
+        f.type = type;
+        f.help = help;
+        f.scale = scale;
+        found = _families.emplace(name, std::move(f)).first;
+    }
+    else if(found->second.type != type)
+        R_STHROW(r_invalid_argument_exception, ("Metric %s is a %s.", name.c_str(), _type_name(found->second.type)));
+
+    return found->second.series[key];
+}
+
+r_metrics& r_utils::metrics()
+{
+    static r_metrics registry;
+    return registry;
+}
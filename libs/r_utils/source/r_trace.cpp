@@ -0,0 +1,350 @@
+#include "r_utils/r_trace.h"
+#include "r_utils/r_file.h"
+#include "r_utils/r_string_utils.h"
+#include "r_utils/r_logger.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if defined(IS_LINUX)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#endif
+
+#if defined(IS_MACOS)
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+using namespace r_utils;
+using namespace std;
+using namespace std::chrono;
+
+// How often the signal watcher checks whether SIGUSR2 arrived.
+static const milliseconds SIGNAL_POLL_INTERVAL(250);
+
+namespace
+{
+
+// Fields are atomics so a dump can read a ring while its thread is writing it (relaxed, so they
+// compile to plain loads and stores).
+struct _span
+{
+    atomic<const char*> name {nullptr};
+    atomic<int64_t> begin_ns {0};
+    atomic<int64_t> end_ns {0};
+};
+
+// A ring only its own thread writes. writing is bumped before a slot is overwritten and written
+// after, so a dump can tell which of the slots it copied were overwritten while it was copying.
+struct _thread_spans
+{
+    _thread_spans(size_t capacity, uint64_t tid, const string& thread_name) :
+        spans(new _span[capacity]),
+        capacity(capacity),
+        tid(tid),
+        thread_name(thread_name)
+    {
+    }
+
+    unique_ptr<_span[]> spans;
+    const size_t capacity;
+    const uint64_t tid;
+    string thread_name;    // guarded by _trace_state::lock
+    atomic<uint64_t> writing {0};
+    atomic<uint64_t> written {0};
+};
+
+struct _trace_state
+{
+    atomic<bool> enabled {false};
+    // Bumped by start_tracing(), threads holding a ring from an older session go get a new one.
+    atomic<uint64_t> session {0};
+    mutex lock;
+    size_t spans_per_thread {r_trace::DEFAULT_SPANS_PER_THREAD};
+    vector<shared_ptr<_thread_spans>> rings;
+    set<string> interned;
+};
+
+// Never destroyed: spans can end during static destruction.
+_trace_state& _state()
+{
+    static _trace_state* state = new _trace_state();
+    return *state;
+}
+
+const steady_clock::time_point _epoch = steady_clock::now();
+
+uint64_t _os_thread_id()
+{
+#if defined(IS_LINUX)
+    return (uint64_t)syscall(SYS_gettid);
+#elif defined(IS_MACOS)
+    uint64_t tid = 0;
+    pthread_threadid_np(nullptr, &tid);
+    return tid;
+#elif defined(IS_WINDOWS)
+    return (uint64_t)GetCurrentThreadId();
+#else
+    return 0;
+#endif
+}
+
+struct _thread_handle
+{
+    shared_ptr<_thread_spans> ring;
+    uint64_t session {0};
+    string thread_name;
+};
+
+thread_local _thread_handle _this_thread;
+
+_thread_spans* _ring_for_this_thread()
+{
+    auto& s = _state();
+    auto session = s.session.load(memory_order_acquire);
+
+    if(!_this_thread.ring || _this_thread.session != session)
+    {
+        lock_guard<mutex> g(s.lock);
+        _this_thread.ring = make_shared<_thread_spans>(s.spans_per_thread, _os_thread_id(), _this_thread.thread_name);
+        _this_thread.session = s.session.load(memory_order_relaxed);
+        s.rings.push_back(_this_thread.ring);
+    }
+
+    return _this_thread.ring.get();
+}
+
+string _json_escape(const char* s)
+{
+    string out;
+    for(; *s; ++s)
+    {
+        auto c = *s;
+        if(c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if((unsigned char)c < 0x20)
+            out += r_string_utils::format("\\u%04x", (unsigned)(unsigned char)c);
+        else out += c;
+    }
+    return out;
+}
+
+#if defined(IS_LINUX) || defined(IS_MACOS)
+volatile sig_atomic_t _signal_pending = 0;
+
+void _on_sigusr2(int)
+{
+    _signal_pending = 1;
+}
+
+void _signal_watcher(string dump_dir)
+{
+    while(true)
+    {
+        this_thread::sleep_for(SIGNAL_POLL_INTERVAL);
+
+        if(!_signal_pending)
+            continue;
+        _signal_pending = 0;
+
+        try
+        {
+            if(!r_trace::enabled())
+            {
+                r_trace::start_tracing();
+                R_LOG_NOTICE("Tracing started (send SIGUSR2 again to write the trace).");
+            }
+            else
+            {
+                r_trace::stop_tracing();
+                auto path = r_fs::path_join(dump_dir, r_string_utils::format("trace_%lld.json", (long long)duration_cast<seconds>(system_clock::now().time_since_epoch()).count()));
+                r_trace::dump_to_file(path);
+                R_LOG_NOTICE("Trace written to %s", path.c_str());
+            }
+        }
+        catch(const exception& e)
+        {
+            R_LOG_ERROR("Unable to write trace: %s", e.what());
+        }
+    }
+}
+#endif
+
+}
+
+bool r_trace::enabled() noexcept
+{
+    return _state().enabled.load(memory_order_relaxed);
+}
+
+void r_trace::start_tracing(size_t spans_per_thread)
+{
+    auto& s = _state();
+    lock_guard<mutex> g(s.lock);
+    s.spans_per_thread = (spans_per_thread > 0) ? spans_per_thread : 1;
+    s.rings.clear();
+    s.session.fetch_add(1, memory_order_release);
+    s.enabled.store(true, memory_order_relaxed);
+}
+
+void r_trace::stop_tracing()
+{
+    _state().enabled.store(false, memory_order_relaxed);
+}
+
+string r_trace::dump_json()
+{
+    auto& s = _state();
+
+    vector<shared_ptr<_thread_spans>> rings;
+    {
+        lock_guard<mutex> g(s.lock);
+        rings = s.rings;
+    }
+
+#if defined(IS_WINDOWS)
+    auto pid = (unsigned long long)GetCurrentProcessId();
+#elif defined(IS_LINUX) || defined(IS_MACOS)
+    auto pid = (unsigned long long)getpid();
+#else
+    unsigned long long pid = 0;
+#endif
+
+    string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto add = [&](const string& event){
+        if(!first)
+            out += ",";
+        out += "\n" + event;
+        first = false;
+    };
+
+    for(auto& r : rings)
+    {
+        auto written = r->written.load(memory_order_acquire);
+        auto n = (written < r->capacity) ? written : r->capacity;
+
+        struct copied { const char* name; int64_t begin_ns; int64_t end_ns; uint64_t index; };
+        vector<copied> spans;
+        spans.reserve((size_t)n);
+
+        for(auto i = written - n; i < written; ++i)
+        {
+            auto& span = r->spans[i % r->capacity];
+            spans.push_back({span.name.load(memory_order_relaxed), span.begin_ns.load(memory_order_relaxed), span.end_ns.load(memory_order_relaxed), i});
+        }
+
+        // Anything the thread started overwriting while we copied may be torn, drop it.
+        atomic_thread_fence(memory_order_acquire);
+        auto writing = r->writing.load(memory_order_relaxed);
+        auto oldest_intact = (writing > r->capacity) ? writing - r->capacity : 0;
+
+        string thread_name;
+        {
+            lock_guard<mutex> g(s.lock);
+            thread_name = r->thread_name;
+        }
+
+        if(!thread_name.empty())
+            add(r_string_utils::format("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%llu,\"tid\":%llu,\"args\":{\"name\":\"%s\"}}", pid, (unsigned long long)r->tid, _json_escape(thread_name.c_str()).c_str()));
+
+        for(auto& c : spans)
+        {
+            if(c.index < oldest_intact || !c.name)
+                continue;
+
+            add(r_string_utils::format(
+                "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%llu,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f}",
+                _json_escape(c.name).c_str(),
+                pid,
+                (unsigned long long)r->tid,
+                (double)c.begin_ns / 1000.0,
+                (double)(c.end_ns - c.begin_ns) / 1000.0
+            ));
+        }
+    }
+
+    out += "\n]}\n";
+
+    return out;
+}
+
+void r_trace::dump_to_file(const string& path)
+{
+    auto json = dump_json();
+    r_fs::write_file((const uint8_t*)json.data(), json.size(), path);
+}
+
+void r_trace::set_thread_name(const string& name)
+{
+    _this_thread.thread_name = name;
+
+    if(_this_thread.ring)
+    {
+        lock_guard<mutex> g(_state().lock);
+        _this_thread.ring->thread_name = name;
+    }
+}
+
+const char* r_trace::intern(const string& name)
+{
+    auto& s = _state();
+    lock_guard<mutex> g(s.lock);
+    return s.interned.insert(name).first->c_str();
+}
+
+void r_trace::install_trace_signal(const string& dump_dir)
+{
+#if defined(IS_LINUX) || defined(IS_MACOS)
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _on_sigusr2;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &sa, nullptr);
+
+    thread(_signal_watcher, dump_dir).detach();
+#else
+    (void)dump_dir;
+#endif
+}
+
+int64_t r_trace::now_ns() noexcept
+{
+    return duration_cast<nanoseconds>(steady_clock::now() - _epoch).count();
+}
+
+void r_trace::record(const char* name, int64_t begin_ns, int64_t end_ns) noexcept
+{
+    try
+    {
+        auto r = _ring_for_this_thread();
+
+        auto i = r->written.load(memory_order_relaxed);
+        r->writing.store(i + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        auto& span = r->spans[i % r->capacity];
+        span.name.store(name, memory_order_relaxed);
+        span.begin_ns.store(begin_ns, memory_order_relaxed);
+        span.end_ns.store(end_ns, memory_order_relaxed);
+
+        r->written.store(i + 1, memory_order_release);
+    }
+    catch(...)
+    {
+        // Out of memory for a new ring, lose the span rather than the caller.
+    }
+}
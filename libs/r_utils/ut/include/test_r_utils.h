@@ -48,6 +48,9 @@ public:
       TEST(test_r_utils::test_blob_tree_basic);
       TEST(test_r_utils::test_blob_tree_objects_in_array);
       TEST(test_r_utils::test_blob_tree_big);
+      TEST(test_r_utils::test_blob_tree_view_basic);
+      TEST(test_r_utils::test_blob_tree_view_bad_buffers);
+      TEST(test_r_utils::test_blob_tree_view_video_chunk);
       TEST(test_r_utils::test_work_q_basic);
       TEST(test_r_utils::test_work_q_timeout);
       TEST(test_r_utils::test_timer_basic);
@@ -63,6 +66,22 @@ public:
       TEST(test_r_utils::test_ring_buffer_iteration);
       TEST(test_r_utils::test_ring_buffer_count_if);
       TEST(test_r_utils::test_ring_buffer_last_n_match);
+      TEST(test_r_utils::test_lru_cache_basic);
+      TEST(test_r_utils::test_lru_cache_cost);
+      TEST(test_r_utils::test_lru_cache_coalescing);
+      TEST(test_r_utils::test_keyed_pool_basic);
+      TEST(test_r_utils::test_keyed_pool_recycle);
+      TEST(test_r_utils::test_keyed_pool_checkout_cap);
+      TEST(test_r_utils::test_parallel_for);
+      TEST(test_r_utils::test_ring_q_basic);
+      TEST(test_r_utils::test_ring_q_mpmc);
+      TEST(test_r_utils::test_logger_async);
+      TEST(test_r_utils::test_logger_async_limits);
+      TEST(test_r_utils::test_metrics_basic);
+      TEST(test_r_utils::test_metrics_histogram);
+      TEST(test_r_utils::test_metrics_concurrent);
+      TEST(test_r_utils::test_trace_spans);
+      TEST(test_r_utils::test_trace_wraparound);
     RTF_FIXTURE_END();
 
     virtual ~test_r_utils() throw() {}
@@ -113,6 +132,9 @@ public:
     void test_blob_tree_basic();
     void test_blob_tree_objects_in_array();
     void test_blob_tree_big();
+    void test_blob_tree_view_basic();
+    void test_blob_tree_view_bad_buffers();
+    void test_blob_tree_view_video_chunk();
     void test_work_q_basic();
     void test_work_q_timeout();
     void test_timer_basic();
@@ -128,4 +150,20 @@ public:
     void test_ring_buffer_iteration();
     void test_ring_buffer_count_if();
     void test_ring_buffer_last_n_match();
+    void test_lru_cache_basic();
+    void test_lru_cache_cost();
+    void test_lru_cache_coalescing();
+    void test_keyed_pool_basic();
+    void test_keyed_pool_recycle();
+    void test_keyed_pool_checkout_cap();
+    void test_parallel_for();
+    void test_ring_q_basic();
+    void test_ring_q_mpmc();
+    void test_logger_async();
+    void test_logger_async_limits();
+    void test_metrics_basic();
+    void test_metrics_histogram();
+    void test_metrics_concurrent();
+    void test_trace_spans();
+    void test_trace_wraparound();
 };
@@ -16,21 +16,61 @@
 #include "r_utils/r_time_utils.h"
 #include "r_utils/r_uuid.h"
 #include "r_utils/r_blob_tree.h"
+#include "r_utils/r_blob_tree_view.h"
 #include "r_utils/r_work_q.h"
 #include "r_utils/r_timer.h"
 #include "r_utils/r_avg.h"
 #include "r_utils/r_algorithms.h"
 #include "r_utils/r_ring_buffer.h"
+#include "r_utils/r_lru_cache.h"
+#include "r_utils/r_keyed_pool.h"
+#include "r_utils/r_parallel_for.h"
+#include "r_utils/r_ring_q.h"
+#include "r_utils/r_blocking_q.h"
+#include "r_utils/r_logger.h"
+#include "r_utils/r_metrics.h"
+#include "r_utils/r_trace.h"
+#include "r_utils/3rdparty/json/json.h"
 #include <chrono>
 #include <thread>
 #include <climits>
 #include <numeric>
 #include <cstdint>
+#include <atomic>
+#include <future>
+#include <new>
+#include <cstdlib>
+#include <set>
+#include <map>
 
 using namespace std;
 using namespace std::chrono;
 using namespace r_utils;
 
+// Counts every allocation in the process so tests can check how many a reader makes. Windows doesn't
+// route allocations made inside other DLLs through a replacement, so it goes uncounted there.
+static atomic<uint64_t> _n_allocations {0};
+
+#if defined(IS_LINUX) || defined(IS_MACOS)
+void* operator new(size_t size)
+{
+    ++_n_allocations;
+    if(void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+#endif
+
 REGISTER_TEST_FIXTURE(test_r_utils);
 
 #ifdef WIN32
@@ -1268,6 +1308,199 @@ void test_r_utils::test_blob_tree_big()
 
 }
 
+void test_r_utils::test_blob_tree_view_basic()
+{
+    vector<uint8_t> blob = {1, 2, 3, 4, 5};
+
+    r_blob_tree rt;
+    rt["name"] = string("front door");
+    rt["count"] = string("42");
+    rt["big"] = string(" -9000000000");
+    rt["ratio"] = string("0.25");
+    rt["frames"][0]["ts"] = string("100");
+    rt["frames"][0]["data"] = blob;
+    rt["frames"][1]["ts"] = string("200");
+    rt["frames"][1]["data"] = vector<uint8_t>();
+    rt["nested"]["a"]["b"] = string("deep");
+
+    auto buffer = r_blob_tree::serialize(rt, 7);
+
+    uint32_t version = 0;
+    r_blob_tree_view v(buffer.data(), buffer.size(), version);
+
+    RTF_ASSERT(version == 7);
+    RTF_ASSERT(v.type() == r_blob_tree::NT_OBJECT);
+    RTF_ASSERT(v.size() == 6);
+    RTF_ASSERT(v.has_key("name") && !v.has_key("nope"));
+    RTF_ASSERT(v["name"].get_string() == "front door");
+    RTF_ASSERT(v["count"].get_value<int>() == 42);
+    RTF_ASSERT(v["big"].get_value<int64_t>() == -9000000000LL);
+    RTF_ASSERT(v["ratio"].get_value<double>() == 0.25);
+    RTF_ASSERT(v["nested"]["a"]["b"].get_string_view() == "deep");
+
+    auto frames = v["frames"];
+    RTF_ASSERT(frames.type() == r_blob_tree::NT_ARRAY);
+    RTF_ASSERT(frames.size() == 2);
+    RTF_ASSERT(frames.has_index(1) && !frames.has_index(2));
+
+    // Payloads point into the buffer rather than being copied.
+    auto data = frames[0]["data"].get_blob();
+    RTF_ASSERT(data.size() == blob.size());
+    RTF_ASSERT(data.data() > buffer.data() && data.data() < buffer.data() + buffer.size());
+    RTF_ASSERT(data.to_vector() == blob);
+    RTF_ASSERT(frames[1]["data"].get_blob().empty());
+
+    // Children iterate in order, object children know their keys.
+    vector<int64_t> tss;
+    for(auto f : frames)
+        tss.push_back(f["ts"].get_value<int64_t>());
+    RTF_ASSERT(tss == vector<int64_t>({100, 200}));
+
+    vector<string> keys;
+    for(auto c : v.root())
+        keys.push_back(string(c.key()));
+    RTF_ASSERT(keys == vector<string>({"big", "count", "frames", "name", "nested", "ratio"}));
+
+    // Same answers as the tree it came from.
+    auto rt2 = r_blob_tree::deserialize(buffer.data(), buffer.size(), version);
+    RTF_ASSERT(rt2["frames"][0]["data"].get_blob() == v["frames"][0]["data"].get_blob().to_vector());
+    RTF_ASSERT(rt2["count"].get_value<int>() == v["count"].get_value<int>());
+
+    bool threw = false;
+    try { v["nope"]; } catch(const r_not_found_exception&) { threw = true; }
+    RTF_ASSERT(threw);
+
+    threw = false;
+    try { frames[2]; } catch(const r_not_found_exception&) { threw = true; }
+    RTF_ASSERT(threw);
+
+    threw = false;
+    try { v["name"]["x"]; } catch(const r_internal_exception&) { threw = true; }
+    RTF_ASSERT(threw);
+
+    threw = false;
+    try { v["name"].get_value<int>(); } catch(const r_exception&) { threw = true; }
+    RTF_ASSERT(threw);
+}
+
+void test_r_utils::test_blob_tree_view_bad_buffers()
+{
+    r_blob_tree rt;
+    rt["frames"][0]["data"] = vector<uint8_t>(100);
+    rt["frames"][0]["ts"] = string("1");
+    auto buffer = r_blob_tree::serialize(rt, 1);
+
+    auto throws = [](const vector<uint8_t>& b){
+        try
+        {
+            uint32_t version = 0;
+            r_blob_tree_view v(b.data(), b.size(), version);
+        }
+        catch(const r_invalid_argument_exception&)
+        {
+            return true;
+        }
+        return false;
+    };
+
+    // Every truncation is caught rather than read past.
+    for(size_t n = 0; n < buffer.size(); ++n)
+        RTF_ASSERT(throws(vector<uint8_t>(buffer.begin(), buffer.begin() + n)));
+
+    auto bad_magic = buffer;
+    bad_magic[0] ^= 0xff;
+    RTF_ASSERT(throws(bad_magic));
+
+    auto bad_type = buffer;
+    bad_type[8] = 9;
+    RTF_ASSERT(throws(bad_type));
+
+    RTF_ASSERT(!throws(buffer));
+}
+
+static vector<uint8_t> _make_video_chunk(int seconds)
+{
+    // Shaped like what query_get_video() returns: 30 fps video with a key frame every second
+    // (~60KB key frames, ~4KB deltas) and 50 audio frames a second of ~160 bytes.
+    r_blob_tree bt;
+    bt["has_audio"] = string("true");
+    bt["video_codec_name"] = string("h264");
+    bt["video_codec_parameters"] = string("sprop-parameter-sets=Z2QAKKwbGoB4AiflwFuAgICgAAB9AAAdTAHixdQ=,aO44MAA=,profile-level-id=640028");
+    bt["audio_codec_name"] = string("pcmu");
+    bt["audio_codec_parameters"] = string("sc_audio_rate=8000,sc_audio_channels=1");
+
+    vector<uint8_t> key_frame(60000, 0x65), delta_frame(4000, 0x41), audio_frame(160, 0xff);
+
+    int64_t ts = 1700000000000;
+    size_t fi = 0;
+    for(int ms = 0; ms < seconds * 1000; ms += 20)
+    {
+        if(ms % 100 == 0 || ms % 100 == 40 || ms % 100 == 60)
+        {
+            // roughly 30 fps
+            bool key = (ms % 1000) == 0;
+            auto& f = bt["frames"][fi++];
+            f["stream_id"] = string("1");
+            f["key"] = string(key ? "true" : "false");
+            f["ts"] = r_string_utils::int64_to_s(ts + ms);
+            f["data"] = key ? key_frame : delta_frame;
+        }
+
+        auto& a = bt["frames"][fi++];
+        a["stream_id"] = string("2");
+        a["key"] = string("true");
+        a["ts"] = r_string_utils::int64_to_s(ts + ms);
+        a["data"] = audio_frame;
+    }
+
+    return r_blob_tree::serialize(bt, 1);
+}
+
+void test_r_utils::test_blob_tree_view_video_chunk()
+{
+    // Reads a 5 minute chunk with r_blob_tree and with r_blob_tree_view (the frame loop is the one in
+    // r_playback_prefetcher::_read_chunk()), they have to agree and the view mustn't copy the frames.
+    auto chunk = _make_video_chunk(5 * 60);
+
+    int64_t tree_ts_sum = 0, view_ts_sum = 0;
+    size_t tree_bytes = 0, view_bytes = 0;
+
+    {
+        uint32_t version = 0;
+        auto bt = r_blob_tree::deserialize(chunk.data(), chunk.size(), version);
+        auto n_frames = bt["frames"].size();
+        for(size_t fi = 0; fi < n_frames; ++fi)
+        {
+            auto& f = bt["frames"][fi];
+            tree_ts_sum += f["ts"].get_value<int64_t>() + f["stream_id"].get_value<int>() + ((f["key"].get_string() == "true") ? 1 : 0);
+            tree_bytes += f["data"].get_blob().size();
+        }
+    }
+
+    auto before = _n_allocations.load();
+    {
+        uint32_t version = 0;
+        r_blob_tree_view bt(chunk.data(), chunk.size(), version);
+        for(auto f : bt["frames"])
+        {
+            view_ts_sum += f["ts"].get_value<int64_t>() + f["stream_id"].get_value<int>() + ((f["key"].get_string_view() == "true") ? 1 : 0);
+            view_bytes += f["data"].get_blob().size();
+        }
+    }
+    auto view_allocations = _n_allocations.load() - before;
+
+    RTF_ASSERT(tree_bytes > 0);
+    RTF_ASSERT(tree_ts_sum == view_ts_sum);
+    RTF_ASSERT(tree_bytes == view_bytes);
+
+#if defined(IS_LINUX) || defined(IS_MACOS)
+    // The index is the only allocation.
+    RTF_ASSERT(view_allocations <= 1);
+#else
+    (void)view_allocations;
+#endif
+}
+
 void test_r_utils::test_work_q_basic()
 {
     r_work_q<int,int> wq;
@@ -1741,6 +1974,780 @@ void test_r_utils::test_ring_buffer_last_n_match()
     RTF_ASSERT(!motion_rb.last_n_match(2, [](const motion_sample& s) { return !s.is_significant; }));
 }
 
+void test_r_utils::test_lru_cache_basic()
+{
+    r_lru_cache<string, int> cache(3);
+
+    RTF_ASSERT(cache.get("a") == nullptr);
+
+    auto v = cache.get_or_create("a", [](){return 1;});
+    RTF_ASSERT(*v == 1);
+    cache.get_or_create("b", [](){return 2;});
+    cache.get_or_create("c", [](){return 3;});
+
+    // Cached, so create must not run.
+    v = cache.get_or_create("a", [](){RTF_ASSERT(false); return 0;});
+    RTF_ASSERT(*v == 1);
+
+    // b is now least recently used and is the one evicted.
+    cache.get_or_create("d", [](){return 4;});
+    RTF_ASSERT(cache.get("b") == nullptr);
+    RTF_ASSERT(cache.get("a") != nullptr);
+    RTF_ASSERT(cache.get("c") != nullptr);
+    RTF_ASSERT(cache.get("d") != nullptr);
+
+    auto s = cache.stats();
+    RTF_ASSERT(s.hits == 1);
+    RTF_ASSERT(s.misses == 4);
+    RTF_ASSERT(s.evictions == 1);
+    RTF_ASSERT(s.entries == 3);
+
+    cache.erase("a");
+    RTF_ASSERT(cache.get("a") == nullptr);
+
+    // A failed create is not cached and is rethrown.
+    bool threw = false;
+    try
+    {
+        cache.get_or_create("e", []()->int{R_THROW(("boom"));});
+    }
+    catch(const std::exception&)
+    {
+        threw = true;
+    }
+    RTF_ASSERT(threw);
+    RTF_ASSERT(cache.get("e") == nullptr);
+
+    cache.clear();
+    RTF_ASSERT(cache.stats().entries == 0);
+    RTF_ASSERT(cache.stats().cost == 0);
+}
+
+void test_r_utils::test_lru_cache_cost()
+{
+    r_lru_cache<int, vector<uint8_t>> cache(100, [](const vector<uint8_t>& v){return v.size();});
+
+    cache.put(1, vector<uint8_t>(40));
+    cache.put(2, vector<uint8_t>(40));
+    RTF_ASSERT(cache.stats().cost == 80);
+
+    // Pushes total cost to 120, so 1 goes.
+    cache.put(3, vector<uint8_t>(40));
+    RTF_ASSERT(cache.get(1) == nullptr);
+    RTF_ASSERT(cache.stats().cost == 80);
+
+    // Too big to ever fit, so it is not cached and nothing is evicted to make room for it.
+    cache.put(4, vector<uint8_t>(101));
+    RTF_ASSERT(cache.get(4) == nullptr);
+    RTF_ASSERT(cache.get(2) != nullptr);
+    RTF_ASSERT(cache.get(3) != nullptr);
+
+    // Replacing a value adjusts the cost.
+    cache.put(2, vector<uint8_t>(10));
+    RTF_ASSERT(cache.stats().cost == 50);
+}
+
+void test_r_utils::test_lru_cache_coalescing()
+{
+    r_lru_cache<string, int> cache(10);
+
+    std::atomic<int> creates{0};
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    auto create = [&](){
+        ++creates;
+        released.wait();
+        return 42;
+    };
+
+    vector<thread> threads;
+    vector<int> results(8, 0);
+    for(size_t i = 0; i < results.size(); ++i)
+        threads.push_back(thread([&, i](){results[i] = *cache.get_or_create("k", create);}));
+
+    // Give everyone a chance to pile up behind the first create.
+    while(cache.stats().misses + cache.stats().coalesced < results.size())
+        this_thread::sleep_for(milliseconds(1));
+
+    release.set_value();
+
+    for(auto& t : threads)
+        t.join();
+
+    RTF_ASSERT(creates == 1);
+    for(auto r : results)
+        RTF_ASSERT(r == 42);
+
+    auto s = cache.stats();
+    RTF_ASSERT(s.misses == 1);
+    RTF_ASSERT(s.coalesced == results.size() - 1);
+}
+
+void test_r_utils::test_keyed_pool_basic()
+{
+    r_keyed_pool<string, int> pool(2);
+
+    int n_created = 0;
+    auto create = [&](){return ++n_created;};
+
+    int* first = nullptr;
+    {
+        auto a = pool.get("a", create);
+        first = a.get();
+        RTF_ASSERT(*a == 1);
+        RTF_ASSERT(pool.stats().idle == 0);
+    }
+    RTF_ASSERT(pool.stats().idle == 1);
+
+    // Same key gets the same (warm) object back.
+    {
+        auto a = pool.get("a", create);
+        RTF_ASSERT(a.get() == first);
+        RTF_ASSERT(n_created == 1);
+
+        // While it's checked out another "a" must be created.
+        auto a2 = pool.get("a", create);
+        RTF_ASSERT(a2.get() != first);
+        RTF_ASSERT(n_created == 2);
+    }
+
+    // Different keys never share.
+    {
+        auto b = pool.get("b", create);
+        RTF_ASSERT(n_created == 3);
+    }
+
+    // max_idle is 2, so of a, a2 and b the least recently returned went away.
+    auto s = pool.stats();
+    RTF_ASSERT(s.idle == 2);
+    RTF_ASSERT(s.created == 3);
+    RTF_ASSERT(s.reused == 1);
+    RTF_ASSERT(s.discarded == 1);
+
+    pool.clear();
+    RTF_ASSERT(pool.stats().idle == 0);
+
+    // Objects released after the pool is gone are simply destroyed.
+    shared_ptr<int> survivor;
+    {
+        r_keyed_pool<string, int> short_lived(2);
+        survivor = short_lived.get("a", create);
+    }
+    survivor.reset();
+}
+
+void test_r_utils::test_keyed_pool_recycle()
+{
+    int n_recycled = 0;
+    r_keyed_pool<int, vector<uint8_t>> pool(4, [&](vector<uint8_t>& v){
+        ++n_recycled;
+        v.clear();
+        return n_recycled != 2;
+    });
+
+    {
+        auto v = pool.get(1, [](){return vector<uint8_t>();});
+        v->push_back(42);
+    }
+
+    // Recycle cleared it.
+    {
+        auto v = pool.get(1, [](){return vector<uint8_t>(10);});
+        RTF_ASSERT(v->empty());
+    }
+
+    // The second recycle refused, so nothing is idle and the next get() creates.
+    RTF_ASSERT(pool.stats().idle == 0);
+    RTF_ASSERT(pool.stats().discarded == 1);
+
+    auto v = pool.get(1, [](){return vector<uint8_t>(10);});
+    RTF_ASSERT(v->size() == 10);
+}
+
+void test_r_utils::test_keyed_pool_checkout_cap()
+{
+    r_keyed_pool<string, int> pool(4, [](int&){return true;}, 2);
+
+    auto create = [](){return 1;};
+
+    auto a = pool.get("a", create);
+    auto b = pool.get("b", create);
+    RTF_ASSERT(pool.stats().checked_out == 2);
+
+    // A third waits until one of the first two comes back.
+    atomic<bool> got_c {false};
+    thread th([&](){
+        auto c = pool.get("a", create);
+        got_c = true;
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    RTF_ASSERT(!got_c);
+
+    a.reset();
+    th.join();
+    RTF_ASSERT(got_c);
+
+    // It was handed the "a" that came back rather than a new one.
+    RTF_ASSERT(pool.stats().reused == 1);
+    RTF_ASSERT(pool.stats().checked_out == 1);
+
+    // A create() that throws doesn't use up a slot.
+    RTF_ASSERT_THROWS(pool.get("c", []()->int{R_THROW(("nope"));}), r_exception);
+    RTF_ASSERT(pool.stats().checked_out == 1);
+
+    b.reset();
+    RTF_ASSERT(pool.stats().checked_out == 0);
+}
+
+void test_r_utils::test_parallel_for()
+{
+    // Every index is visited exactly once and never by more than max_threads threads at a time.
+    vector<atomic<int>> visits(100);
+    atomic<int> running {0}, max_running {0};
+
+    r_parallel_for(visits.size(), 4, [&](size_t i){
+        auto now_running = ++running;
+        auto prev = max_running.load();
+        while(now_running > prev && !max_running.compare_exchange_weak(prev, now_running));
+        this_thread::sleep_for(chrono::milliseconds(2));
+        ++visits[i];
+        --running;
+    });
+
+    RTF_ASSERT(all_of(begin(visits), end(visits), [](const atomic<int>& v){return v == 1;}));
+    RTF_ASSERT(max_running <= 4);
+    RTF_ASSERT(max_running > 1);
+
+    // Nothing to do is fine.
+    r_parallel_for(0, 4, [](size_t){RTF_ASSERT(false);});
+
+    // The first exception comes back out.
+    bool caught = false;
+    try
+    {
+        r_parallel_for(10, 2, [](size_t i){
+            if(i == 3)
+                R_THROW(("boom"));
+        });
+    }
+    catch(const r_exception&)
+    {
+        caught = true;
+    }
+    RTF_ASSERT(caught);
+}
+
+void test_r_utils::test_ring_q_basic()
+{
+    {
+        r_spsc_q<int> q(4, r_queue_full_policy::drop_newest);
+        RTF_ASSERT(q.max_size() == 4);
+        RTF_ASSERT(q.size() == 0);
+
+        for(int i = 0; i < 4; ++i)
+            RTF_ASSERT(q.post(i));
+        RTF_ASSERT(!q.post(4));
+        RTF_ASSERT(q.dropped_count() == 1);
+        RTF_ASSERT(q.size() == 4);
+
+        int v = -1;
+        RTF_ASSERT(q.try_pop(v) && v == 0);
+
+        vector<int> out;
+        RTF_ASSERT(q.try_pop_n(out, 2) == 2);
+        RTF_ASSERT(out == vector<int>({1, 2}));
+
+        RTF_ASSERT(q.post(5));
+        RTF_ASSERT(q.pop_all(out) == 2);
+        RTF_ASSERT(out == vector<int>({1, 2, 3, 5}));
+        RTF_ASSERT(!q.try_pop(v));
+
+        q.reset_dropped_count();
+        RTF_ASSERT(q.dropped_count() == 0);
+    }
+
+    {
+        // drop_oldest keeps the newest capacity items, in order.
+        r_spsc_q<string> q(3);
+        for(int i = 0; i < 10; ++i)
+            RTF_ASSERT(q.post(to_string(i)));
+        RTF_ASSERT(q.dropped_count() == 7);
+
+        vector<string> out;
+        q.pop_all(out);
+        RTF_ASSERT(out == vector<string>({"7", "8", "9"}));
+    }
+
+    {
+        // Items still queued are destroyed with the queue.
+        auto p = make_shared<int>(42);
+        {
+            r_mpmc_q<shared_ptr<int>> q(8);
+            q.post(p);
+            q.post(p);
+            RTF_ASSERT(p.use_count() == 3);
+        }
+        RTF_ASSERT(p.use_count() == 1);
+    }
+
+    {
+        r_spsc_q<int> q(8);
+
+        // Times out with nothing to read.
+        auto before = steady_clock::now();
+        RTF_ASSERT(q.poll(milliseconds(50)).is_null());
+        RTF_ASSERT(steady_clock::now() - before >= milliseconds(50));
+
+        // Wakes for a post from another thread.
+        auto producer = std::async(std::launch::async, [&](){
+            this_thread::sleep_for(milliseconds(50));
+            q.post(7);
+        });
+        auto result = q.poll();
+        RTF_ASSERT(!result.is_null() && result.value() == 7);
+        producer.get();
+
+        // And for wake().
+        auto waker = std::async(std::launch::async, [&](){
+            this_thread::sleep_for(milliseconds(50));
+            q.wake();
+        });
+        RTF_ASSERT(q.poll().is_null());
+        waker.get();
+
+        q.post(1);
+        q.post(2);
+        q.clear();
+        RTF_ASSERT(q.size() == 0);
+    }
+}
+
+void test_r_utils::test_ring_q_mpmc()
+{
+    // Every item posted by every producer is seen exactly once across all the consumers.
+    const int N_PRODUCERS = 4, N_CONSUMERS = 4, N_PER_PRODUCER = 50000;
+
+    r_mpmc_q<int> q(64, r_queue_full_policy::drop_newest);
+    vector<atomic<int>> seen(N_PRODUCERS * N_PER_PRODUCER);
+    atomic<int> consumed {0};
+
+    vector<thread> producers;
+    for(int p = 0; p < N_PRODUCERS; ++p)
+    {
+        producers.push_back(thread([&, p](){
+            for(int i = 0; i < N_PER_PRODUCER; ++i)
+            {
+                while(!q.post((p * N_PER_PRODUCER) + i))
+                    this_thread::yield();
+            }
+        }));
+    }
+
+    vector<thread> consumers;
+    for(int c = 0; c < N_CONSUMERS; ++c)
+    {
+        consumers.push_back(thread([&](){
+            while(consumed < (int)seen.size())
+            {
+                auto v = q.poll(milliseconds(10));
+                if(!v.is_null())
+                {
+                    ++seen[v.value()];
+                    ++consumed;
+                }
+            }
+        }));
+    }
+
+    for(auto& t : producers)
+        t.join();
+    for(auto& t : consumers)
+        t.join();
+
+    RTF_ASSERT(all_of(begin(seen), end(seen), [](const atomic<int>& v){return v == 1;}));
+    RTF_ASSERT(q.size() == 0);
+}
+
+void test_r_utils::test_logger_async()
+{
+    mutex lok;
+    vector<string> seen;
+    r_logger::set_log_callback([&](r_logger::LOG_LEVEL, const string& message){
+        lock_guard<mutex> g(lok);
+        seen.push_back(message);
+    });
+
+    r_logger::async_logging_config config;
+    config.max_per_second_per_callsite = 0;
+    r_logger::start_async_logging(config);
+
+    // Nothing is written on the calling thread...
+    R_LOG_INFO("async %d", 1);
+
+    // ...but it all comes out, in order, from every thread.
+    vector<thread> threads;
+    for(int t = 0; t < 4; ++t)
+    {
+        threads.push_back(thread([t](){
+            for(int i = 0; i < 50; ++i)
+                R_LOG_INFO("thread %d message %d", t, i);
+        }));
+    }
+    for(auto& th : threads)
+        th.join();
+
+    r_logger::flush_log();
+
+    {
+        lock_guard<mutex> g(lok);
+        RTF_ASSERT(!seen.empty() && seen.front() == "async 1");
+        RTF_ASSERT(seen.size() == 201);
+
+        for(int t = 0; t < 4; ++t)
+        {
+            int next = 0;
+            for(auto& m : seen)
+            {
+                if(m.find(r_string_utils::format("thread %d message ", t)) == 0)
+                    RTF_ASSERT(m == r_string_utils::format("thread %d message %d", t, next++));
+            }
+            RTF_ASSERT(next == 50);
+        }
+        seen.clear();
+    }
+
+    // Critical is written before R_LOG_CRITICAL returns, after what was already queued.
+    R_LOG_INFO("before critical");
+    R_LOG_CRITICAL("critical");
+    {
+        lock_guard<mutex> g(lok);
+        RTF_ASSERT(seen.size() == 2);
+        RTF_ASSERT(seen[0] == "before critical" && seen[1] == "critical");
+        seen.clear();
+    }
+
+    // Stopping writes what's left and goes back to writing synchronously.
+    R_LOG_INFO("queued at stop");
+    r_logger::stop_async_logging();
+    R_LOG_INFO("sync again");
+    {
+        lock_guard<mutex> g(lok);
+        RTF_ASSERT(seen.size() == 2);
+        RTF_ASSERT(seen[0] == "queued at stop" && seen[1] == "sync again");
+    }
+
+    r_logger::clear_log_callback();
+}
+
+void test_r_utils::test_logger_async_limits()
+{
+    atomic<int> n_seen {0};
+    mutex lok;
+    vector<string> warnings;
+    r_logger::set_log_callback([&](r_logger::LOG_LEVEL level, const string& message){
+        ++n_seen;
+        if(level == r_logger::LOG_LEVEL_WARNING)
+        {
+            lock_guard<mutex> g(lok);
+            warnings.push_back(message);
+        }
+    });
+
+    {
+        // One call site is held to its per second budget.
+        r_logger::async_logging_config config;
+        config.max_per_second_per_callsite = 10;
+        config.flush_interval = milliseconds(10000);
+        r_logger::start_async_logging(config);
+
+        auto before = r_logger::get_logger_stats();
+
+        for(int i = 0; i < 1000; ++i)
+            R_LOG_INFO("busy %d", i);
+
+        r_logger::flush_log();
+
+        auto after = r_logger::get_logger_stats();
+        // Up to two windows if we happened to straddle a second boundary.
+        RTF_ASSERT(after.written - before.written <= 20);
+        RTF_ASSERT(after.suppressed - before.suppressed >= 980);
+
+        r_logger::stop_async_logging();
+
+        lock_guard<mutex> g(lok);
+        RTF_ASSERT(!warnings.empty() && warnings.back().find("suppressed") != string::npos);
+        warnings.clear();
+    }
+
+    {
+        // A full ring drops (and counts) rather than blocking the caller.
+        r_logger::async_logging_config config;
+        config.records_per_thread = 16;
+        config.max_per_second_per_callsite = 0;
+        config.flush_interval = milliseconds(10000);
+
+        // Rings are made when a thread first logs, so this has to be a fresh thread.
+        thread([&](){
+            r_logger::start_async_logging(config);
+
+            auto before = r_logger::get_logger_stats();
+            n_seen = 0;
+
+            for(int i = 0; i < 100; ++i)
+                R_LOG_INFO("flood %d", i);
+
+            r_logger::flush_log();
+
+            auto after = r_logger::get_logger_stats();
+            RTF_ASSERT(after.written - before.written == 16);
+            RTF_ASSERT(after.dropped - before.dropped == 84);
+
+            r_logger::stop_async_logging();
+        }).join();
+
+        lock_guard<mutex> g(lok);
+        RTF_ASSERT(!warnings.empty() && warnings.back().find("dropped 84") != string::npos);
+    }
+
+    r_logger::clear_log_callback();
+}
+
+void test_r_utils::test_metrics_basic()
+{
+    r_metrics m;
+
+    auto& frames = m.counter("test_frames_total", "Frames received.", {{"camera", "a"}});
+    frames.inc();
+    frames.inc(4);
+    RTF_ASSERT(frames.value() == 5);
+
+    // Same name and labels (in any order) is the same counter.
+    RTF_ASSERT(&m.counter("test_frames_total", "Frames received.", {{"camera", "a"}}) == &frames);
+    auto& multi = m.counter("test_frames_total", "Frames received.", {{"media", "video"}, {"camera", "b"}});
+    RTF_ASSERT(&m.counter("test_frames_total", "Frames received.", {{"camera", "b"}, {"media", "video"}}) == &multi);
+    RTF_ASSERT(&multi != &frames);
+
+    auto& depth = m.gauge("test_queue_depth", "Items queued.");
+    depth.set(10);
+    depth.sub(3);
+    depth.add();
+    RTF_ASSERT(depth.value() == 8);
+
+    // A name can't change type, and names and label names are checked.
+    RTF_ASSERT_THROWS(m.gauge("test_frames_total", "Oops."), r_invalid_argument_exception);
+    RTF_ASSERT_THROWS(m.counter("bad name", "Oops."), r_invalid_argument_exception);
+    RTF_ASSERT_THROWS(m.counter("test_ok", "Oops.", {{"le", "1"}}), r_invalid_argument_exception);
+
+    auto id = m.add_callback(R_METRIC_GAUGE, "test_cache_entries", "Entries in the cache.", {}, [](){return 42.0;});
+
+    // Counters are added up across the shards of every thread that touched them.
+    vector<thread> threads;
+    for(int i = 0; i < 16; ++i)
+        threads.push_back(thread([&](){for(int j = 0; j < 1000; ++j) frames.inc();}));
+    for(auto& t : threads)
+        t.join();
+    RTF_ASSERT(frames.value() == 16005);
+
+    auto text = m.render_prometheus();
+    RTF_ASSERT(text.find("# TYPE test_frames_total counter\n") != string::npos);
+    RTF_ASSERT(text.find("test_frames_total{camera=\"a\"} 16005\n") != string::npos);
+    RTF_ASSERT(text.find("test_frames_total{camera=\"b\",media=\"video\"} 0\n") != string::npos);
+    RTF_ASSERT(text.find("# TYPE test_queue_depth gauge\n") != string::npos);
+    RTF_ASSERT(text.find("test_queue_depth 8\n") != string::npos);
+    RTF_ASSERT(text.find("test_cache_entries 42\n") != string::npos);
+
+    m.remove_callback(id);
+    RTF_ASSERT(m.render_prometheus().find("test_cache_entries") == string::npos);
+
+    // Label values are escaped.
+    m.counter("test_escaped_total", "Escaping.", {{"path", "a\"b\\c"}}).inc();
+    RTF_ASSERT(m.render_prometheus().find("test_escaped_total{path=\"a\\\"b\\\\c\"} 1\n") != string::npos);
+}
+
+void test_r_utils::test_metrics_histogram()
+{
+    // Powers of two are bucket edges and every value lands in a bucket whose bounds hold it.
+    RTF_ASSERT(r_histogram::bucket_of(0) == 0);
+    RTF_ASSERT(r_histogram::upper_bound(r_histogram::bucket_of(1024)) == 1024);
+    RTF_ASSERT(r_histogram::upper_bound(r_histogram::bucket_of(1025)) > 1024);
+    RTF_ASSERT(r_histogram::bucket_of(UINT64_MAX) == r_histogram::N_BUCKETS - 1);
+    RTF_ASSERT(r_histogram::upper_bound(r_histogram::N_BUCKETS - 1) == UINT64_MAX);
+
+    for(uint64_t v : {1ULL, 3ULL, 5ULL, 7ULL, 100ULL, 999ULL, 123456ULL, 987654321ULL, 1ULL << 40, (1ULL << 62) + 1})
+    {
+        auto b = r_histogram::bucket_of(v);
+        RTF_ASSERT(v <= r_histogram::upper_bound(b));
+        RTF_ASSERT(b == 0 || v > r_histogram::upper_bound(b - 1));
+        // Within 25% of the real value.
+        RTF_ASSERT((double)r_histogram::upper_bound(b) <= (double)v * 1.25 + 1.0);
+    }
+
+    r_metrics m;
+    auto& latency = m.histogram("test_latency_seconds", "Latency.", {{"route", "jpg"}}, R_METRICS_MICROSECONDS);
+
+    for(uint64_t i = 1; i <= 1000; ++i)
+        latency.observe(i);
+
+    auto snap = latency.snapshot();
+    RTF_ASSERT(snap.count == 1000);
+    RTF_ASSERT(snap.sum == 500500);
+    auto p50 = snap.percentile(0.5);
+    RTF_ASSERT(p50 >= 500 && p50 <= 625);
+    auto p99 = snap.percentile(0.99);
+    RTF_ASSERT(p99 >= 990 && p99 <= 1024);
+
+    auto text = m.render_prometheus();
+    RTF_ASSERT(text.find("# TYPE test_latency_seconds histogram\n") != string::npos);
+    RTF_ASSERT(text.find("test_latency_seconds_bucket{route=\"jpg\",le=\"0.000512\"} 512\n") != string::npos);
+    RTF_ASSERT(text.find("test_latency_seconds_bucket{route=\"jpg\",le=\"0.001024\"} 1000\n") != string::npos);
+    RTF_ASSERT(text.find("test_latency_seconds_bucket{route=\"jpg\",le=\"+Inf\"} 1000\n") != string::npos);
+    RTF_ASSERT(text.find("test_latency_seconds_sum{route=\"jpg\"} 0.5005\n") != string::npos);
+    RTF_ASSERT(text.find("test_latency_seconds_count{route=\"jpg\"} 1000\n") != string::npos);
+}
+
+void test_r_utils::test_metrics_concurrent()
+{
+    // Threads recording into the same metric land on different shards, every one of them has to
+    // show up in the totals.
+    const int N_THREADS = 4;
+    const int N = 100000;
+
+    r_metrics m;
+    auto& c = m.counter("test_ops_total", "Ops.");
+    auto& h = m.histogram("test_op_size", "Op sizes.");
+
+    vector<thread> threads;
+    for(int i = 0; i < N_THREADS; ++i)
+    {
+        threads.push_back(thread([&](){
+            for(int j = 0; j < N; ++j)
+            {
+                c.inc();
+                h.observe((uint64_t)j);
+            }
+        }));
+    }
+    for(auto& t : threads)
+        t.join();
+
+    RTF_ASSERT(c.value() == (uint64_t)N_THREADS * N);
+
+    auto snap = h.snapshot();
+    RTF_ASSERT(snap.count == (uint64_t)N_THREADS * N);
+    RTF_ASSERT(snap.sum == (uint64_t)N_THREADS * (((uint64_t)N * (N - 1)) / 2));
+}
+
+void test_r_utils::test_trace_spans()
+{
+    // Nothing is recorded while tracing is off.
+    r_trace::start_tracing();
+    r_trace::stop_tracing();
+    {
+        R_TRACE_SPAN("test.off");
+    }
+    RTF_ASSERT(r_trace::dump_json().find("test.off") == string::npos);
+
+    r_trace::start_tracing();
+
+    auto dynamic_name = r_trace::intern(string("test.") + "dynamic");
+    RTF_ASSERT(dynamic_name == r_trace::intern("test.dynamic"));
+
+    vector<thread> threads;
+    for(int i = 0; i < 4; ++i)
+    {
+        threads.push_back(thread([i, dynamic_name](){
+            r_trace::set_thread_name("worker \"" + to_string(i) + "\"");
+            for(int j = 0; j < 10; ++j)
+            {
+                R_TRACE_SPAN("test.outer");
+                {
+                    R_TRACE_SPAN(dynamic_name);
+                    this_thread::sleep_for(microseconds(50));
+                }
+            }
+        }));
+    }
+    for(auto& t : threads)
+        t.join();
+
+    r_trace::stop_tracing();
+
+    auto doc = nlohmann::json::parse(r_trace::dump_json());
+    auto& events = doc["traceEvents"];
+
+    map<string, int> counts;
+    set<uint64_t> tids;
+    size_t named_threads = 0;
+    for(auto& e : events)
+    {
+        if(e["ph"] == "M")
+        {
+            ++named_threads;
+            RTF_ASSERT(e["args"]["name"].get<string>().find("worker \"") == 0);
+            continue;
+        }
+
+        RTF_ASSERT(e["ph"] == "X");
+        RTF_ASSERT(e["dur"].get<double>() >= 0.0);
+        ++counts[e["name"].get<string>()];
+        tids.insert(e["tid"].get<uint64_t>());
+    }
+
+    RTF_ASSERT(counts["test.outer"] == 40);
+    RTF_ASSERT(counts["test.dynamic"] == 40);
+    RTF_ASSERT(tids.size() == 4);
+    RTF_ASSERT(named_threads == 4);
+
+    // Every inner span sits inside an outer span on the same thread.
+    for(auto& inner : events)
+    {
+        if(inner["ph"] != "X" || inner["name"] != "test.dynamic")
+            continue;
+
+        bool nested = false;
+        for(auto& outer : events)
+        {
+            if(outer["ph"] == "X" && outer["name"] == "test.outer" && outer["tid"] == inner["tid"] &&
+               outer["ts"].get<double>() <= inner["ts"].get<double>() &&
+               outer["ts"].get<double>() + outer["dur"].get<double>() >= inner["ts"].get<double>() + inner["dur"].get<double>())
+                nested = true;
+        }
+        RTF_ASSERT(nested);
+    }
+}
+
+void test_r_utils::test_trace_wraparound()
+{
+    // A full ring keeps the most recent spans.
+    r_trace::start_tracing(16);
+
+    static const char* names[] = {"test.a", "test.b"};
+    for(int i = 0; i < 100; ++i)
+    {
+        R_TRACE_SPAN(names[(i < 84) ? 0 : 1]);
+    }
+
+    r_trace::stop_tracing();
+
+    auto doc = nlohmann::json::parse(r_trace::dump_json());
+    size_t n = 0;
+    for(auto& e : doc["traceEvents"])
+    {
+        if(e["ph"] != "X")
+            continue;
+        ++n;
+        RTF_ASSERT(e["name"] == "test.b");
+    }
+    RTF_ASSERT(n == 16);
+
+    // Starting again throws the old session away.
+    r_trace::start_tracing();
+    r_trace::stop_tracing();
+    RTF_ASSERT(r_trace::dump_json().find("test.b") == string::npos);
+}
+
 #ifdef WIN32
 #pragma warning(pop)
 #endif
@@ -0,0 +1,163 @@
+#ifndef __r_vss_r_decode_session_cache_h
+#define __r_vss_r_decode_session_cache_h
+
+#include "r_storage/r_storage_file_reader.h"
+#include "r_av/r_video_decoder.h"
+#include "r_utils/r_macro.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <atomic>
+
+namespace r_vss
+{
+
+// A session nobody has stepped in for this long is dropped (along with its decoder and pictures).
+constexpr std::chrono::seconds DECODE_SESSION_TTL(30);
+
+// When a new session would go over this, the least recently used one is dropped.
+constexpr size_t DECODE_SESSION_MAX_SESSIONS = 16;
+
+// Decoded pictures a session keeps, the ones nearest the last frame asked for. Stepping onto any of
+// them costs no decode.
+constexpr size_t DECODE_SESSION_MAX_PICTURES = 64;
+
+// Bytes of decoded pictures a session keeps beyond the one just decoded, so all sessions together
+// hold about DECODE_SESSION_MAX_SESSIONS times this.
+constexpr size_t DECODE_SESSION_MAX_PICTURE_BYTES = 16 * 1024 * 1024;
+
+// Largest picture a session decodes to. A 1080p picture is about 3MB, so a session can keep at least
+// a handful.
+constexpr uint16_t DECODE_SESSION_MAX_WIDTH = 1920;
+constexpr uint16_t DECODE_SESSION_MAX_HEIGHT = 1080;
+
+// Largest step (either way) a single get() takes. Every frame stepped over is looked up, and may be
+// decoded, so a step is held to about ten seconds of 30fps video.
+constexpr int DECODE_SESSION_MAX_STEP = 300;
+
+struct r_decoded_step
+{
+    int64_t ts {0};
+    std::shared_ptr<const std::vector<uint8_t>> picture;
+    size_t frames_decoded {0};
+};
+
+struct r_decode_session_stats
+{
+    uint64_t hits {0};      // answered from a session's pictures, no decode
+    uint64_t forwards {0};  // the session's decoder carried on from where it was
+    uint64_t misses {0};    // decoded from a key frame
+    uint64_t frames_decoded {0};
+    size_t sessions {0};
+
+    double hit_ratio() const
+    {
+        auto total = hits + forwards + misses;
+        return (total > 0) ? (double)(hits + forwards) / (double)total : 0.0;
+    }
+};
+
+// r_decode_session_cache makes frame accurate seeking and single stepping through a recording
+// cheap. Getting at a frame inside a GOP means decoding from the key frame before it, so each
+// client (session) keeps its decoder positioned where it last stopped along with the pictures it
+// decoded on the way. A step forward then decodes one frame, and a step back (or forward again)
+// onto a frame already decoded decodes nothing. Sessions expire after ttl.
+//
+// Each frame's timestamp goes into the decoder with its data and a picture is labelled with the one
+// it comes out with, so streams with B frames (which come out in a different order than they went
+// in) get the right picture for each frame.
+class r_decode_session_cache final
+{
+public:
+    R_API r_decode_session_cache(
+        std::chrono::milliseconds ttl = DECODE_SESSION_TTL,
+        size_t max_sessions = DECODE_SESSION_MAX_SESSIONS,
+        size_t max_pictures = DECODE_SESSION_MAX_PICTURES,
+        size_t max_picture_bytes = DECODE_SESSION_MAX_PICTURE_BYTES
+    );
+    R_API r_decode_session_cache(const r_decode_session_cache&) = delete;
+    R_API r_decode_session_cache(r_decode_session_cache&&) = delete;
+    R_API ~r_decode_session_cache() noexcept;
+
+    R_API r_decode_session_cache& operator=(const r_decode_session_cache&) = delete;
+    R_API r_decode_session_cache& operator=(r_decode_session_cache&&) = delete;
+
+    // Returns the picture of the video frame at or before ts in sf, or of the frame step frames
+    // after (step > 0) or before (step < 0) it. Stepping past the end of the recording stays on
+    // the last frame. A session must always be given the same recording. Throws if step is more
+    // than DECODE_SESSION_MAX_STEP either way, or if the output is bigger than
+    // DECODE_SESSION_MAX_WIDTH x DECODE_SESSION_MAX_HEIGHT.
+    R_API r_decoded_step get(
+        const std::string& session,
+        r_storage::r_storage_file_reader& sf,
+        int64_t ts,
+        int step,
+        AVPixelFormat output_format,
+        uint16_t output_width,
+        uint16_t output_height
+    );
+
+    R_API r_decode_session_stats stats() const;
+
+private:
+    struct _session
+    {
+        std::mutex lock;
+        std::chrono::steady_clock::time_point last_used;
+
+        AVPixelFormat output_format {AV_PIX_FMT_NONE};
+        uint16_t output_width {0};
+        uint16_t output_height {0};
+
+        std::string codec_name;
+        std::string codec_parameters;
+        std::unique_ptr<r_av::r_video_decoder> decoder;
+
+        // Every frame given to the decoder since the key frame at key_ts, and those of them it
+        // hasn't handed back yet.
+        bool positioned {false};
+        int64_t key_ts {0};
+        std::vector<int64_t> gop;
+        std::deque<int64_t> pending;
+
+        std::map<int64_t, std::shared_ptr<const std::vector<uint8_t>>> pictures;
+        size_t picture_bytes {0};
+    };
+
+    struct _cost
+    {
+        size_t decoded {0};
+        bool restarted {false};
+    };
+
+    std::shared_ptr<_session> _get_session(const std::string& session);
+    int64_t _seek(_session& s, r_storage::r_storage_file_reader& sf, int64_t ts, _cost& cost);
+    int64_t _next(_session& s, r_storage::r_storage_file_reader& sf, int64_t ts, _cost& cost);
+    int64_t _prev(_session& s, r_storage::r_storage_file_reader& sf, int64_t ts, _cost& cost);
+    void _restart(_session& s, r_storage::r_storage_file_reader& sf, int64_t key_ts, _cost& cost);
+    void _decode_through(_session& s, r_storage::r_storage_file_reader& sf, int64_t ts, _cost& cost);
+    void _feed(_session& s, const r_storage::r_storage_frame_ref& frame, _cost& cost);
+    void _drain(_session& s);
+    void _take_picture(_session& s);
+
+    std::chrono::milliseconds _ttl;
+    size_t _max_sessions;
+    size_t _max_pictures;
+    size_t _max_picture_bytes;
+
+    mutable std::mutex _lock;
+    std::map<std::string, std::shared_ptr<_session>> _sessions;
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _forwards;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _frames_decoded;
+};
+
+}
+
+#endif
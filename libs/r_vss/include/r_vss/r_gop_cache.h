@@ -0,0 +1,75 @@
+
+#ifndef __r_vss_r_gop_cache_h
+#define __r_vss_r_gop_cache_h
+
+#include "r_pipeline/r_gst_buffer.h"
+#include "r_utils/r_macro.h"
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+namespace r_vss
+{
+
+// Upper bounds on a single GOP. Cameras with very long GOPs (or a stream that never sends a key
+// frame) would otherwise grow the cache without limit. The duration covers the 4 to 8 second GOPs
+// many cameras ship with, the sample count is a backstop for high frame rates (10 seconds of 60fps
+// video + 50fps audio is 1100 samples). A GOP that exceeds either is dropped.
+constexpr size_t GOP_CACHE_MAX_SAMPLES = 1200;
+constexpr int64_t GOP_CACHE_MAX_DURATION_MS = 10000;
+
+struct r_gop_sample
+{
+    r_pipeline::r_gst_buffer buffer;
+    int64_t pts;
+    bool key;
+    bool video;
+    uint64_t seq;
+};
+
+// r_gop_cache holds every sample since the most recent video key frame for a single camera. New
+// live restream clients are primed from it so they can start decoding immediately instead of
+// waiting for the camera to send its next IDR.
+//
+// Samples are not copied, the cache just holds a reference to the GstBuffer that was handed to us
+// by the source. Every sample is given a monotonically increasing sequence number so that a client
+// primed from a snapshot can tell which of the subsequently delivered samples it has already seen.
+
+class r_gop_cache final
+{
+public:
+    R_API r_gop_cache(size_t max_samples = GOP_CACHE_MAX_SAMPLES, int64_t max_duration_ms = GOP_CACHE_MAX_DURATION_MS);
+    R_API r_gop_cache(const r_gop_cache&) = delete;
+    R_API r_gop_cache(r_gop_cache&&) = delete;
+    R_API ~r_gop_cache() noexcept = default;
+
+    R_API r_gop_cache& operator=(const r_gop_cache&) = delete;
+    R_API r_gop_cache& operator=(r_gop_cache&&) = delete;
+
+    // Returns the sequence number assigned to this sample.
+    R_API uint64_t post_video(const r_pipeline::r_gst_buffer& buffer, int64_t pts, bool key);
+    R_API uint64_t post_audio(const r_pipeline::r_gst_buffer& buffer, int64_t pts, bool key);
+
+    // Calls fn with the current GOP and the sequence number of the last sample posted. The cache
+    // lock is held for the duration of the call, so anything fn does (like registering a new
+    // client) is atomic with respect to post_video() and post_audio().
+    R_API void prime(std::function<void(const std::vector<r_gop_sample>& samples, uint64_t last_seq)> fn) const;
+
+    R_API void clear();
+
+    R_API size_t size() const;
+
+private:
+    uint64_t _post(const r_pipeline::r_gst_buffer& buffer, int64_t pts, bool key, bool video);
+
+    mutable std::mutex _lock;
+    std::vector<r_gop_sample> _samples;
+    size_t _max_samples;
+    int64_t _max_duration_ms;
+    uint64_t _seq;
+};
+
+}
+
+#endif
@@ -3,7 +3,8 @@
 #define __r_vss_r_motion_engine_h
 
 #include "r_motion/r_motion_state.h"
-#include "r_utils/r_blocking_q.h"
+#include "r_utils/r_ring_q.h"
+#include "r_utils/r_metrics.h"
 #include "r_utils/r_macro.h"
 #include "r_utils/r_ring_buffer.h"
 #include "r_av/r_video_decoder.h"
@@ -75,12 +76,16 @@ public:
         _keyframe_motion_buffer(motion_confirm_frames)
     {
         _video_decoder.set_extradata(ed);
+        // Motion detection blurs and thresholds what it is given, it doesn't need a careful scale.
+        _video_decoder.set_scaler_quality(r_av::R_SCALER_QUALITY_FAST_BILINEAR);
     }
     ~r_work_context() noexcept
     {
     }
     r_av::r_video_decoder& decoder(){return _video_decoder;}
     r_motion::r_motion_state& motion_state(){return _motion_state;}
+    // Reused for every scaled key frame so analysis doesn't allocate one per frame.
+    std::vector<uint8_t>& scaled_frame(){return _scaled_frame;}
     r_storage::r_ring& ring(){return _ring;}
     bool get_in_event() const { return _in_event; }
     void set_in_event(bool v) { _in_event = v; }
@@ -121,6 +126,8 @@ private:
 
     // Counter for consecutive keyframes without motion (for event end hysteresis)
     size_t _no_motion_count {0};
+
+    std::vector<uint8_t> _scaled_frame;
 };
 
 class r_motion_engine final
@@ -142,7 +149,8 @@ public:
 
     R_API void remove_work_context(const std::string& camera_id);
 
-    // Returns number of frames dropped since last call (resets counter)
+    // Returns number of frames dropped since last call (resets counter). The drops are added to the
+    // revere_motion_frames_dropped_total metric here, so it lags until someone asks.
     R_API size_t get_and_reset_dropped_count();
 
     // Returns current queue size
@@ -154,11 +162,16 @@ private:
     r_disco::r_devices& _devices;
     std::string _top_dir;
     // Bounded queue to prevent memory exhaustion if motion processing can't keep up
-    r_utils::r_blocking_q<r_work_item> _work{MOTION_ENGINE_MAX_QUEUE_SIZE};
+    r_utils::r_mpmc_q<r_work_item> _work;
     std::map<std::string, std::shared_ptr<r_work_context>> _work_contexts;
     bool _running;
     std::thread _thread;
     r_motion_event_plugin_host& _meph;
+    r_utils::r_counter& _frames_processed;
+    r_utils::r_counter& _frames_dropped;
+    r_utils::r_counter& _events_started;
+    r_utils::r_gauge& _queue_depth;
+    r_utils::r_histogram& _key_frame_duration;
 };
 
 }
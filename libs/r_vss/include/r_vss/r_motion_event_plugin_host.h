@@ -6,6 +6,7 @@
 #include "r_vss/r_motion_plugin.h"
 #include "r_utils/r_dynamic_library.h"
 #include "r_utils/r_macro.h"
+#include "r_utils/r_metrics.h"
 #include "r_disco/r_devices.h"
 
 #include <list>
@@ -43,6 +44,9 @@ private:
         void (*stop_func)(r_motion_plugin_handle);  // Function pointer to stop_plugin
         void (*destroy_func)(r_motion_plugin_handle);  // Function pointer to destroy_plugin
         void (*post_func)(r_motion_plugin_handle, int, const char*, int64_t, const uint8_t*, size_t, uint16_t, uint16_t, int, int, int, int, bool);  // Function pointer to post_motion_event
+        r_utils::r_counter* events_posted;
+        r_utils::r_histogram* post_duration;  // How long the plugin holds up the motion engine
+        const char* trace_name;
     };
 
     r_disco::r_devices& _devices;
@@ -0,0 +1,110 @@
+
+#ifndef __r_vss_r_playback_prefetcher_h
+#define __r_vss_r_playback_prefetcher_h
+
+#include "r_disco/r_devices.h"
+#include "r_pipeline/r_gst_buffer.h"
+#include "r_utils/r_avg.h"
+#include "r_utils/r_macro.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+
+namespace r_vss
+{
+
+// Playback chunks cover this much output time (at 1x, this much recorded time)
+constexpr std::chrono::milliseconds PLAYBACK_CHUNK_DURATION = std::chrono::seconds(5);
+
+// Bounds on the number of chunks read ahead of the consumer. Two is classic double buffering
+// (one being consumed, one ready). Slow or jittery storage pushes the depth up toward the max.
+constexpr size_t PLAYBACK_PREFETCH_MIN_DEPTH = 2;
+constexpr size_t PLAYBACK_PREFETCH_MAX_DEPTH = 6;
+
+struct r_playback_frame
+{
+    int stream_id;
+    bool key;
+    int64_t ts;
+    r_pipeline::r_gst_buffer buffer;
+};
+
+struct r_playback_chunk
+{
+    std::chrono::system_clock::time_point start;
+    std::chrono::system_clock::time_point end;
+    std::vector<r_playback_frame> frames;
+};
+
+// r_playback_prefetcher reads playback chunks on its own thread so that the disk seek and blob
+// tree deserialization for the next chunk overlap with the consumption of the current one. Chunks
+// are handed to the consumer by shared_ptr, so nothing is copied after the read.
+//
+// The read ahead depth adapts to the observed read latency: when reading a chunk takes a
+// meaningful fraction of the time it takes to play it, we keep more chunks in flight.
+//
+// Above 1x each chunk spans chunk_duration * rate of recorded time, and at rates of
+// TRICK_PLAY_KEY_FRAME_RATE and above only key frames are read. Timestamps are left untouched.
+
+class r_playback_prefetcher final
+{
+public:
+    R_API r_playback_prefetcher(
+        const std::string& top_dir,
+        r_disco::r_devices& devices,
+        const std::string& camera_id,
+        std::chrono::system_clock::time_point start,
+        std::chrono::system_clock::time_point end,
+        double rate = 1.0,
+        std::chrono::milliseconds chunk_duration = PLAYBACK_CHUNK_DURATION
+    );
+    R_API r_playback_prefetcher(const r_playback_prefetcher&) = delete;
+    R_API r_playback_prefetcher(r_playback_prefetcher&&) = delete;
+    R_API ~r_playback_prefetcher() noexcept;
+
+    R_API r_playback_prefetcher& operator=(const r_playback_prefetcher&) = delete;
+    R_API r_playback_prefetcher& operator=(r_playback_prefetcher&&) = delete;
+
+    R_API void start();
+    R_API void stop();
+
+    // Returns the next chunk in order, or nullptr if none became ready within timeout.
+    R_API std::shared_ptr<r_playback_chunk> next(std::chrono::milliseconds timeout);
+
+    // True once every chunk up to end has been read and handed out.
+    R_API bool exhausted() const;
+
+    R_API size_t depth() const;
+    R_API std::chrono::milliseconds avg_read_latency() const;
+
+private:
+    void _entry_point();
+    std::shared_ptr<r_playback_chunk> _read_chunk(std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end);
+    void _update_depth(std::chrono::milliseconds latency);
+
+    std::string _top_dir;
+    r_disco::r_devices& _devices;
+    std::string _camera_id;
+    std::chrono::system_clock::time_point _end;
+    double _rate;
+    std::chrono::milliseconds _chunk_duration;
+
+    mutable std::mutex _lock;
+    std::condition_variable _cond;
+    std::deque<std::shared_ptr<r_playback_chunk>> _chunks;
+    std::chrono::system_clock::time_point _query_start;
+    size_t _depth;
+    r_utils::r_exp_avg<double> _read_latency_ms;
+    bool _in_flight;
+    bool _running;
+    std::thread _th;
+};
+
+}
+
+#endif
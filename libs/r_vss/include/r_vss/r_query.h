@@ -5,6 +5,7 @@
 #include "r_utils/r_nullable.h"
 #include "r_disco/r_devices.h"
 #include "r_storage/r_md_storage_file_reader.h"
+#include "r_vss/r_decode_session_cache.h"
 #include <vector>
 #include <chrono>
 #include <string>
@@ -12,6 +13,22 @@
 namespace r_vss
 {
 
+// Playback rates at or above this are served as key frames only.
+constexpr double TRICK_PLAY_KEY_FRAME_RATE = 4.0;
+
+// In key frame only mode, key frames are picked so that roughly this many are delivered per second
+// of (rewritten) output time.
+constexpr double TRICK_PLAY_OUTPUT_FPS = 4.0;
+
+constexpr double TRICK_PLAY_MAX_RATE = 64.0;
+
+// Exports are cut at key frames into pieces of about this long, which are muxed in parallel.
+constexpr std::chrono::seconds EXPORT_SEGMENT_DURATION(60);
+
+// Each export thread holds a whole muxed piece in memory until it is written, so an export uses at
+// most this many whatever the number of cores.
+constexpr size_t EXPORT_MAX_THREADS = 4;
+
 struct motion_event_info
 {
     std::chrono::system_clock::time_point start;
@@ -32,12 +49,50 @@ struct contents
     std::vector<segment> segments;
 };
 
+struct export_stats
+{
+    uint64_t bytes_read {0};
+    uint64_t bytes_written {0};
+    size_t segments {0};
+    size_t fragments {0};
+    std::chrono::milliseconds media_duration {0};
+    std::chrono::milliseconds elapsed {0};
+
+    // Recorded media read per second of wall clock time.
+    double mb_per_second() const
+    {
+        auto seconds = (double)elapsed.count() / 1000.0;
+        return (seconds > 0.0) ? ((double)bytes_read / (1024.0 * 1024.0)) / seconds : 0.0;
+    }
+};
+
 R_API std::vector<uint8_t> query_get_jpg(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts, uint16_t w, uint16_t h);
 
+struct frame_step
+{
+    std::chrono::system_clock::time_point ts; // the time of the frame returned
+    std::vector<uint8_t> jpg;
+    size_t frames_decoded {0};
+};
+
+// Frame accurate version of query_get_jpg(): the frame at or before ts, or the frame step frames
+// after or before it. Each session (one per client) keeps its decoder and the pictures it decoded
+// for DECODE_SESSION_TTL, so stepping through a GOP decodes each frame once rather than the GOP
+// up to it every step.
+R_API frame_step query_get_frame_jpg(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, const std::string& session, std::chrono::system_clock::time_point ts, int step, uint16_t w, uint16_t h);
+
+R_API r_decode_session_stats query_get_decode_session_stats();
+
 R_API std::vector<uint8_t> query_get_webp(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts, uint16_t w, uint16_t h);
 
 R_API std::chrono::hours query_get_retention_hours(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id);
 
+// Returns the timestamp (epoch millis) of the key frame that query_get_jpg(), query_get_webp() and
+// query_get_key_frame() would decode for ts. Only frame headers are read.
+R_API r_utils::r_nullable<int64_t> query_get_key_frame_ts(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts);
+
+// Returns the stored key frame for ts (a serialized blob tree holding the frame and its codec
+// parameters) as is, nothing is decoded.
 R_API std::vector<uint8_t> query_get_key_frame(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts);
 
 R_API std::vector<uint8_t> query_get_bgr24_frame(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts, uint16_t w, uint16_t h);
@@ -46,6 +101,24 @@ R_API std::vector<uint8_t> query_get_rgb24_frame(const std::string& top_dir, r_d
 
 R_API std::vector<uint8_t> query_get_video(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end);
 
+// Returns the same format as query_get_video() but with only video key frames, at most one per interval.
+R_API std::vector<uint8_t> query_get_key_frames(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end, std::chrono::milliseconds interval);
+
+// Trick play version of query_get_video(). Audio is dropped, rates at or above TRICK_PLAY_KEY_FRAME_RATE
+// are served as key frames only, and frame timestamps are rewritten so that they advance at 1/rate
+// of the recorded speed from start (the recorded timestamp is preserved in "source_ts").
+R_API std::vector<uint8_t> query_get_video(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end, double rate);
+
+// The spacing between key frames needed to deliver TRICK_PLAY_OUTPUT_FPS at rate.
+R_API std::chrono::milliseconds trick_play_key_frame_interval(double rate);
+
+// Remuxes (no decoding) the recording of camera_id in [start, end) into a fragmented MP4 at
+// output_path. The output starts at the key frame at or before start. Pieces of about
+// EXPORT_SEGMENT_DURATION are muxed on up to max_threads threads (0, or anything over it, means
+// EXPORT_MAX_THREADS) and joined in order, so at most that many pieces are held in memory at once.
+// Throws if video timestamps go backwards, within a piece or from one piece to the next.
+R_API export_stats query_export_mp4(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end, const std::string& output_path, size_t max_threads = 0);
+
 R_API contents query_get_contents(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end);
 
 R_API r_utils::r_nullable<std::chrono::system_clock::time_point> query_get_first_ts(const std::string& top_dir, r_disco::r_devices& devices, const std::string& camera_id);
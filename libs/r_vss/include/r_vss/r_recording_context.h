@@ -4,6 +4,8 @@
 
 #include "r_vss/r_stream_keeper.h"
 #include "r_vss/r_ws.h"
+#include "r_vss/r_gop_cache.h"
+#include "r_vss/r_playback_prefetcher.h"
 #include "r_disco/r_camera.h"
 #include "r_pipeline/r_gst_source.h"
 #include "r_pipeline/r_sample_context.h"
@@ -12,6 +14,8 @@
 #include "r_storage/r_storage_file.h"
 #include "r_storage/r_md_storage_file.h"
 #include "r_utils/r_blocking_q.h"
+#include "r_utils/r_ring_q.h"
+#include "r_utils/r_metrics.h"
 #include "r_utils/r_macro.h"
 #include <mutex>
 #include <chrono>
@@ -35,6 +39,11 @@ namespace r_vss
 // At 30fps, 300 frames = 10 seconds of buffer
 constexpr size_t LIVE_RESTREAM_MAX_QUEUE_SIZE = 300;
 
+// A new client is primed with a whole cached GOP at once, on top of whatever is already queued. The
+// live restream queues make room for that so the GOP's key frame isn't dropped off the front. The
+// slots only hold buffer references, the media itself is shared with the GOP cache.
+constexpr size_t LIVE_RESTREAM_QUEUE_CAPACITY = LIVE_RESTREAM_MAX_QUEUE_SIZE + GOP_CACHE_MAX_SAMPLES;
+
 // Maximum frames to buffer for playback restreaming
 // Increased from 120 to 300 to accommodate 5-second fetches without dropping frames
 // Video at 30fps: ~150 frames per 5 seconds
@@ -68,9 +77,16 @@ struct live_restreaming_state
     bool first_restream_a_times_set {false};
     uint64_t first_restream_a_pts {0};
     uint64_t first_restream_a_dts {0};
-    // Bounded queues - drop oldest frames when full to prevent memory exhaustion
-    r_utils::r_blocking_q<struct _frame_context> video_samples{LIVE_RESTREAM_MAX_QUEUE_SIZE};
-    r_utils::r_blocking_q<struct _frame_context> audio_samples{LIVE_RESTREAM_MAX_QUEUE_SIZE};
+    // Samples with a sequence number at or below this were delivered when priming from the GOP cache
+    uint64_t gop_primed_seq {0};
+    bool primed_from_gop_cache {false};
+    // Time to first frame tracking
+    std::chrono::steady_clock::time_point configured_at;
+    bool first_video_pushed {false};
+    // Bounded queues - drop oldest frames when full to prevent memory exhaustion. Posted to from the
+    // camera's sample callbacks (and by GOP priming), so these are lock free.
+    r_utils::r_mpmc_q<struct _frame_context> video_samples{LIVE_RESTREAM_QUEUE_CAPACITY};
+    r_utils::r_mpmc_q<struct _frame_context> audio_samples{LIVE_RESTREAM_QUEUE_CAPACITY};
 };
 
 struct playback_restreaming_state
@@ -90,10 +106,12 @@ struct playback_restreaming_state
     std::string friendly_name;
     std::chrono::system_clock::time_point start_time;
     std::chrono::system_clock::time_point end_time;
-    std::chrono::system_clock::time_point query_start;
-    std::chrono::system_clock::time_point query_end;
     std::string camera_id;
     r_utils::r_nullable<int64_t> first_ts;
+    r_utils::r_nullable<int64_t> last_video_ts;
+    // Playback speed (from the ?rate= query arg). At anything but 1x audio is not delivered.
+    double rate {1.0};
+    bool audio_eos_sent {false};
 
     contents con;
     std::chrono::milliseconds playback_duration {0};
@@ -108,6 +126,7 @@ struct playback_restreaming_state
     // Bounded queues - drop oldest frames when full to prevent memory exhaustion
     r_utils::r_blocking_q<struct _frame_context> video_samples;
     r_utils::r_blocking_q<struct _frame_context> audio_samples;
+    std::unique_ptr<r_playback_prefetcher> prefetcher;
     std::thread playback_thread;
     bool running;
 
@@ -132,6 +151,9 @@ public:
 
     R_API int32_t bytes_per_second() const;
 
+    // How long we've been receiving samples, zero until the first one arrives.
+    R_API std::chrono::seconds stream_duration() const;
+
     R_API r_storage::r_md_storage_file& metadata_storage();
 
     R_API void write_metadata(const std::string& stream_tag, const std::string& json_data, int64_t timestamp_ms);
@@ -144,9 +166,12 @@ public:
 
 private:
     std::tuple<std::string, std::chrono::system_clock::time_point, std::chrono::system_clock::time_point> _get_playback_url_parts();
+    double _get_playback_rate();
 
     static void _live_restream_cleanup_cbs(live_restreaming_state* lrs);
 
+    static void _prime_live_restream(live_restreaming_state& lrs, const std::vector<r_gop_sample>& samples, uint64_t last_seq);
+
     static void _playback_restream_media_configure_cbs(GstRTSPMediaFactory* factory, GstRTSPMedia* media, r_recording_context* rc);
     void _playback_restream_media_configure(GstRTSPMediaFactory* factory, GstRTSPMedia* media);
 
@@ -171,12 +196,17 @@ private:
     r_utils::r_nullable<r_pipeline::r_gst_caps> _video_caps;
     r_utils::r_nullable<r_pipeline::r_gst_caps> _audio_caps;
     std::string _restream_mount_path;
+    std::shared_ptr<r_gop_cache> _gop_cache;
     std::mutex _playback_restreaming_states_lok;
     std::map<GstRTSPMedia*, std::shared_ptr<playback_restreaming_state>> _playback_restreaming_states;
     bool _got_first_audio_sample;
     bool _got_first_video_sample;
     bool _die;
     r_ws& _ws;
+    r_utils::r_counter& _video_frames;
+    r_utils::r_counter& _video_bytes;
+    r_utils::r_counter& _audio_frames;
+    r_utils::r_counter& _audio_bytes;
 };
 
 }
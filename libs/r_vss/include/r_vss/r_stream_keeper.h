@@ -7,6 +7,7 @@
 #include "r_vss/r_system_plugin_host.h"
 #include "r_vss/r_ws.h"
 #include "r_vss/r_prune.h"
+#include "r_vss/r_gop_cache.h"
 #include "r_disco/r_devices.h"
 #include "r_disco/r_camera.h"
 #include "r_utils/r_nullable.h"
@@ -84,6 +85,17 @@ struct r_stream_status
     uint32_t bytes_per_second;
     r_overflow_type overflow_flags {r_overflow_type::none};
     size_t dropped_frames {0};  // Total frames dropped since last check
+    // Time from a live restream client being configured to its first video frame being pushed
+    uint32_t live_last_time_to_first_frame_ms {0};
+    double live_avg_time_to_first_frame_ms {0.0};
+    size_t live_clients_started {0};
+};
+
+struct r_time_to_first_frame_stats
+{
+    uint32_t last_ms {0};
+    uint64_t total_ms {0};
+    size_t count {0};
 };
 
 enum r_stream_keeper_commands
@@ -155,6 +167,10 @@ public:
     R_API void remove_live_restreaming_state(GstRTSPMedia* media);
     R_API void iterate_live_restreaming_states(const std::string& camera_id, std::function<void(live_restreaming_state&)> fn);
 
+    // GOP cache used to prime new live restream clients (one per camera, created on demand)
+    R_API std::shared_ptr<r_gop_cache> get_gop_cache(const std::string& camera_id);
+    R_API void record_live_time_to_first_frame(const std::string& camera_id, std::chrono::milliseconds ttff, bool primed);
+
     // Queue overflow monitoring
     R_API size_t get_motion_engine_dropped_count();
     R_API size_t get_motion_engine_queue_size() const;
@@ -170,6 +186,7 @@ private:
     std::vector<r_stream_status> _fetch_stream_status() const;
     void _update_status_cache();
     void _update_retention_cache();
+    void _refine_bitrate_estimates();
     static void _live_restream_media_configure(GstRTSPMediaFactory* factory, GstRTSPMedia* media, gpointer user_data);
     void _stop(const std::string& id);
     static void _client_connected_cbs(GstRTSPServer* server, GstRTSPClient* client, r_stream_keeper* sk);
@@ -194,6 +211,9 @@ private:
     std::map<std::string, std::chrono::hours> _retention_cache;
     std::chrono::steady_clock::time_point _last_retention_update;
 
+    // Recording byte counts are fed back into r_pipeline::bitrate_cache() (used for storage sizing)
+    std::chrono::steady_clock::time_point _last_bitrate_refine;
+
     std::thread _rtsp_server_th;
     GMainLoop* _loop;
     GstRTSPServer* _server;
@@ -210,6 +230,12 @@ private:
     mutable std::mutex _live_restreaming_states_lok;
     std::map<GstRTSPMedia*, std::shared_ptr<live_restreaming_state>> _live_restreaming_states;
 
+    mutable std::mutex _gop_caches_lok;
+    std::map<std::string, std::shared_ptr<r_gop_cache>> _gop_caches;
+
+    mutable std::mutex _ttff_stats_lok;
+    std::map<std::string, r_time_to_first_frame_stats> _ttff_stats;
+
     // Overflow tracking
     std::chrono::steady_clock::time_point _last_overflow_log_time;
     std::chrono::steady_clock::time_point _last_overflow_time;
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 #include "r_utils/r_macro.h"
 
 namespace r_vss
@@ -10,6 +11,9 @@ namespace r_vss
 
 R_API std::vector<std::pair<int64_t, int64_t>> find_contiguous_segments(const std::vector<int64_t>& times);
 
+// True if an H.264 access unit carries its own SPS (so the decoder doesn't need extradata).
+R_API bool has_inline_sps(const uint8_t* data, size_t size);
+
 }
 
 #endif
@@ -6,6 +6,8 @@
 #include "r_http/r_http_exception.h"
 #include "r_utils/r_socket.h"
 #include "r_utils/r_macro.h"
+#include "r_utils/r_lru_cache.h"
+#include "r_utils/r_metrics.h"
 #include "r_disco/r_devices.h"
 #include "r_storage/r_storage_file.h"
 #include "r_vss/r_query.h"
@@ -15,6 +17,9 @@
 namespace r_vss
 {
 
+// Upper bound on the total size of the encoded /jpg and /webp images we keep around.
+constexpr size_t IMAGE_CACHE_MAX_BYTES = 32 * 1024 * 1024;
+
 class r_ws final
 {
 public:
@@ -24,6 +29,7 @@ public:
     R_API void stop();
     R_API const std::string& get_top_dir() const;
     R_API r_disco::r_devices& get_devices();
+    R_API r_utils::r_lru_cache_stats image_cache_stats() const;
 
 private:
     r_http::r_server_response _get_jpg(const r_http::r_web_server<r_utils::r_socket>& r_ws,
@@ -34,6 +40,12 @@ private:
                                         r_utils::r_socket& conn,
                                         const r_http::r_server_request& request);
 
+    r_http::r_server_response _get_image(const r_http::r_server_request& request, const std::string& format);
+
+    r_http::r_server_response _get_frame(const r_http::r_web_server<r_utils::r_socket>& r_ws,
+                                         r_utils::r_socket& conn,
+                                         const r_http::r_server_request& request);
+
     r_http::r_server_response _get_key_frame(const r_http::r_web_server<r_utils::r_socket>& r_ws,
                                              r_utils::r_socket& conn,
                                              const r_http::r_server_request& request);
@@ -57,12 +69,30 @@ private:
     r_http::r_server_response _get_analytics(const r_http::r_web_server<r_utils::r_socket>& r_ws,
                                              r_utils::r_socket& conn,
                                              const r_http::r_server_request& request);
+    r_http::r_server_response _get_timeline(const r_http::r_web_server<r_utils::r_socket>& r_ws,
+                                            r_utils::r_socket& conn,
+                                            const r_http::r_server_request& request);
 
     r_http::r_server_response _get_video(const r_http::r_web_server<r_utils::r_socket>& r_ws,
                                          r_utils::r_socket& conn,
                                          const r_http::r_server_request& request);
+
+    r_http::r_server_response _get_metrics(const r_http::r_web_server<r_utils::r_socket>& r_ws,
+                                           r_utils::r_socket& conn,
+                                           const r_http::r_server_request& request);
+
+    r_http::r_server_response _get_trace(const r_http::r_web_server<r_utils::r_socket>& r_ws,
+                                         r_utils::r_socket& conn,
+                                         const r_http::r_server_request& request);
+
+    // Wraps a route handler so it counts its requests and failures and times them.
+    r_http::r_web_server<r_utils::r_socket>::http_cb _instrumented(const std::string& route, r_http::r_web_server<r_utils::r_socket>::http_cb cb);
+    void _add_metric_callbacks();
+
     std::string _top_dir;
     r_disco::r_devices& _devices;
+    r_utils::r_lru_cache<std::string, std::vector<uint8_t>> _image_cache;
+    std::vector<uint64_t> _metric_callbacks;
     r_http::r_web_server<r_utils::r_socket> _server;
 };
 
@@ -0,0 +1,324 @@
+#include "r_vss/r_decode_session_cache.h"
+#include "r_vss/r_vss_utils.h"
+#include "r_pipeline/r_stream_info.h"
+#include "r_av/r_muxer.h"
+#include "r_utils/r_exception.h"
+#include "r_utils/r_trace.h"
+#include <algorithm>
+
+using namespace r_vss;
+using namespace r_storage;
+using namespace r_av;
+using namespace r_utils;
+using namespace std;
+using namespace std::chrono;
+
+r_decode_session_cache::r_decode_session_cache(milliseconds ttl, size_t max_sessions, size_t max_pictures, size_t max_picture_bytes) :
+    _ttl(ttl),
+    _max_sessions((max_sessions > 0) ? max_sessions : 1),
+    _max_pictures((max_pictures > 0) ? max_pictures : 1),
+    _max_picture_bytes(max_picture_bytes),
+    _lock(),
+    _sessions(),
+    _hits(0),
+    _forwards(0),
+    _misses(0),
+    _frames_decoded(0)
+{
+}
+
+r_decode_session_cache::~r_decode_session_cache() noexcept
+{
+}
+
+r_decoded_step r_decode_session_cache::get(
+    const string& session,
+    r_storage_file_reader& sf,
+    int64_t ts,
+    int step,
+    AVPixelFormat output_format,
+    uint16_t output_width,
+    uint16_t output_height
+)
+{
+    R_TRACE_SPAN("decode_session.get");
+
+    if(step > DECODE_SESSION_MAX_STEP || step < -DECODE_SESSION_MAX_STEP)
+        R_THROW(("Step of %d frames is more than %d.", step, DECODE_SESSION_MAX_STEP));
+
+    if(output_width > DECODE_SESSION_MAX_WIDTH || output_height > DECODE_SESSION_MAX_HEIGHT)
+        R_THROW(("Output of %ux%u is larger than %ux%u.", output_width, output_height, DECODE_SESSION_MAX_WIDTH, DECODE_SESSION_MAX_HEIGHT));
+
+    auto s = _get_session(session);
+    lock_guard<mutex> g(s->lock);
+
+    if(s->output_format != output_format || s->output_width != output_width || s->output_height != output_height)
+    {
+        s->output_format = output_format;
+        s->output_width = output_width;
+        s->output_height = output_height;
+        s->pictures.clear();
+        s->picture_bytes = 0;
+    }
+
+    _cost cost;
+
+    auto target = _seek(*s, sf, ts, cost);
+    for(; step > 0; --step)
+        target = _next(*s, sf, target, cost);
+    for(; step < 0; ++step)
+        target = _prev(*s, sf, target, cost);
+
+    auto found = s->pictures.find(target);
+    if(found == s->pictures.end())
+    {
+        // Either the picture was dropped to make room for others, or the decoder is still holding
+        // on to it.
+        if(s->pending.empty() || s->pending.front() > target)
+        {
+            _restart(*s, sf, s->key_ts, cost);
+            _decode_through(*s, sf, target, cost);
+        }
+
+        if(s->pictures.find(target) == s->pictures.end())
+            _drain(*s);
+
+        found = s->pictures.find(target);
+        if(found == s->pictures.end())
+            R_THROW(("Unable to decode the frame at %lld.", (long long)target));
+    }
+
+    _frames_decoded += cost.decoded;
+    if(cost.restarted)
+        ++_misses;
+    else if(cost.decoded > 0)
+        ++_forwards;
+    else ++_hits;
+
+    r_decoded_step result;
+    result.ts = target;
+    result.picture = found->second;
+    result.frames_decoded = cost.decoded;
+    return result;
+}
+
+r_decode_session_stats r_decode_session_cache::stats() const
+{
+    r_decode_session_stats result;
+    result.hits = _hits;
+    result.forwards = _forwards;
+    result.misses = _misses;
+    result.frames_decoded = _frames_decoded;
+
+    lock_guard<mutex> g(_lock);
+    result.sessions = _sessions.size();
+    return result;
+}
+
+shared_ptr<r_decode_session_cache::_session> r_decode_session_cache::_get_session(const string& session)
+{
+    auto now = steady_clock::now();
+
+    lock_guard<mutex> g(_lock);
+
+    // A session that expires while a get() is using it lives on until that get() is done with it.
+    for(auto i = _sessions.begin(); i != _sessions.end();)
+    {
+        if(now - i->second->last_used > _ttl)
+            i = _sessions.erase(i);
+        else ++i;
+    }
+
+    auto found = _sessions.find(session);
+    if(found == _sessions.end())
+    {
+        if(_sessions.size() >= _max_sessions)
+        {
+            auto oldest = min_element(_sessions.begin(), _sessions.end(), [](const auto& a, const auto& b){
+                return a.second->last_used < b.second->last_used;
+            });
+            _sessions.erase(oldest);
+        }
+
+        found = _sessions.emplace(session, make_shared<_session>()).first;
+    }
+
+    found->second->last_used = now;
+
+    return found->second;
+}
+
+int64_t r_decode_session_cache::_seek(_session& s, r_storage_file_reader& sf, int64_t ts, _cost& cost)
+{
+    if(s.positioned && !s.gop.empty() && ts >= s.key_ts && ts <= s.gop.back())
+        return *(upper_bound(s.gop.begin(), s.gop.end(), ts) - 1);
+
+    auto key_ts = sf.key_frame_ts(R_STORAGE_MEDIA_TYPE_VIDEO, ts);
+
+    if(key_ts.is_null() || key_ts.value() > ts)
+        R_THROW(("No key frame at or before %lld.", (long long)ts));
+
+    // Still in the GOP the decoder is in, so it can carry on rather than start again.
+    if(!s.positioned || key_ts.value() != s.key_ts)
+        _restart(s, sf, key_ts.value(), cost);
+
+    _decode_through(s, sf, ts, cost);
+
+    if(s.gop.empty())
+        R_THROW(("No video at %lld.", (long long)ts));
+
+    return *(upper_bound(s.gop.begin(), s.gop.end(), ts) - 1);
+}
+
+int64_t r_decode_session_cache::_next(_session& s, r_storage_file_reader& sf, int64_t ts, _cost& cost)
+{
+    auto found = upper_bound(s.gop.begin(), s.gop.end(), ts);
+    if(found != s.gop.end())
+        return *found;
+
+    // ts is the last frame the decoder was given, give it the one after (which may start a new GOP).
+    bool fed = false;
+    sf.visit_video(ts + 1, [&](const r_storage_frame_ref& frame){
+        _feed(s, frame, cost);
+        fed = true;
+        return false;
+    });
+
+    return (fed) ? s.gop.back() : ts;
+}
+
+int64_t r_decode_session_cache::_prev(_session& s, r_storage_file_reader& sf, int64_t ts, _cost& cost)
+{
+    auto found = lower_bound(s.gop.begin(), s.gop.end(), ts);
+    if(found != s.gop.begin() && found != s.gop.end() && *found == ts)
+        return *(found - 1);
+
+    // ts is a key frame, the frame before it is the last of the previous GOP (if there is one).
+    auto key_ts = sf.key_frame_ts(R_STORAGE_MEDIA_TYPE_VIDEO, ts - 1);
+    if(key_ts.is_null() || key_ts.value() >= ts)
+        return ts;
+
+    return _seek(s, sf, ts - 1, cost);
+}
+
+void r_decode_session_cache::_restart(_session& s, r_storage_file_reader& sf, int64_t key_ts, _cost& cost)
+{
+    auto ci = sf.codec_info(key_ts, key_ts + 1);
+
+    if(!s.decoder || ci.video_codec_name != s.codec_name || ci.video_codec_parameters != s.codec_parameters)
+    {
+        s.decoder.reset();
+        s.codec_name = ci.video_codec_name;
+        s.codec_parameters = ci.video_codec_parameters;
+    }
+    else s.decoder->reset();
+
+    s.positioned = true;
+    s.key_ts = key_ts;
+    s.gop.clear();
+    s.pending.clear();
+
+    cost.restarted = true;
+}
+
+void r_decode_session_cache::_decode_through(_session& s, r_storage_file_reader& sf, int64_t ts, _cost& cost)
+{
+    auto start = (s.gop.empty()) ? s.key_ts : s.gop.back() + 1;
+    if(start > ts)
+        return;
+
+    sf.visit_video(start, [&](const r_storage_frame_ref& frame){
+        if(frame.ts > ts)
+            return false;
+        _feed(s, frame, cost);
+        return true;
+    });
+}
+
+void r_decode_session_cache::_feed(_session& s, const r_storage_frame_ref& frame, _cost& cost)
+{
+    if(!s.decoder)
+    {
+        // Access units come out of storage whole, so there's nothing for a parser to do (and a parser
+        // would hold each one back until the next arrived).
+        s.decoder = make_unique<r_video_decoder>(r_av::encoding_to_av_codec_id(s.codec_name));
+        s.decoder->set_threading(R_DECODER_THREADING_LOW_LATENCY);
+
+        if(!has_inline_sps(frame.data, frame.size))
+            s.decoder->set_extradata(r_pipeline::get_video_codec_extradata(s.codec_name, s.codec_parameters));
+    }
+
+    // A key frame further on starts a new GOP, the decoder just carries on into it.
+    if(frame.key && !s.gop.empty())
+    {
+        s.key_ts = frame.ts;
+        s.gop.clear();
+    }
+
+    s.gop.push_back(frame.ts);
+    s.pending.push_back(frame.ts);
+    ++cost.decoded;
+
+    s.decoder->attach_buffer(frame.data, frame.size, frame.ts);
+
+    while(true)
+    {
+        auto ds = s.decoder->decode();
+        if(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+            _take_picture(s);
+        // AGAIN_HAS_OUTPUT means the packet is still waiting to go in.
+        if(ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+            break;
+    }
+}
+
+void r_decode_session_cache::_drain(_session& s)
+{
+    if(!s.decoder)
+        return;
+
+    auto ds = s.decoder->flush();
+    while(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
+    {
+        _take_picture(s);
+        ds = s.decoder->flush();
+    }
+
+    // A drained decoder has to start again from a key frame.
+    s.positioned = false;
+    s.pending.clear();
+}
+
+void r_decode_session_cache::_take_picture(_session& s)
+{
+    if(s.pending.empty())
+        return;
+
+    // The frame's timestamp went in with its data, it comes back on the picture decoded from it.
+    auto frame = s.decoder->get_frame();
+    auto ts = (frame && frame->best_effort_timestamp != AV_NOPTS_VALUE) ? frame->best_effort_timestamp : s.pending.front();
+
+    auto found = find(s.pending.begin(), s.pending.end(), ts);
+    if(found == s.pending.end())
+    {
+        ts = s.pending.front();
+        found = s.pending.begin();
+    }
+    s.pending.erase(found);
+
+    auto& picture = s.pictures[ts];
+    if(picture)
+        s.picture_bytes -= picture->size();
+    picture = s.decoder->get(s.output_format, s.output_width, s.output_height, 1);
+    s.picture_bytes += picture->size();
+
+    // Keep the pictures nearest the one just decoded, that's where the next steps will land.
+    while(s.pictures.size() > 1 && (s.pictures.size() > _max_pictures || s.picture_bytes > _max_picture_bytes))
+    {
+        auto first = s.pictures.begin();
+        auto last = prev(s.pictures.end());
+        auto victim = (ts - first->first >= last->first - ts) ? first : last;
+        s.picture_bytes -= victim->second->size();
+        s.pictures.erase(victim);
+    }
+}
@@ -0,0 +1,75 @@
+
+#include "r_vss/r_gop_cache.h"
+
+using namespace r_vss;
+using namespace r_pipeline;
+using namespace std;
+
+r_gop_cache::r_gop_cache(size_t max_samples, int64_t max_duration_ms) :
+    _lock(),
+    _samples(),
+    _max_samples(max_samples),
+    _max_duration_ms(max_duration_ms),
+    _seq(0)
+{
+}
+
+uint64_t r_gop_cache::post_video(const r_gst_buffer& buffer, int64_t pts, bool key)
+{
+    return _post(buffer, pts, key, true);
+}
+
+uint64_t r_gop_cache::post_audio(const r_gst_buffer& buffer, int64_t pts, bool key)
+{
+    return _post(buffer, pts, key, false);
+}
+
+void r_gop_cache::prime(function<void(const vector<r_gop_sample>& samples, uint64_t last_seq)> fn) const
+{
+    lock_guard<mutex> g(_lock);
+    fn(_samples, _seq);
+}
+
+void r_gop_cache::clear()
+{
+    lock_guard<mutex> g(_lock);
+    _samples.clear();
+}
+
+size_t r_gop_cache::size() const
+{
+    lock_guard<mutex> g(_lock);
+    return _samples.size();
+}
+
+uint64_t r_gop_cache::_post(const r_gst_buffer& buffer, int64_t pts, bool key, bool video)
+{
+    lock_guard<mutex> g(_lock);
+
+    ++_seq;
+
+    // A video key frame starts a new GOP. Clearing here (rather than at the end of a GOP) means the
+    // cache always holds a decodable sequence: key frame first, followed by everything since.
+    if(video && key)
+        _samples.clear();
+    else if(_samples.empty())
+        return _seq; // Nothing is decodable until we see a key frame.
+
+    // A GOP that outgrows the cache is useless without its head, so drop it and wait for the
+    // next key frame rather than holding a partial GOP.
+    if(_samples.size() >= _max_samples || (pts - _samples.front().pts) > _max_duration_ms)
+    {
+        _samples.clear();
+        return _seq;
+    }
+
+    r_gop_sample s;
+    s.buffer = buffer;
+    s.pts = pts;
+    s.key = key;
+    s.video = video;
+    s.seq = _seq;
+    _samples.push_back(std::move(s));
+
+    return _seq;
+}
@@ -9,6 +9,7 @@
 #include "r_pipeline/r_gst_buffer.h"
 #include "r_utils/r_file.h"
 #include "r_utils/r_logger.h"
+#include "r_utils/r_trace.h"
 #include <opencv2/opencv.hpp>
 #include <chrono>
 #include <algorithm>
@@ -74,11 +75,16 @@ namespace {
 r_motion_engine::r_motion_engine(r_disco::r_devices& devices, const string& top_dir, r_motion_event_plugin_host& meph) :
     _devices(devices),
     _top_dir(top_dir),
-    _work(),
+    _work(MOTION_ENGINE_MAX_QUEUE_SIZE),
     _work_contexts(),
     _running(false),
     _thread(),
-    _meph(meph)
+    _meph(meph),
+    _frames_processed(metrics().counter("revere_motion_frames_total", "Frames taken off the motion queue.")),
+    _frames_dropped(metrics().counter("revere_motion_frames_dropped_total", "Frames dropped because the motion queue was full.")),
+    _events_started(metrics().counter("revere_motion_events_total", "Motion events started.")),
+    _queue_depth(metrics().gauge("revere_motion_queue_depth", "Frames waiting for the motion engine.")),
+    _key_frame_duration(metrics().histogram("revere_motion_key_frame_duration_seconds", "Time taken to decode and analyze a key frame.", {}, R_METRICS_MICROSECONDS))
 {
 }
 
@@ -129,6 +135,7 @@ size_t r_motion_engine::get_and_reset_dropped_count()
 {
     size_t count = _work.dropped_count();
     _work.reset_dropped_count();
+    _frames_dropped.inc(count);
     return count;
 }
 
@@ -139,12 +146,16 @@ size_t r_motion_engine::get_queue_size() const
 
 void r_motion_engine::_entry_point()
 {
+    r_trace::set_thread_name("motion_engine");
+
     _running = true;
 
     while(_running)
     {
         auto maybe_work = _work.poll(chrono::milliseconds(1000));
 
+        _queue_depth.set((int64_t)_work.size());
+
         if(!maybe_work.is_null())
         {
             auto work = maybe_work.value();
@@ -168,8 +179,13 @@ void r_motion_engine::_entry_point()
 
                 auto& wc = found_wc->second;
 
+                _frames_processed.inc();
+
                 if(work.is_key_frame)
                 {
+                    R_TRACE_SPAN("motion.key_frame");
+                    r_histogram_timer timer(_key_frame_duration);
+
                     auto mi = work.frame.map(r_pipeline::r_gst_buffer::MT_READ);
                     int max_decode_attempts = 10;
                     wc->decoder().attach_buffer(mi.data(), mi.size());
@@ -181,7 +197,11 @@ void r_motion_engine::_entry_point()
                             R_THROW(("Unable to decode!"));
                         --max_decode_attempts;
 
-                        auto ds = wc->decoder().decode();
+                        r_av::r_codec_state ds;
+                        {
+                            R_TRACE_SPAN("motion.decode");
+                            ds = wc->decoder().decode();
+                        }
 
                         if(ds == r_av::R_CODEC_STATE_HAS_OUTPUT || ds == r_av::R_CODEC_STATE_AGAIN_HAS_OUTPUT)
                         {
@@ -191,12 +211,16 @@ void r_motion_engine::_entry_point()
                             // Calculate letterbox parameters for 640x640 target
                             auto lp = calc_letterbox(input_w, input_h);
 
+                            R_TRACE_SPAN("motion.analyze");
+
                             // Decode to scaled size (maintains aspect ratio)
-                            auto decoded = wc->decoder().get(AV_PIX_FMT_RGB24, (uint16_t)lp.scaled_w, (uint16_t)lp.scaled_h, 1);
+                            auto& decoded = wc->scaled_frame();
+                            decoded.resize(r_av::r_video_decoder::output_image_size(AV_PIX_FMT_RGB24, (uint16_t)lp.scaled_w, (uint16_t)lp.scaled_h, 1));
+                            wc->decoder().get(AV_PIX_FMT_RGB24, (uint16_t)lp.scaled_w, (uint16_t)lp.scaled_h, decoded.data(), decoded.size(), 1);
 
                             // Create 640x640 letterboxed image and get ROI for motion detection
                             cv::Mat letterbox_img;
-                            cv::Mat roi_mat = create_letterbox(*decoded, lp.scaled_w, lp.scaled_h, lp, letterbox_img);
+                            cv::Mat roi_mat = create_letterbox(decoded, lp.scaled_w, lp.scaled_h, lp, letterbox_img);
 
                             // Process motion on ROI only (efficient), with offset correction
                             auto maybe_motion_info = wc->motion_state().process(roi_mat, lp.pad_x, lp.pad_y, false);
@@ -258,6 +282,7 @@ void r_motion_engine::_entry_point()
                                         wc->set_in_event(true);
                                         wc->set_event_start_ts(trigger_entry.ts);
                                         wc->set_no_motion_count(0);
+                                        _events_started.inc();
 
                                         // Post event start with the first triggering frame
                                         _meph.post(r_vss::motion_event_start, wc->get_camera_id(), trigger_entry.ts,
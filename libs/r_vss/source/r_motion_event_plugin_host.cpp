@@ -3,6 +3,7 @@
 #include "r_utils/r_dynamic_library.h"
 #include "r_utils/r_file.h"
 #include "r_utils/r_logger.h"
+#include "r_utils/r_trace.h"
 #include <filesystem>
 #include <vector>
 
@@ -77,7 +78,13 @@ r_motion_event_plugin_host::r_motion_event_plugin_host(r_disco::r_devices& devic
 
                             if (plugin_handle)
                             {
-                                _plugins.push_back({std::move(lib), plugin_handle, stop_func, destroy_func, post_func});
+                                auto plugin_name = entry.path().stem().string();
+                                auto events_posted = &metrics().counter("revere_plugin_events_total", "Motion events posted to plugins.", {{"plugin", plugin_name}});
+                                auto post_duration = &metrics().histogram("revere_plugin_post_duration_seconds", "Time plugins take to accept a motion event.", {{"plugin", plugin_name}}, R_METRICS_MICROSECONDS);
+
+                                auto trace_name = r_trace::intern("plugin." + plugin_name);
+
+                                _plugins.push_back({std::move(lib), plugin_handle, stop_func, destroy_func, post_func, events_posted, post_duration, trace_name});
                                 R_LOG_INFO("Loaded motion plugin: %s", filename.c_str());
                             }
                             else
@@ -157,6 +164,10 @@ void r_motion_event_plugin_host::post(r_motion_event evt, const std::string& cam
     {
         if (p.plugin_handle && p.post_func)
         {
+            p.events_posted->inc();
+            r_histogram_timer timer(*p.post_duration);
+            R_TRACE_SPAN(p.trace_name);
+
             // Call the C API post_motion_event function
             p.post_func(
                 p.plugin_handle,
@@ -0,0 +1,212 @@
+
+#include "r_vss/r_playback_prefetcher.h"
+#include "r_vss/r_query.h"
+#include "r_utils/r_blob_tree_view.h"
+#include "r_utils/r_logger.h"
+#include "r_utils/r_exception.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace r_vss;
+using namespace r_disco;
+using namespace r_pipeline;
+using namespace r_utils;
+using namespace std;
+using namespace std::chrono;
+
+r_playback_prefetcher::r_playback_prefetcher(
+    const string& top_dir,
+    r_devices& devices,
+    const string& camera_id,
+    system_clock::time_point start,
+    system_clock::time_point end,
+    double rate,
+    milliseconds chunk_duration
+) :
+    _top_dir(top_dir),
+    _devices(devices),
+    _camera_id(camera_id),
+    _end(end),
+    _rate(rate),
+    _chunk_duration(duration_cast<milliseconds>(chunk_duration * std::max(rate, 1.0))),
+    _lock(),
+    _cond(),
+    _chunks(),
+    _query_start(start),
+    _depth(PLAYBACK_PREFETCH_MIN_DEPTH),
+    _read_latency_ms(0.0, 8.0),
+    _in_flight(false),
+    _running(false),
+    _th()
+{
+}
+
+r_playback_prefetcher::~r_playback_prefetcher() noexcept
+{
+    stop();
+}
+
+void r_playback_prefetcher::start()
+{
+    unique_lock<mutex> g(_lock);
+    if(_running)
+        R_THROW(("Playback prefetcher already started!"));
+    _running = true;
+    _th = thread(&r_playback_prefetcher::_entry_point, this);
+}
+
+void r_playback_prefetcher::stop()
+{
+    {
+        unique_lock<mutex> g(_lock);
+        if(!_running)
+            return;
+        _running = false;
+        _chunks.clear();
+    }
+    _cond.notify_all();
+
+    // A read in progress cannot be interrupted, so teardown waits for at most one chunk read.
+    _th.join();
+}
+
+shared_ptr<r_playback_chunk> r_playback_prefetcher::next(milliseconds timeout)
+{
+    unique_lock<mutex> g(_lock);
+
+    _cond.wait_for(g, timeout, [this](){return !_chunks.empty() || !_running;});
+
+    if(_chunks.empty())
+        return nullptr;
+
+    auto chunk = std::move(_chunks.front());
+    _chunks.pop_front();
+
+    // There is room for another read now.
+    _cond.notify_all();
+
+    return chunk;
+}
+
+bool r_playback_prefetcher::exhausted() const
+{
+    unique_lock<mutex> g(_lock);
+    return _query_start >= _end && !_in_flight && _chunks.empty();
+}
+
+size_t r_playback_prefetcher::depth() const
+{
+    unique_lock<mutex> g(_lock);
+    return _depth;
+}
+
+milliseconds r_playback_prefetcher::avg_read_latency() const
+{
+    unique_lock<mutex> g(_lock);
+    return milliseconds((int64_t)_read_latency_ms.value());
+}
+
+void r_playback_prefetcher::_entry_point()
+{
+    while(true)
+    {
+        system_clock::time_point qs, qe;
+
+        {
+            unique_lock<mutex> g(_lock);
+
+            _cond.wait(g, [this](){return !_running || (!_in_flight && _chunks.size() < _depth && _query_start < _end);});
+
+            if(!_running)
+                return;
+
+            qs = _query_start;
+            qe = std::min(qs + _chunk_duration, _end);
+            _query_start = qe;
+            _in_flight = true;
+        }
+
+        auto before = steady_clock::now();
+
+        shared_ptr<r_playback_chunk> chunk;
+        try
+        {
+            chunk = _read_chunk(qs, qe);
+        }
+        catch(const std::exception& e)
+        {
+            R_LOG_EXCEPTION(e);
+
+            // Hand out an empty chunk so the consumer keeps moving past the bad range.
+            chunk = make_shared<r_playback_chunk>();
+            chunk->start = qs;
+            chunk->end = qe;
+        }
+
+        auto latency = duration_cast<milliseconds>(steady_clock::now() - before);
+
+        {
+            unique_lock<mutex> g(_lock);
+
+            _in_flight = false;
+
+            // Stopped while we were reading, nobody wants it.
+            if(!_running)
+                return;
+
+            _update_depth(latency);
+            _chunks.push_back(std::move(chunk));
+        }
+
+        _cond.notify_all();
+    }
+}
+
+shared_ptr<r_playback_chunk> r_playback_prefetcher::_read_chunk(system_clock::time_point start, system_clock::time_point end)
+{
+    auto chunk = make_shared<r_playback_chunk>();
+    chunk->start = start;
+    chunk->end = end;
+
+    auto video_buffer = (_rate >= TRICK_PLAY_KEY_FRAME_RATE)
+        ? query_get_key_frames(_top_dir, _devices, _camera_id, start, end, trick_play_key_frame_interval(_rate))
+        : query_get_video(_top_dir, _devices, _camera_id, start, end);
+
+    uint32_t version = 0;
+    r_blob_tree_view bt(video_buffer.data(), video_buffer.size(), version);
+
+    if(bt.has_key("frames"))
+    {
+        auto frames = bt["frames"];
+
+        chunk->frames.reserve(frames.size());
+
+        for(auto f : frames)
+        {
+            auto frame = f["data"].get_blob();
+
+            r_playback_frame pf;
+            pf.stream_id = f["stream_id"].get_value<int>();
+            pf.key = (f["key"].get_string_view() == "true");
+            pf.ts = f["ts"].get_value<int64_t>();
+            pf.buffer = r_gst_buffer(frame.data(), frame.size());
+
+            chunk->frames.push_back(std::move(pf));
+        }
+    }
+
+    return chunk;
+}
+
+void r_playback_prefetcher::_update_depth(milliseconds latency)
+{
+    _read_latency_ms.update((double)latency.count());
+
+    // Budget for a pessimistic read (mean + 2 sigma) and keep enough chunks queued to cover it
+    // with one chunk to spare.
+    auto pessimistic_ms = _read_latency_ms.value() + (2 * _read_latency_ms.standard_deviation());
+    auto chunk_play_ms = (double)_chunk_duration.count() / _rate;
+    auto chunks_to_cover = (size_t)std::ceil(pessimistic_ms / chunk_play_ms);
+
+    _depth = std::clamp(chunks_to_cover + 1, PLAYBACK_PREFETCH_MIN_DEPTH, PLAYBACK_PREFETCH_MAX_DEPTH);
+}
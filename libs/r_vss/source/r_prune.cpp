@@ -4,6 +4,8 @@
 #include "r_vss/r_query.h"
 #include "r_utils/r_exception.h"
 #include "r_utils/r_time_utils.h"
+#include "r_utils/r_metrics.h"
+#include "r_utils/r_trace.h"
 
 using namespace r_vss;
 using namespace r_utils;
@@ -49,6 +51,12 @@ void r_prune::stop()
 
 void r_prune::_entry_point()
 {
+    r_trace::set_thread_name("prune");
+
+    auto& blocks_checked = metrics().counter("revere_prune_blocks_checked_total", "Blocks the pruner has checked for motion.");
+    auto& blocks_removed = metrics().counter("revere_prune_blocks_removed_total", "Blocks the pruner removed because they had no motion.");
+    auto& remove_duration = metrics().histogram("revere_prune_remove_duration_seconds", "Time taken to remove a block.", {}, R_METRICS_MICROSECONDS);
+
     while(_running)
     {
         try
@@ -88,6 +96,8 @@ void r_prune::_entry_point()
                 }
                 else
                 {
+                    R_TRACE_SPAN("prune.check_block");
+
                     auto current_ps = _ps.value();
 
                     auto block_start = current_ps.blocks[current_ps.bi].start;
@@ -111,6 +121,8 @@ void r_prune::_entry_point()
                         block_end + chrono::seconds(30)
                     );
 
+                    blocks_checked.inc();
+
                     if(motion_events.empty())
                     {
 #if 1
@@ -121,13 +133,18 @@ void r_prune::_entry_point()
                             r_time_utils::tp_to_iso_8601(block_end, false).c_str()
                         );
 #endif
-                        query_remove_blocks(
-                            _top_dir,
-                            _devices,
-                            current_ps.camera.id,
-                            block_start,
-                            block_end
-                        );                        
+                        {
+                            R_TRACE_SPAN("prune.remove_block");
+                            r_histogram_timer timer(remove_duration);
+                            query_remove_blocks(
+                                _top_dir,
+                                _devices,
+                                current_ps.camera.id,
+                                block_start,
+                                block_end
+                            );
+                        }
+                        blocks_removed.inc();
                     }
 
                     ++current_ps.bi;
@@ -1,8 +1,14 @@
 #include "r_vss/r_query.h"
 #include "r_vss/r_motion_engine.h"
+#include "r_vss/r_vss_utils.h"
 #include "r_utils/r_time_utils.h"
 #include "r_utils/r_file.h"
 #include "r_utils/r_blob_tree.h"
+#include "r_utils/r_string_utils.h"
+#include "r_utils/r_keyed_pool.h"
+#include "r_utils/r_metrics.h"
+#include "r_utils/r_trace.h"
+#include "r_utils/r_parallel_for.h"
 #include "r_disco/r_camera.h"
 #include "r_storage/r_storage_file.h"
 #include "r_storage/r_storage_file_reader.h"
@@ -11,8 +17,10 @@
 #include "r_av/r_video_decoder.h"
 #include "r_av/r_video_encoder.h"
 #include "r_av/r_muxer.h"
+#include "r_av/r_fmp4.h"
 #include <functional>
 #include <array>
+#include <cmath>
 
 using namespace r_utils;
 using namespace r_disco;
@@ -32,20 +40,47 @@ static string _get_storage_path(const string& record_file_path, const string& to
     return top_dir + PATH_SLASH + "video" + PATH_SLASH + record_file_path;
 }
 
-// Helper: check if frame data has inline SPS (H.264 NAL type 7)
-static bool _has_inline_sps(const vector<uint8_t>& frame)
+// Opening a codec costs more than decoding or encoding a single small image, so decoders and
+// encoders are kept warm between queries. Decoders are keyed by codec and codec parameters, encoders
+// by output codec, format and size.
+// CODEC_POOL_MAX_CHECKED_OUT bounds how many are open at once, queries past that wait for one to
+// come back rather than opening more.
+static const size_t CODEC_POOL_MAX_IDLE = 16;
+static const size_t CODEC_POOL_MAX_CHECKED_OUT = 8;
+
+static r_keyed_pool<string, r_video_decoder> _decoder_pool(CODEC_POOL_MAX_IDLE, [](r_video_decoder& d){
+    d.reset();
+    return true;
+}, CODEC_POOL_MAX_CHECKED_OUT);
+
+static r_keyed_pool<string, r_video_encoder> _encoder_pool(CODEC_POOL_MAX_IDLE, [](r_video_encoder& e){
+    return e.reset();
+}, CODEC_POOL_MAX_CHECKED_OUT);
+
+// Frame stepping clients each keep a decoder positioned in the GOP they're stepping through.
+static r_decode_session_cache _decode_sessions;
+
+static r_histogram& _query_duration(const char* query)
 {
-    for(size_t i = 0; i + 4 < frame.size() && i < 500; ++i)
-    {
-        if(frame[i] == 0x00 && frame[i+1] == 0x00 &&
-           frame[i+2] == 0x00 && frame[i+3] == 0x01)
-        {
-            uint8_t nal_type = frame[i+4] & 0x1F;
-            if(nal_type == 7) // SPS
-                return true;
-        }
-    }
-    return false;
+    return metrics().histogram("revere_query_duration_seconds", "Time taken by storage queries.", {{"query", query}}, R_METRICS_MICROSECONDS);
+}
+
+static vector<uint8_t> _encode_jpg(const vector<uint8_t>& yuvj420p, uint16_t w, uint16_t h)
+{
+    auto encoder = _encoder_pool.get(
+        r_string_utils::format("mjpeg/yuvj420p/%ux%u", w, h),
+        [&](){return r_video_encoder(AV_CODEC_ID_MJPEG, 100000, w, h, {1,1}, AV_PIX_FMT_YUVJ420P, 0, 1, 0, 0);}
+    );
+    encoder->attach_buffer(yuvj420p.data(), yuvj420p.size(), 0);
+    auto es = encoder->encode();
+    if(es != R_CODEC_STATE_HAS_OUTPUT)
+        R_THROW(("Unable to encode JPG."));
+
+    auto pi = encoder->get();
+
+    vector<uint8_t> result(pi.size);
+    memcpy(result.data(), pi.data, pi.size);
+    return result;
 }
 
 // Helper: decode a single frame with proper parser and flush support
@@ -57,20 +92,29 @@ static shared_ptr<vector<uint8_t>> _decode_single_frame(
     uint16_t w,
     uint16_t h)
 {
-    // Enable parsing to properly handle Annex B streams with multiple NAL units
-    r_video_decoder decoder(r_av::encoding_to_av_codec_id(video_codec_name), true);
+    auto inline_sps = has_inline_sps(frame.data(), frame.size());
+
+    auto decoder = _decoder_pool.get(
+        r_string_utils::format("%s/%s/%s", video_codec_name.c_str(), video_codec_parameters.c_str(), (inline_sps)?"inline":"extradata"),
+        [&](){
+            // Enable parsing to properly handle Annex B streams with multiple NAL units
+            r_video_decoder d(r_av::encoding_to_av_codec_id(video_codec_name), true);
 
-    // Only set extradata if stream doesn't have inline SPS/PPS
-    if(!_has_inline_sps(frame))
-        decoder.set_extradata(r_pipeline::get_video_codec_extradata(video_codec_name, video_codec_parameters));
+            // Only set extradata if stream doesn't have inline SPS/PPS
+            if(!inline_sps)
+                d.set_extradata(r_pipeline::get_video_codec_extradata(video_codec_name, video_codec_parameters));
 
-    decoder.attach_buffer(frame.data(), frame.size());
+            return d;
+        }
+    );
+
+    decoder->attach_buffer(frame.data(), frame.size());
 
     int attempts = 0;
-    auto ds = decoder.decode();
+    auto ds = decoder->decode();
     while(ds != R_CODEC_STATE_HAS_OUTPUT && ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT && attempts < 10)
     {
-        ds = decoder.decode();
+        ds = decoder->decode();
         ++attempts;
     }
 
@@ -79,19 +123,23 @@ static shared_ptr<vector<uint8_t>> _decode_single_frame(
     {
         while(ds != R_CODEC_STATE_HAS_OUTPUT && ds != R_CODEC_STATE_AGAIN_HAS_OUTPUT && attempts < 20)
         {
-            ds = decoder.flush();
+            ds = decoder->flush();
             ++attempts;
         }
     }
 
     if(ds == R_CODEC_STATE_HAS_OUTPUT || ds == R_CODEC_STATE_AGAIN_HAS_OUTPUT)
-        return decoder.get(output_format, w, h, 1);
+        return decoder->get(output_format, w, h, 1);
 
     return nullptr;
 }
 
 vector<uint8_t> r_vss::query_get_jpg(const std::string& top_dir, r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts, uint16_t w, uint16_t h)
 {
+    static auto& duration = _query_duration("jpg");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.jpg");
+
     auto maybe_camera = devices.get_camera_by_id(camera_id);
 
     if(maybe_camera.is_null())
@@ -123,25 +171,47 @@ vector<uint8_t> r_vss::query_get_jpg(const std::string& top_dir, r_devices& devi
     auto decoded = _decode_single_frame(video_codec_name, video_codec_parameters, frame, AV_PIX_FMT_YUVJ420P, w, h);
 
     if(decoded)
-    {
-        r_video_encoder encoder(AV_CODEC_ID_MJPEG, 100000, w, h, {1,1}, AV_PIX_FMT_YUVJ420P, 0, 1, 0, 0);
-        encoder.attach_buffer(decoded->data(), decoded->size(), 0);
-        auto es = encoder.encode();
-        if(es == R_CODEC_STATE_HAS_OUTPUT)
-        {
-            auto pi = encoder.get();
-
-            vector<uint8_t> result(pi.size);
-            memcpy(result.data(), pi.data, pi.size);
-            return result;
-        }
-    }
+        return _encode_jpg(*decoded, w, h);
 
     R_THROW(("Unable to JPG fail."));
 }
 
+r_vss::frame_step r_vss::query_get_frame_jpg(const string& top_dir, r_devices& devices, const string& camera_id, const string& session, chrono::system_clock::time_point ts, int step, uint16_t w, uint16_t h)
+{
+    static auto& duration = _query_duration("frame_jpg");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.frame_jpg");
+
+    auto maybe_camera = devices.get_camera_by_id(camera_id);
+
+    if(maybe_camera.is_null())
+        R_THROW(("Unknown camera id: %s", camera_id.c_str()));
+
+    if(maybe_camera.value().record_file_path.is_null())
+        R_THROW(("Camera has no recording file!"));
+
+    r_storage_file_reader sf(_get_storage_path(maybe_camera.value().record_file_path.value(), top_dir));
+
+    auto decoded = _decode_sessions.get(session + "/" + camera_id, sf, r_time_utils::tp_to_epoch_millis(ts), step, AV_PIX_FMT_YUVJ420P, w, h);
+
+    frame_step result;
+    result.ts = r_time_utils::epoch_millis_to_tp(decoded.ts);
+    result.jpg = _encode_jpg(*decoded.picture, w, h);
+    result.frames_decoded = decoded.frames_decoded;
+    return result;
+}
+
+r_decode_session_stats r_vss::query_get_decode_session_stats()
+{
+    return _decode_sessions.stats();
+}
+
 vector<uint8_t> r_vss::query_get_webp(const string& top_dir, r_devices& devices, const string& camera_id, chrono::system_clock::time_point ts, uint16_t w, uint16_t h)
 {
+    static auto& duration = _query_duration("webp");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.webp");
+
     auto maybe_camera = devices.get_camera_by_id(camera_id);
 
     if(maybe_camera.is_null())
@@ -174,15 +244,22 @@ vector<uint8_t> r_vss::query_get_webp(const string& top_dir, r_devices& devices,
 
     if(decoded)
     {
-        r_video_encoder encoder(AV_CODEC_ID_WEBP, 100000, w, h, {1,1}, AV_PIX_FMT_YUV420P, 0, 1, 0, 0);
-        encoder.attach_buffer(decoded->data(), decoded->size(), 0);
-        auto es = encoder.encode();
-
-        es = encoder.flush();
+        // The still webp encoder outputs a packet per frame, so normally there's no need to drain it
+        // and it goes back in the pool for reuse. If encode() didn't produce anything (an encoder
+        // that buffers) we flush, and the pool discards it unless the encoder can be reset.
+        auto encoder = _encoder_pool.get(
+            r_string_utils::format("webp/yuv420p/%ux%u", w, h),
+            [&](){return r_video_encoder(AV_CODEC_ID_WEBP, 100000, w, h, {1,1}, AV_PIX_FMT_YUV420P, 0, 1, 0, 0);}
+        );
+        encoder->attach_buffer(decoded->data(), decoded->size(), 0);
+        auto es = encoder->encode();
+
+        if(es != R_CODEC_STATE_HAS_OUTPUT)
+            es = encoder->flush();
 
         if(es == R_CODEC_STATE_HAS_OUTPUT)
         {
-            auto pi = encoder.get();
+            auto pi = encoder->get();
 
             vector<uint8_t> result(pi.size);
             memcpy(result.data(), pi.data, pi.size);
@@ -213,8 +290,27 @@ chrono::hours r_vss::query_get_retention_hours(const std::string& top_dir, r_dev
     return chrono::duration_cast<chrono::hours>(chrono::system_clock::now() - r_time_utils::epoch_millis_to_tp(maybe_first_ts.value()));
 }
 
+r_nullable<int64_t> r_vss::query_get_key_frame_ts(const std::string& top_dir, r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts)
+{
+    auto maybe_camera = devices.get_camera_by_id(camera_id);
+
+    if(maybe_camera.is_null())
+        R_THROW(("Unknown camera id: %s", camera_id.c_str()));
+
+    if(maybe_camera.value().record_file_path.is_null())
+        R_THROW(("Camera has no recording file!"));
+
+    r_storage_file_reader sf(_get_storage_path(maybe_camera.value().record_file_path.value(), top_dir));
+
+    return sf.key_frame_ts(R_STORAGE_MEDIA_TYPE_VIDEO, r_time_utils::tp_to_epoch_millis(ts));
+}
+
 vector<uint8_t> r_vss::query_get_key_frame(const std::string& top_dir, r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point ts)
 {
+    static auto& duration = _query_duration("key_frame");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.key_frame");
+
     auto maybe_camera = devices.get_camera_by_id(camera_id);
 
     if(maybe_camera.is_null())
@@ -310,6 +406,10 @@ vector<uint8_t> r_vss::query_get_rgb24_frame(const std::string& top_dir, r_devic
 
 vector<uint8_t> r_vss::query_get_video(const std::string& top_dir, r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end)
 {
+    static auto& duration = _query_duration("video");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.video");
+
     auto maybe_camera = devices.get_camera_by_id(camera_id);
 
     if(maybe_camera.is_null())
@@ -327,8 +427,392 @@ vector<uint8_t> r_vss::query_get_video(const std::string& top_dir, r_devices& de
     );
 }
 
+vector<uint8_t> r_vss::query_get_key_frames(const std::string& top_dir, r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end, std::chrono::milliseconds interval)
+{
+    static auto& duration = _query_duration("key_frames");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.key_frames");
+
+    auto maybe_camera = devices.get_camera_by_id(camera_id);
+
+    if(maybe_camera.is_null())
+        R_THROW(("Unknown camera id: %s", camera_id.c_str()));
+
+    if(maybe_camera.value().record_file_path.is_null())
+        R_THROW(("Camera has no recording file!"));
+
+    r_storage_file_reader sf(_get_storage_path(maybe_camera.value().record_file_path.value(), top_dir));
+
+    return sf.query_key_frames(
+        r_time_utils::tp_to_epoch_millis(start),
+        r_time_utils::tp_to_epoch_millis(end),
+        interval.count()
+    );
+}
+
+vector<uint8_t> r_vss::query_get_video(const std::string& top_dir, r_devices& devices, const std::string& camera_id, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end, double rate)
+{
+    if(rate <= 0.0 || rate > TRICK_PLAY_MAX_RATE)
+        R_THROW(("Invalid playback rate: %f", rate));
+
+    if(rate == 1.0)
+        return query_get_video(top_dir, devices, camera_id, start, end);
+
+    static auto& duration = _query_duration("trick_play");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.trick_play");
+
+    vector<uint8_t> buffer;
+
+    if(rate >= TRICK_PLAY_KEY_FRAME_RATE)
+        buffer = query_get_key_frames(top_dir, devices, camera_id, start, end, trick_play_key_frame_interval(rate));
+    else
+    {
+        auto maybe_camera = devices.get_camera_by_id(camera_id);
+
+        if(maybe_camera.is_null())
+            R_THROW(("Unknown camera id: %s", camera_id.c_str()));
+
+        if(maybe_camera.value().record_file_path.is_null())
+            R_THROW(("Camera has no recording file!"));
+
+        r_storage_file_reader sf(_get_storage_path(maybe_camera.value().record_file_path.value(), top_dir));
+
+        // Audio can't be played back at anything but 1x, so don't bother reading it.
+        buffer = sf.query(
+            R_STORAGE_MEDIA_TYPE_VIDEO,
+            r_time_utils::tp_to_epoch_millis(start),
+            r_time_utils::tp_to_epoch_millis(end)
+        );
+    }
+
+    uint32_t version = 0;
+    auto bt = r_blob_tree::deserialize(buffer.data(), buffer.size(), version);
+
+    if(bt.has_key("frames"))
+    {
+        auto start_ms = r_time_utils::tp_to_epoch_millis(start);
+
+        auto n_frames = bt["frames"].size();
+
+        for(size_t fi = 0; fi < n_frames; ++fi)
+        {
+            auto& f = bt["frames"][fi];
+            auto ts = f["ts"].get_value<int64_t>();
+            auto rewritten_ts = start_ms + (int64_t)llround((double)(ts - start_ms) / rate);
+            f["source_ts"] = r_string_utils::int64_to_s(ts);
+            f["ts"] = r_string_utils::int64_to_s(rewritten_ts);
+        }
+    }
+
+    bt["has_audio"] = string("false");
+    bt["rate"] = r_string_utils::double_to_s(rate);
+
+    return r_blob_tree::serialize(bt, version);
+}
+
+milliseconds r_vss::trick_play_key_frame_interval(double rate)
+{
+    return milliseconds((int64_t)llround((rate * 1000.0) / TRICK_PLAY_OUTPUT_FPS));
+}
+
+// Used when a recording has no sc_framerate and too few frames to measure one.
+static const float DEFAULT_EXPORT_FRAMERATE = 30.0f;
+
+// How much of an export is looked at to estimate its frame rate.
+static const int64_t FRAMERATE_SAMPLE_MILLIS = 5000;
+
+static const char* EXPORT_MOVFLAGS = "frag_keyframe+empty_moov+default_base_moof";
+
+static float _estimate_framerate(r_storage_file_reader& sf, int64_t start_ts, int64_t end_ts)
+{
+    int64_t last_ts = 0, total = 0;
+    bool has_last_ts = false;
+    size_t n_deltas = 0;
+
+    sf.visit(start_ts, (std::min)(end_ts, start_ts + FRAMERATE_SAMPLE_MILLIS), [&](const r_storage_frame_ref& f){
+        if(f.stream_id != R_STORAGE_MEDIA_TYPE_VIDEO)
+            return;
+
+        if(has_last_ts && f.ts > last_ts)
+        {
+            total += f.ts - last_ts;
+            ++n_deltas;
+        }
+
+        last_ts = f.ts;
+        has_last_ts = true;
+    });
+
+    if(n_deltas == 0 || total == 0)
+        return DEFAULT_EXPORT_FRAMERATE;
+
+    return 1000.0f / ((float)total / (float)n_deltas);
+}
+
+static void _add_export_streams(r_muxer& muxer, const r_storage_codec_info& ci, float fr)
+{
+    auto video_codec_id = r_av::encoding_to_av_codec_id(ci.video_codec_name);
+
+    if(video_codec_id == AV_CODEC_ID_H264)
+    {
+        auto maybe_sps = r_pipeline::get_h264_sps(ci.video_codec_parameters);
+        if(!maybe_sps.is_null())
+        {
+            auto sps_info = r_pipeline::parse_h264_sps(maybe_sps.value());
+
+            muxer.add_video_stream(
+                av_d2q(fr, 10000),
+                video_codec_id,
+                sps_info.width,
+                sps_info.height,
+                sps_info.profile_idc,
+                sps_info.level_idc
+            );
+        }
+        auto maybe_pps = r_pipeline::get_h264_pps(ci.video_codec_parameters);
+        muxer.set_video_extradata(r_pipeline::make_h264_extradata(maybe_sps, maybe_pps));
+    }
+    else if(video_codec_id == AV_CODEC_ID_HEVC)
+    {
+        auto maybe_vps = r_pipeline::get_h265_vps(ci.video_codec_parameters);
+        auto maybe_sps = r_pipeline::get_h265_sps(ci.video_codec_parameters);
+        if(!maybe_sps.is_null())
+        {
+            auto sps_info = r_pipeline::parse_h265_sps(maybe_sps.value());
+
+            muxer.add_video_stream(
+                av_d2q(fr, 10000),
+                video_codec_id,
+                sps_info.width,
+                sps_info.height,
+                sps_info.profile_idc,
+                sps_info.level_idc
+            );
+        }
+        auto maybe_pps = r_pipeline::get_h265_pps(ci.video_codec_parameters);
+        muxer.set_video_extradata(r_pipeline::make_h265_extradata(maybe_vps, maybe_sps, maybe_pps));
+    }
+    else R_THROW(("Unable to export video codec: %s", ci.video_codec_name.c_str()));
+
+    if(ci.has_audio)
+    {
+        r_nullable<int> audio_rate, audio_channels;
+        auto audio_codec_parameter_parts = r_string_utils::split(ci.audio_codec_parameters, ",");
+        for(auto part : audio_codec_parameter_parts)
+        {
+            auto inner_parts = r_string_utils::split(part, "=");
+            if(inner_parts.size() == 2)
+            {
+                if(r_string_utils::strip(inner_parts[0]) == "sc_audio_rate")
+                    audio_rate.set_value(r_string_utils::s_to_int(inner_parts[1]));
+                if(r_string_utils::strip(inner_parts[0]) == "sc_audio_channels")
+                    audio_channels.set_value(r_string_utils::s_to_int(inner_parts[1]));
+            }
+        }
+
+        auto audio_codec_id = r_av::encoding_to_av_codec_id(ci.audio_codec_name);
+
+        if(audio_channels.is_null())
+            audio_channels.set_value(1);
+
+        if(audio_rate.is_null())
+        {
+            if(audio_codec_id == AV_CODEC_ID_PCM_MULAW)
+                audio_rate.set_value(8000);
+            else if(audio_codec_id == AV_CODEC_ID_PCM_ALAW)
+                audio_rate.set_value(8000);
+        }
+
+        if(audio_rate.is_null())
+            R_THROW(("Missing audio rate."));
+
+        muxer.add_audio_stream(
+            audio_codec_id,
+            (uint8_t)audio_channels.value(),
+            (uint16_t)audio_rate.value()
+        );
+    }
+}
+
+// Muxes [start_ts, end_ts) into an in memory fragmented MP4 whose timestamps start at 0.
+struct _export_piece
+{
+    vector<uint8_t> mp4;
+    bool has_video {false};
+    int64_t first_video_ts {0};
+    int64_t last_video_ts {0};
+    uint64_t bytes_read {0};
+};
+
+static _export_piece _mux_export_segment(const string& storage_path, const r_storage_codec_info& ci, float fr, int64_t start_ts, int64_t end_ts)
+{
+    R_TRACE_SPAN("query.export.segment");
+
+    r_storage_file_reader sf(storage_path);
+
+    r_muxer muxer("segment.mp4", true, "mp4");
+    _add_export_streams(muxer, ci, fr);
+    muxer.set_format_option("movflags", EXPORT_MOVFLAGS);
+    muxer.open();
+
+    _export_piece piece;
+
+    sf.visit(start_ts, end_ts, [&](const r_storage_frame_ref& f){
+        auto ts = f.ts - start_ts;
+
+        if(f.stream_id == R_STORAGE_MEDIA_TYPE_VIDEO)
+        {
+            if(piece.has_video && f.ts < piece.last_video_ts)
+                R_THROW(("Timestamp is not monotonically increasing."));
+
+            if(!piece.has_video)
+                piece.first_video_ts = f.ts;
+            piece.has_video = true;
+            piece.last_video_ts = f.ts;
+
+            muxer.write_video_frame((uint8_t*)f.data, f.size, ts, ts, {1, 1000}, f.key);
+        }
+        else if(f.stream_id == R_STORAGE_MEDIA_TYPE_AUDIO && ci.has_audio)
+            muxer.write_audio_frame((uint8_t*)f.data, f.size, ts, {1, 1000});
+        else return;
+
+        piece.bytes_read += f.size;
+    });
+
+    muxer.finalize();
+
+    piece.mp4.assign(muxer.buffer(), muxer.buffer() + muxer.buffer_size());
+
+    return piece;
+}
+
+export_stats r_vss::query_export_mp4(const string& top_dir, r_devices& devices, const string& camera_id, system_clock::time_point start, system_clock::time_point end, const string& output_path, size_t max_threads)
+{
+    static auto& duration = _query_duration("export");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.export");
+
+    auto started = steady_clock::now();
+
+    auto maybe_camera = devices.get_camera_by_id(camera_id);
+
+    if(maybe_camera.is_null())
+        R_THROW(("Unknown camera id: %s", camera_id.c_str()));
+
+    if(maybe_camera.value().record_file_path.is_null())
+        R_THROW(("Camera has no recording file!"));
+
+    auto storage_path = _get_storage_path(maybe_camera.value().record_file_path.value(), top_dir);
+
+    auto start_ts = r_time_utils::tp_to_epoch_millis(start);
+    auto end_ts = r_time_utils::tp_to_epoch_millis(end);
+
+    r_storage_file_reader sf(storage_path);
+
+    auto key_frames = sf.key_frame_start_times(R_STORAGE_MEDIA_TYPE_VIDEO, start_ts, end_ts);
+
+    auto first_key = sf.key_frame_ts(R_STORAGE_MEDIA_TYPE_VIDEO, start_ts);
+    if(first_key.is_null())
+    {
+        if(key_frames.empty())
+            R_THROW(("No video to export."));
+        first_key.set_value(key_frames.front());
+    }
+
+    // Every piece starts on a key frame, so each can be muxed without the others.
+    auto segment_millis = duration_cast<milliseconds>(EXPORT_SEGMENT_DURATION).count();
+    vector<int64_t> boundaries = {first_key.value()};
+    for(auto kf : key_frames)
+    {
+        if(kf - boundaries.back() >= segment_millis)
+            boundaries.push_back(kf);
+    }
+    boundaries.push_back(end_ts);
+
+    auto n_segments = boundaries.size() - 1;
+
+    auto ci = sf.codec_info(first_key.value(), end_ts);
+
+    r_nullable<float> fr;
+    auto parts = r_string_utils::split(ci.video_codec_parameters, ",");
+    for(auto part : parts)
+    {
+        auto inner_parts = r_string_utils::split(part, "=");
+        if(inner_parts.size() == 2)
+        {
+            if(r_string_utils::strip(inner_parts[0]) == "sc_framerate")
+                fr.set_value(r_string_utils::s_to_float(inner_parts[1]));
+        }
+    }
+
+    if(fr.is_null())
+        fr.set_value(_estimate_framerate(sf, first_key.value(), end_ts));
+
+    if(max_threads == 0 || max_threads > EXPORT_MAX_THREADS)
+        max_threads = EXPORT_MAX_THREADS;
+
+    export_stats stats;
+    stats.segments = n_segments;
+
+    auto f = r_file::open(output_path, "wb");
+
+    r_fmp4_concat concat([&](const uint8_t* p, size_t size){
+        r_fs::block_write_file(p, size, f, 65536);
+    });
+
+    uint64_t bytes_read = 0;
+    bool has_last_video_ts = false;
+    int64_t last_video_ts = 0;
+
+    // Pieces are muxed a batch at a time and written in order, so memory is bounded by the batch.
+    for(size_t batch = 0; batch < n_segments; batch += max_threads)
+    {
+        auto batch_size = (std::min)(max_threads, n_segments - batch);
+
+        vector<_export_piece> pieces(batch_size);
+
+        r_parallel_for(batch_size, max_threads, [&](size_t i){
+            pieces[i] = _mux_export_segment(storage_path, ci, fr.value(), boundaries[batch + i], boundaries[batch + i + 1]);
+        });
+
+        for(size_t i = 0; i < batch_size; ++i)
+        {
+            auto& piece = pieces[i];
+
+            // Each piece checked its own timestamps, this catches a step back where two meet (before
+            // concat rewrites the piece's decode times onto the end of the previous one).
+            if(piece.has_video)
+            {
+                if(has_last_video_ts && piece.first_video_ts < last_video_ts)
+                    R_THROW(("Timestamp is not monotonically increasing."));
+                has_last_video_ts = true;
+                last_video_ts = piece.last_video_ts;
+            }
+
+            concat.append(piece.mp4, boundaries[batch + i] - first_key.value(), {1, 1000});
+            bytes_read += piece.bytes_read;
+            vector<uint8_t>().swap(piece.mp4);
+        }
+    }
+
+    f.close();
+
+    stats.bytes_read = bytes_read;
+    stats.bytes_written = concat.bytes_written();
+    stats.fragments = concat.n_fragments();
+    stats.media_duration = milliseconds(end_ts - first_key.value());
+    stats.elapsed = duration_cast<milliseconds>(steady_clock::now() - started);
+
+    return stats;
+}
+
 contents r_vss::query_get_contents(const string& top_dir, r_devices& devices, const string& camera_id, system_clock::time_point start, system_clock::time_point end)
 {
+    static auto& duration = _query_duration("contents");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.contents");
+
     auto maybe_camera = devices.get_camera_by_id(camera_id);
     if(maybe_camera.is_null())
         R_THROW(("Unknown camera id: %s", camera_id.c_str()));
@@ -387,6 +871,10 @@ vector<r_camera> r_vss::query_get_cameras(r_devices& devices)
 
 vector<r_vss::motion_event_info> r_vss::query_get_motion_events(const std::string& top_dir, r_devices& devices, const std::string& camera_id, uint8_t motion_threshold, std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end)
 {
+    static auto& duration = _query_duration("motion_events");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.motion_events");
+
     vector<motion_event_info> result;
 
     try
@@ -469,6 +957,10 @@ vector<r_vss::motion_event_info> r_vss::query_get_motion_events(const std::strin
 
 vector<r_vss::segment> r_vss::query_get_blocks(const string& top_dir, r_devices& devices, const string& camera_id, system_clock::time_point start, system_clock::time_point end)
 {
+    static auto& duration = _query_duration("blocks");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.blocks");
+
     auto maybe_camera = devices.get_camera_by_id(camera_id);
     if(maybe_camera.is_null())
         R_THROW(("Unknown camera id: %s", camera_id.c_str()));
@@ -515,6 +1007,10 @@ void r_vss::query_remove_blocks(const std::string& top_dir, r_devices& devices,
 
 vector<r_metadata_entry> r_vss::query_get_analytics(const string& top_dir, r_devices& devices, const string& camera_id, system_clock::time_point start, system_clock::time_point end, const r_nullable<string>& stream_tag)
 {
+    static auto& duration = _query_duration("analytics");
+    r_histogram_timer timer(duration);
+    R_TRACE_SPAN("query.analytics");
+
     vector<r_metadata_entry> result;
 
     auto maybe_camera = devices.get_camera_by_id(camera_id);
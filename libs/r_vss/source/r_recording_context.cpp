@@ -30,9 +30,13 @@
 #include "r_utils/r_time_utils.h"
 #include "r_utils/r_exception.h"
 #include "r_utils/r_logger.h"
-#include "r_utils/r_blob_tree.h"
+#include "r_utils/r_blob_tree_view.h"
+#include "r_utils/r_metrics.h"
+#include "r_utils/r_trace.h"
 #include "r_utils/r_time_utils.h"
 #include <vector>
+#include <cmath>
+#include <cstdlib>
 
 using namespace r_vss;
 using namespace r_disco;
@@ -72,13 +76,22 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
     _video_caps(),
     _audio_caps(),
     _restream_mount_path(),
+    _gop_cache(sk->get_gop_cache(camera.id)),
     _playback_restreaming_states_lok(),
     _playback_restreaming_states(),
     _got_first_audio_sample(false),
     _got_first_video_sample(false),
     _die(false),
-    _ws(ws)
+    _ws(ws),
+    _video_frames(metrics().counter("revere_ingest_frames_total", "Frames received from cameras.", {{"camera", camera.id}, {"media", "video"}})),
+    _video_bytes(metrics().counter("revere_ingest_bytes_total", "Bytes received from cameras.", {{"camera", camera.id}, {"media", "video"}})),
+    _audio_frames(metrics().counter("revere_ingest_frames_total", "Frames received from cameras.", {{"camera", camera.id}, {"media", "audio"}})),
+    _audio_bytes(metrics().counter("revere_ingest_bytes_total", "Bytes received from cameras.", {{"camera", camera.id}, {"media", "audio"}}))
 {
+    // The cache may still hold samples from a previous (now dead) recording context for this
+    // camera. Their timestamps are unrelated to the stream we are about to start.
+    _gop_cache->clear();
+
     // Only create metadata storage if motion detection is enabled
     if(!_camera.do_motion_detection.is_null() && _camera.do_motion_detection.value())
     {
@@ -99,6 +112,8 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
 
     _source.set_audio_sample_cb([this](const sample_context& sc, const r_gst_buffer& buffer, bool key, int64_t pts){
 
+        R_TRACE_SPAN("recording.audio_sample");
+
         try
         {
             if(!_stream_start_ts_set)
@@ -139,6 +154,8 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
             _last_a_time = system_clock::now();
             auto mi = buffer.map(r_gst_buffer::MT_READ);
             _a_bytes_received += mi.size();
+            _audio_frames.inc();
+            _audio_bytes.inc(mi.size());
 
             if(this->_audio_caps.is_null())
                 this->_audio_caps = _source.get_audio_caps();
@@ -147,17 +164,28 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
                 this->_restream_mount_path = this->_sk->add_restream_mount(_sdp_medias, _camera, this, sc.video_encoding(), sc.audio_encoding());
 
             auto ts = (sc.stream_start_ts() + pts);
-            this->_storage_file.write_frame(
-                this->_maybe_audio_storage_write_context.value(),
-                R_STORAGE_MEDIA_TYPE_AUDIO,
-                mi.data(),
-                mi.size(),
-                key,
-                ts,
-                pts
-            );
+            {
+                R_TRACE_SPAN("recording.write_frame");
+                this->_storage_file.write_frame(
+                    this->_maybe_audio_storage_write_context.value(),
+                    R_STORAGE_MEDIA_TYPE_AUDIO,
+                    mi.data(),
+                    mi.size(),
+                    key,
+                    ts,
+                    pts
+                );
+            }
+
+            // Runs to the end of the callback.
+            R_TRACE_SPAN("recording.restream");
+
+            auto seq = this->_gop_cache->post_audio(buffer, pts, key);
 
             this->_sk->iterate_live_restreaming_states(this->_camera.id, [&](live_restreaming_state& lrs) {
+                if(seq <= lrs.gop_primed_seq)
+                    return;
+
                 if(lrs.live_restream_key_sent)
                 {
                     if(!lrs.first_restream_a_times_set)
@@ -186,6 +214,8 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
 
     _source.set_video_sample_cb([this](const sample_context& sc, const r_gst_buffer& buffer, bool key, int64_t pts){
 
+        R_TRACE_SPAN("recording.video_sample");
+
         try
         {
             if(!_stream_start_ts_set)
@@ -260,6 +290,8 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
             _last_v_time = system_clock::now();
             auto mi = buffer.map(r_gst_buffer::MT_READ);
             _v_bytes_received += mi.size();
+            _video_frames.inc();
+            _video_bytes.inc(mi.size());
             if(this->_video_caps.is_null())
             {
                 this->_video_caps = _source.get_video_caps();
@@ -268,20 +300,24 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
             }
 
             auto ts = (sc.stream_start_ts() + pts);
-            this->_storage_file.write_frame(
-                this->_maybe_video_storage_write_context.value(),
-                R_STORAGE_MEDIA_TYPE_VIDEO,
-                mi.data(),
-                mi.size(),
-                key,
-                ts,
-                pts
-            );
+            {
+                R_TRACE_SPAN("recording.write_frame");
+                this->_storage_file.write_frame(
+                    this->_maybe_video_storage_write_context.value(),
+                    R_STORAGE_MEDIA_TYPE_VIDEO,
+                    mi.data(),
+                    mi.size(),
+                    key,
+                    ts,
+                    pts
+                );
+            }
 
             bool do_motion = (!this->_camera.do_motion_detection.is_null())?this->_camera.do_motion_detection.value():false;
 
             if(do_motion)
             {
+                R_TRACE_SPAN("recording.post_to_motion");
                 this->_sk->post_frame_to_motion_engine(
                     buffer,
                     ts,
@@ -292,7 +328,15 @@ r_recording_context::r_recording_context(r_stream_keeper* sk, const r_camera& ca
                 );
             }
 
+            // Runs to the end of the callback.
+            R_TRACE_SPAN("recording.restream");
+
+            auto seq = this->_gop_cache->post_video(buffer, pts, key);
+
             this->_sk->iterate_live_restreaming_states(this->_camera.id, [&](live_restreaming_state& lrs) {
+                if(seq <= lrs.gop_primed_seq)
+                    return;
+
                 if(lrs.live_restream_key_sent || key)
                 {
                     lrs.live_restream_key_sent = true;
@@ -372,6 +416,13 @@ int32_t r_recording_context::bytes_per_second() const
     return (int32_t)((_v_bytes_received + _a_bytes_received) / div);
 }
 
+seconds r_recording_context::stream_duration() const
+{
+    if(!_stream_start_ts_set)
+        return seconds(0);
+    return duration_cast<seconds>(system_clock::now() - _stream_start_ts);
+}
+
 r_md_storage_file& r_recording_context::metadata_storage()
 {
     if(!_md_storage_file)
@@ -402,6 +453,13 @@ static void _need_live_data_cbs(GstElement* appsrc, guint, live_restreaming_stat
             int ret;
             g_signal_emit_by_name(appsrc, "push-buffer", output_buffer, &ret);
             gst_buffer_unref(output_buffer);
+
+            if(!lrs->first_video_pushed)
+            {
+                lrs->first_video_pushed = true;
+                auto ttff = duration_cast<milliseconds>(steady_clock::now() - lrs->configured_at);
+                lrs->sk->record_live_time_to_first_frame(lrs->camera_id, ttff, lrs->primed_from_gop_cache);
+            }
         }
     }
     else
@@ -426,6 +484,7 @@ void r_recording_context::live_restream_media_configure(GstRTSPMediaFactory*, Gs
     lrs->sk = _sk;  // Store stream_keeper pointer for safe cleanup
     lrs->media = media;
     lrs->camera_id = _camera.id;
+    lrs->configured_at = steady_clock::now();
 
     auto element = gst_rtsp_media_get_element(media);
     if(!element)
@@ -458,8 +517,58 @@ void r_recording_context::live_restream_media_configure(GstRTSPMediaFactory*, Gs
         g_signal_connect(lrs->a_appsrc, "need-data", (GCallback)_need_live_data_cbs, lrs.get());
     }
 
-    // Store in r_stream_keeper's map (not r_recording_context's)
-    _sk->add_live_restreaming_state(media, lrs);
+    // Prime the new client with the GOP in progress and register it in r_stream_keeper's map (not
+    // r_recording_context's). Both happen under the GOP cache lock so every sample is delivered to
+    // this client exactly once: either here, or later by the sample callbacks.
+    _gop_cache->prime([&](const vector<r_gop_sample>& samples, uint64_t last_seq){
+        _prime_live_restream(*lrs, samples, last_seq);
+        _sk->add_live_restreaming_state(media, lrs);
+    });
+}
+
+void r_recording_context::_prime_live_restream(live_restreaming_state& lrs, const vector<r_gop_sample>& samples, uint64_t last_seq)
+{
+    lrs.gop_primed_seq = last_seq;
+
+    // Samples always begin with a video key frame (see r_gop_cache), so the timestamps below are
+    // rebased exactly the way the sample callbacks would have rebased them had this client been
+    // connected when that key frame arrived.
+    for(const auto& s : samples)
+    {
+        _frame_context fc;
+        fc.key = s.key;
+        fc.buffer = s.buffer;
+
+        if(s.video)
+        {
+            if(!lrs.first_restream_v_times_set)
+            {
+                lrs.first_restream_v_times_set = true;
+                lrs.first_restream_v_pts = s.pts * 1000000;
+                lrs.first_restream_v_dts = s.pts * 1000000;
+            }
+
+            lrs.live_restream_key_sent = true;
+            fc.gst_pts = (s.pts * 1000000) - lrs.first_restream_v_pts;
+            fc.gst_dts = (s.pts * 1000000) - lrs.first_restream_v_dts;
+            lrs.video_samples.post(fc);
+        }
+        else if(lrs.a_appsrc)
+        {
+            if(!lrs.first_restream_a_times_set)
+            {
+                lrs.first_restream_a_times_set = true;
+                lrs.first_restream_a_pts = s.pts * 1000000;
+                lrs.first_restream_a_dts = s.pts * 1000000;
+            }
+
+            fc.gst_pts = (s.pts * 1000000) - lrs.first_restream_a_pts;
+            fc.gst_dts = (s.pts * 1000000) - lrs.first_restream_a_dts;
+            lrs.audio_samples.post(fc);
+        }
+    }
+
+    lrs.primed_from_gop_cache = lrs.live_restream_key_sent;
 }
 
 void r_recording_context::stop()
@@ -485,7 +594,7 @@ void r_recording_context::create_playback_mount(GstRTSPServer*, GstRTSPMountPoin
     auto video_buffer = query_get_video(_top_dir, _sk->get_devices(), _camera.id, first_segment.start, first_segment.start + seconds(5));
 
     uint32_t version = 0;
-    auto bt = r_blob_tree::deserialize(video_buffer.data(), video_buffer.size(), version);
+    r_blob_tree_view bt(video_buffer.data(), video_buffer.size(), version);
 
     if(!bt.has_key("has_audio"))
         R_THROW(("Blob tree missing audio indicator."));
@@ -570,6 +679,35 @@ tuple<string, system_clock::time_point, system_clock::time_point> r_recording_co
     return make_tuple(friendly_name, r_time_utils::iso_8601_to_tp(start_time_s), r_time_utils::iso_8601_to_tp(end_time_s));
 }
 
+double r_recording_context::_get_playback_rate()
+{
+    GstRTSPContext* context = gst_rtsp_context_get_current();
+
+    if(!context->uri || !context->uri->query)
+        return 1.0;
+
+    // playback urls may carry a rate: the_porch_2024-12-10T12:00:00.000Z_2024-12-10T13:00:00.000Z?rate=16
+    auto args = r_string_utils::split(string(context->uri->query), '&');
+    for(auto& a : args)
+    {
+        auto kv = r_string_utils::split(a, '=');
+        if(kv.size() == 2 && kv[0] == "rate")
+        {
+            // A bad ?rate= shouldn't cost the client its playback, it gets normal speed instead.
+            char* end = nullptr;
+            auto rate = strtod(kv[1].c_str(), &end);
+            if(end == kv[1].c_str() || *end != '\0' || !(rate > 0.0) || rate > TRICK_PLAY_MAX_RATE)
+            {
+                R_LOG_ERROR("Invalid playback rate: %s, playing at normal speed.", kv[1].c_str());
+                return 1.0;
+            }
+            return rate;
+        }
+    }
+
+    return 1.0;
+}
+
 void r_recording_context::_live_restream_cleanup_cbs(live_restreaming_state* lrs)
 {
     // This callback is called by GStreamer when the media object is destroyed.
@@ -590,7 +728,7 @@ _fetch_stream_info(shared_ptr<playback_restreaming_state> prs, const string& cam
     auto video_buffer = query_get_video(prs->top_dir, prs->devices, camera_id, first_segment.start, first_segment.start + seconds(5));
 
     uint32_t version = 0;
-    auto bt = r_blob_tree::deserialize(video_buffer.data(), video_buffer.size(), version);
+    r_blob_tree_view bt(video_buffer.data(), video_buffer.size(), version);
 
     if(!bt.has_key("has_audio"))
         R_THROW(("Blob tree missing audio indicator."));
@@ -644,7 +782,15 @@ static tuple<contents, std::chrono::milliseconds> _fetch_contents(const string&
 
 void r_recording_context::_playback_restream_media_configure_cbs(GstRTSPMediaFactory* factory, GstRTSPMedia* media, r_recording_context* rc)
 {
-    rc->_playback_restream_media_configure(factory, media);
+    // Called from GStreamer's C code, nothing may be thrown back through it.
+    try
+    {
+        rc->_playback_restream_media_configure(factory, media);
+    }
+    catch(const std::exception& e)
+    {
+        R_LOG_EXCEPTION(e);
+    }
 }
 
 static r_gst_caps _create_caps(const string& codec_parameters, const string& key)
@@ -683,6 +829,19 @@ static void _need_playback_data_cbs(GstElement* appsrc, guint, playback_restream
     }
     else
     {
+        // Audio isn't delivered during trick play, so end the audio stream right away rather than
+        // letting the client wait on it.
+        if(prs->rate != 1.0)
+        {
+            if(!prs->audio_eos_sent)
+            {
+                prs->audio_eos_sent = true;
+                int ret;
+                g_signal_emit_by_name(appsrc, "end-of-stream", &ret);
+            }
+            return;
+        }
+
         auto sample = prs->audio_samples.poll(chrono::milliseconds(3000));
         if(!sample.is_null())
         {
@@ -716,53 +875,61 @@ static void _playback_entry_point(shared_ptr<playback_restreaming_state> prs)
 {
     prs->running = true;
 
+    // The prefetcher reads ahead on its own thread, so by the time our queues run low the next
+    // chunk is usually already deserialized and waiting.
+    prs->prefetcher->start();
+
     while(prs->running)
     {
         try
         {
             if(_time_to_get_more_data(prs))
             {
-                auto video_buffer = query_get_video(prs->top_dir, prs->devices, prs->camera_id, prs->query_start, prs->query_end);
-
-                prs->query_start = prs->query_end;
-                prs->query_end = prs->query_start + seconds(5);
+                auto chunk = prs->prefetcher->next(chrono::milliseconds(200));
 
-                uint32_t version = 0;
-                auto bt = r_blob_tree::deserialize(video_buffer.data(), video_buffer.size(), version);
+                if(!chunk)
+                {
+                    if(prs->prefetcher->exhausted())
+                        prs->running = false;
+                    continue;
+                }
 
-                if(bt.has_key("frames"))
+                for(auto& f : chunk->frames)
                 {
-                    auto n_frames = bt["frames"].size();
+                    if(prs->first_ts.is_null())
+                        prs->first_ts.set_value(f.ts);
 
-                    for(size_t fi = 0; fi < n_frames; ++fi)
+                    if(system_clock::time_point(milliseconds(f.ts)) > prs->end_time)
                     {
-                        auto sid = bt["frames"][fi]["stream_id"].get_value<int>();
-                        auto key = (bt["frames"][fi]["key"].get_string() == "true");
-                        auto frame = bt["frames"][fi]["data"].get_blob();
-                        auto ts = bt["frames"][fi]["ts"].get_value<int64_t>();
-
-                        if(prs->first_ts.is_null())
-                            prs->first_ts.set_value(ts);
-
-                        if(system_clock::time_point(milliseconds(ts)) > prs->end_time)
-                        {
-                            prs->running = false;
-                            break;
-                        }
-
-                        r_gst_buffer buffer(frame.data(), frame.size());
-
-                        _frame_context fc;
-                        fc.gst_pts = (ts - prs->first_ts.value()) * 1000000;
-                        fc.gst_dts = (ts - prs->first_ts.value()) * 1000000;
-                        fc.key = key;                
-                        fc.buffer = buffer;
-
-                        if(sid == R_STORAGE_MEDIA_TYPE_VIDEO)
-                            prs->video_samples.post(fc);
-                        else if(sid == R_STORAGE_MEDIA_TYPE_AUDIO)
-                            prs->audio_samples.post(fc);
+                        prs->running = false;
+                        break;
                     }
+
+                    if(f.stream_id == R_STORAGE_MEDIA_TYPE_AUDIO && prs->rate != 1.0)
+                        continue;
+
+                    // Each chunk read backs up to the key frame preceding its start, which the
+                    // previous chunk may have already delivered.
+                    if(f.stream_id == R_STORAGE_MEDIA_TYPE_VIDEO)
+                    {
+                        if(!prs->last_video_ts.is_null() && f.ts <= prs->last_video_ts.value())
+                            continue;
+                        prs->last_video_ts.set_value(f.ts);
+                    }
+
+                    // Rewrite timestamps so that recorded time passes at rate times real time.
+                    auto output_ts = (uint64_t)llround((double)((f.ts - prs->first_ts.value()) * 1000000) / prs->rate);
+
+                    _frame_context fc;
+                    fc.gst_pts = output_ts;
+                    fc.gst_dts = output_ts;
+                    fc.key = f.key;
+                    fc.buffer = f.buffer;
+
+                    if(f.stream_id == R_STORAGE_MEDIA_TYPE_VIDEO)
+                        prs->video_samples.post(fc);
+                    else if(f.stream_id == R_STORAGE_MEDIA_TYPE_AUDIO)
+                        prs->audio_samples.post(fc);
                 }
             }
             else this_thread::sleep_for(chrono::milliseconds(200));
@@ -772,6 +939,8 @@ static void _playback_entry_point(shared_ptr<playback_restreaming_state> prs)
             R_LOG_EXCEPTION(e);
         }
     }
+
+    prs->prefetcher->stop();
 }
 
 void r_recording_context::_playback_restream_media_configure(GstRTSPMediaFactory*, GstRTSPMedia* media)
@@ -783,9 +952,8 @@ void r_recording_context::_playback_restream_media_configure(GstRTSPMediaFactory
     tie(prs->friendly_name, prs->start_time, prs->end_time) =
         _get_playback_url_parts();
 
-    prs->query_start = prs->start_time;
-    prs->query_end = prs->start_time + seconds(5);
     prs->camera_id = _camera.id;
+    prs->rate = _get_playback_rate();
 
     tie(prs->con, prs->playback_duration) = 
         _fetch_contents(_top_dir, _sk->get_devices(), _camera.id, prs->start_time, prs->end_time);
@@ -812,7 +980,7 @@ void r_recording_context::_playback_restream_media_configure(GstRTSPMediaFactory
 
 //    gst_util_set_object_arg(G_OBJECT(prs->v_appsrc), "stream-type", "seekable");
 
-    g_object_set(G_OBJECT(prs->v_appsrc), "duration", chrono::duration_cast<chrono::nanoseconds>(prs->playback_duration).count(), NULL);
+    g_object_set(G_OBJECT(prs->v_appsrc), "duration", (gint64)(chrono::duration_cast<chrono::nanoseconds>(prs->playback_duration).count() / prs->rate), NULL);
 
     g_signal_connect(prs->v_appsrc, "need-data", (GCallback)_need_playback_data_cbs, prs.get());
 
@@ -828,13 +996,15 @@ void r_recording_context::_playback_restream_media_configure(GstRTSPMediaFactory
 
 //        gst_util_set_object_arg(G_OBJECT(prs->a_appsrc), "stream-type", "seekable");
 
-        g_object_set(G_OBJECT(prs->a_appsrc), "duration", chrono::duration_cast<chrono::nanoseconds>(prs->playback_duration).count(), NULL);
+        g_object_set(G_OBJECT(prs->a_appsrc), "duration", (gint64)(chrono::duration_cast<chrono::nanoseconds>(prs->playback_duration).count() / prs->rate), NULL);
 
         g_signal_connect(prs->a_appsrc, "need-data", (GCallback)_need_playback_data_cbs, prs.get());
 
 //        g_signal_connect(prs->a_appsrc, "seek-data", (GCallback)_seek_playback_data_cbs, prs.get());
     }
 
+    prs->prefetcher = make_unique<r_playback_prefetcher>(_top_dir, _sk->get_devices(), _camera.id, prs->start_time, prs->end_time, prs->rate);
+
     prs->playback_thread = std::thread(
         _playback_entry_point,
         prs
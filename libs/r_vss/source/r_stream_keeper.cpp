@@ -2,6 +2,7 @@
 #include "r_vss/r_stream_keeper.h"
 #include "r_vss/r_recording_context.h"
 #include "r_vss/r_query.h"
+#include "r_pipeline/r_bitrate_cache.h"
 #include "r_utils/r_exception.h"
 #include "r_utils/r_std_utils.h"
 #include "r_utils/r_functional.h"
@@ -9,6 +10,7 @@
 #include "r_utils/r_file.h"
 #include "r_utils/r_time_utils.h"
 #include "r_utils/r_string_utils.h"
+#include "r_utils/r_metrics.h"
 #include "r_utils/r_time_utils.h"
 
 #include <algorithm>
@@ -194,6 +196,9 @@ void r_stream_keeper::_update_status_cache()
     }
     if(restream_dropped > 0)
     {
+        static auto& restream_frames_dropped = metrics().counter("revere_restream_frames_dropped_total", "Frames dropped because a live restream client fell behind.");
+        restream_frames_dropped.inc(restream_dropped);
+
         _total_restream_dropped += restream_dropped;
         _current_overflow_flags |= r_overflow_type::live_restream;
     }
@@ -240,6 +245,21 @@ void r_stream_keeper::_update_status_cache()
         s.dropped_frames = _total_motion_dropped + _total_restream_dropped;
     }
 
+    // Add live restream time to first frame
+    {
+        lock_guard<mutex> g(_ttff_stats_lok);
+        for(auto& s : status)
+        {
+            auto found = _ttff_stats.find(s.camera.id);
+            if(found != _ttff_stats.end())
+            {
+                s.live_last_time_to_first_frame_ms = found->second.last_ms;
+                s.live_avg_time_to_first_frame_ms = (double)found->second.total_ms / (double)found->second.count;
+                s.live_clients_started = found->second.count;
+            }
+        }
+    }
+
     std::lock_guard<std::mutex> lock(_status_cache_mutex);
     _status_cache = std::move(status);
 }
@@ -363,6 +383,49 @@ std::chrono::hours r_stream_keeper::get_retention_hours(const string& camera_id)
     return std::chrono::hours(0);
 }
 
+static const chrono::seconds BITRATE_REFINE_INTERVAL(30);
+static const chrono::seconds BITRATE_REFINE_MIN_STREAM_DURATION(60);
+
+static string _value_or_empty(const r_nullable<string>& v)
+{
+    return (v.is_null())?string():v.value();
+}
+
+void r_stream_keeper::_refine_bitrate_estimates()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if((now - _last_bitrate_refine) < BITRATE_REFINE_INTERVAL)
+        return;
+
+    _last_bitrate_refine = now;
+
+    std::lock_guard<std::mutex> lock(_streams_mutex);
+
+    for(const auto& stream : _streams)
+    {
+        // The recording context's rate is an average since the stream started, give it long
+        // enough to cover a few GOPs before we trust it over a probe.
+        if(stream.second->stream_duration() < BITRATE_REFINE_MIN_STREAM_DURATION)
+            continue;
+
+        auto camera = stream.second->camera();
+        if(camera.rtsp_url.is_null())
+            continue;
+
+        r_pipeline::bitrate_cache().refine(
+            camera.rtsp_url.value(),
+            r_pipeline::codec_signature(
+                _value_or_empty(camera.video_codec),
+                _value_or_empty(camera.video_codec_parameters),
+                _value_or_empty(camera.audio_codec),
+                _value_or_empty(camera.audio_codec_parameters)
+            ),
+            stream.second->bytes_per_second()
+        );
+    }
+}
+
 void r_stream_keeper::_update_retention_cache()
 {
     auto now = std::chrono::steady_clock::now();
@@ -582,6 +645,7 @@ void r_stream_keeper::_entry_point()
             // Update caches for non-blocking reads from GUI thread
             _update_status_cache();
             _update_retention_cache();
+            _refine_bitrate_estimates();
         }
         catch(const std::exception& e)
         {
@@ -644,6 +708,11 @@ void r_stream_keeper::_remove_recording_contexts(const std::vector<r_disco::r_ca
             _stop(camera.id);
             // Erase the recording context (this will close all file handles)
             _streams.erase(camera.id);
+
+            {
+                lock_guard<mutex> g(_gop_caches_lok);
+                _gop_caches.erase(camera.id);
+            }
         }
     }
 }
@@ -807,6 +876,34 @@ void r_stream_keeper::iterate_live_restreaming_states(const std::string& camera_
         fn(*lrs);
 }
 
+shared_ptr<r_gop_cache> r_stream_keeper::get_gop_cache(const string& camera_id)
+{
+    lock_guard<mutex> g(_gop_caches_lok);
+    auto found = _gop_caches.find(camera_id);
+    if(found != _gop_caches.end())
+        return found->second;
+    auto gc = make_shared<r_gop_cache>();
+    _gop_caches[camera_id] = gc;
+    return gc;
+}
+
+void r_stream_keeper::record_live_time_to_first_frame(const string& camera_id, chrono::milliseconds ttff, bool primed)
+{
+    {
+        lock_guard<mutex> g(_ttff_stats_lok);
+        auto& stats = _ttff_stats[camera_id];
+        stats.last_ms = (uint32_t)ttff.count();
+        stats.total_ms += (uint64_t)ttff.count();
+        ++stats.count;
+    }
+
+    static auto& primed_ttff = metrics().histogram("revere_restream_time_to_first_frame_seconds", "Time from a live restream client connecting to its first video frame.", {{"primed", "true"}}, R_METRICS_MICROSECONDS);
+    static auto& unprimed_ttff = metrics().histogram("revere_restream_time_to_first_frame_seconds", "Time from a live restream client connecting to its first video frame.", {{"primed", "false"}}, R_METRICS_MICROSECONDS);
+    ((primed) ? primed_ttff : unprimed_ttff).observe((uint64_t)chrono::duration_cast<chrono::microseconds>(ttff).count());
+
+    R_LOG_INFO("Live restream client for camera %s got first frame in %lld ms (%s)", camera_id.c_str(), (long long)ttff.count(), (primed)?"primed from GOP cache":"waited for key frame");
+}
+
 size_t r_stream_keeper::get_motion_engine_dropped_count()
 {
     return _motionEngine.get_and_reset_dropped_count();
@@ -48,3 +48,17 @@ vector<pair<int64_t, int64_t>> r_vss::find_contiguous_segments(const vector<int6
     return segments;
 }
 
+bool r_vss::has_inline_sps(const uint8_t* data, size_t size)
+{
+    for(size_t i = 0; i + 4 < size && i < 500; ++i)
+    {
+        if(data[i] == 0x00 && data[i+1] == 0x00 &&
+           data[i+2] == 0x00 && data[i+3] == 0x01)
+        {
+            uint8_t nal_type = data[i+4] & 0x1F;
+            if(nal_type == 7) // SPS
+                return true;
+        }
+    }
+    return false;
+}
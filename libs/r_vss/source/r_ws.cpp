@@ -6,18 +6,23 @@
 #include "r_utils/3rdparty/json/json.h"
 #include "r_utils/r_time_utils.h"
 #include "r_utils/r_file.h"
-#include "r_utils/r_blob_tree.h"
+#include "r_utils/r_md5.h"
+#include "r_utils/r_metrics.h"
+#include "r_utils/r_trace.h"
+#include "r_utils/r_logger.h"
 #include "r_utils/3rdparty/json/json.h"
 #include "r_disco/r_camera.h"
 #include "r_storage/r_storage_file.h"
 #include "r_storage/r_storage_file_reader.h"
 #include "r_storage/r_ring.h"
 #include "r_pipeline/r_stream_info.h"
-#include "r_av/r_muxer.h"
+#include "r_pipeline/r_bitrate_cache.h"
 #include "r_av/r_video_decoder.h"
 #include "r_av/r_video_encoder.h"
 #include <functional>
+#include <algorithm>
 #include <array>
+#include <thread>
 
 using namespace r_utils;
 using namespace r_http;
@@ -32,27 +37,112 @@ using json = nlohmann::json;
 
 const int WEB_SERVER_PORT = 10080;
 
+static const char* IMAGE_CACHE_CONTROL = "private, max-age=3600";
+
+// /trace?seconds=N holds a web server thread for N seconds, so N is kept to a few. Longer traces are
+// taken with SIGUSR2 (once to start, again to write the trace), which holds no thread at all.
+static const int MAX_TRACE_SECONDS = 5;
+
+// /timeline answers for this many cameras at most.
+static const size_t MAX_TIMELINE_CAMERAS = 64;
+
+static json _contents_json(const string& top_dir, r_devices& devices, const string& camera_id, system_clock::time_point start, system_clock::time_point end, bool z_time)
+{
+    auto contents = query_get_contents(top_dir, devices, camera_id, start, end);
+
+    auto segments = json::array();
+
+    for(auto& s : contents.segments)
+    {
+        // note: instead of push_back here its also possible to use += operator to append json object to array
+        segments.push_back({{"start_time", r_time_utils::tp_to_iso_8601(s.start, z_time)},
+                            {"end_time", r_time_utils::tp_to_iso_8601(s.end, z_time)}});
+    }
+
+    return segments;
+}
+
+static json _motion_events_json(const string& top_dir, r_devices& devices, const string& camera_id, uint8_t motion_threshold, system_clock::time_point start, system_clock::time_point end, bool z_time)
+{
+    auto motion_events = query_get_motion_events(top_dir, devices, camera_id, motion_threshold, start, end);
+
+    auto events = json::array();
+
+    for(auto e : motion_events)
+    {
+        json j_motion;
+
+        j_motion["start_time"] = r_time_utils::tp_to_iso_8601(e.start, z_time);
+        j_motion["end_time"] = r_time_utils::tp_to_iso_8601(e.end, z_time);
+        j_motion["motion"] = e.motion;
+        j_motion["avg_motion"] = e.avg_motion;
+        j_motion["stddev"] = e.stddev;
+
+        events.push_back(j_motion);
+    }
+
+    return events;
+}
+
+static json _analytics_json(const string& top_dir, r_devices& devices, const string& camera_id, system_clock::time_point start, system_clock::time_point end, const r_nullable<string>& stream_tag)
+{
+    auto analytics_data = query_get_analytics(top_dir, devices, camera_id, start, end, stream_tag);
+
+    auto analytics = json::array();
+
+    for(const auto& entry : analytics_data)
+    {
+        // Parse the JSON data and extract the analytics object
+        try {
+            auto parsed = json::parse(entry.json_data);
+            if(parsed.contains("analytics")) {
+                analytics.push_back(parsed["analytics"]);
+            }
+        } catch(const exception&) {
+            // Skip entries that don't parse or don't contain analytics
+        }
+    }
+
+    return analytics;
+}
+
 r_ws::r_ws(const string& top_dir, r_devices& devices) :
     _top_dir(top_dir),
     _devices(devices),
+    _image_cache(IMAGE_CACHE_MAX_BYTES, [](const vector<uint8_t>& image){return image.size();}),
+    _metric_callbacks(),
     _server(WEB_SERVER_PORT)
 {
-    _server.add_route(METHOD_GET, "/jpg", std::bind(&r_ws::_get_jpg, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/webp", std::bind(&r_ws::_get_webp, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/contents", std::bind(&r_ws::_get_contents, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/cameras", std::bind(&r_ws::_get_cameras, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/export", std::bind(&r_ws::_get_export, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/motion_events", std::bind(&r_ws::_get_motion_events, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/key_frame", std::bind(&r_ws::_get_key_frame, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/analytics", std::bind(&r_ws::_get_analytics, this, _1, _2, _3));
-    _server.add_route(METHOD_GET, "/video", std::bind(&r_ws::_get_video, this, _1, _2, _3));
+    _server.add_route(METHOD_GET, "/jpg", _instrumented("jpg", std::bind(&r_ws::_get_jpg, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/webp", _instrumented("webp", std::bind(&r_ws::_get_webp, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/contents", _instrumented("contents", std::bind(&r_ws::_get_contents, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/cameras", _instrumented("cameras", std::bind(&r_ws::_get_cameras, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/export", _instrumented("export", std::bind(&r_ws::_get_export, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/motion_events", _instrumented("motion_events", std::bind(&r_ws::_get_motion_events, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/frame", _instrumented("frame", std::bind(&r_ws::_get_frame, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/key_frame", _instrumented("key_frame", std::bind(&r_ws::_get_key_frame, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/analytics", _instrumented("analytics", std::bind(&r_ws::_get_analytics, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/timeline", _instrumented("timeline", std::bind(&r_ws::_get_timeline, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/video", _instrumented("video", std::bind(&r_ws::_get_video, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/metrics", _instrumented("metrics", std::bind(&r_ws::_get_metrics, this, _1, _2, _3)));
+    _server.add_route(METHOD_GET, "/trace", std::bind(&r_ws::_get_trace, this, _1, _2, _3));
 
     _server.start();
+
+    _add_metric_callbacks();
 }
 
 r_ws::~r_ws()
 {
     _server.stop();
+
+    for(auto id : _metric_callbacks)
+        metrics().remove_callback(id);
+}
+
+r_lru_cache_stats r_ws::image_cache_stats() const
+{
+    return _image_cache.stats();
 }
 
 void r_ws::stop()
@@ -60,41 +150,98 @@ void r_ws::stop()
     _server.stop();
 }
 
-r_http::r_server_response r_ws::_get_jpg(const r_http::r_web_server<r_utils::r_socket>&,
-                                         r_utils::r_socket&,
-                                         const r_http::r_server_request& request)
+r_web_server<r_socket>::http_cb r_ws::_instrumented(const string& route, r_web_server<r_socket>::http_cb cb)
 {
-    try
-    {
-        auto args = request.get_uri().get_get_args();
+    auto& requests = metrics().counter("revere_http_requests_total", "Requests handled, by route.", {{"route", route}});
+    auto& errors = metrics().counter("revere_http_request_errors_total", "Requests that failed, by route.", {{"route", route}});
+    auto& latency = metrics().histogram("revere_http_request_duration_seconds", "Time spent handling requests, by route.", {{"route", route}}, R_METRICS_MICROSECONDS);
+    auto span_name = r_trace::intern("http." + route);
 
-        if(args.find("camera_id") == end(args))
-            R_THROW(("Missing camera_id."));
+    return [cb, &requests, &errors, &latency, span_name](const r_web_server<r_socket>& ws, r_socket& conn, const r_server_request& request){
+        R_TRACE_SPAN(span_name);
+        r_histogram_timer timer(latency);
+        requests.inc();
 
-        if(args.find("start_time") == end(args))
-            R_THROW(("Missing start_time."));
+        try
+        {
+            return cb(ws, conn, request);
+        }
+        catch(...)
+        {
+            errors.inc();
+            throw;
+        }
+    };
+}
 
-        uint16_t w = 640;
-        if(args.find("width") != end(args))
-            w = r_string_utils::s_to_uint16(args["width"]);
+void r_ws::_add_metric_callbacks()
+{
+    auto& m = metrics();
+
+    // These already keep their own stats, so they are read when /metrics is rendered rather than
+    // being recorded twice.
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_image_cache_hits_total", "Image cache hits.", {}, [this](){return (double)_image_cache.stats().hits;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_image_cache_misses_total", "Image cache misses.", {}, [this](){return (double)_image_cache.stats().misses;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_image_cache_evictions_total", "Images evicted from the image cache.", {}, [this](){return (double)_image_cache.stats().evictions;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_GAUGE, "revere_image_cache_bytes", "Bytes held by the image cache.", {}, [this](){return (double)_image_cache.stats().cost;}));
+
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_decode_session_hits_total", "Frame steps answered from a decode session's pictures, with no decode.", {}, [](){return (double)query_get_decode_session_stats().hits;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_decode_session_forwards_total", "Frame steps a decode session's decoder carried on to from where it was.", {}, [](){return (double)query_get_decode_session_stats().forwards;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_decode_session_misses_total", "Frame steps decoded from a key frame.", {}, [](){return (double)query_get_decode_session_stats().misses;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_decode_session_frames_decoded_total", "Frames decoded by decode sessions.", {}, [](){return (double)query_get_decode_session_stats().frames_decoded;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_GAUGE, "revere_decode_session_hit_ratio", "Share of frame steps that didn't decode from a key frame.", {}, [](){return query_get_decode_session_stats().hit_ratio();}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_GAUGE, "revere_decode_sessions", "Open decode sessions.", {}, [](){return (double)query_get_decode_session_stats().sessions;}));
+
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_log_records_written_total", "Log records written.", {}, [](){return (double)r_logger::get_logger_stats().written;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_log_records_dropped_total", "Log records dropped because a thread's log ring was full.", {}, [](){return (double)r_logger::get_logger_stats().dropped;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_log_records_suppressed_total", "Log records suppressed by the per call site rate limit.", {}, [](){return (double)r_logger::get_logger_stats().suppressed;}));
+
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_bitrate_cache_hits_total", "Stream bitrate cache hits.", {}, [](){return (double)r_pipeline::bitrate_cache().stats().hits;}));
+    _metric_callbacks.push_back(m.add_callback(R_METRIC_COUNTER, "revere_bitrate_probes_total", "Stream bitrate probes run.", {}, [](){return (double)r_pipeline::bitrate_cache().stats().probes;}));
+}
 
-        uint16_t h = 480;
-        if(args.find("height") != end(args))
-            h = r_string_utils::s_to_uint16(args["height"]);
+r_http::r_server_response r_ws::_get_metrics(const r_http::r_web_server<r_utils::r_socket>&,
+                                             r_utils::r_socket&,
+                                             const r_http::r_server_request&)
+{
+    r_server_response response;
+    response.set_content_type("text/plain; version=0.0.4");
+    response.set_body(metrics().render_prometheus());
+    return response;
+}
 
-        auto result = query_get_jpg(
-            _top_dir,
-            _devices,
-            args["camera_id"],
-            r_time_utils::iso_8601_to_tp(args["start_time"]),
-            w,
-            h
-        );
+r_http::r_server_response r_ws::_get_trace(const r_http::r_web_server<r_utils::r_socket>&,
+                                           r_utils::r_socket&,
+                                           const r_http::r_server_request& request)
+{
+    auto args = request.get_uri().get_get_args();
 
-        r_server_response response;
-        response.set_content_type("image/jpeg");
-        response.set_body(result.size(), result.data());
-        return response;
+    // If tracing is already on (SIGUSR2) this returns what has been recorded so far. Otherwise
+    // ?seconds=N records for N seconds and returns that.
+    if(!r_trace::enabled() && args.find("seconds") != args.end())
+    {
+        auto n_seconds = r_string_utils::s_to_int(args["seconds"]);
+        if(n_seconds < 1 || n_seconds > MAX_TRACE_SECONDS)
+            R_STHROW(r_http_400_exception, ("seconds must be between 1 and %d.", MAX_TRACE_SECONDS));
+
+        r_trace::start_tracing();
+        this_thread::sleep_for(chrono::seconds(n_seconds));
+        r_trace::stop_tracing();
+    }
+
+    r_server_response response;
+    response.set_content_type("application/json");
+    response.set_body(r_trace::dump_json());
+    return response;
+}
+
+r_http::r_server_response r_ws::_get_jpg(const r_http::r_web_server<r_utils::r_socket>&,
+                                         r_utils::r_socket&,
+                                         const r_http::r_server_request& request)
+{
+    try
+    {
+        return _get_image(request, "jpg");
     }
     catch(const std::exception& ex)
     {
@@ -110,8 +257,99 @@ r_http::r_server_response r_ws::_get_webp(const r_http::r_web_server<r_utils::r_
 {
     try
     {
-        auto args = request.get_uri().get_get_args();
+        return _get_image(request, "webp");
+    }
+    catch(const std::exception& ex)
+    {
+        R_LOG_EXCEPTION_AT(ex, __FILE__, __LINE__);
+    }
+
+    R_STHROW(r_http_500_exception, ("Failed to create webp."));
+}
+
+r_http::r_server_response r_ws::_get_image(const r_http::r_server_request& request, const string& format)
+{
+    auto args = request.get_uri().get_get_args();
+
+    if(args.find("camera_id") == end(args))
+        R_THROW(("Missing camera_id."));
+
+    if(args.find("start_time") == end(args))
+        R_THROW(("Missing start_time."));
+
+    uint16_t w = 640;
+    if(args.find("width") != end(args))
+        w = r_string_utils::s_to_uint16(args["width"]);
+
+    uint16_t h = 480;
+    if(args.find("height") != end(args))
+        h = r_string_utils::s_to_uint16(args["height"]);
+
+    auto camera_id = args["camera_id"];
+    auto ts = r_time_utils::iso_8601_to_tp(args["start_time"]);
+
+    // Every ts in a GOP decodes to the same image (the key frame), so that's what we key on.
+    auto maybe_key_ts = query_get_key_frame_ts(_top_dir, _devices, camera_id, ts);
+    if(maybe_key_ts.is_null())
+        R_THROW(("No key frame found."));
+
+    auto key = r_string_utils::format(
+        "%s/%s/%ux%u/%s",
+        camera_id.c_str(),
+        r_string_utils::int64_to_s(maybe_key_ts.value()).c_str(),
+        w,
+        h,
+        format.c_str()
+    );
+
+    r_md5 hash;
+    hash.update((const uint8_t*)key.c_str(), key.length());
+    hash.finalize();
+    auto etag = "\"" + hash.get_as_string() + "\"";
+
+    auto content_type = (format == "webp") ? string("image/webp") : string("image/jpeg");
+
+    // Recorded frames never change, so a client that already has this etag can keep using its copy.
+    auto if_none_match = request.get_header("If-None-Match");
+    if(!if_none_match.is_null() && if_none_match.value() == etag)
+    {
+        r_server_response response(response_not_modified, content_type);
+        response.add_additional_header("ETag", etag);
+        response.add_additional_header("Cache-Control", IMAGE_CACHE_CONTROL);
+        return response;
+    }
+
+    auto result = _image_cache.get_or_create(key, [&](){
+        return (format == "webp")
+            ? query_get_webp(_top_dir, _devices, camera_id, ts, w, h)
+            : query_get_jpg(_top_dir, _devices, camera_id, ts, w, h);
+    });
+
+    r_server_response response;
+    response.set_content_type(content_type);
+    response.set_body(result->size(), result->data());
+    response.add_additional_header("ETag", etag);
+    response.add_additional_header("Cache-Control", IMAGE_CACHE_CONTROL);
+    return response;
+}
+
+r_http::r_server_response r_ws::_get_frame(const r_http::r_web_server<r_utils::r_socket>&,
+                                           r_utils::r_socket&,
+                                           const r_http::r_server_request& request)
+{
+    auto args = request.get_uri().get_get_args();
 
+    // Every frame stepped over is looked up and may be decoded, so a step is held to a few hundred.
+    int step = 0;
+    if(args.find("step") != end(args))
+    {
+        step = r_string_utils::s_to_int(args["step"]);
+        if(step > DECODE_SESSION_MAX_STEP || step < -DECODE_SESSION_MAX_STEP)
+            R_STHROW(r_http_400_exception, ("step must be between -%d and %d.", DECODE_SESSION_MAX_STEP, DECODE_SESSION_MAX_STEP));
+    }
+
+    try
+    {
         if(args.find("camera_id") == end(args))
             R_THROW(("Missing camera_id."));
 
@@ -126,18 +364,36 @@ r_http::r_server_response r_ws::_get_webp(const r_http::r_web_server<r_utils::r_
         if(args.find("height") != end(args))
             h = r_string_utils::s_to_uint16(args["height"]);
 
-        auto result = query_get_webp(
+        // Sessions keep decoded pictures, so their size is held down (keeping the shape asked for).
+        if(w > DECODE_SESSION_MAX_WIDTH || h > DECODE_SESSION_MAX_HEIGHT)
+        {
+            auto scale = (std::min)((double)DECODE_SESSION_MAX_WIDTH / w, (double)DECODE_SESSION_MAX_HEIGHT / h);
+            w = (uint16_t)(std::max)(2.0, w * scale);
+            h = (uint16_t)(std::max)(2.0, h * scale);
+        }
+
+        // Clients that don't name a session share one per camera.
+        string session;
+        if(args.find("session") != end(args))
+            session = args["session"];
+
+        auto result = query_get_frame_jpg(
             _top_dir,
             _devices,
             args["camera_id"],
+            session,
             r_time_utils::iso_8601_to_tp(args["start_time"]),
+            step,
             w,
             h
         );
 
         r_server_response response;
-        response.set_content_type("image/webp");
-        response.set_body(result.size(), result.data());
+        response.set_content_type("image/jpeg");
+        response.set_body(result.jpg.size(), result.jpg.data());
+        // The time of the frame returned, which is where the next step starts from.
+        response.add_additional_header("X-Frame-Time", r_time_utils::tp_to_iso_8601(result.ts, true));
+        response.add_additional_header("X-Frames-Decoded", r_string_utils::size_t_to_s(result.frames_decoded));
         return response;
     }
     catch(const std::exception& ex)
@@ -145,7 +401,7 @@ r_http::r_server_response r_ws::_get_webp(const r_http::r_web_server<r_utils::r_
         R_LOG_EXCEPTION_AT(ex, __FILE__, __LINE__);
     }
 
-    R_STHROW(r_http_500_exception, ("Failed to create webp."));
+    R_STHROW(r_http_500_exception, ("Failed to get frame."));
 }
 
 r_http::r_server_response r_ws::_get_key_frame(const r_http::r_web_server<r_utils::r_socket>&,
@@ -199,25 +455,16 @@ r_http::r_server_response r_ws::_get_contents(const r_http::r_web_server<r_utils
         
         auto end_time_s = args["end_time"];
 
-        auto contents = query_get_contents(
+        json j;
+        j["segments"] = _contents_json(
             _top_dir,
             _devices,
             args["camera_id"],
             r_time_utils::iso_8601_to_tp(start_time_s),
-            r_time_utils::iso_8601_to_tp(end_time_s)            
+            r_time_utils::iso_8601_to_tp(end_time_s),
+            input_z_time
         );
 
-        json j;
-        j["segments"] = json::array();
-
-        for(auto& s : contents.segments)
-        {
-            // note: instead of push_back here its also possible to use += operator to append json object to array
-            j["segments"].push_back({{"start_time", r_time_utils::tp_to_iso_8601(s.start, input_z_time)},
-                                    {"end_time", r_time_utils::tp_to_iso_8601(s.end, input_z_time)}});
-
-        }
-
         r_server_response response;
         response.set_content_type("text/json");
         response.set_body(j.dump());
@@ -274,85 +521,6 @@ r_http::r_server_response r_ws::_get_cameras(const r_http::r_web_server<r_utils:
     R_STHROW(r_http_500_exception, ("Failed to get cameras."));
 }
 
-static float _compute_framerate(const r_blob_tree& bt)
-{
-    if(!bt.has_key("frames"))
-        R_THROW(("Blob tree missing frames array."));
-
-    auto frame_count = bt.at("frames").size();
-
-    int64_t last_video_ts = 0;
-    bool has_last_video_ts = false;;
-
-    vector<int64_t> deltas;
-
-    for(size_t fi = 0; fi < frame_count; ++fi)
-    {
-        if(!bt.at("frames").has_index(fi))
-            R_THROW(("Blob tree missing frame."));
-
-        if(!bt.at("frames").at(fi).has_key("stream_id"))
-            R_THROW(("Blob tree missing stream_id."));
-
-        auto stream_id = bt.at("frames").at(fi).at("stream_id").get_value<int>();
-        if(stream_id == r_storage::R_STORAGE_MEDIA_TYPE_VIDEO)
-        {
-            if(!bt.at("frames").at(fi).has_key("ts"))
-                R_THROW(("Blob tree missing ts."));
-
-            auto ts = bt.at("frames").at(fi).at("ts").get_value<int64_t>();
-
-            if(has_last_video_ts && (ts > last_video_ts))
-                deltas.push_back(ts - last_video_ts);
-
-            last_video_ts = ts;
-            has_last_video_ts = true;
-        }
-    }
-
-    int64_t avg_delta = (std::accumulate(begin(deltas), end(deltas), (int64_t)0, [](int64_t a, int64_t b) {return a + b;}) / deltas.size());
-
-    return (float)1000 / (float)avg_delta;
-}
-
-static void _check_timestamps(const r_blob_tree& bt)
-{
-    if(!bt.has_key("frames"))
-        R_THROW(("Blob tree missing frames array."));
-
-    auto frame_count = bt.at("frames").size();
-
-    int64_t last_video_ts = 0;
-    bool has_last_video_ts = false;;
-
-    for(size_t fi = 0; fi < frame_count; ++fi)
-    {
-        if(!bt.at("frames").has_index(fi))
-            R_THROW(("Blob tree missing frame."));
-
-        if(!bt.at("frames").at(fi).has_key("stream_id"))
-            R_THROW(("Blob tree missing stream_id."));
-
-        auto stream_id = bt.at("frames").at(fi).at("stream_id").get_value<int>();
-        if(stream_id == r_storage::R_STORAGE_MEDIA_TYPE_VIDEO)
-        {
-            if(!bt.at("frames").at(fi).has_key("ts"))
-                R_THROW(("Blob tree missing ts."));
-
-            auto ts = bt.at("frames").at(fi).at("ts").get_value<int64_t>();
-
-            if(has_last_video_ts)
-            {
-                if(ts < last_video_ts)
-                    R_THROW(("Timestamp is not monotonically increasing."));
-            }
-
-            last_video_ts = ts;
-            has_last_video_ts = true;
-        }
-    }
-}
-
 r_http::r_server_response r_ws::_get_export(const r_http::r_web_server<r_utils::r_socket>&,
                                             r_utils::r_socket&,
                                             const r_http::r_server_request& request)
@@ -383,228 +551,36 @@ r_http::r_server_response r_ws::_get_export(const r_http::r_web_server<r_utils::
         if(args.find("file_name") == args.end())
             R_THROW(("Missing file name."));
 
-        r_muxer muxer(exports_path + PATH_SLASH + args["file_name"]);
-
-        auto qs = r_time_utils::iso_8601_to_tp(start_time_s);
-
-        auto qe = r_time_utils::iso_8601_to_tp(end_time_s);
-
-        bool muxer_opened = false;
-
-        int64_t ts_first_frame = 0;
-
-        bool done = false;
-
-        while(!done)
-        {
-            auto rs = qs;
-            auto re = rs;
-            if(rs + std::chrono::minutes(5) >= qe)
-            {
-                re = qe;
-                done = true;
-            }
-            else re = rs + std::chrono::minutes(5);
-
-            auto qr_buffer = query_get_video(
-                _top_dir,
-                _devices,
-                args["camera_id"],
-                rs,
-                re
-            );
-
-            qs = re;
-
-            uint32_t version = 0;
-            auto bt = r_blob_tree::deserialize(qr_buffer.data(), qr_buffer.size(), version);
-
-            _check_timestamps(bt);
-
-            if(!muxer_opened)
-            {
-                muxer_opened = true;
-
-                // first extract metadata from the blob tree
-
-                if(!bt.has_key("has_audio"))
-                    R_THROW(("Blob tree missing audio indicator."));
-
-                bool has_audio = (bt["has_audio"].get_string() == "true")?true:false;
-
-                if(!bt.has_key("video_codec_name"))
-                    R_THROW(("Blob tree missing video codec name."));
-
-                auto video_codec_name = bt["video_codec_name"].get_string();
-
-                if(!bt.has_key("video_codec_parameters"))
-                    R_THROW(("Blob tree missing video codec parameters."));
-
-                auto video_codec_parameters = bt["video_codec_parameters"].get_string();
-
-                string audio_codec_name, audio_codec_parameters;
-                if(has_audio)
-                {
-                    if(!bt.has_key("audio_codec_name"))
-                        R_THROW(("Blob tree missing audio codec name but has audio!"));
-                    audio_codec_name = bt["audio_codec_name"].get_string();
-
-                    if(!bt.has_key("audio_codec_parameters"))
-                        R_THROW(("Blob tree missing audio codec parameters but has audio!"));
-                    audio_codec_parameters = bt["audio_codec_parameters"].get_string();
-                }
-
-                // now, look for the sc_framerate or estimate it...
-
-                r_nullable<float> fr;
-
-                auto parts = r_string_utils::split(video_codec_parameters, ",");
-                for(auto part : parts)
-                {
-                    auto inner_parts = r_string_utils::split(part, "=");
-                    if(inner_parts.size() == 2)
-                    {
-                        if(r_string_utils::strip(inner_parts[0]) == "sc_framerate")
-                            fr.set_value(r_string_utils::s_to_float(inner_parts[1]));
-                    }
-                }
-
-                if(fr.is_null())
-                    fr.set_value(_compute_framerate(bt));
-
-                // get the video codec information and add the right kinds of video stream...
-
-                auto video_codec_id = r_av::encoding_to_av_codec_id(video_codec_name);
-
-                if(video_codec_id == AV_CODEC_ID_H264)
-                {
-                    auto maybe_sps = r_pipeline::get_h264_sps(video_codec_parameters);
-                    if(!maybe_sps.is_null())
-                    {
-                        auto sps_info = r_pipeline::parse_h264_sps(maybe_sps.value());
-
-                        muxer.add_video_stream(
-                            av_d2q(fr, 10000),
-                            video_codec_id,
-                            sps_info.width,
-                            sps_info.height,
-                            sps_info.profile_idc,
-                            sps_info.level_idc
-                        );
-                    }
-                    auto maybe_pps = r_pipeline::get_h264_pps(video_codec_parameters);
-                    muxer.set_video_extradata(r_pipeline::make_h264_extradata(maybe_sps, maybe_pps));
-                }
-                else if(video_codec_id == AV_CODEC_ID_HEVC)
-                {
-                    auto maybe_vps = r_pipeline::get_h265_vps(video_codec_parameters);
-                    auto maybe_sps = r_pipeline::get_h265_sps(video_codec_parameters);
-                    if(!maybe_sps.is_null())
-                    {
-                        auto sps_info = r_pipeline::parse_h265_sps(maybe_sps.value());
-
-                        muxer.add_video_stream(
-                            av_d2q(fr, 10000),
-                            video_codec_id,
-                            sps_info.width,
-                            sps_info.height,
-                            sps_info.profile_idc,
-                            sps_info.level_idc
-                        );
-
-                        //muxer.set_video_bitstream_filter("hevc_mp4toannexb");
-                    }
-                    auto maybe_pps = r_pipeline::get_h265_pps(video_codec_parameters);
-                    muxer.set_video_extradata(r_pipeline::make_h265_extradata(maybe_vps, maybe_sps, maybe_pps));
-                }
-
-                // If there is audio, add the audio stream...
-
-                if(has_audio)
-                {
-                    r_nullable<int> audio_rate, audio_channels;
-                    auto audio_codec_parameter_parts = r_string_utils::split(audio_codec_parameters, ",");
-                    for(auto part : audio_codec_parameter_parts)
-                    {
-                        auto inner_parts = r_string_utils::split(part, "=");
-                        if(inner_parts.size() == 2)
-                        {
-                            if(r_string_utils::strip(inner_parts[0]) == "sc_audio_rate")
-                                audio_rate.set_value(r_string_utils::s_to_int(inner_parts[1]));
-                            if(r_string_utils::strip(inner_parts[0]) == "sc_audio_channels")
-                                audio_channels.set_value(r_string_utils::s_to_int(inner_parts[1]));
-                        }
-                    }
-
-                    auto audio_codec_id = r_av::encoding_to_av_codec_id(audio_codec_name);
-
-                    if(audio_channels.is_null())
-                        audio_channels.set_value(1);
-
-                    if(audio_rate.is_null())
-                    {
-                        if(audio_codec_id == AV_CODEC_ID_PCM_MULAW)
-                            audio_rate.set_value(8000);
-                        else if(audio_codec_id == AV_CODEC_ID_PCM_ALAW)
-                            audio_rate.set_value(8000);
-                    }
-
-                    if(audio_rate.is_null())
-                        R_THROW(("Missing audio rate."));
-
-                    muxer.add_audio_stream(
-                        audio_codec_id,
-                        (uint8_t)audio_channels.value(),
-                        (uint16_t)audio_rate.value()
-                    );
-                }
-
-                muxer.open();
-            }
-
-            if(!bt.has_key("frames"))
-                R_THROW(("Blob tree missing frames."));
-
-            auto n_frames = bt["frames"].size();
-
-            for(size_t fi = 0; fi < n_frames; ++fi)
-            {
-                if(!bt["frames"].has_index(fi))
-                    R_THROW(("Blob tree missing frame."));
-
-                if(!bt["frames"][fi].has_key("stream_id"))
-                    R_THROW(("Blob tree missing stream id."));
-
-                auto sid = bt["frames"][fi]["stream_id"].get_value<int>();
-
-                if(!bt["frames"][fi].has_key("key"))
-                    R_THROW(("Blob tree missing key."));
-
-                auto key = (bt["frames"][fi]["key"].get_string() == "true");
-
-                if(!bt["frames"][fi].has_key("data"))
-                    R_THROW(("Blob tree missing data."));
+        auto output_path = exports_path + PATH_SLASH + args["file_name"];
 
-                auto frame = bt["frames"][fi]["data"].get_blob();
-
-                if(!bt["frames"][fi].has_key("ts"))
-                    R_THROW(("Blob tree missing ts."));
-
-                auto ts = bt["frames"][fi]["ts"].get_value<int64_t>();
-
-                if(ts_first_frame == 0)
-                    ts_first_frame = ts;
+        auto stats = query_export_mp4(
+            _top_dir,
+            _devices,
+            args["camera_id"],
+            r_time_utils::iso_8601_to_tp(start_time_s),
+            r_time_utils::iso_8601_to_tp(end_time_s),
+            output_path
+        );
 
-                if(sid == R_STORAGE_MEDIA_TYPE_VIDEO)
-                    muxer.write_video_frame(frame.data(), frame.size(), ts-ts_first_frame, ts-ts_first_frame, {1, 1000}, key);
-                else if(sid == R_STORAGE_MEDIA_TYPE_AUDIO)
-                    muxer.write_audio_frame(frame.data(), frame.size(), ts-ts_first_frame, {1, 1000});
-            }
-        }
+        R_LOG_INFO("Exported %s: %.1f MB in %lld ms (%.1f MB/s, %zu segments).",
+                   output_path.c_str(),
+                   (double)stats.bytes_written / (1024.0 * 1024.0),
+                   (long long)stats.elapsed.count(),
+                   stats.mb_per_second(),
+                   stats.segments);
 
-        muxer.finalize();
+        json j;
+        j["bytes_read"] = stats.bytes_read;
+        j["bytes_written"] = stats.bytes_written;
+        j["segments"] = stats.segments;
+        j["fragments"] = stats.fragments;
+        j["duration_ms"] = stats.media_duration.count();
+        j["elapsed_ms"] = stats.elapsed.count();
+        j["mb_per_second"] = stats.mb_per_second();
 
         r_server_response response;
+        response.set_content_type("text/json");
+        response.set_body(j.dump());
         return response;
     }
     catch(const std::exception& ex)
@@ -644,23 +620,8 @@ r_http::r_server_response r_ws::_get_analytics(const r_http::r_web_server<r_util
             stream_tag.set_value(args["stream_tag"]);
         }
 
-        auto analytics_data = query_get_analytics(_top_dir, _devices, args["camera_id"], start_tp, end_tp, stream_tag);
-
         json j;
-        j["analytics"] = json::array();
-
-        for(const auto& entry : analytics_data)
-        {
-            // Parse the JSON data and extract the analytics object
-            try {
-                auto parsed = json::parse(entry.json_data);
-                if(parsed.contains("analytics")) {
-                    j["analytics"].push_back(parsed["analytics"]);
-                }
-            } catch(const exception&) {
-                // Skip entries that don't parse or don't contain analytics
-            }
-        }
+        j["analytics"] = _analytics_json(_top_dir, _devices, args["camera_id"], start_tp, end_tp, stream_tag);
 
         r_server_response response;
         response.set_content_type("text/json");
@@ -704,22 +665,74 @@ r_http::r_server_response r_ws::_get_motion_events(const r_http::r_web_server<r_
 
         auto end_tp = r_time_utils::iso_8601_to_tp(end_time_s);
 
-        auto motion_events = query_get_motion_events(_top_dir, _devices, args["camera_id"], motion_threshold, start_tp, end_tp);
-
         json j;
-        j["motion_events"] = json::array();
+        j["motion_events"] = _motion_events_json(_top_dir, _devices, args["camera_id"], motion_threshold, start_tp, end_tp, input_z_time);
 
-        for(auto e : motion_events)
-        {
-            json j_motion;
+        r_server_response response;
+        response.set_content_type("text/json");
+        response.set_body(j.dump());
+        return response;
+    }
+    catch(const std::exception& ex)
+    {
+        R_LOG_EXCEPTION_AT(ex, __FILE__, __LINE__);
+    }
+
+    R_STHROW(r_http_500_exception, ("Failed to query motions."));
+}
+
+r_http::r_server_response r_ws::_get_timeline(const r_http::r_web_server<r_utils::r_socket>&,
+                                              r_utils::r_socket&,
+                                              const r_http::r_server_request& request)
+{
+    // Everything a timeline shows (segments, motion events and analytics) for several cameras at
+    // once, so a client refreshing a wall of cameras makes one request rather than three per camera.
+    auto args = request.get_uri().get_get_args();
+
+    if(args.find("camera_ids") == args.end())
+        R_STHROW(r_http_400_exception, ("Missing camera_ids."));
+
+    auto camera_ids = r_string_utils::split(args["camera_ids"], ',');
+    if(camera_ids.size() > MAX_TIMELINE_CAMERAS)
+        R_STHROW(r_http_400_exception, ("At most %zu camera_ids.", MAX_TIMELINE_CAMERAS));
+
+    try
+    {
+        if(args.find("start_time") == args.end())
+            R_THROW(("Missing start_time."));
+
+        auto start_time_s = args["start_time"];
+        auto start_tp = r_time_utils::iso_8601_to_tp(start_time_s);
 
-            j_motion["start_time"] = r_time_utils::tp_to_iso_8601(e.start, input_z_time);
-            j_motion["end_time"] = r_time_utils::tp_to_iso_8601(e.end, input_z_time);
-            j_motion["motion"] = e.motion;
-            j_motion["avg_motion"] = e.avg_motion;
-            j_motion["stddev"] = e.stddev;
+        bool input_z_time = start_time_s.find("Z") != std::string::npos;
+
+        if(args.find("end_time") == args.end())
+            R_THROW(("Missing end_time."));
+
+        auto end_tp = r_time_utils::iso_8601_to_tp(args["end_time"]);
+
+        uint8_t motion_threshold = 1;
+        if(args.count("motion_threshold") > 0)
+            motion_threshold = r_string_utils::s_to_uint8(args["motion_threshold"]);
 
-            j["motion_events"].push_back(j_motion);
+        json j;
+        j["cameras"] = json::object();
+
+        // A camera that can't be queried is left out rather than failing the others.
+        for(auto& camera_id : camera_ids)
+        {
+            try
+            {
+                json camera;
+                camera["segments"] = _contents_json(_top_dir, _devices, camera_id, start_tp, end_tp, input_z_time);
+                camera["motion_events"] = _motion_events_json(_top_dir, _devices, camera_id, motion_threshold, start_tp, end_tp, input_z_time);
+                camera["analytics"] = _analytics_json(_top_dir, _devices, camera_id, start_tp, end_tp, r_nullable<string>());
+                j["cameras"][camera_id] = camera;
+            }
+            catch(const std::exception& ex)
+            {
+                R_LOG_EXCEPTION_AT(ex, __FILE__, __LINE__);
+            }
         }
 
         r_server_response response;
@@ -732,7 +745,7 @@ r_http::r_server_response r_ws::_get_motion_events(const r_http::r_web_server<r_
         R_LOG_EXCEPTION_AT(ex, __FILE__, __LINE__);
     }
 
-    R_STHROW(r_http_500_exception, ("Failed to query motions."));
+    R_STHROW(r_http_500_exception, ("Failed to get timeline."));
 }
 
 r_http::r_server_response r_ws::_get_video(const r_http::r_web_server<r_utils::r_socket>&,
@@ -752,12 +765,17 @@ r_http::r_server_response r_ws::_get_video(const r_http::r_web_server<r_utils::r
         if(args.find("end_time") == args.end())
             R_THROW(("Missing end_time."));
 
+        double rate = 1.0;
+        if(args.find("rate") != end(args))
+            rate = r_string_utils::s_to_double(args["rate"]);
+
         auto qr_buffer = query_get_video(
             _top_dir,
             _devices,
             args["camera_id"],
             r_time_utils::iso_8601_to_tp(args["start_time"]),
-            r_time_utils::iso_8601_to_tp(args["end_time"])
+            r_time_utils::iso_8601_to_tp(args["end_time"]),
+            rate
         );
 
         r_server_response response;
@@ -0,0 +1,31 @@
+
+#include "framework.h"
+
+class test_r_vss : public test_fixture
+{
+public:
+    RTF_FIXTURE(test_r_vss);
+      TEST(test_r_vss::test_r_vss_decode_session_b_frames);
+      TEST(test_r_vss::test_r_vss_decode_session_steps);
+      TEST(test_r_vss::test_r_vss_decode_session_picture_budget);
+      TEST(test_r_vss::test_r_vss_decode_session_sessions_and_expiry);
+      TEST(test_r_vss::test_r_vss_decode_session_limits);
+      TEST(test_r_vss::test_r_vss_ws_frame_step_too_large);
+      TEST(test_r_vss::test_r_vss_playback_prefetcher_hits);
+      TEST(test_r_vss::test_r_vss_playback_prefetcher_misses);
+    RTF_FIXTURE_END();
+
+    virtual ~test_r_vss() throw() {}
+
+    virtual void setup();
+    virtual void teardown();
+
+    void test_r_vss_decode_session_b_frames();
+    void test_r_vss_decode_session_steps();
+    void test_r_vss_decode_session_picture_budget();
+    void test_r_vss_decode_session_sessions_and_expiry();
+    void test_r_vss_decode_session_limits();
+    void test_r_vss_ws_frame_step_too_large();
+    void test_r_vss_playback_prefetcher_hits();
+    void test_r_vss_playback_prefetcher_misses();
+};
@@ -0,0 +1,495 @@
+#include "test_r_vss.h"
+#include "r_vss/r_decode_session_cache.h"
+#include "r_vss/r_ws.h"
+#include "r_vss/r_playback_prefetcher.h"
+#include "r_pipeline/r_gst_source.h"
+#include "r_av/r_video_encoder.h"
+#include "r_storage/r_storage_file.h"
+#include "r_storage/r_storage_file_reader.h"
+#include "r_disco/r_devices.h"
+#include "r_disco/r_stream_config.h"
+#include "r_http/r_client_request.h"
+#include "r_http/r_client_response.h"
+#include "r_utils/r_file.h"
+#include "r_utils/r_socket.h"
+#include "r_utils/r_exception.h"
+#include "r_utils/r_string_utils.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <set>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace std::chrono;
+using namespace r_utils;
+using namespace r_storage;
+using namespace r_av;
+using namespace r_vss;
+
+REGISTER_TEST_FIXTURE(test_r_vss);
+
+static const uint16_t W = 320;
+static const uint16_t H = 240;
+static const int GOP = 10;
+static const int N_FRAMES = 60;
+
+static void _whack_files()
+{
+    if(r_fs::file_exists("session_test.nts"))
+        r_fs::remove_file("session_test.nts");
+
+    // r_devices keeps its database under top_dir/db, recordings live in top_dir/video.
+    for(auto f : {"top_dir/db/cameras.db", "top_dir/db/cameras.db-wal", "top_dir/db/cameras.db-shm", "top_dir/db/cameras.db-journal", "top_dir/video/prefetch_test.nts"})
+    {
+        if(r_fs::file_exists(f))
+            r_fs::remove_file(f);
+    }
+
+    for(auto d : {"top_dir/db", "top_dir/video", "top_dir"})
+    {
+        if(r_fs::is_dir(d))
+            r_fs::rmdir(d);
+    }
+}
+
+void test_r_vss::setup()
+{
+    r_raw_socket::socket_startup();
+    r_pipeline::gstreamer_init();
+    _whack_files();
+    r_fs::mkdir("top_dir");
+}
+
+void test_r_vss::teardown()
+{
+    _whack_files();
+    r_raw_socket::socket_cleanup();
+}
+
+struct _recorded_frame
+{
+    int64_t ts;
+    uint8_t luma;
+};
+
+static uint8_t _frame_luma(int64_t f)
+{
+    return (uint8_t)(16 + (f * 4));
+}
+
+// Records N_FRAMES flat frames (frame f is all _frame_luma(f)) 100ms apart, in the order the encoder
+// hands them out. Returns the stored frames in that order along with the luma each should decode to.
+static vector<_recorded_frame> _make_recording(uint8_t max_b_frames)
+{
+    vector<_recorded_frame> recorded;
+
+    r_storage_file::allocate("session_test.rvd", 1024 * 1024, 10);
+    r_storage_file sf("session_test.rvd");
+    auto wc = sf.create_write_context("h264", string(), R_STORAGE_MEDIA_TYPE_VIDEO);
+
+    auto preset = (max_b_frames > 0) ? string("veryfast") : string("ultrafast");
+    auto tune = (max_b_frames > 0) ? string() : string("zerolatency");
+    r_video_encoder encoder(AV_CODEC_ID_H264, 500000, W, H, {10, 1}, AV_PIX_FMT_YUV420P, max_b_frames, GOP, AV_PROFILE_H264_MAIN, 41, preset, tune);
+
+    // The encoder keeps its SPS and PPS to itself, storage has them in front of each key frame (like
+    // cameras send them).
+    auto extradata = encoder.get_extradata();
+
+    auto store = [&](const r_packet_info& pi){
+        vector<uint8_t> data;
+        if(pi.key)
+            data = extradata;
+        data.insert(data.end(), pi.data, pi.data + pi.size);
+
+        int64_t ts = 1000 + ((int64_t)recorded.size() * 100);
+        sf.write_frame(wc, R_STORAGE_MEDIA_TYPE_VIDEO, data.data(), data.size(), pi.key, ts, ts);
+        recorded.push_back({ts, _frame_luma(pi.pts)});
+    };
+
+    vector<uint8_t> yuv((size_t)W * H * 3 / 2, 128);
+    for(int f = 0; f < N_FRAMES; ++f)
+    {
+        memset(yuv.data(), _frame_luma(f), (size_t)W * H);
+
+        encoder.attach_buffer(yuv.data(), yuv.size(), f);
+
+        while(encoder.encode() == R_CODEC_STATE_HAS_OUTPUT)
+            store(encoder.get());
+    }
+
+    while(encoder.flush() == R_CODEC_STATE_HAS_OUTPUT)
+        store(encoder.get());
+
+    return recorded;
+}
+
+static bool _luma_matches(const r_decoded_step& step, uint8_t expected)
+{
+    auto luma = (*step.picture)[((size_t)(H / 2) * W) + (W / 2)];
+    return abs((int)luma - (int)expected) <= 1;
+}
+
+static r_decoded_step _get(r_decode_session_cache& cache, const string& session, r_storage_file_reader& sf, int64_t ts, int step)
+{
+    return cache.get(session, sf, ts, step, AV_PIX_FMT_YUV420P, W, H);
+}
+
+void test_r_vss::test_r_vss_decode_session_b_frames()
+{
+    if(!avcodec_find_encoder(AV_CODEC_ID_H264))
+        return;
+
+    auto recorded = _make_recording(2);
+    RTF_ASSERT(recorded.size() == (size_t)N_FRAMES);
+
+    // Make sure the encoder really did reorder, otherwise this proves nothing.
+    bool reordered = false;
+    for(size_t i = 0; i < recorded.size(); ++i)
+    {
+        if(recorded[i].luma != _frame_luma((int64_t)i))
+            reordered = true;
+    }
+    RTF_ASSERT(reordered);
+
+    r_storage_file_reader sf("session_test.rvd");
+    r_decode_session_cache cache;
+
+    // Every frame comes back with the picture decoded from its own data, not the one the decoder
+    // happened to hand out next.
+    for(auto& r : recorded)
+    {
+        auto step = _get(cache, "b_frames", sf, r.ts, 0);
+        RTF_ASSERT(step.ts == r.ts);
+        RTF_ASSERT(_luma_matches(step, r.luma));
+    }
+
+    // And the same stepping through them one at a time.
+    auto step = _get(cache, "stepping", sf, recorded.front().ts, 0);
+    for(size_t i = 1; i < recorded.size(); ++i)
+    {
+        step = _get(cache, "stepping", sf, step.ts, 1);
+        RTF_ASSERT(step.ts == recorded[i].ts);
+        RTF_ASSERT(_luma_matches(step, recorded[i].luma));
+    }
+}
+
+void test_r_vss::test_r_vss_decode_session_steps()
+{
+    if(!avcodec_find_encoder(AV_CODEC_ID_H264))
+        return;
+
+    auto recorded = _make_recording(0);
+
+    r_storage_file_reader sf("session_test.rvd");
+    r_decode_session_cache cache;
+
+    // Frame 15 is 5 frames into the GOP that starts at frame 10, so getting there decodes 6.
+    auto step = _get(cache, "s", sf, recorded[15].ts, 0);
+    RTF_ASSERT(step.ts == recorded[15].ts);
+    RTF_ASSERT(step.frames_decoded == 6);
+    RTF_ASSERT(_luma_matches(step, recorded[15].luma));
+
+    // A step forward carries on from there.
+    step = _get(cache, "s", sf, step.ts, 1);
+    RTF_ASSERT(step.ts == recorded[16].ts);
+    RTF_ASSERT(step.frames_decoded == 1);
+    RTF_ASSERT(_luma_matches(step, recorded[16].luma));
+
+    // A step back lands on a picture the session kept.
+    step = _get(cache, "s", sf, step.ts, -1);
+    RTF_ASSERT(step.ts == recorded[15].ts);
+    RTF_ASSERT(step.frames_decoded == 0);
+    RTF_ASSERT(_luma_matches(step, recorded[15].luma));
+
+    // Back over a key frame is the last frame of the GOP before it.
+    step = _get(cache, "s", sf, recorded[10].ts, -1);
+    RTF_ASSERT(step.ts == recorded[9].ts);
+    RTF_ASSERT(_luma_matches(step, recorded[9].luma));
+
+    // Stepping past either end stays on the first or last frame.
+    step = _get(cache, "s", sf, recorded.front().ts, -1);
+    RTF_ASSERT(step.ts == recorded.front().ts);
+    step = _get(cache, "s", sf, recorded.back().ts, 1);
+    RTF_ASSERT(step.ts == recorded.back().ts);
+
+    auto stats = cache.stats();
+    RTF_ASSERT(stats.hits >= 1);
+    RTF_ASSERT(stats.forwards >= 1);
+    RTF_ASSERT(stats.misses >= 1);
+}
+
+void test_r_vss::test_r_vss_decode_session_picture_budget()
+{
+    if(!avcodec_find_encoder(AV_CODEC_ID_H264))
+        return;
+
+    auto recorded = _make_recording(0);
+
+    r_storage_file_reader sf("session_test.rvd");
+
+    // Room for three pictures, however many the count would allow.
+    auto picture_size = r_video_decoder::output_image_size(AV_PIX_FMT_YUV420P, W, H, 1);
+    r_decode_session_cache cache(DECODE_SESSION_TTL, DECODE_SESSION_MAX_SESSIONS, DECODE_SESSION_MAX_PICTURES, picture_size * 3);
+
+    auto step = _get(cache, "s", sf, recorded[17].ts, 0);
+    RTF_ASSERT(step.frames_decoded == 8);
+
+    // 17, 16 and 15 were kept, 14 has to be decoded again.
+    step = _get(cache, "s", sf, step.ts, -1);
+    RTF_ASSERT(step.ts == recorded[16].ts && step.frames_decoded == 0);
+    step = _get(cache, "s", sf, step.ts, -1);
+    RTF_ASSERT(step.ts == recorded[15].ts && step.frames_decoded == 0);
+    step = _get(cache, "s", sf, step.ts, -1);
+    RTF_ASSERT(step.ts == recorded[14].ts && step.frames_decoded > 0);
+    RTF_ASSERT(_luma_matches(step, recorded[14].luma));
+}
+
+void test_r_vss::test_r_vss_decode_session_sessions_and_expiry()
+{
+    if(!avcodec_find_encoder(AV_CODEC_ID_H264))
+        return;
+
+    auto recorded = _make_recording(0);
+
+    r_storage_file_reader sf("session_test.rvd");
+
+    {
+        // Each session keeps its own position.
+        r_decode_session_cache cache;
+        _get(cache, "a", sf, recorded[15].ts, 0);
+        _get(cache, "b", sf, recorded[35].ts, 0);
+
+        auto step = _get(cache, "a", sf, recorded[15].ts, 1);
+        RTF_ASSERT(step.ts == recorded[16].ts && step.frames_decoded == 1);
+        step = _get(cache, "b", sf, recorded[35].ts, 1);
+        RTF_ASSERT(step.ts == recorded[36].ts && step.frames_decoded == 1);
+        RTF_ASSERT(cache.stats().sessions == 2);
+    }
+
+    {
+        // A new session over the limit pushes out the least recently used one.
+        r_decode_session_cache cache(DECODE_SESSION_TTL, 2);
+        _get(cache, "a", sf, recorded[15].ts, 0);
+        _get(cache, "b", sf, recorded[15].ts, 0);
+        _get(cache, "a", sf, recorded[15].ts, 0);
+        _get(cache, "c", sf, recorded[15].ts, 0);
+        RTF_ASSERT(cache.stats().sessions == 2);
+
+        // "a" survived with its pictures, "b" has to start again.
+        RTF_ASSERT(_get(cache, "a", sf, recorded[15].ts, 0).frames_decoded == 0);
+        RTF_ASSERT(_get(cache, "b", sf, recorded[15].ts, 0).frames_decoded == 6);
+    }
+
+    {
+        // Sessions nobody has used for the ttl are dropped.
+        r_decode_session_cache cache(milliseconds(100));
+        _get(cache, "a", sf, recorded[15].ts, 0);
+        this_thread::sleep_for(milliseconds(300));
+        _get(cache, "b", sf, recorded[15].ts, 0);
+        RTF_ASSERT(cache.stats().sessions == 1);
+        RTF_ASSERT(_get(cache, "a", sf, recorded[15].ts, 0).frames_decoded == 6);
+    }
+}
+
+void test_r_vss::test_r_vss_decode_session_limits()
+{
+    if(!avcodec_find_encoder(AV_CODEC_ID_H264))
+        return;
+
+    auto recorded = _make_recording(0);
+
+    r_storage_file_reader sf("session_test.rvd");
+    r_decode_session_cache cache;
+
+    RTF_ASSERT_THROWS(_get(cache, "s", sf, recorded[15].ts, DECODE_SESSION_MAX_STEP + 1), r_exception);
+    RTF_ASSERT_THROWS(_get(cache, "s", sf, recorded[15].ts, -(DECODE_SESSION_MAX_STEP + 1)), r_exception);
+    RTF_ASSERT_THROWS(cache.get("s", sf, recorded[15].ts, 0, AV_PIX_FMT_YUV420P, DECODE_SESSION_MAX_WIDTH + 2, H), r_exception);
+    RTF_ASSERT_THROWS(cache.get("s", sf, recorded[15].ts, 0, AV_PIX_FMT_YUV420P, W, DECODE_SESSION_MAX_HEIGHT + 2), r_exception);
+
+    // The largest step is fine (and stays on the last frame, the recording is shorter than that).
+    auto step = _get(cache, "s", sf, recorded[15].ts, DECODE_SESSION_MAX_STEP);
+    RTF_ASSERT(step.ts == recorded.back().ts);
+}
+
+void test_r_vss::test_r_vss_ws_frame_step_too_large()
+{
+    r_disco::r_devices devices("top_dir");
+    devices.start();
+
+    {
+        r_ws ws("top_dir", devices);
+
+        auto get_status = [](const string& uri){
+            r_socket socket;
+            socket.connect("127.0.0.1", 10080);
+
+            r_http::r_client_request request("127.0.0.1", 10080);
+            request.set_uri(uri);
+            request.write_request(socket);
+
+            r_http::r_client_response response;
+            response.read_response(socket);
+            return response.get_status();
+        };
+
+        // Rejected before the camera or recording is even looked at.
+        RTF_ASSERT(get_status(r_string_utils::format("/frame?camera_id=none&start_time=2024-01-01T00:00:00.000Z&step=%d", DECODE_SESSION_MAX_STEP + 1)) == 400);
+        RTF_ASSERT(get_status(r_string_utils::format("/frame?camera_id=none&start_time=2024-01-01T00:00:00.000Z&step=%d", -(DECODE_SESSION_MAX_STEP + 1))) == 400);
+
+        // A step in range gets as far as looking for the camera.
+        RTF_ASSERT(get_status("/frame?camera_id=none&start_time=2024-01-01T00:00:00.000Z&step=1") == 500);
+
+        ws.stop();
+    }
+
+    devices.stop();
+}
+
+static const int64_t PLAYBACK_FIRST_TS = 1000;
+static const int PLAYBACK_N_FRAMES = 60;
+
+static system_clock::time_point _tp(int64_t ts)
+{
+    return system_clock::time_point(milliseconds(ts));
+}
+
+// Registers camera_0 with r_devices. With a recording, it also writes PLAYBACK_N_FRAMES video frames
+// 100ms apart (a key frame every GOP) whose payload is their own timestamp.
+static void _add_playback_camera(r_disco::r_devices& devices, bool with_recording)
+{
+    r_disco::r_stream_config sc;
+    sc.id = "camera_0";
+    sc.camera_name.set_value("Camera 0");
+    sc.ipv4.set_value("10.0.0.1");
+    sc.rtsp_url.set_value("rtsp://10.0.0.1/stream1");
+    sc.video_codec.set_value("h264");
+    devices.insert_or_update_devices({make_pair(sc, r_disco::hash_stream_config(sc))});
+
+    if(!with_recording)
+        return;
+
+    r_fs::mkdir("top_dir/video");
+    r_storage_file::allocate("top_dir/video/prefetch_test.rvd", 1024 * 1024, 10);
+    {
+        r_storage_file sf("top_dir/video/prefetch_test.rvd");
+        auto wc = sf.create_write_context("h264", string(), R_STORAGE_MEDIA_TYPE_VIDEO);
+
+        for(int f = 0; f < PLAYBACK_N_FRAMES; ++f)
+        {
+            int64_t ts = PLAYBACK_FIRST_TS + ((int64_t)f * 100);
+            sf.write_frame(wc, R_STORAGE_MEDIA_TYPE_VIDEO, (const uint8_t*)&ts, sizeof(ts), (f % GOP) == 0, ts, ts);
+        }
+    }
+
+    auto camera = devices.get_camera_by_id("camera_0").value();
+    camera.record_file_path.set_value("prefetch_test.rvd");
+    devices.save_camera(camera);
+}
+
+void test_r_vss::test_r_vss_playback_prefetcher_hits()
+{
+    r_disco::r_devices devices("top_dir");
+    devices.start();
+    _add_playback_camera(devices, true);
+
+    auto start = _tp(PLAYBACK_FIRST_TS);
+    auto end = _tp(PLAYBACK_FIRST_TS + (PLAYBACK_N_FRAMES * 100));
+
+    {
+        r_playback_prefetcher pf("top_dir", devices, "camera_0", start, end, 1.0, seconds(1));
+
+        // Nothing is read until start().
+        RTF_ASSERT(!pf.next(milliseconds(50)));
+        RTF_ASSERT(!pf.exhausted());
+
+        pf.start();
+
+        // Chunks come back in order, each picking up where the last one ended, and together they
+        // deliver every recorded frame with its own payload.
+        set<int64_t> delivered;
+        auto expected_start = start;
+        while(expected_start < end)
+        {
+            auto chunk = pf.next(seconds(10));
+            RTF_ASSERT(chunk);
+            RTF_ASSERT(chunk->start == expected_start);
+            RTF_ASSERT(chunk->end == std::min(expected_start + seconds(1), end));
+
+            for(auto& f : chunk->frames)
+            {
+                RTF_ASSERT(f.stream_id == R_STORAGE_MEDIA_TYPE_VIDEO);
+                RTF_ASSERT(f.key == (((f.ts - PLAYBACK_FIRST_TS) / 100) % GOP == 0));
+                RTF_ASSERT(_tp(f.ts) <= chunk->end);
+
+                auto mi = f.buffer.map(r_pipeline::r_gst_buffer::MT_READ);
+                RTF_ASSERT(mi.size() == sizeof(int64_t));
+                int64_t payload;
+                memcpy(&payload, mi.data(), sizeof(payload));
+                RTF_ASSERT(payload == f.ts);
+
+                delivered.insert(f.ts);
+            }
+
+            expected_start = chunk->end;
+        }
+
+        RTF_ASSERT(delivered.size() == (size_t)PLAYBACK_N_FRAMES);
+        RTF_ASSERT(*delivered.begin() == PLAYBACK_FIRST_TS);
+
+        // Everything has been handed out.
+        RTF_ASSERT(!pf.next(milliseconds(50)));
+        RTF_ASSERT(pf.exhausted());
+
+        RTF_ASSERT(pf.depth() >= PLAYBACK_PREFETCH_MIN_DEPTH && pf.depth() <= PLAYBACK_PREFETCH_MAX_DEPTH);
+
+        pf.stop();
+    }
+
+    devices.stop();
+}
+
+void test_r_vss::test_r_vss_playback_prefetcher_misses()
+{
+    r_disco::r_devices devices("top_dir");
+    devices.start();
+    _add_playback_camera(devices, false);
+
+    auto start = _tp(PLAYBACK_FIRST_TS);
+    auto end = _tp(PLAYBACK_FIRST_TS + 3000);
+
+    // A failing read (here the camera has no recording file) hands out an empty chunk for its range
+    // so playback keeps moving, and the prefetcher still runs out at end.
+    {
+        r_playback_prefetcher pf("top_dir", devices, "camera_0", start, end, 1.0, seconds(1));
+        pf.start();
+
+        auto expected_start = start;
+        while(expected_start < end)
+        {
+            auto chunk = pf.next(seconds(10));
+            RTF_ASSERT(chunk);
+            RTF_ASSERT(chunk->start == expected_start);
+            RTF_ASSERT(chunk->frames.empty());
+            expected_start = chunk->end;
+        }
+
+        RTF_ASSERT(expected_start == end);
+        RTF_ASSERT(!pf.next(milliseconds(50)));
+        RTF_ASSERT(pf.exhausted());
+    }
+
+    // Stopping with reads queued (and maybe one in flight) discards them.
+    {
+        r_playback_prefetcher pf("top_dir", devices, "camera_0", start, end, 1.0, seconds(1));
+        pf.start();
+
+        RTF_ASSERT(pf.next(seconds(10)));
+
+        pf.stop();
+        RTF_ASSERT(!pf.next(milliseconds(0)));
+    }
+
+    devices.stop();
+}
@@ -38,6 +38,10 @@ else()
     add_compile_definitions(IS_LITTLE_ENDIAN)
 endif()
 
+# Benchmark programs (libs/*/bench) print timings rather than pass or fail, so they aren't part of
+# the default build or the unit tests.
+option(REVERE_BUILD_BENCHMARKS "Build the benchmark programs" OFF)
+
 if(NOT CMAKE_BUILD_TYPE)
     set (CMAKE_BUILD_TYPE Debug)
 endif()